@@ -22,11 +22,13 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 layout(std140, binding = 0) uniform buf {
-        mat4 MVP;
-        vec4 position[12*3];
-        vec4 attr[12*3];
+        mat4 VP;
 } ubuf;
 
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 uv;
+layout (location = 2) in mat4 model;
+
 layout (location = 0) out vec4 texcoord;
 
 out gl_PerVertex {
@@ -35,8 +37,8 @@ out gl_PerVertex {
 
 void main() 
 {
-   texcoord = ubuf.attr[gl_VertexIndex];
-   gl_Position = ubuf.MVP * ubuf.position[gl_VertexIndex];
+   texcoord = vec4(uv, 0.0, 0.0);
+   gl_Position = ubuf.VP * model * vec4(position, 1.0);
 
    // GL->VK conventions
    gl_Position.y = -gl_Position.y;
@@ -0,0 +1,251 @@
+
+#include <assert.h>
+
+#include "block_allocator.hpp"
+
+namespace vulkan {
+
+	free_list_block::free_list_block(uint64_t size, uint64_t granularity) : _size(size), _granularity(granularity > 0 ? granularity : 1) {
+		_free[0] = size;
+	}
+
+	bool free_list_block::place(uint64_t free_offset, uint64_t free_size, uint64_t size, uint64_t alignment, resource_kind kind, uint64_t& offset) const {
+		const uint64_t free_end = free_offset + free_size;
+		uint64_t candidate = align_up(free_offset, alignment);
+
+		// The allocation (if any) immediately before this free range ends at
+		// free_offset. If it is of the other kind and we would share its last
+		// page, push the start onto a fresh page.
+		if (_granularity > 1 && free_offset > 0) {
+			auto prev = _allocated.lower_bound(free_offset);
+			if (prev != _allocated.begin()) {
+				--prev;
+				const uint64_t prev_last = prev->first + prev->second.size - 1;
+				if (prev->second.kind != kind && prev_last / _granularity == candidate / _granularity) {
+					candidate = align_up(candidate, _granularity);
+				}
+			}
+		}
+
+		if (candidate + size > free_end) {
+			return false;
+		}
+
+		// Likewise the allocation after this range starts at free_end.
+		if (_granularity > 1 && free_end < _size) {
+			auto next = _allocated.find(free_end);
+			if (next != _allocated.end() && next->second.kind != kind && (candidate + size - 1) / _granularity == next->first / _granularity) {
+				return false;
+			}
+		}
+
+		offset = candidate;
+		return true;
+	}
+
+	bool free_list_block::allocate(uint64_t size, uint64_t alignment, resource_kind kind, uint64_t& offset) {
+		if (size == 0) {
+			return false;
+		}
+
+		auto best = _free.end();
+		uint64_t best_offset = 0;
+
+		for (auto it = _free.begin(); it != _free.end(); ++it) {
+			uint64_t candidate;
+			if (it->second < size || !place(it->first, it->second, size, alignment, kind, candidate)) {
+				continue;
+			}
+
+			if (best == _free.end() || it->second < best->second) {
+				best = it;
+				best_offset = candidate;
+				if (it->second == size) {
+					break;
+				}
+			}
+		}
+
+		if (best == _free.end()) {
+			return false;
+		}
+
+		const uint64_t free_offset = best->first;
+		const uint64_t free_end = best->first + best->second;
+		_free.erase(best);
+
+		// Leading padding goes back to the free list, trailing space too.
+		if (best_offset > free_offset) {
+			_free[free_offset] = best_offset - free_offset;
+		}
+		if (best_offset + size < free_end) {
+			_free[best_offset + size] = free_end - (best_offset + size);
+		}
+
+		_allocated[best_offset] = { size, size, kind };
+		offset = best_offset;
+		return true;
+	}
+
+	void free_list_block::free(uint64_t offset) {
+		auto it = _allocated.find(offset);
+		assert(it != _allocated.end());
+		if (it == _allocated.end()) {
+			return;
+		}
+
+		uint64_t start = offset;
+		uint64_t size = it->second.size;
+		_allocated.erase(it);
+
+		// Coalesce with the free range that ends where we start...
+		auto next = _free.lower_bound(start);
+		if (next != _free.begin()) {
+			auto prev = next;
+			--prev;
+			if (prev->first + prev->second == start) {
+				start = prev->first;
+				size += prev->second;
+				_free.erase(prev);
+			}
+		}
+
+		// ...and the one that starts where we end.
+		next = _free.find(start + size);
+		if (next != _free.end()) {
+			size += next->second;
+			_free.erase(next);
+		}
+
+		_free[start] = size;
+	}
+
+	block_stats free_list_block::get_stats() const {
+		block_stats stats;
+		stats.size = _size;
+
+		for (auto& allocation : _allocated) {
+			stats.used += allocation.second.size;
+			stats.requested += allocation.second.requested;
+		}
+		stats.allocation_count = (uint32_t)_allocated.size();
+
+		// Padding left behind by alignment is free but unusable until its
+		// neighbours go; it counts against us through largest_free.
+		for (auto& range : _free) {
+			if (range.second > stats.largest_free) {
+				stats.largest_free = range.second;
+			}
+		}
+		stats.free_range_count = (uint32_t)_free.size();
+
+		return stats;
+	}
+
+	buddy_block::buddy_block(uint64_t size, uint64_t min_node_size) : _min_node_size(next_power_of_two(min_node_size > 0 ? min_node_size : 1)) {
+		_size = next_power_of_two(size);
+		if (_size > size) {
+			// Never hand out bytes the backing memory does not have.
+			_size >>= 1;
+		}
+		assert(_size >= _min_node_size);
+
+		uint32_t levels = 1;
+		while (node_size(levels - 1) < _size) {
+			levels++;
+		}
+
+		_free_nodes.resize(levels);
+		_free_nodes[levels - 1].insert(0);
+	}
+
+	bool buddy_block::allocate(uint64_t size, uint64_t alignment, resource_kind /* kind */, uint64_t& offset) {
+		if (size == 0) {
+			return false;
+		}
+
+		uint64_t needed = size;
+		if (alignment > needed) {
+			needed = alignment;
+		}
+		needed = next_power_of_two(needed);
+
+		uint32_t level = 0;
+		while (node_size(level) < needed) {
+			level++;
+		}
+
+		if (level >= _free_nodes.size()) {
+			return false;
+		}
+
+		// Find the smallest free node that is large enough...
+		uint32_t found = level;
+		while (found < _free_nodes.size() && _free_nodes[found].empty()) {
+			found++;
+		}
+		if (found == _free_nodes.size()) {
+			return false;
+		}
+
+		uint64_t node = *_free_nodes[found].begin();
+		_free_nodes[found].erase(_free_nodes[found].begin());
+
+		// ...and split it down, releasing the upper halves.
+		while (found > level) {
+			found--;
+			_free_nodes[found].insert(node + node_size(found));
+		}
+
+		_allocated[node] = { level, size };
+		offset = node;
+		return true;
+	}
+
+	void buddy_block::free(uint64_t offset) {
+		auto it = _allocated.find(offset);
+		assert(it != _allocated.end());
+		if (it == _allocated.end()) {
+			return;
+		}
+
+		uint32_t level = it->second.first;
+		uint64_t node = offset;
+		_allocated.erase(it);
+
+		while (level + 1 < _free_nodes.size()) {
+			const uint64_t buddy = node ^ node_size(level);
+			auto buddy_it = _free_nodes[level].find(buddy);
+			if (buddy_it == _free_nodes[level].end()) {
+				break;
+			}
+
+			_free_nodes[level].erase(buddy_it);
+			node = node < buddy ? node : buddy;
+			level++;
+		}
+
+		_free_nodes[level].insert(node);
+	}
+
+	block_stats buddy_block::get_stats() const {
+		block_stats stats;
+		stats.size = _size;
+
+		for (auto& allocation : _allocated) {
+			stats.used += node_size(allocation.second.first);
+			stats.requested += allocation.second.second;
+		}
+		stats.allocation_count = (uint32_t)_allocated.size();
+
+		for (uint32_t level = 0; level < _free_nodes.size(); ++level) {
+			if (!_free_nodes[level].empty()) {
+				stats.largest_free = node_size(level);
+			}
+			stats.free_range_count += (uint32_t)_free_nodes[level].size();
+		}
+
+		return stats;
+	}
+
+}
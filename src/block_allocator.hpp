@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace vulkan {
+
+	// Placement logic for sub-allocating one device memory block. Nothing in
+	// here touches Vulkan, so it can be exercised on the CPU without a GPU.
+
+	// bufferImageGranularity only matters between "linear" resources (buffers,
+	// linear images) and "optimal" (tiled) images sharing a page.
+	enum class resource_kind : uint8_t {
+		linear,
+		optimal,
+	};
+
+	struct block_stats {
+		uint64_t size = 0;
+		uint64_t used = 0;			// bytes handed out, including alignment padding owned by allocations
+		uint64_t requested = 0;		// bytes callers actually asked for
+		uint64_t largest_free = 0;
+		uint32_t allocation_count = 0;
+		uint32_t free_range_count = 0;
+
+		// 0 when all free space is one contiguous range, approaching 1 as it
+		// splinters into many small holes.
+		float fragmentation() const {
+			const uint64_t free_bytes = size - used;
+			if (free_bytes == 0) {
+				return 0.0f;
+			}
+			return 1.0f - (float)largest_free / (float)free_bytes;
+		}
+	};
+
+	class sub_block {
+	public:
+		virtual ~sub_block() {}
+
+		virtual bool allocate(uint64_t size, uint64_t alignment, resource_kind kind, uint64_t& offset) = 0;
+		virtual void free(uint64_t offset) = 0;
+
+		virtual block_stats get_stats() const = 0;
+		virtual bool empty() const = 0;
+	};
+
+	// Best-fit over an address-ordered free list. Alignment padding stays in
+	// the free list so it can be coalesced back when neighbours are released.
+	class free_list_block : public sub_block {
+	public:
+		free_list_block(uint64_t size, uint64_t granularity);
+
+		bool allocate(uint64_t size, uint64_t alignment, resource_kind kind, uint64_t& offset) override;
+		void free(uint64_t offset) override;
+
+		block_stats get_stats() const override;
+		bool empty() const override {
+			return _allocated.empty();
+		}
+
+	private:
+		struct allocation_record {
+			uint64_t size;
+			uint64_t requested;
+			resource_kind kind;
+		};
+
+		bool place(uint64_t free_offset, uint64_t free_size, uint64_t size, uint64_t alignment, resource_kind kind, uint64_t& offset) const;
+
+		uint64_t _size;
+		uint64_t _granularity;
+
+		std::map<uint64_t, uint64_t> _free;					// offset -> size
+		std::map<uint64_t, allocation_record> _allocated;	// offset -> record
+	};
+
+	// Power-of-two buddy allocator. Nodes are naturally aligned to their size
+	// and never smaller than the granularity, so two allocations can never
+	// share a granularity page and the resource kind can be ignored.
+	class buddy_block : public sub_block {
+	public:
+		buddy_block(uint64_t size, uint64_t min_node_size);
+
+		bool allocate(uint64_t size, uint64_t alignment, resource_kind kind, uint64_t& offset) override;
+		void free(uint64_t offset) override;
+
+		block_stats get_stats() const override;
+		bool empty() const override {
+			return _allocated.empty();
+		}
+
+		uint64_t get_min_node_size() const {
+			return _min_node_size;
+		}
+
+	private:
+		uint64_t node_size(uint32_t level) const {
+			return _min_node_size << level;
+		}
+
+		uint64_t _size;
+		uint64_t _min_node_size;
+
+		std::vector<std::set<uint64_t>> _free_nodes;		// per level, level 0 = min node
+		std::map<uint64_t, std::pair<uint32_t, uint64_t>> _allocated;	// offset -> level, requested
+	};
+
+	inline uint64_t align_up(uint64_t value, uint64_t alignment) {
+		if (alignment <= 1) {
+			return value;
+		}
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	inline uint64_t next_power_of_two(uint64_t value) {
+		uint64_t result = 1;
+		while (result < value) {
+			result <<= 1;
+		}
+		return result;
+	}
+
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+
+#include "cpu_profiler.hpp"
+
+namespace vulkan {
+
+	namespace {
+
+		// Hands the ring back when the thread exits, so the next thread can
+		// reuse it instead of growing the profiler by one ring per thread.
+		struct thread_state {
+			cpu_profiler::thread_ring * ring = nullptr;
+			uint32_t depth = 0;
+
+			~thread_state() {
+				if (ring != nullptr) {
+					cpu_profiler::get().release_ring(ring);
+				}
+			}
+		};
+
+		thread_local thread_state this_thread;
+
+		// Scope and thread names are plain identifiers, but keep the JSON
+		// valid whatever they contain.
+		void write_json_string(FILE * fp, const char * text) {
+			fputc('"', fp);
+			for (const char * c = text; *c; c++) {
+				if (*c == '"' || *c == '\\') {
+					fputc('\\', fp);
+					fputc(*c, fp);
+				} else if ((unsigned char)*c < 0x20) {
+					fprintf(fp, "\\u%04x", *c);
+				} else {
+					fputc(*c, fp);
+				}
+			}
+			fputc('"', fp);
+		}
+
+	}
+
+	cpu_profiler& cpu_profiler::get() {
+		static cpu_profiler profiler;
+		return profiler;
+	}
+
+	cpu_profiler::cpu_profiler() : _enabled(false), _epoch(std::chrono::high_resolution_clock::now()) {
+	}
+
+	cpu_profiler::thread_ring * cpu_profiler::ring_for_this_thread() {
+		if (this_thread.ring != nullptr) {
+			return this_thread.ring;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_free_rings.size() > 0) {
+			this_thread.ring = _free_rings.back();
+			_free_rings.pop_back();
+		} else {
+			std::unique_ptr<thread_ring> ring(new thread_ring());
+			ring->lane = (uint32_t)_rings.size();
+			ring->name = "thread " + std::to_string(ring->lane);
+			ring->events.resize(cpu_profiler_ring_events);
+			ring->written.store(0, std::memory_order_relaxed);
+
+			this_thread.ring = ring.get();
+			_rings.push_back(std::move(ring));
+		}
+
+		return this_thread.ring;
+	}
+
+	void cpu_profiler::release_ring(thread_ring * ring) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_free_rings.push_back(ring);
+	}
+
+	void cpu_profiler::set_thread_name(const char * name) {
+		thread_ring * ring = ring_for_this_thread();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		ring->name = name;
+	}
+
+	void cpu_profiler::record(const char * name, uint64_t start_ns, uint64_t end_ns, uint32_t depth) {
+		thread_ring * ring = ring_for_this_thread();
+
+		// Only this thread writes the ring; the release publishes the event to
+		// a reader that acquires written.
+		const uint64_t index = ring->written.load(std::memory_order_relaxed);
+		cpu_event& event = ring->events[index % cpu_profiler_ring_events];
+		event.name = name;
+		event.start_ns = start_ns;
+		event.duration_ns = end_ns - start_ns;
+		event.depth = depth;
+		ring->written.store(index + 1, std::memory_order_release);
+	}
+
+	bool cpu_profiler::write_chrome_trace(const std::string& path) const {
+		FILE * fp = fopen(path.c_str(), "wb");
+		if (!fp) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+		bool first = true;
+		for (auto& ring : _rings) {
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", ring->lane);
+			write_json_string(fp, ring->name.c_str());
+			fprintf(fp, "}}");
+			first = false;
+
+			const uint64_t written = ring->written.load(std::memory_order_acquire);
+			const uint64_t begin = written > cpu_profiler_ring_events ? written - cpu_profiler_ring_events : 0;
+
+			// Complete ("X") events, in microseconds.
+			for (uint64_t i = begin; i < written; i++) {
+				const cpu_event& event = ring->events[i % cpu_profiler_ring_events];
+				fprintf(fp, ",\n{\"name\":");
+				write_json_string(fp, event.name);
+				fprintf(fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}",
+					ring->lane, event.start_ns / 1000.0, event.duration_ns / 1000.0, event.depth);
+			}
+		}
+
+		fprintf(fp, "\n]}\n");
+
+		const bool ok = ferror(fp) == 0;
+		fclose(fp);
+		return ok;
+	}
+
+	std::vector<cpu_scope_stats> cpu_profiler::summarize() const {
+		std::map<std::string, cpu_scope_stats> totals;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			for (auto& ring : _rings) {
+				const uint64_t written = ring->written.load(std::memory_order_acquire);
+				const uint64_t begin = written > cpu_profiler_ring_events ? written - cpu_profiler_ring_events : 0;
+
+				for (uint64_t i = begin; i < written; i++) {
+					const cpu_event& event = ring->events[i % cpu_profiler_ring_events];
+					const double ms = event.duration_ns * 1e-6;
+
+					auto& stats = totals[event.name];
+					stats.name = event.name;
+					stats.count++;
+					stats.total_ms += ms;
+					stats.max_ms = (std::max)(stats.max_ms, ms);
+				}
+			}
+		}
+
+		std::vector<cpu_scope_stats> summary;
+		for (auto& entry : totals) {
+			summary.push_back(entry.second);
+		}
+		std::sort(summary.begin(), summary.end(), [](const cpu_scope_stats& a, const cpu_scope_stats& b) {
+			return a.total_ms > b.total_ms;
+		});
+		return summary;
+	}
+
+	cpu_scope::cpu_scope(const char * name) : _name(name) {
+		cpu_profiler& profiler = cpu_profiler::get();
+		if (profiler.enabled()) {
+			_active = true;
+			_start_ns = profiler.now_ns();
+			this_thread.depth++;
+		}
+	}
+
+	cpu_scope::~cpu_scope() {
+		if (_active) {
+			this_thread.depth--;
+			cpu_profiler::get().record(_name, _start_ns, cpu_profiler::get().now_ns(), this_thread.depth);
+		}
+	}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vulkan {
+
+	// One finished scope. name must outlive the profiler; scopes only ever
+	// pass string literals.
+	struct cpu_event {
+		const char * name = nullptr;
+		uint64_t start_ns = 0;
+		uint64_t duration_ns = 0;
+		uint32_t depth = 0;
+	};
+
+	// Totals per scope name over whatever the rings still hold.
+	struct cpu_scope_stats {
+		const char * name = nullptr;
+		uint64_t count = 0;
+		double total_ms = 0.0;
+		double max_ms = 0.0;
+	};
+
+	const uint32_t cpu_profiler_ring_events = 1 << 16;
+
+	// Records nested CPU scopes from any thread. Each thread writes to its own
+	// ring, so recording takes no lock and never allocates; the only lock is
+	// taken once per thread, to be handed a ring. Rings of threads that have
+	// exited are handed to the next new thread, so per-frame worker threads
+	// reuse the same few lanes. When the profiler is disabled a scope costs
+	// one relaxed load. Export and summarize read the rings while they may be
+	// written, so call them once the frame loop has stopped.
+	class cpu_profiler {
+	public:
+		static cpu_profiler& get();
+
+		void set_enabled(bool enabled) {
+			_enabled.store(enabled, std::memory_order_relaxed);
+		}
+
+		bool enabled() const {
+			return _enabled.load(std::memory_order_relaxed);
+		}
+
+		// Names the calling thread's lane in the trace.
+		void set_thread_name(const char * name);
+
+		uint64_t now_ns() const {
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - _epoch).count();
+		}
+
+		void record(const char * name, uint64_t start_ns, uint64_t end_ns, uint32_t depth);
+
+		// Chrome trace_event JSON, for chrome://tracing or Perfetto.
+		bool write_chrome_trace(const std::string& path) const;
+
+		// Sorted by total time, largest first.
+		std::vector<cpu_scope_stats> summarize() const;
+
+		struct thread_ring {
+			uint32_t lane = 0;
+			std::string name;
+			std::vector<cpu_event> events;
+			std::atomic<uint64_t> written;
+		};
+
+		// Called from a thread_local's destructor when a thread exits.
+		void release_ring(thread_ring * ring);
+
+	private:
+		cpu_profiler();
+
+		thread_ring * ring_for_this_thread();
+
+		std::atomic<bool> _enabled;
+		std::chrono::high_resolution_clock::time_point _epoch;
+
+		mutable std::mutex _mutex;
+		std::vector<std::unique_ptr<thread_ring>> _rings;
+		std::vector<thread_ring *> _free_rings;
+	};
+
+	// Times its own lifetime as one event on the calling thread; scopes on the
+	// same thread nest.
+	class cpu_scope {
+	public:
+		explicit cpu_scope(const char * name);
+		~cpu_scope();
+
+		cpu_scope(const cpu_scope&) = delete;
+		cpu_scope& operator=(const cpu_scope&) = delete;
+
+	private:
+		const char * _name;
+		uint64_t _start_ns = 0;
+		bool _active = false;
+	};
+
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "ktx2.hpp"
+
+namespace vulkan {
+
+	namespace {
+
+		const uint8_t ktx2_identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+		// identifier, header, index
+		const uint32_t ktx2_level_index_offset = 80;
+		const uint32_t ktx2_level_index_entry = 24;
+
+		// Khronos Data Format descriptor values for the formats handled here.
+		const uint32_t df_model_rgbsda = 1;
+		const uint32_t df_model_bc1a = 128;
+		const uint32_t df_model_bc3 = 130;
+		const uint32_t df_model_bc7 = 134;
+		const uint32_t df_model_etc2 = 161;
+		const uint32_t df_primaries_bt709 = 1;
+		const uint32_t df_transfer_linear = 1;
+
+		struct df_sample {
+			uint32_t channel;
+			uint32_t bit_offset;
+			uint32_t bit_length;
+			uint32_t upper;
+		};
+
+		// Everything the writer needs to describe a format; samples are in
+		// bit order.
+		struct format_info {
+			VkFormat format;
+			uint32_t block_bytes;
+			bool compressed;
+			uint32_t model;
+			std::vector<df_sample> samples;
+		};
+
+		const format_info * find_format(VkFormat format) {
+			static const std::vector<format_info> formats = {
+				{ VK_FORMAT_R8G8B8A8_UNORM, 4, false, df_model_rgbsda, { { 0, 0, 8, 255 }, { 1, 8, 8, 255 }, { 2, 16, 8, 255 }, { 15, 24, 8, 255 } } },
+				{ VK_FORMAT_BC1_RGB_UNORM_BLOCK, 8, true, df_model_bc1a, { { 0, 0, 64, UINT32_MAX } } },
+				{ VK_FORMAT_BC3_UNORM_BLOCK, 16, true, df_model_bc3, { { 15, 0, 64, UINT32_MAX }, { 0, 64, 64, UINT32_MAX } } },
+				{ VK_FORMAT_BC7_UNORM_BLOCK, 16, true, df_model_bc7, { { 0, 0, 128, UINT32_MAX } } },
+				{ VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, 8, true, df_model_etc2, { { 2, 0, 64, UINT32_MAX } } },
+				{ VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, 16, true, df_model_etc2, { { 15, 0, 64, UINT32_MAX }, { 2, 64, 64, UINT32_MAX } } },
+			};
+
+			for (auto& info : formats) {
+				if (info.format == format) {
+					return &info;
+				}
+			}
+			return nullptr;
+		}
+
+		uint64_t level_size(const format_info& info, uint32_t width, uint32_t height) {
+			if (!info.compressed) {
+				return (uint64_t)width * height * info.block_bytes;
+			}
+			return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * info.block_bytes;
+		}
+
+		uint64_t align_up(uint64_t value, uint64_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+			for (int b = 0; b < 4; b++) {
+				out.push_back((uint8_t)(value >> (b * 8)));
+			}
+		}
+
+		void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+			for (int b = 0; b < 8; b++) {
+				out.push_back((uint8_t)(value >> (b * 8)));
+			}
+		}
+
+		uint32_t get_u32(const std::vector<uint8_t>& in, size_t offset) {
+			uint32_t value = 0;
+			for (int b = 0; b < 4; b++) {
+				value |= (uint32_t)in[offset + b] << (b * 8);
+			}
+			return value;
+		}
+
+		uint64_t get_u64(const std::vector<uint8_t>& in, size_t offset) {
+			return (uint64_t)get_u32(in, offset) | ((uint64_t)get_u32(in, offset + 4) << 32);
+		}
+
+	}
+
+	uint32_t ktx2_format_block_bytes(VkFormat format) {
+		const format_info * info = find_format(format);
+		return info != nullptr ? info->block_bytes : 0;
+	}
+
+	bool ktx2_format_is_block_compressed(VkFormat format) {
+		const format_info * info = find_format(format);
+		return info != nullptr && info->compressed;
+	}
+
+	void write_ktx2(const char * file_name, const ktx2_texture& texture) {
+		const format_info * info = find_format(texture.format);
+		if (info == nullptr) {
+			throw std::runtime_error(std::string("[write_ktx2] unsupported format for ") + file_name);
+		}
+		if (texture.levels.empty()) {
+			throw std::runtime_error(std::string("[write_ktx2] no levels to write to ") + file_name);
+		}
+
+		const uint32_t level_count = (uint32_t)texture.levels.size();
+
+		// Basic data format descriptor: one block, one sample per channel.
+		std::vector<uint8_t> dfd;
+		const uint32_t block_size = 24 + 16 * (uint32_t)info->samples.size();
+		put_u32(dfd, 4 + block_size);
+		put_u32(dfd, 0);
+		put_u32(dfd, 2 | (block_size << 16));
+		put_u32(dfd, info->model | (df_primaries_bt709 << 8) | (df_transfer_linear << 16));
+		put_u32(dfd, info->compressed ? (3 | (3 << 8)) : 0);
+		put_u32(dfd, info->block_bytes);
+		put_u32(dfd, 0);
+		for (auto& sample : info->samples) {
+			put_u32(dfd, sample.bit_offset | ((sample.bit_length - 1) << 16) | (sample.channel << 24));
+			put_u32(dfd, 0);
+			put_u32(dfd, 0);
+			put_u32(dfd, sample.upper);
+		}
+
+		std::vector<uint8_t> kvd;
+		const char writer_key[] = "KTXwriter";
+		const char writer_value[] = "vulkan-test";
+		put_u32(kvd, (uint32_t)(sizeof(writer_key) + sizeof(writer_value)));
+		kvd.insert(kvd.end(), writer_key, writer_key + sizeof(writer_key));
+		kvd.insert(kvd.end(), writer_value, writer_value + sizeof(writer_value));
+		kvd.resize((size_t)align_up(kvd.size(), 4), 0);
+
+		const uint32_t dfd_offset = ktx2_level_index_offset + level_count * ktx2_level_index_entry;
+		const uint32_t kvd_offset = dfd_offset + (uint32_t)dfd.size();
+
+		// Levels are stored smallest first, each aligned to the block size
+		// and to 4.
+		const uint64_t alignment = info->block_bytes % 4 == 0 ? info->block_bytes : 4;
+		std::vector<uint64_t> file_offsets(level_count);
+		uint64_t end = kvd_offset + kvd.size();
+		for (uint32_t i = level_count; i-- > 0;) {
+			const ktx2_level& level = texture.levels[i];
+			if (level.size != level_size(*info, level.width, level.height) || level.offset + level.size > texture.data.size()) {
+				throw std::runtime_error(std::string("[write_ktx2] level sizes don't match the format for ") + file_name);
+			}
+			file_offsets[i] = align_up(end, alignment);
+			end = file_offsets[i] + level.size;
+		}
+
+		std::vector<uint8_t> out(ktx2_identifier, ktx2_identifier + sizeof(ktx2_identifier));
+		put_u32(out, (uint32_t)texture.format);
+		put_u32(out, 1);
+		put_u32(out, texture.width);
+		put_u32(out, texture.height);
+		put_u32(out, 0);
+		put_u32(out, 0);
+		put_u32(out, 1);
+		put_u32(out, level_count);
+		put_u32(out, 0);
+
+		put_u32(out, dfd_offset);
+		put_u32(out, (uint32_t)dfd.size());
+		put_u32(out, kvd_offset);
+		put_u32(out, (uint32_t)kvd.size());
+		put_u64(out, 0);
+		put_u64(out, 0);
+
+		for (uint32_t i = 0; i < level_count; i++) {
+			put_u64(out, file_offsets[i]);
+			put_u64(out, texture.levels[i].size);
+			put_u64(out, texture.levels[i].size);
+		}
+
+		out.insert(out.end(), dfd.begin(), dfd.end());
+		out.insert(out.end(), kvd.begin(), kvd.end());
+
+		out.resize((size_t)end, 0);
+		for (uint32_t i = 0; i < level_count; i++) {
+			memcpy(out.data() + file_offsets[i], texture.data.data() + texture.levels[i].offset, (size_t)texture.levels[i].size);
+		}
+
+		FILE * fp = fopen(file_name, "wb");
+		if (!fp) {
+			throw std::runtime_error(std::string("[write_ktx2] ") + file_name + " could not be opened for writing");
+		}
+		const size_t written = fwrite(out.data(), 1, out.size(), fp);
+		fclose(fp);
+		if (written != out.size()) {
+			throw std::runtime_error(std::string("[write_ktx2] could not write ") + file_name);
+		}
+	}
+
+	ktx2_texture read_ktx2(const char * file_name) {
+		FILE * fp = fopen(file_name, "rb");
+		if (!fp) {
+			throw std::runtime_error(std::string("[read_ktx2] ") + file_name + " could not be opened for reading");
+		}
+
+		std::vector<uint8_t> file;
+		uint8_t chunk[64 * 1024];
+		size_t read = 0;
+		while ((read = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+			file.insert(file.end(), chunk, chunk + read);
+		}
+		fclose(fp);
+
+		if (file.size() < ktx2_level_index_offset || memcmp(file.data(), ktx2_identifier, sizeof(ktx2_identifier)) != 0) {
+			throw std::runtime_error(std::string("[read_ktx2] ") + file_name + " is not a KTX2 file");
+		}
+
+		ktx2_texture texture;
+		texture.format = (VkFormat)get_u32(file, 12);
+		texture.width = get_u32(file, 20);
+		texture.height = get_u32(file, 24);
+		const uint32_t depth = get_u32(file, 28);
+		const uint32_t layers = get_u32(file, 32);
+		const uint32_t faces = get_u32(file, 36);
+		const uint32_t level_count = (std::max)(get_u32(file, 40), 1u);
+		const uint32_t supercompression = get_u32(file, 44);
+
+		const format_info * info = find_format(texture.format);
+		if (info == nullptr) {
+			throw std::runtime_error(std::string("[read_ktx2] ") + file_name + " has an unsupported format");
+		}
+		if (texture.width == 0 || texture.height == 0 || depth > 1 || layers > 1 || faces != 1 || supercompression != 0) {
+			throw std::runtime_error(std::string("[read_ktx2] ") + file_name + " is not a plain 2D texture");
+		}
+		if (file.size() < ktx2_level_index_offset + (uint64_t)level_count * ktx2_level_index_entry) {
+			throw std::runtime_error(std::string("[read_ktx2] ") + file_name + " is truncated");
+		}
+
+		uint32_t width = texture.width, height = texture.height;
+		for (uint32_t i = 0; i < level_count; i++) {
+			const size_t entry = ktx2_level_index_offset + i * ktx2_level_index_entry;
+			const uint64_t file_offset = get_u64(file, entry);
+			const uint64_t size = get_u64(file, entry + 8);
+
+			if (size != level_size(*info, width, height) || file_offset + size > file.size()) {
+				throw std::runtime_error(std::string("[read_ktx2] ") + file_name + " has a malformed level index");
+			}
+
+			ktx2_level level;
+			level.offset = align_up(texture.data.size(), 16);
+			level.size = size;
+			level.width = width;
+			level.height = height;
+
+			texture.data.resize((size_t)(level.offset + size), 0);
+			memcpy(texture.data.data() + level.offset, file.data() + file_offset, (size_t)size);
+			texture.levels.push_back(level);
+
+			width = (std::max)(1u, width / 2);
+			height = (std::max)(1u, height / 2);
+		}
+
+		return texture;
+	}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+
+namespace vulkan {
+
+	struct ktx2_level {
+		uint64_t offset = 0;		// into ktx2_texture::data
+		uint64_t size = 0;
+		uint32_t width = 0, height = 0;
+	};
+
+	// A single-layer 2D texture and its mip levels, largest first. Each
+	// level's offset is a multiple of 16, which covers every block size and
+	// vkCmdCopyBufferToImage's alignment.
+	struct ktx2_texture {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0, height = 0;
+		std::vector<ktx2_level> levels;
+		std::vector<uint8_t> data;
+	};
+
+	// Bytes per 4x4 block, or per texel for R8G8B8A8_UNORM; 0 for formats
+	// the reader and writer don't handle.
+	uint32_t ktx2_format_block_bytes(VkFormat format);
+	bool ktx2_format_is_block_compressed(VkFormat format);
+
+	// KTX 2.0 without supercompression, with the data format descriptor the
+	// spec requires for the format. Both throw std::runtime_error, like
+	// load_image::png.
+	void write_ktx2(const char * file_name, const ktx2_texture& texture);
+	ktx2_texture read_ktx2(const char * file_name);
+
+}
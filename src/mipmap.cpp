@@ -0,0 +1,169 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "mipmap.hpp"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MIPMAP_X86 1
+#include <immintrin.h>
+#endif
+
+// As in transform_batch.cpp: GCC and Clang only emit AVX2 in functions
+// compiled for it.
+#if defined(MIPMAP_X86) && !defined(_MSC_VER)
+#define MIPMAP_AVX2 __attribute__((target("avx2")))
+#else
+#define MIPMAP_AVX2
+#endif
+
+namespace vulkan {
+
+	namespace {
+
+		// Columns [begin, end) of one destination row.
+		void downsample_row_scalar(const uint8_t * row0, const uint8_t * row1, uint32_t width, uint32_t begin, uint32_t end, uint8_t * dst) {
+			for (uint32_t x = begin; x < end; x++) {
+				const uint32_t x0 = (x * 2) * 4;
+				const uint32_t x1 = (std::min)(x * 2 + 1, width - 1) * 4;
+				for (uint32_t c = 0; c < 4; c++) {
+					dst[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+				}
+			}
+		}
+
+#ifdef MIPMAP_X86
+
+		// SSE2: four destination texels, from eight in each source row, per
+		// iteration. Even and odd texels are split apart as 32-bit lanes, then
+		// summed at 16 bits so the rounding matches the scalar path exactly.
+		void downsample_row_sse(const uint8_t * row0, const uint8_t * row1, uint32_t width, uint32_t dst_width, uint8_t * dst) {
+			// Only where both texels of every pair exist; the clamped tail
+			// goes through the scalar path.
+			const uint32_t simd_end = (width / 2) & ~3u;
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i two = _mm_set1_epi16(2);
+
+			for (uint32_t x = 0; x < simd_end; x += 4) {
+				const __m128 a0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(row0 + x * 8)));
+				const __m128 b0 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(row0 + x * 8 + 16)));
+				const __m128 a1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(row1 + x * 8)));
+				const __m128 b1 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(row1 + x * 8 + 16)));
+
+				const __m128i even0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+				const __m128i odd0 = _mm_castps_si128(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+				const __m128i even1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+				const __m128i odd1 = _mm_castps_si128(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(even0, zero), _mm_unpacklo_epi8(odd0, zero));
+				lo = _mm_add_epi16(lo, _mm_add_epi16(_mm_unpacklo_epi8(even1, zero), _mm_unpacklo_epi8(odd1, zero)));
+				lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(even0, zero), _mm_unpackhi_epi8(odd0, zero));
+				hi = _mm_add_epi16(hi, _mm_add_epi16(_mm_unpackhi_epi8(even1, zero), _mm_unpackhi_epi8(odd1, zero)));
+				hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+
+				_mm_storeu_si128((__m128i *)(dst + x * 4), _mm_packus_epi16(lo, hi));
+			}
+
+			downsample_row_scalar(row0, row1, width, simd_end, dst_width, dst);
+		}
+
+		// AVX2: the same as SSE2, eight destination texels at a time. The
+		// even/odd shuffle works within 128-bit lanes, which leaves pairs of
+		// output texels out of order; one cross-lane permute puts them back.
+		MIPMAP_AVX2 void downsample_row_avx2(const uint8_t * row0, const uint8_t * row1, uint32_t width, uint32_t dst_width, uint8_t * dst) {
+			const uint32_t simd_end = (width / 2) & ~7u;
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i two = _mm256_set1_epi16(2);
+
+			for (uint32_t x = 0; x < simd_end; x += 8) {
+				const __m256 a0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(row0 + x * 8)));
+				const __m256 b0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(row0 + x * 8 + 32)));
+				const __m256 a1 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(row1 + x * 8)));
+				const __m256 b1 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(row1 + x * 8 + 32)));
+
+				const __m256i even0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)));
+				const __m256i odd0 = _mm256_castps_si256(_mm256_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+				const __m256i even1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+				const __m256i odd1 = _mm256_castps_si256(_mm256_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+				__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(even0, zero), _mm256_unpacklo_epi8(odd0, zero));
+				lo = _mm256_add_epi16(lo, _mm256_add_epi16(_mm256_unpacklo_epi8(even1, zero), _mm256_unpacklo_epi8(odd1, zero)));
+				lo = _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2);
+
+				__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(even0, zero), _mm256_unpackhi_epi8(odd0, zero));
+				hi = _mm256_add_epi16(hi, _mm256_add_epi16(_mm256_unpackhi_epi8(even1, zero), _mm256_unpackhi_epi8(odd1, zero)));
+				hi = _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2);
+
+				// Texels 0-1, 4-5 | 2-3, 6-7 in 64-bit pairs.
+				const __m256i packed = _mm256_packus_epi16(lo, hi);
+				_mm256_storeu_si256((__m256i *)(dst + x * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+			}
+
+			downsample_row_scalar(row0, row1, width, simd_end, dst_width, dst);
+		}
+
+#endif
+
+	}
+
+	uint32_t mip_level_count(uint32_t width, uint32_t height) {
+		uint32_t levels = 1;
+		uint32_t size = (std::max)(width, height);
+		while (size > 1) {
+			size /= 2;
+			levels++;
+		}
+		return levels;
+	}
+
+	uint64_t mip_chain_layout(uint32_t width, uint32_t height, uint32_t levels, std::vector<mip_level>& out) {
+		out.clear();
+
+		uint64_t offset = 0;
+		for (uint32_t i = 0; i < levels; i++) {
+			mip_level level;
+			level.offset = offset;
+			level.width = width;
+			level.height = height;
+			out.push_back(level);
+
+			offset += (uint64_t)width * height * 4;
+			width = (std::max)(1u, width / 2);
+			height = (std::max)(1u, height / 2);
+		}
+		return offset;
+	}
+
+	void downsample_rgba8(simd_level level, const uint8_t * src, uint32_t width, uint32_t height, uint8_t * dst) {
+		assert(width > 0 && height > 0);
+
+		const uint32_t dst_width = (std::max)(1u, width / 2);
+		const uint32_t dst_height = (std::max)(1u, height / 2);
+
+		for (uint32_t y = 0; y < dst_height; y++) {
+			const uint8_t * row0 = src + (size_t)(y * 2) * width * 4;
+			const uint8_t * row1 = src + (size_t)(std::min)(y * 2 + 1, height - 1) * width * 4;
+			uint8_t * out = dst + (size_t)y * dst_width * 4;
+#ifdef MIPMAP_X86
+			if (level == simd_level::avx2) {
+				downsample_row_avx2(row0, row1, width, dst_width, out);
+				continue;
+			}
+			if (level == simd_level::sse) {
+				downsample_row_sse(row0, row1, width, dst_width, out);
+				continue;
+			}
+#endif
+			downsample_row_scalar(row0, row1, width, 0, dst_width, out);
+		}
+	}
+
+	void generate_mip_chain_rgba8(simd_level level, uint8_t * chain, const std::vector<mip_level>& levels) {
+		for (size_t i = 1; i < levels.size(); i++) {
+			const mip_level& above = levels[i - 1];
+			downsample_rgba8(level, chain + above.offset, above.width, above.height, chain + levels[i].offset);
+		}
+	}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "transform_batch.hpp"
+
+namespace vulkan {
+
+	// Levels in a full chain, halving each side (rounding down, never below
+	// one) until both reach 1.
+	uint32_t mip_level_count(uint32_t width, uint32_t height);
+
+	struct mip_level {
+		uint64_t offset = 0;		// bytes from the start of the chain
+		uint32_t width = 0, height = 0;
+	};
+
+	// Tightly packed RGBA8 levels, one after another, as a single staging
+	// buffer holds them for vkCmdCopyBufferToImage. Returns the total size
+	// in bytes.
+	uint64_t mip_chain_layout(uint32_t width, uint32_t height, uint32_t levels, std::vector<mip_level>& out);
+
+	// 2x2 box filter of one RGBA8 level into the next, (max)(1, width / 2)
+	// by (max)(1, height / 2), each channel the rounded mean of the four
+	// texels. On odd sizes the last row or column is left out, as a blit to
+	// the halved size would.
+	void downsample_rgba8(simd_level level, const uint8_t * src, uint32_t width, uint32_t height, uint8_t * dst);
+
+	// Fills levels 1 onward of a chain laid out by mip_chain_layout from
+	// level 0, each from the one above. The fallback for formats that can't
+	// be blitted with a linear filter.
+	void generate_mip_chain_rgba8(simd_level level, uint8_t * chain, const std::vector<mip_level>& levels);
+
+}
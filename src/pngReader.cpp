@@ -13,11 +13,14 @@
 #include "CoreFoundation/CoreFoundation.h"
 #endif
 
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <stdint.h>
 #include <memory>
+#include <vector>
 #include <png.h>
 #ifdef _WIN32
 #include <Windows.h>
@@ -38,70 +41,143 @@ namespace load_image {
         CFRelease(resourcesURL);
 #elif defined(_WIN32)
 		char path[MAX_PATH] = "./resources";
+#else
+        const char * path = "./resources";
 #endif
 
         auto png_path = std::string(path) + "/" + std::string(file_name);
         return png_path;
     }
     
-    std::shared_ptr<uint8_t> png(const char * file_name, unsigned int &width, unsigned int &height) {
-        char header[8];    // 8 is the maximum size that can be checked
+    namespace {
+        
+        // Owns everything a decode opens, so png_rows releases it however it
+        // leaves.
+        struct png_reader {
+            FILE * fp = NULL;
+            png_structp png_ptr = NULL;
+            png_infop info_ptr = NULL;
+            // Decode buffers live here rather than as locals after the
+            // setjmp: a longjmp out of libpng would skip their destructors.
+            std::vector<uint8_t> rows;
+            std::vector<png_bytep> row_pointers;
+            
+            ~png_reader() {
+                if (png_ptr != NULL) {
+                    png_destroy_read_struct(&png_ptr, info_ptr != NULL ? &info_ptr : NULL, NULL);
+                }
+                if (fp != NULL) {
+                    fclose(fp);
+                }
+            }
+        };
+        
+        std::runtime_error read_error(const char * file_name, const char * what) {
+            return std::runtime_error(std::string("[read_png_file] File ") + file_name + " " + what);
+        }
+        
+    }
+    
+    void png_rows(const char * file_name, const png_sink& sink) {
+        png_reader reader;
         
         /* open file and test for it being a png */
-        FILE *fp = fopen(file_name, "rb");
-        if (!fp)
-            throw std::runtime_error("[read_png_file] File %s could not be opened for reading");
-        fread(header, 1, 8, fp);
-        if (png_sig_cmp((png_const_bytep)header, 0, 8))
-            throw std::runtime_error("[read_png_file] File %s is not recognized as a PNG file");
+        reader.fp = fopen(file_name, "rb");
+        if (!reader.fp)
+            throw read_error(file_name, "could not be opened for reading");
         
+        png_byte header[8];    // 8 is the maximum size that can be checked
+        if (fread(header, 1, 8, reader.fp) != 8 || png_sig_cmp(header, 0, 8))
+            throw read_error(file_name, "is not recognized as a PNG file");
         
         /* initialize stuff */
-        auto png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-        
-        if (!png_ptr)
-            throw std::runtime_error("[read_png_file] png_create_read_struct failed");
-        
-        auto info_ptr = png_create_info_struct(png_ptr);
-        if (!info_ptr)
-            throw std::runtime_error("[read_png_file] png_create_info_struct failed");
-        
-        if (setjmp(png_jmpbuf(png_ptr)))
-            throw std::runtime_error("[read_png_file] Error during init_io");
-        
-        png_init_io(png_ptr, fp);
-        png_set_sig_bytes(png_ptr, 8);
-        
-        png_read_info(png_ptr, info_ptr);
-        
-        width = png_get_image_width(png_ptr, info_ptr);
-        height = png_get_image_height(png_ptr, info_ptr);
-        auto color_type = png_get_color_type(png_ptr, info_ptr);
-        auto bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-        
-        auto number_of_passes = png_set_interlace_handling(png_ptr);
-        png_read_update_info(png_ptr, info_ptr);
-        
+        reader.png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        if (!reader.png_ptr)
+            throw read_error(file_name, "failed png_create_read_struct");
+        
+        reader.info_ptr = png_create_info_struct(reader.png_ptr);
+        if (!reader.info_ptr)
+            throw read_error(file_name, "failed png_create_info_struct");
+        
+        // Only libpng longjmps here; the sink is called from this frame, so
+        // whatever it throws unwinds normally. Nothing with a destructor may
+        // be constructed below this point, so buffers belong to reader.
+        if (setjmp(png_jmpbuf(reader.png_ptr)))
+            throw read_error(file_name, "could not be decoded");
+        
+        png_init_io(reader.png_ptr, reader.fp);
+        png_set_sig_bytes(reader.png_ptr, 8);
+        
+        png_read_info(reader.png_ptr, reader.info_ptr);
+        
+        const unsigned int width = png_get_image_width(reader.png_ptr, reader.info_ptr);
+        const unsigned int height = png_get_image_height(reader.png_ptr, reader.info_ptr);
+        const auto color_type = png_get_color_type(reader.png_ptr, reader.info_ptr);
+        const auto bit_depth = png_get_bit_depth(reader.png_ptr, reader.info_ptr);
+        const bool has_transparency = png_get_valid(reader.png_ptr, reader.info_ptr, PNG_INFO_tRNS) != 0;
+        
+        /* expand everything to 8 bit RGBA */
+        if (color_type == PNG_COLOR_TYPE_PALETTE)
+            png_set_palette_to_rgb(reader.png_ptr);
+        if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+            png_set_expand_gray_1_2_4_to_8(reader.png_ptr);
+        if (has_transparency)
+            png_set_tRNS_to_alpha(reader.png_ptr);
+        if (bit_depth == 16)
+            png_set_strip_16(reader.png_ptr);
+        if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+            png_set_gray_to_rgb(reader.png_ptr);
+        if (!(color_type & PNG_COLOR_MASK_ALPHA) && !has_transparency)
+            png_set_filler(reader.png_ptr, 0xFF, PNG_FILLER_AFTER);
+        
+        const auto number_of_passes = png_set_interlace_handling(reader.png_ptr);
+        png_read_update_info(reader.png_ptr, reader.info_ptr);
+        
+        const size_t row_bytes = (size_t)width * 4;
+        if (png_get_rowbytes(reader.png_ptr, reader.info_ptr) != row_bytes)
+            throw read_error(file_name, "has an unsupported pixel format");
+        
+        if (sink.begin)
+            sink.begin(width, height);
         
         /* read file */
-        if (setjmp(png_jmpbuf(png_ptr)))
-            throw std::runtime_error("[read_png_file] Error during read_image");
-        
-        auto final_image = std::shared_ptr<uint8_t>((uint8_t *) malloc(sizeof(uint8_t) * height * png_get_rowbytes(png_ptr,info_ptr)), [](uint8_t * ptr){ if (ptr != NULL) {free(ptr);} } );
-        
-        auto row_pointers = (png_bytep*) malloc(sizeof(png_bytep) * height);
-        
-        for (int y=0; y<height; y++) {
-            row_pointers[y] = &(final_image.get()[y*png_get_rowbytes(png_ptr,info_ptr)]);
+        if (number_of_passes == 1) {
+            reader.rows.resize(row_bytes);
+            for (unsigned int y = 0; y < height; y++) {
+                png_read_row(reader.png_ptr, reader.rows.data(), NULL);
+                sink.row(y, reader.rows.data());
+            }
+        } else {
+            reader.rows.resize(row_bytes * height);
+            reader.row_pointers.resize(height);
+            for (unsigned int y = 0; y < height; y++) {
+                reader.row_pointers[y] = reader.rows.data() + y * row_bytes;
+            }
+            
+            png_read_image(reader.png_ptr, reader.row_pointers.data());
+            
+            for (unsigned int y = 0; y < height; y++) {
+                sink.row(y, reader.row_pointers[y]);
+            }
         }
+    }
+    
+    std::shared_ptr<uint8_t> png(const char * file_name, unsigned int &width, unsigned int &height) {
+        std::shared_ptr<uint8_t> final_image = nullptr;
         
-        png_read_image(png_ptr, row_pointers);
+        png_sink sink;
+        sink.begin = [&](unsigned int image_width, unsigned int image_height) {
+            width = image_width;
+            height = image_height;
+            final_image = std::shared_ptr<uint8_t>((uint8_t *) malloc(sizeof(uint8_t) * width * height * 4), [](uint8_t * ptr){ if (ptr != NULL) {free(ptr);} } );
+        };
+        sink.row = [&](unsigned int y, const uint8_t * row) {
+            memcpy(final_image.get() + (size_t)y * width * 4, row, (size_t)width * 4);
+        };
         
-        free(row_pointers);
-        fclose(fp);
+        png_rows(file_name, sink);
         
         return final_image;
     };
     
 }
-
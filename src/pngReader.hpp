@@ -9,6 +9,8 @@
 #ifndef pngReader_hpp
 #define pngReader_hpp
 
+#include <stdint.h>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -16,6 +18,20 @@ namespace load_image {
     
     std::string get_path(const char * file_name);
     
+    // Receives an image a row at a time, as tightly packed RGBA8 whatever
+    // the file's colour type. begin gets the size before any rows; rows come
+    // top to bottom and are only valid for the duration of the call.
+    struct png_sink {
+        std::function<void(unsigned int width, unsigned int height)> begin;
+        std::function<void(unsigned int y, const uint8_t * row)> row;
+    };
+    
+    // Decodes with png_read_row, so rows can be copied out (into staging
+    // memory, say) while the rest of the file is still inflating. Interlaced
+    // files only come out whole, so their rows follow the last pass. Throws
+    // std::runtime_error, as png does.
+    void png_rows(const char * file_name, const png_sink& sink);
+    
     std::shared_ptr<uint8_t> png(const char * file_name, unsigned int &width, unsigned int &height);
     
 }
@@ -0,0 +1,697 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "texture_codec.hpp"
+
+namespace vulkan {
+
+	namespace {
+
+		// One 4x4 block, texel (x, y) at [y * 4 + x].
+		struct texel_block {
+			int texels[16][4];
+		};
+
+		void fetch_block(const uint8_t * rgba, uint32_t width, uint32_t height, uint32_t block_x, uint32_t block_y, texel_block& block) {
+			for (uint32_t y = 0; y < 4; y++) {
+				const uint32_t source_y = (std::min)(block_y * 4 + y, height - 1);
+				for (uint32_t x = 0; x < 4; x++) {
+					const uint32_t source_x = (std::min)(block_x * 4 + x, width - 1);
+					const uint8_t * texel = rgba + ((size_t)source_y * width + source_x) * 4;
+					for (int c = 0; c < 4; c++) {
+						block.texels[y * 4 + x][c] = texel[c];
+					}
+				}
+			}
+		}
+
+		int clamp_int(int value, int low, int high) {
+			return value < low ? low : (value > high ? high : value);
+		}
+
+		// The line through the block's colours that the endpoints are fitted
+		// along: the mean and the principal axis of the first channels, by
+		// power iteration on the covariance. A flat block gets a zero axis.
+		void fit_line(const texel_block& block, int channels, float low[4], float high[4]) {
+			float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; i++) {
+				for (int c = 0; c < channels; c++) {
+					mean[c] += block.texels[i][c] / 16.0f;
+				}
+			}
+
+			float covariance[4][4] = {};
+			for (int i = 0; i < 16; i++) {
+				for (int a = 0; a < channels; a++) {
+					for (int b = 0; b < channels; b++) {
+						covariance[a][b] += (block.texels[i][a] - mean[a]) * (block.texels[i][b] - mean[b]);
+					}
+				}
+			}
+
+			// Start along the channel that varies most. A fixed start such as
+			// (1, 1, 1) is orthogonal to any two colours whose channel
+			// differences sum to zero, and the iteration never leaves it.
+			int widest = 0;
+			for (int c = 1; c < channels; c++) {
+				if (covariance[c][c] > covariance[widest][widest]) {
+					widest = c;
+				}
+			}
+			float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			axis[widest] = 1.0f;
+			for (int iteration = 0; iteration < 8; iteration++) {
+				float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				float length = 0.0f;
+				for (int a = 0; a < channels; a++) {
+					for (int b = 0; b < channels; b++) {
+						next[a] += covariance[a][b] * axis[b];
+					}
+					length += next[a] * next[a];
+				}
+
+				if (length < 1e-12f) {
+					memset(axis, 0, sizeof(axis));
+					break;
+				}
+
+				length = sqrtf(length);
+				for (int c = 0; c < channels; c++) {
+					axis[c] = next[c] / length;
+				}
+			}
+
+			float t_min = 0.0f, t_max = 0.0f;
+			for (int i = 0; i < 16; i++) {
+				float t = 0.0f;
+				for (int c = 0; c < channels; c++) {
+					t += (block.texels[i][c] - mean[c]) * axis[c];
+				}
+				t_min = (std::min)(t_min, t);
+				t_max = (std::max)(t_max, t);
+			}
+
+			for (int c = 0; c < channels; c++) {
+				low[c] = (std::max)(0.0f, (std::min)(255.0f, mean[c] + axis[c] * t_min));
+				high[c] = (std::max)(0.0f, (std::min)(255.0f, mean[c] + axis[c] * t_max));
+			}
+		}
+
+		// Least-squares endpoints for texels fixed at texel[i] ~ (1 - weight[i])
+		// * low + weight[i] * high. False when every texel has the same weight,
+		// which leaves the endpoints undetermined.
+		bool refit_line(const texel_block& block, const float weights[16], int channels, float low[4], float high[4]) {
+			float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+			float x_low[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float x_high[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+			for (int i = 0; i < 16; i++) {
+				const float a = 1.0f - weights[i];
+				const float b = weights[i];
+				aa += a * a;
+				bb += b * b;
+				ab += a * b;
+				for (int c = 0; c < channels; c++) {
+					x_low[c] += a * block.texels[i][c];
+					x_high[c] += b * block.texels[i][c];
+				}
+			}
+
+			const float determinant = aa * bb - ab * ab;
+			if (fabsf(determinant) < 1e-6f) {
+				return false;
+			}
+
+			for (int c = 0; c < channels; c++) {
+				low[c] = (std::max)(0.0f, (std::min)(255.0f, (x_low[c] * bb - x_high[c] * ab) / determinant));
+				high[c] = (std::max)(0.0f, (std::min)(255.0f, (x_high[c] * aa - x_low[c] * ab) / determinant));
+			}
+			return true;
+		}
+
+		// LSB first, as BC7 packs its fields.
+		struct bit_writer {
+			uint8_t * out;
+			uint32_t position;
+
+			void write(uint32_t value, uint32_t bits) {
+				for (uint32_t b = 0; b < bits; b++, position++) {
+					if ((value >> b) & 1) {
+						out[position >> 3] |= (uint8_t)(1 << (position & 7));
+					}
+				}
+			}
+		};
+
+		// BC1 colour.
+
+		uint16_t pack_565(const float color[4]) {
+			const int r = clamp_int((int)(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+			const int g = clamp_int((int)(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+			const int b = clamp_int((int)(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+			return (uint16_t)((r << 11) | (g << 5) | b);
+		}
+
+		void unpack_565(uint16_t packed, int color[3]) {
+			const int r = (packed >> 11) & 31;
+			const int g = (packed >> 5) & 63;
+			const int b = packed & 31;
+			color[0] = (r << 3) | (r >> 2);
+			color[1] = (g << 2) | (g >> 4);
+			color[2] = (b << 3) | (b >> 2);
+		}
+
+		// Four-colour mode needs color0 > color1. Equal endpoints decode as
+		// three-colour mode, where index 3 is black, so those blocks use only
+		// index 0.
+		uint32_t bc1_fit_indices(const texel_block& block, uint16_t color0, uint16_t color1, uint32_t& indices) {
+			int palette[4][3];
+			unpack_565(color0, palette[0]);
+			unpack_565(color1, palette[1]);
+			for (int c = 0; c < 3; c++) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			const int entries = color0 > color1 ? 4 : 1;
+
+			uint32_t error = 0;
+			indices = 0;
+			for (int i = 0; i < 16; i++) {
+				int best = 0;
+				int best_error = INT32_MAX;
+				for (int k = 0; k < entries; k++) {
+					int e = 0;
+					for (int c = 0; c < 3; c++) {
+						const int d = block.texels[i][c] - palette[k][c];
+						e += d * d;
+					}
+					if (e < best_error) {
+						best_error = e;
+						best = k;
+					}
+				}
+				indices |= (uint32_t)best << (i * 2);
+				error += best_error;
+			}
+			return error;
+		}
+
+		void encode_bc1_color(const texel_block& block, uint8_t out[8]) {
+			// Where each index sits between color0 and color1.
+			static const float index_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+			float low[4], high[4];
+			fit_line(block, 3, low, high);
+
+			uint16_t color0 = pack_565(high), color1 = pack_565(low);
+			uint16_t best_color0 = 0, best_color1 = 0;
+			uint32_t best_indices = 0;
+			uint32_t best_error = UINT32_MAX;
+
+			// The principal-axis fit, then a least-squares refit to its indices.
+			for (int pass = 0; pass < 2; pass++) {
+				if (color0 < color1) {
+					std::swap(color0, color1);
+				}
+
+				uint32_t indices = 0;
+				const uint32_t error = bc1_fit_indices(block, color0, color1, indices);
+				if (error < best_error) {
+					best_error = error;
+					best_color0 = color0;
+					best_color1 = color1;
+					best_indices = indices;
+				}
+
+				float weights[16];
+				for (int i = 0; i < 16; i++) {
+					weights[i] = index_weights[(best_indices >> (i * 2)) & 3];
+				}
+
+				float refit_low[4], refit_high[4];
+				if (best_error == 0 || !refit_line(block, weights, 3, refit_low, refit_high)) {
+					break;
+				}
+				color0 = pack_565(refit_low);
+				color1 = pack_565(refit_high);
+			}
+
+			out[0] = (uint8_t)(best_color0 & 0xff);
+			out[1] = (uint8_t)(best_color0 >> 8);
+			out[2] = (uint8_t)(best_color1 & 0xff);
+			out[3] = (uint8_t)(best_color1 >> 8);
+			for (int b = 0; b < 4; b++) {
+				out[4 + b] = (uint8_t)(best_indices >> (b * 8));
+			}
+		}
+
+		// BC3 alpha: eight-value mode between the block's extremes.
+		void encode_bc3_alpha(const texel_block& block, uint8_t out[8]) {
+			int alpha_min = 255, alpha_max = 0;
+			for (int i = 0; i < 16; i++) {
+				alpha_min = (std::min)(alpha_min, block.texels[i][3]);
+				alpha_max = (std::max)(alpha_max, block.texels[i][3]);
+			}
+
+			out[0] = (uint8_t)alpha_max;
+			out[1] = (uint8_t)alpha_min;
+
+			uint64_t bits = 0;
+			if (alpha_max > alpha_min) {
+				int palette[8];
+				palette[0] = alpha_max;
+				palette[1] = alpha_min;
+				for (int k = 1; k < 7; k++) {
+					palette[k + 1] = ((7 - k) * alpha_max + k * alpha_min) / 7;
+				}
+
+				for (int i = 0; i < 16; i++) {
+					int best = 0;
+					for (int k = 1; k < 8; k++) {
+						if (abs(block.texels[i][3] - palette[k]) < abs(block.texels[i][3] - palette[best])) {
+							best = k;
+						}
+					}
+					bits |= (uint64_t)best << (i * 3);
+				}
+			}
+
+			for (int b = 0; b < 6; b++) {
+				out[2 + b] = (uint8_t)(bits >> (b * 8));
+			}
+		}
+
+		// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit each,
+		// 4-bit indices. Not the best BC7 can do on blocks with two distinct
+		// colour groups, but good everywhere and simple.
+
+		const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		struct bc7_endpoint {
+			int q[4];	// 7 bits a channel
+			int p;		// shared lowest bit
+		};
+
+		bc7_endpoint quantize_bc7_endpoint(const float color[4]) {
+			bc7_endpoint best = {};
+			float best_error = 1e30f;
+			for (int p = 0; p < 2; p++) {
+				bc7_endpoint candidate;
+				candidate.p = p;
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++) {
+					candidate.q[c] = clamp_int((int)((color[c] - p) / 2.0f + 0.5f), 0, 127);
+					const float d = (float)((candidate.q[c] << 1) | p) - color[c];
+					error += d * d;
+				}
+				if (error < best_error) {
+					best_error = error;
+					best = candidate;
+				}
+			}
+			return best;
+		}
+
+		uint32_t bc7_fit_indices(const texel_block& block, const bc7_endpoint& e0, const bc7_endpoint& e1, int indices[16]) {
+			int palette[16][4];
+			for (int k = 0; k < 16; k++) {
+				for (int c = 0; c < 4; c++) {
+					const int a = (e0.q[c] << 1) | e0.p;
+					const int b = (e1.q[c] << 1) | e1.p;
+					palette[k][c] = ((64 - bc7_weights4[k]) * a + bc7_weights4[k] * b + 32) >> 6;
+				}
+			}
+
+			uint32_t error = 0;
+			for (int i = 0; i < 16; i++) {
+				int best = 0;
+				int best_error = INT32_MAX;
+				for (int k = 0; k < 16; k++) {
+					int e = 0;
+					for (int c = 0; c < 4; c++) {
+						const int d = block.texels[i][c] - palette[k][c];
+						e += d * d;
+					}
+					if (e < best_error) {
+						best_error = e;
+						best = k;
+					}
+				}
+				indices[i] = best;
+				error += best_error;
+			}
+			return error;
+		}
+
+		void encode_bc7(const texel_block& block, uint8_t out[16]) {
+			float low[4], high[4];
+			fit_line(block, 4, low, high);
+
+			bc7_endpoint e0 = quantize_bc7_endpoint(low), e1 = quantize_bc7_endpoint(high);
+			bc7_endpoint best_e0 = e0, best_e1 = e1;
+			int best_indices[16] = {};
+			uint32_t best_error = UINT32_MAX;
+
+			for (int pass = 0; pass < 2; pass++) {
+				int indices[16];
+				const uint32_t error = bc7_fit_indices(block, e0, e1, indices);
+				if (error < best_error) {
+					best_error = error;
+					best_e0 = e0;
+					best_e1 = e1;
+					memcpy(best_indices, indices, sizeof(indices));
+				}
+
+				float weights[16];
+				for (int i = 0; i < 16; i++) {
+					weights[i] = bc7_weights4[best_indices[i]] / 64.0f;
+				}
+
+				if (best_error == 0 || !refit_line(block, weights, 4, low, high)) {
+					break;
+				}
+				e0 = quantize_bc7_endpoint(low);
+				e1 = quantize_bc7_endpoint(high);
+			}
+
+			// The first index drops its top bit, so it has to be below 8.
+			if (best_indices[0] & 8) {
+				std::swap(best_e0, best_e1);
+				for (int i = 0; i < 16; i++) {
+					best_indices[i] = 15 - best_indices[i];
+				}
+			}
+
+			memset(out, 0, 16);
+			bit_writer writer = { out, 0 };
+			writer.write(1 << 6, 7);
+			for (int c = 0; c < 4; c++) {
+				writer.write(best_e0.q[c], 7);
+				writer.write(best_e1.q[c], 7);
+			}
+			writer.write(best_e0.p, 1);
+			writer.write(best_e1.p, 1);
+			for (int i = 0; i < 16; i++) {
+				writer.write(best_indices[i], i == 0 ? 3 : 4);
+			}
+			assert(writer.position == 128);
+		}
+
+		// ETC2 RGB, using only the ETC1 individual and differential modes,
+		// which every ETC2 decoder reads the same way. Two half blocks, side by
+		// side or stacked, each a base colour moved by one of eight modifier
+		// tables. Texel indices run down columns: texel (x, y) is bit x * 4 + y.
+
+		const int etc1_modifiers[8][2] = {
+			{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+		};
+
+		// Best table and selectors for one half block; returns the squared error.
+		uint32_t etc_fit_half(const texel_block& block, const int texels[8], const int base[3], int& table, int selectors[8]) {
+			uint32_t best_error = UINT32_MAX;
+
+			for (int t = 0; t < 8; t++) {
+				const int modifiers[4] = { etc1_modifiers[t][0], etc1_modifiers[t][1], -etc1_modifiers[t][0], -etc1_modifiers[t][1] };
+
+				uint32_t error = 0;
+				int table_selectors[8];
+				for (int k = 0; k < 8; k++) {
+					const int * texel = block.texels[texels[k]];
+					int best = 0;
+					int best_texel_error = INT32_MAX;
+					for (int s = 0; s < 4; s++) {
+						int e = 0;
+						for (int c = 0; c < 3; c++) {
+							const int d = texel[c] - clamp_int(base[c] + modifiers[s], 0, 255);
+							e += d * d;
+						}
+						if (e < best_texel_error) {
+							best_texel_error = e;
+							best = s;
+						}
+					}
+					table_selectors[k] = best;
+					error += best_texel_error;
+				}
+
+				if (error < best_error) {
+					best_error = error;
+					table = t;
+					memcpy(selectors, table_selectors, sizeof(table_selectors));
+				}
+			}
+			return best_error;
+		}
+
+		void encode_etc2_rgb(const texel_block& block, uint8_t out[8]) {
+			uint64_t best_bits = 0;
+			uint32_t best_error = UINT32_MAX;
+
+			for (int flip = 0; flip < 2; flip++) {
+				// Not flipped: left and right 2x4 halves. Flipped: top and bottom 4x2.
+				int texels[2][8];
+				int counts[2] = { 0, 0 };
+				float average[2][3] = {};
+				for (int y = 0; y < 4; y++) {
+					for (int x = 0; x < 4; x++) {
+						const int half = flip ? (y >= 2) : (x >= 2);
+						texels[half][counts[half]++] = y * 4 + x;
+						for (int c = 0; c < 3; c++) {
+							average[half][c] += block.texels[y * 4 + x][c] / 8.0f;
+						}
+					}
+				}
+
+				int q5[2][3], q4[2][3];
+				bool differential_fits = true;
+				for (int h = 0; h < 2; h++) {
+					for (int c = 0; c < 3; c++) {
+						q5[h][c] = clamp_int((int)(average[h][c] * 31.0f / 255.0f + 0.5f), 0, 31);
+						q4[h][c] = clamp_int((int)(average[h][c] * 15.0f / 255.0f + 0.5f), 0, 15);
+					}
+				}
+				for (int c = 0; c < 3; c++) {
+					const int delta = q5[1][c] - q5[0][c];
+					differential_fits = differential_fits && delta >= -4 && delta <= 3;
+				}
+
+				for (int differential = 0; differential < 2; differential++) {
+					if (differential && !differential_fits) {
+						continue;
+					}
+
+					int base[2][3];
+					for (int h = 0; h < 2; h++) {
+						for (int c = 0; c < 3; c++) {
+							base[h][c] = differential ? (q5[h][c] << 3) | (q5[h][c] >> 2) : q4[h][c] * 17;
+						}
+					}
+
+					int tables[2];
+					int selectors[2][8];
+					const uint32_t error = etc_fit_half(block, texels[0], base[0], tables[0], selectors[0]) + etc_fit_half(block, texels[1], base[1], tables[1], selectors[1]);
+					if (error >= best_error) {
+						continue;
+					}
+					best_error = error;
+
+					uint64_t bits = 0;
+					for (int c = 0; c < 3; c++) {
+						if (differential) {
+							bits |= (uint64_t)q5[0][c] << (59 - c * 8);
+							bits |= (uint64_t)((q5[1][c] - q5[0][c]) & 7) << (56 - c * 8);
+						} else {
+							bits |= (uint64_t)q4[0][c] << (60 - c * 8);
+							bits |= (uint64_t)q4[1][c] << (56 - c * 8);
+						}
+					}
+					bits |= (uint64_t)tables[0] << 37;
+					bits |= (uint64_t)tables[1] << 34;
+					bits |= (uint64_t)differential << 33;
+					bits |= (uint64_t)flip << 32;
+
+					// Selector 0..3 is +a, +b, -a, -b: the high bit in the upper
+					// half of the index word, the low bit in the lower.
+					for (int h = 0; h < 2; h++) {
+						for (int k = 0; k < 8; k++) {
+							const int texel = texels[h][k];
+							const int bit = (texel % 4) * 4 + texel / 4;
+							bits |= (uint64_t)(selectors[h][k] >> 1) << (16 + bit);
+							bits |= (uint64_t)(selectors[h][k] & 1) << bit;
+						}
+					}
+					best_bits = bits;
+				}
+			}
+
+			for (int b = 0; b < 8; b++) {
+				out[b] = (uint8_t)(best_bits >> (56 - b * 8));
+			}
+		}
+
+		// EAC alpha for ETC2 RGBA8: a base, a multiplier and one of sixteen
+		// modifier tables, 3-bit selectors down the columns, first texel in
+		// the top bits.
+
+		const int eac_modifiers[16][8] = {
+			{ -3, -6, -9, -15, 2, 5, 8, 14 },
+			{ -3, -7, -10, -13, 2, 6, 9, 12 },
+			{ -2, -5, -8, -13, 1, 4, 7, 12 },
+			{ -2, -4, -6, -13, 1, 3, 5, 12 },
+			{ -3, -6, -8, -12, 2, 5, 7, 11 },
+			{ -3, -7, -9, -11, 2, 6, 8, 10 },
+			{ -4, -7, -8, -11, 3, 6, 7, 10 },
+			{ -3, -5, -8, -11, 2, 4, 7, 10 },
+			{ -2, -6, -8, -10, 1, 5, 7, 9 },
+			{ -2, -5, -8, -10, 1, 4, 7, 9 },
+			{ -2, -4, -8, -10, 1, 3, 7, 9 },
+			{ -2, -5, -7, -10, 1, 4, 6, 9 },
+			{ -3, -4, -7, -10, 2, 3, 6, 9 },
+			{ -1, -2, -3, -10, 0, 1, 2, 9 },
+			{ -4, -6, -8, -9, 3, 5, 7, 8 },
+			{ -3, -5, -7, -9, 2, 4, 6, 8 },
+		};
+
+		void encode_eac_alpha(const texel_block& block, uint8_t out[8]) {
+			int alpha_min = 255, alpha_max = 0;
+			for (int i = 0; i < 16; i++) {
+				alpha_min = (std::min)(alpha_min, block.texels[i][3]);
+				alpha_max = (std::max)(alpha_max, block.texels[i][3]);
+			}
+
+			int best_base = alpha_min, best_multiplier = 1, best_table = 13;
+			int best_selectors[16] = {};
+			uint32_t best_error = UINT32_MAX;
+
+			// Stretch each table over the block's range, trying the multipliers
+			// either side of the closest fit.
+			for (int t = 0; t < 16 && best_error > 0; t++) {
+				const int modifier_min = eac_modifiers[t][3];
+				const int modifier_max = eac_modifiers[t][7];
+				const int estimate = clamp_int((int)((alpha_max - alpha_min) / (float)(modifier_max - modifier_min) + 0.5f), 1, 15);
+
+				for (int multiplier = (std::max)(1, estimate - 1); multiplier <= (std::min)(15, estimate + 1); multiplier++) {
+					const int base = clamp_int((int)floorf((alpha_min + alpha_max) / 2.0f - (modifier_min + modifier_max) * multiplier / 2.0f + 0.5f), 0, 255);
+
+					uint32_t error = 0;
+					int selectors[16];
+					for (int i = 0; i < 16; i++) {
+						int best = 0;
+						int best_texel_error = INT32_MAX;
+						for (int s = 0; s < 8; s++) {
+							const int d = block.texels[i][3] - clamp_int(base + eac_modifiers[t][s] * multiplier, 0, 255);
+							if (d * d < best_texel_error) {
+								best_texel_error = d * d;
+								best = s;
+							}
+						}
+						selectors[i] = best;
+						error += best_texel_error;
+					}
+
+					if (error < best_error) {
+						best_error = error;
+						best_base = base;
+						best_multiplier = multiplier;
+						best_table = t;
+						memcpy(best_selectors, selectors, sizeof(selectors));
+					}
+				}
+			}
+
+			uint64_t bits = 0;
+			for (int i = 0; i < 16; i++) {
+				const int bit = (i % 4) * 4 + i / 4;
+				bits |= (uint64_t)best_selectors[i] << (45 - bit * 3);
+			}
+
+			out[0] = (uint8_t)best_base;
+			out[1] = (uint8_t)((best_multiplier << 4) | best_table);
+			for (int b = 0; b < 6; b++) {
+				out[2 + b] = (uint8_t)(bits >> (40 - b * 8));
+			}
+		}
+
+	}
+
+	const char * block_format_name(block_format format) {
+		switch (format) {
+		case block_format::bc1: return "bc1";
+		case block_format::bc3: return "bc3";
+		case block_format::bc7: return "bc7";
+		case block_format::etc2: return "etc2";
+		case block_format::etc2a: return "etc2a";
+		}
+		return "unknown";
+	}
+
+	bool parse_block_format(const char * name, block_format& format) {
+		const block_format formats[] = { block_format::bc1, block_format::bc3, block_format::bc7, block_format::etc2, block_format::etc2a };
+		for (block_format candidate : formats) {
+			if (strcmp(name, block_format_name(candidate)) == 0) {
+				format = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	VkFormat block_format_vk_format(block_format format) {
+		switch (format) {
+		case block_format::bc1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		case block_format::bc3: return VK_FORMAT_BC3_UNORM_BLOCK;
+		case block_format::bc7: return VK_FORMAT_BC7_UNORM_BLOCK;
+		case block_format::etc2: return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+		case block_format::etc2a: return VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;
+		}
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	uint32_t block_format_block_bytes(block_format format) {
+		return format == block_format::bc1 || format == block_format::etc2 ? 8 : 16;
+	}
+
+	uint64_t block_format_level_size(block_format format, uint32_t width, uint32_t height) {
+		return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * block_format_block_bytes(format);
+	}
+
+	void encode_blocks(block_format format, const uint8_t * rgba, uint32_t width, uint32_t height, uint8_t * out) {
+		assert(width > 0 && height > 0);
+
+		const uint32_t blocks_x = (width + 3) / 4;
+		const uint32_t blocks_y = (height + 3) / 4;
+		const uint32_t block_bytes = block_format_block_bytes(format);
+
+		texel_block block;
+		for (uint32_t by = 0; by < blocks_y; by++) {
+			for (uint32_t bx = 0; bx < blocks_x; bx++) {
+				fetch_block(rgba, width, height, bx, by, block);
+				uint8_t * encoded = out + ((size_t)by * blocks_x + bx) * block_bytes;
+
+				switch (format) {
+				case block_format::bc1:
+					encode_bc1_color(block, encoded);
+					break;
+				case block_format::bc3:
+					encode_bc3_alpha(block, encoded);
+					encode_bc1_color(block, encoded + 8);
+					break;
+				case block_format::bc7:
+					encode_bc7(block, encoded);
+					break;
+				case block_format::etc2:
+					encode_etc2_rgb(block, encoded);
+					break;
+				case block_format::etc2a:
+					encode_eac_alpha(block, encoded);
+					encode_etc2_rgb(block, encoded + 8);
+					break;
+				}
+			}
+		}
+	}
+
+}
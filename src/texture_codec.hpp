@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+namespace vulkan {
+
+	// Block-compressed formats the offline converter writes, all 4x4 texel
+	// blocks. bc1 and etc2 are opaque at 8 bytes a block, an eighth of RGBA8;
+	// the rest keep alpha at 16 bytes. etc2 and etc2a are for devices without
+	// BC support.
+	enum class block_format {
+		bc1,
+		bc3,
+		bc7,
+		etc2,
+		etc2a,
+	};
+
+	const char * block_format_name(block_format format);
+
+	// Accepts the names block_format_name returns.
+	bool parse_block_format(const char * name, block_format& format);
+
+	VkFormat block_format_vk_format(block_format format);
+
+	uint32_t block_format_block_bytes(block_format format);
+
+	// Bytes for one width x height level.
+	uint64_t block_format_level_size(block_format format, uint32_t width, uint32_t height);
+
+	// Encodes a tightly packed RGBA8 level into blocks, left to right and top
+	// to bottom. Blocks hanging off the right or bottom edge repeat the last
+	// column or row. Quality over speed: this runs offline, not at load time.
+	void encode_blocks(block_format format, const uint8_t * rgba, uint32_t width, uint32_t height, uint8_t * out);
+
+}
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <iostream>
+
+#include "texture_decoder.hpp"
+#include "cpu_profiler.hpp"
+
+namespace vulkan {
+
+	texture_decoder::~texture_decoder() {
+		finish();
+	}
+
+	void texture_decoder::init(uint32_t thread_count) {
+		assert(_threads.empty());
+
+		_quit = false;
+
+		if (thread_count == 0) {
+			const uint32_t hardware = std::thread::hardware_concurrency();
+			thread_count = hardware > 1 ? hardware - 1 : 1;
+			if (thread_count > 8) {
+				thread_count = 8;
+			}
+		}
+
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			_threads.push_back(std::thread(&texture_decoder::run, this));
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats.threads = thread_count;
+	}
+
+	decode_handle texture_decoder::submit(const std::string& filename, const load_image::png_sink& sink) {
+		assert(!_threads.empty());
+
+		decode_job job;
+		job.filename = filename;
+		job.sink = sink;
+		decode_handle handle(job.promise.get_future().share());
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobs.push_back(std::move(job));
+			_stats.submitted++;
+		}
+		_condition.notify_one();
+
+		return handle;
+	}
+
+	bool texture_decoder::idle() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _jobs.empty() && _in_flight == 0;
+	}
+
+	void texture_decoder::finish() {
+		if (_threads.empty()) {
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_idle_condition.wait(lock, [this] { return _jobs.empty() && _in_flight == 0; });
+			_quit = true;
+		}
+		_condition.notify_all();
+
+		for (auto& thread : _threads) {
+			thread.join();
+		}
+		_threads.clear();
+	}
+
+	texture_decoder_stats texture_decoder::get_stats() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+	void texture_decoder::run() {
+		cpu_profiler::get().set_thread_name("texture decoder");
+
+		for (;;) {
+			decode_job job;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, [this] { return _quit || !_jobs.empty(); });
+				if (_jobs.empty()) {
+					return;
+				}
+				job = std::move(_jobs.front());
+				_jobs.pop_front();
+				_in_flight++;
+			}
+
+			// Count what reaches the caller's sink without it having to.
+			uint64_t bytes = 0;
+			load_image::png_sink sink = job.sink;
+			sink.begin = [&job, &bytes](unsigned int width, unsigned int height) {
+				bytes = (uint64_t)width * height * 4;
+				if (job.sink.begin) {
+					job.sink.begin(width, height);
+				}
+			};
+
+			auto decode_start = std::chrono::high_resolution_clock::now();
+			bool decoded = true;
+			{
+				cpu_scope scope("decode_png");
+				try {
+					load_image::png_rows(job.filename.c_str(), sink);
+				} catch (std::exception& e) {
+					std::cerr << "Failed to decode texture: " << e.what() << std::endl;
+					decoded = false;
+				}
+			}
+			const double decode_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decode_start).count();
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_in_flight--;
+				if (decoded) {
+					_stats.decoded++;
+					_stats.bytes += bytes;
+				} else {
+					_stats.failed++;
+				}
+				_stats.decode_ms += decode_ms;
+			}
+
+			// Only once the stats are in, so anyone woken by get() sees this
+			// file counted.
+			job.promise.set_value(decoded);
+			_idle_condition.notify_all();
+		}
+	}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pngReader.hpp"
+
+namespace vulkan {
+
+	// A decode that may still be running. ready() never blocks; get() does,
+	// and is false if the file couldn't be decoded.
+	class decode_handle {
+	public:
+		decode_handle() {}
+		explicit decode_handle(std::shared_future<bool> future) : _future(future) {}
+
+		bool valid() const {
+			return _future.valid();
+		}
+
+		bool ready() const {
+			return _future.valid() && _future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		}
+
+		bool get() const {
+			return _future.get();
+		}
+
+	private:
+		std::shared_future<bool> _future;
+	};
+
+	struct texture_decoder_stats {
+		uint32_t threads = 0;
+		uint32_t submitted = 0;
+		uint32_t decoded = 0;
+		uint32_t failed = 0;
+		uint64_t bytes = 0;			// RGBA8 handed to sinks
+		double decode_ms = 0.0;		// summed across workers
+	};
+
+	// Decodes PNGs on a small thread pool, one file per worker at a time.
+	// Each job's sink is called on that worker as rows come out of libpng,
+	// so it can write them straight to their destination while the rest of
+	// the file decodes.
+	class texture_decoder {
+	public:
+		texture_decoder() {}
+		~texture_decoder();
+
+		// thread_count 0 picks one per spare hardware thread.
+		void init(uint32_t thread_count = 0);
+
+		decode_handle submit(const std::string& filename, const load_image::png_sink& sink);
+
+		// True once every submitted file has been decoded.
+		bool idle() const;
+
+		// Waits for outstanding decodes and stops the threads. init may be
+		// called again afterwards.
+		void finish();
+
+		bool running() const {
+			return !_threads.empty();
+		}
+
+		texture_decoder_stats get_stats() const;
+
+	private:
+		struct decode_job {
+			std::string filename;
+			load_image::png_sink sink;
+			std::promise<bool> promise;
+		};
+
+		void run();
+
+		std::vector<std::thread> _threads;
+
+		mutable std::mutex _mutex;
+		std::condition_variable _condition;
+		std::condition_variable _idle_condition;
+		std::deque<decode_job> _jobs;
+		uint32_t _in_flight = 0;
+		bool _quit = false;
+
+		texture_decoder_stats _stats;
+	};
+
+}
@@ -0,0 +1,539 @@
+
+#include <assert.h>
+#include <math.h>
+
+#include "transform_batch.hpp"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define TRANSFORM_BATCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC emits AVX2 intrinsics anywhere; GCC and Clang need the function to be
+// compiled for that target, which keeps the rest of the file baseline.
+#if defined(TRANSFORM_BATCH_X86) && !defined(_MSC_VER)
+#define TRANSFORM_BATCH_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TRANSFORM_BATCH_AVX2
+#endif
+
+namespace vulkan {
+
+	simd_level detect_simd_level() {
+#ifdef TRANSFORM_BATCH_X86
+		int leaf1[4] = { 0, 0, 0, 0 };
+		int leaf7[4] = { 0, 0, 0, 0 };
+		unsigned long long xcr0 = 0;
+
+#ifdef _MSC_VER
+		__cpuid(leaf1, 1);
+		__cpuidex(leaf7, 7, 0);
+		const bool osxsave = (leaf1[2] & (1 << 27)) != 0;
+		if (osxsave) {
+			xcr0 = _xgetbv(0);
+		}
+#else
+		unsigned int a, b, c, d;
+		if (__get_cpuid(1, &a, &b, &c, &d)) {
+			leaf1[0] = (int)a; leaf1[1] = (int)b; leaf1[2] = (int)c; leaf1[3] = (int)d;
+		}
+		if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+			leaf7[0] = (int)a; leaf7[1] = (int)b; leaf7[2] = (int)c; leaf7[3] = (int)d;
+		}
+		const bool osxsave = (leaf1[2] & (1 << 27)) != 0;
+		if (osxsave) {
+			unsigned int lo, hi;
+			__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			xcr0 = ((unsigned long long)hi << 32) | lo;
+		}
+#endif
+
+		// AVX2 needs the CPU bits (AVX, FMA, AVX2) and the OS saving YMM state.
+		const bool avx = (leaf1[2] & (1 << 28)) != 0;
+		const bool fma = (leaf1[2] & (1 << 12)) != 0;
+		const bool avx2 = (leaf7[1] & (1 << 5)) != 0;
+		if (osxsave && avx && fma && avx2 && (xcr0 & 6) == 6) {
+			return simd_level::avx2;
+		}
+
+		const bool sse2 = (leaf1[3] & (1 << 26)) != 0;
+		if (sse2) {
+			return simd_level::sse;
+		}
+#endif
+		return simd_level::scalar;
+	}
+
+	const char * simd_level_name(simd_level level) {
+		switch (level) {
+		case simd_level::sse: return "sse";
+		case simd_level::avx2: return "avx2";
+		default: return "scalar";
+		}
+	}
+
+	void transform_soa::resize(uint32_t count) {
+		_count = count;
+		for (auto& element : _elements) {
+			element.resize(count);
+		}
+	}
+
+	void transform_soa::set(uint32_t index, const float matrix[16]) {
+		assert(index < _count);
+		for (int i = 0; i < 16; i++) {
+			_elements[i][index] = matrix[i];
+		}
+	}
+
+	void transform_soa::get(uint32_t index, float matrix[16]) const {
+		assert(index < _count);
+		for (int i = 0; i < 16; i++) {
+			matrix[i] = _elements[i][index];
+		}
+	}
+
+	void extract_frustum_planes(const float clip[16], float planes[6][4]) {
+		for (int i = 0; i < 6; i++) {
+			const int row = i / 2;
+			const float sign = (i % 2) == 0 ? 1.0f : -1.0f;
+
+			float plane[4];
+			for (int column = 0; column < 4; column++) {
+				plane[column] = clip[column * 4 + 3] + sign * clip[column * 4 + row];
+			}
+
+			const float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			for (int j = 0; j < 4; j++) {
+				planes[i][j] = length > 0.0f ? plane[j] / length : plane[j];
+			}
+		}
+	}
+
+	namespace {
+
+		// Scalar reference kernels. Each takes [begin, end) so the SIMD
+		// versions can hand them their tails.
+
+		void compose_translations_scalar(const float s[16], const float * x, const float * y, const float * z, uint32_t begin, uint32_t end, transform_soa& out) {
+			const float * p[3] = { x, y, z };
+			for (int c = 0; c < 4; c++) {
+				for (int r = 0; r < 4; r++) {
+					float * o = out.element(c, r);
+					for (uint32_t i = begin; i < end; i++) {
+						o[i] = r < 3 ? s[c * 4 + r] + p[r][i] * s[c * 4 + 3] : s[c * 4 + 3];
+					}
+				}
+			}
+		}
+
+		void multiply_transforms_scalar(const float l[16], const transform_soa& in, uint32_t begin, uint32_t end, transform_soa& out) {
+			for (int c = 0; c < 4; c++) {
+				const float * i0 = in.element(c, 0);
+				const float * i1 = in.element(c, 1);
+				const float * i2 = in.element(c, 2);
+				const float * i3 = in.element(c, 3);
+				for (uint32_t i = begin; i < end; i++) {
+					const float k0 = i0[i], k1 = i1[i], k2 = i2[i], k3 = i3[i];
+					for (int r = 0; r < 4; r++) {
+						out.element(c, r)[i] = l[0 * 4 + r] * k0 + l[1 * 4 + r] * k1 + l[2 * 4 + r] * k2 + l[3 * 4 + r] * k3;
+					}
+				}
+			}
+		}
+
+		uint32_t cull_spheres_scalar(const float planes[6][4], const float * x, const float * y, const float * z, const float * radius, uint32_t begin, uint32_t end, uint8_t * visible) {
+			uint32_t count = 0;
+			for (uint32_t i = begin; i < end; i++) {
+				uint8_t inside = 1;
+				for (int p = 0; p < 6; p++) {
+					const float distance = planes[p][0] * x[i] + planes[p][1] * y[i] + planes[p][2] * z[i] + planes[p][3];
+					if (distance < -radius[i]) {
+						inside = 0;
+					}
+				}
+				visible[i] = inside;
+				count += inside;
+			}
+			return count;
+		}
+
+		uint32_t cull_aabbs_scalar(const float planes[6][4], const float * cx, const float * cy, const float * cz, const float * ex, const float * ey, const float * ez,
+			uint32_t begin, uint32_t end, uint8_t * visible) {
+			uint32_t count = 0;
+			for (uint32_t i = begin; i < end; i++) {
+				uint8_t inside = 1;
+				for (int p = 0; p < 6; p++) {
+					// Distance of the corner furthest along the plane normal.
+					const float distance = planes[p][0] * cx[i] + planes[p][1] * cy[i] + planes[p][2] * cz[i] + planes[p][3]
+						+ fabsf(planes[p][0]) * ex[i] + fabsf(planes[p][1]) * ey[i] + fabsf(planes[p][2]) * ez[i];
+					if (distance < 0.0f) {
+						inside = 0;
+					}
+				}
+				visible[i] = inside;
+				count += inside;
+			}
+			return count;
+		}
+
+		uint32_t store_transforms_scalar(const transform_soa& in, const uint8_t * visible, uint32_t begin, uint32_t end, float * out) {
+			uint32_t written = 0;
+			for (uint32_t i = begin; i < end; i++) {
+				if (visible != nullptr && !visible[i]) {
+					continue;
+				}
+				for (int e = 0; e < 16; e++) {
+					out[written * 16 + e] = in.element(e / 4, e % 4)[i];
+				}
+				written++;
+			}
+			return written;
+		}
+
+#ifdef TRANSFORM_BATCH_X86
+
+		// SSE: four matrices per instruction.
+
+		void compose_translations_sse(const float s[16], const float * x, const float * y, const float * z, uint32_t count, transform_soa& out) {
+			const uint32_t simd_end = count & ~3u;
+			const float * p[3] = { x, y, z };
+
+			for (int c = 0; c < 4; c++) {
+				const __m128 w = _mm_set1_ps(s[c * 4 + 3]);
+				for (int r = 0; r < 4; r++) {
+					float * o = out.element(c, r);
+					if (r == 3) {
+						for (uint32_t i = 0; i < simd_end; i += 4) {
+							_mm_storeu_ps(o + i, w);
+						}
+						continue;
+					}
+					const __m128 base = _mm_set1_ps(s[c * 4 + r]);
+					for (uint32_t i = 0; i < simd_end; i += 4) {
+						_mm_storeu_ps(o + i, _mm_add_ps(base, _mm_mul_ps(_mm_loadu_ps(p[r] + i), w)));
+					}
+				}
+			}
+
+			compose_translations_scalar(s, x, y, z, simd_end, count, out);
+		}
+
+		void multiply_transforms_sse(const float l[16], const transform_soa& in, transform_soa& out) {
+			const uint32_t count = in.size();
+			const uint32_t simd_end = count & ~3u;
+
+			__m128 lhs[16];
+			for (int e = 0; e < 16; e++) {
+				lhs[e] = _mm_set1_ps(l[e]);
+			}
+
+			for (int c = 0; c < 4; c++) {
+				const float * i0 = in.element(c, 0);
+				const float * i1 = in.element(c, 1);
+				const float * i2 = in.element(c, 2);
+				const float * i3 = in.element(c, 3);
+				float * o[4] = { out.element(c, 0), out.element(c, 1), out.element(c, 2), out.element(c, 3) };
+
+				for (uint32_t i = 0; i < simd_end; i += 4) {
+					const __m128 k0 = _mm_loadu_ps(i0 + i);
+					const __m128 k1 = _mm_loadu_ps(i1 + i);
+					const __m128 k2 = _mm_loadu_ps(i2 + i);
+					const __m128 k3 = _mm_loadu_ps(i3 + i);
+					for (int r = 0; r < 4; r++) {
+						__m128 sum = _mm_mul_ps(lhs[0 * 4 + r], k0);
+						sum = _mm_add_ps(sum, _mm_mul_ps(lhs[1 * 4 + r], k1));
+						sum = _mm_add_ps(sum, _mm_mul_ps(lhs[2 * 4 + r], k2));
+						sum = _mm_add_ps(sum, _mm_mul_ps(lhs[3 * 4 + r], k3));
+						_mm_storeu_ps(o[r] + i, sum);
+					}
+				}
+			}
+
+			multiply_transforms_scalar(l, in, simd_end, count, out);
+		}
+
+		inline uint32_t write_visible_mask(int mask, int lanes, uint8_t * visible) {
+			uint32_t count = 0;
+			for (int lane = 0; lane < lanes; lane++) {
+				const uint8_t inside = (uint8_t)((mask >> lane) & 1);
+				visible[lane] = inside;
+				count += inside;
+			}
+			return count;
+		}
+
+		uint32_t cull_spheres_sse(const float planes[6][4], const float * x, const float * y, const float * z, const float * radius, uint32_t count, uint8_t * visible) {
+			const uint32_t simd_end = count & ~3u;
+			uint32_t visible_count = 0;
+
+			for (uint32_t i = 0; i < simd_end; i += 4) {
+				const __m128 px = _mm_loadu_ps(x + i);
+				const __m128 py = _mm_loadu_ps(y + i);
+				const __m128 pz = _mm_loadu_ps(z + i);
+				const __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int p = 0; p < 6; p++) {
+					// Same summation order as the scalar reference.
+					__m128 distance = _mm_mul_ps(_mm_set1_ps(planes[p][0]), px);
+					distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[p][1]), py));
+					distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[p][2]), pz));
+					distance = _mm_add_ps(distance, _mm_set1_ps(planes[p][3]));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_radius));
+				}
+
+				visible_count += write_visible_mask(_mm_movemask_ps(inside), 4, visible + i);
+			}
+
+			return visible_count + cull_spheres_scalar(planes, x, y, z, radius, simd_end, count, visible);
+		}
+
+		uint32_t cull_aabbs_sse(const float planes[6][4], const float * cx, const float * cy, const float * cz, const float * ex, const float * ey, const float * ez,
+			uint32_t count, uint8_t * visible) {
+			const uint32_t simd_end = count & ~3u;
+			uint32_t visible_count = 0;
+
+			for (uint32_t i = 0; i < simd_end; i += 4) {
+				const __m128 px = _mm_loadu_ps(cx + i);
+				const __m128 py = _mm_loadu_ps(cy + i);
+				const __m128 pz = _mm_loadu_ps(cz + i);
+				const __m128 qx = _mm_loadu_ps(ex + i);
+				const __m128 qy = _mm_loadu_ps(ey + i);
+				const __m128 qz = _mm_loadu_ps(ez + i);
+
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int p = 0; p < 6; p++) {
+					// Same summation order as the scalar reference.
+					__m128 distance = _mm_mul_ps(_mm_set1_ps(planes[p][0]), px);
+					distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[p][1]), py));
+					distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[p][2]), pz));
+					distance = _mm_add_ps(distance, _mm_set1_ps(planes[p][3]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(fabsf(planes[p][0])), qx));
+					distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(fabsf(planes[p][1])), qy));
+					distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(fabsf(planes[p][2])), qz));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+				}
+
+				visible_count += write_visible_mask(_mm_movemask_ps(inside), 4, visible + i);
+			}
+
+			return visible_count + cull_aabbs_scalar(planes, cx, cy, cz, ex, ey, ez, simd_end, count, visible);
+		}
+
+		uint32_t store_transforms_sse(const transform_soa& in, uint32_t begin, uint32_t end, const uint8_t * visible, float * out) {
+			const uint32_t simd_end = begin + ((end - begin) & ~3u);
+			uint32_t written = 0;
+
+			for (uint32_t i = begin; i < simd_end; i += 4) {
+				// Transpose each column's four rows across four matrices, so
+				// columns[c][lane] is column c of matrix i + lane.
+				__m128 columns[4][4];
+				for (int c = 0; c < 4; c++) {
+					columns[c][0] = _mm_loadu_ps(in.element(c, 0) + i);
+					columns[c][1] = _mm_loadu_ps(in.element(c, 1) + i);
+					columns[c][2] = _mm_loadu_ps(in.element(c, 2) + i);
+					columns[c][3] = _mm_loadu_ps(in.element(c, 3) + i);
+					_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+				}
+
+				for (int lane = 0; lane < 4; lane++) {
+					if (visible != nullptr && !visible[i + lane]) {
+						continue;
+					}
+					float * matrix = out + written * 16;
+					for (int c = 0; c < 4; c++) {
+						_mm_storeu_ps(matrix + c * 4, columns[c][lane]);
+					}
+					written++;
+				}
+			}
+
+			return written + store_transforms_scalar(in, visible, simd_end, end, out + written * 16);
+		}
+
+		// AVX2 + FMA: eight matrices per instruction.
+
+		TRANSFORM_BATCH_AVX2 void compose_translations_avx2(const float s[16], const float * x, const float * y, const float * z, uint32_t count, transform_soa& out) {
+			const uint32_t simd_end = count & ~7u;
+			const float * p[3] = { x, y, z };
+
+			for (int c = 0; c < 4; c++) {
+				const __m256 w = _mm256_set1_ps(s[c * 4 + 3]);
+				for (int r = 0; r < 4; r++) {
+					float * o = out.element(c, r);
+					if (r == 3) {
+						for (uint32_t i = 0; i < simd_end; i += 8) {
+							_mm256_storeu_ps(o + i, w);
+						}
+						continue;
+					}
+					const __m256 base = _mm256_set1_ps(s[c * 4 + r]);
+					for (uint32_t i = 0; i < simd_end; i += 8) {
+						_mm256_storeu_ps(o + i, _mm256_fmadd_ps(_mm256_loadu_ps(p[r] + i), w, base));
+					}
+				}
+			}
+
+			compose_translations_scalar(s, x, y, z, simd_end, count, out);
+		}
+
+		TRANSFORM_BATCH_AVX2 void multiply_transforms_avx2(const float l[16], const transform_soa& in, transform_soa& out) {
+			const uint32_t count = in.size();
+			const uint32_t simd_end = count & ~7u;
+
+			for (int c = 0; c < 4; c++) {
+				const float * i0 = in.element(c, 0);
+				const float * i1 = in.element(c, 1);
+				const float * i2 = in.element(c, 2);
+				const float * i3 = in.element(c, 3);
+				float * o[4] = { out.element(c, 0), out.element(c, 1), out.element(c, 2), out.element(c, 3) };
+
+				for (uint32_t i = 0; i < simd_end; i += 8) {
+					const __m256 k0 = _mm256_loadu_ps(i0 + i);
+					const __m256 k1 = _mm256_loadu_ps(i1 + i);
+					const __m256 k2 = _mm256_loadu_ps(i2 + i);
+					const __m256 k3 = _mm256_loadu_ps(i3 + i);
+					for (int r = 0; r < 4; r++) {
+						__m256 sum = _mm256_mul_ps(_mm256_set1_ps(l[0 * 4 + r]), k0);
+						sum = _mm256_fmadd_ps(_mm256_set1_ps(l[1 * 4 + r]), k1, sum);
+						sum = _mm256_fmadd_ps(_mm256_set1_ps(l[2 * 4 + r]), k2, sum);
+						sum = _mm256_fmadd_ps(_mm256_set1_ps(l[3 * 4 + r]), k3, sum);
+						_mm256_storeu_ps(o[r] + i, sum);
+					}
+				}
+			}
+
+			multiply_transforms_scalar(l, in, simd_end, count, out);
+		}
+
+		TRANSFORM_BATCH_AVX2 uint32_t cull_spheres_avx2(const float planes[6][4], const float * x, const float * y, const float * z, const float * radius, uint32_t count, uint8_t * visible) {
+			const uint32_t simd_end = count & ~7u;
+			uint32_t visible_count = 0;
+
+			for (uint32_t i = 0; i < simd_end; i += 8) {
+				const __m256 px = _mm256_loadu_ps(x + i);
+				const __m256 py = _mm256_loadu_ps(y + i);
+				const __m256 pz = _mm256_loadu_ps(z + i);
+				const __m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (int p = 0; p < 6; p++) {
+					__m256 distance = _mm256_fmadd_ps(_mm256_set1_ps(planes[p][0]), px, _mm256_set1_ps(planes[p][3]));
+					distance = _mm256_fmadd_ps(_mm256_set1_ps(planes[p][1]), py, distance);
+					distance = _mm256_fmadd_ps(_mm256_set1_ps(planes[p][2]), pz, distance);
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, neg_radius, _CMP_GE_OQ));
+				}
+
+				visible_count += write_visible_mask(_mm256_movemask_ps(inside), 8, visible + i);
+			}
+
+			return visible_count + cull_spheres_scalar(planes, x, y, z, radius, simd_end, count, visible);
+		}
+
+		TRANSFORM_BATCH_AVX2 uint32_t cull_aabbs_avx2(const float planes[6][4], const float * cx, const float * cy, const float * cz, const float * ex, const float * ey, const float * ez,
+			uint32_t count, uint8_t * visible) {
+			const uint32_t simd_end = count & ~7u;
+			uint32_t visible_count = 0;
+
+			for (uint32_t i = 0; i < simd_end; i += 8) {
+				const __m256 px = _mm256_loadu_ps(cx + i);
+				const __m256 py = _mm256_loadu_ps(cy + i);
+				const __m256 pz = _mm256_loadu_ps(cz + i);
+				const __m256 qx = _mm256_loadu_ps(ex + i);
+				const __m256 qy = _mm256_loadu_ps(ey + i);
+				const __m256 qz = _mm256_loadu_ps(ez + i);
+
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (int p = 0; p < 6; p++) {
+					__m256 distance = _mm256_fmadd_ps(_mm256_set1_ps(planes[p][0]), px, _mm256_set1_ps(planes[p][3]));
+					distance = _mm256_fmadd_ps(_mm256_set1_ps(planes[p][1]), py, distance);
+					distance = _mm256_fmadd_ps(_mm256_set1_ps(planes[p][2]), pz, distance);
+					distance = _mm256_fmadd_ps(_mm256_set1_ps(fabsf(planes[p][0])), qx, distance);
+					distance = _mm256_fmadd_ps(_mm256_set1_ps(fabsf(planes[p][1])), qy, distance);
+					distance = _mm256_fmadd_ps(_mm256_set1_ps(fabsf(planes[p][2])), qz, distance);
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+				}
+
+				visible_count += write_visible_mask(_mm256_movemask_ps(inside), 8, visible + i);
+			}
+
+			return visible_count + cull_aabbs_scalar(planes, cx, cy, cz, ex, ey, ez, simd_end, count, visible);
+		}
+
+#endif
+
+	}
+
+	void compose_translations(simd_level level, const float shared[16], const float * x, const float * y, const float * z, uint32_t count, transform_soa& out) {
+		assert(out.size() >= count);
+#ifdef TRANSFORM_BATCH_X86
+		if (level == simd_level::avx2) {
+			compose_translations_avx2(shared, x, y, z, count, out);
+			return;
+		}
+		if (level == simd_level::sse) {
+			compose_translations_sse(shared, x, y, z, count, out);
+			return;
+		}
+#endif
+		compose_translations_scalar(shared, x, y, z, 0, count, out);
+	}
+
+	void multiply_transforms(simd_level level, const float lhs[16], const transform_soa& in, transform_soa& out) {
+		assert(out.size() >= in.size());
+#ifdef TRANSFORM_BATCH_X86
+		if (level == simd_level::avx2) {
+			multiply_transforms_avx2(lhs, in, out);
+			return;
+		}
+		if (level == simd_level::sse) {
+			multiply_transforms_sse(lhs, in, out);
+			return;
+		}
+#endif
+		multiply_transforms_scalar(lhs, in, 0, in.size(), out);
+	}
+
+	uint32_t cull_spheres(simd_level level, const float planes[6][4], const float * x, const float * y, const float * z, const float * radius, uint32_t count, uint8_t * visible) {
+#ifdef TRANSFORM_BATCH_X86
+		if (level == simd_level::avx2) {
+			return cull_spheres_avx2(planes, x, y, z, radius, count, visible);
+		}
+		if (level == simd_level::sse) {
+			return cull_spheres_sse(planes, x, y, z, radius, count, visible);
+		}
+#endif
+		return cull_spheres_scalar(planes, x, y, z, radius, 0, count, visible);
+	}
+
+	uint32_t cull_aabbs(simd_level level, const float planes[6][4], const float * center_x, const float * center_y, const float * center_z,
+		const float * extent_x, const float * extent_y, const float * extent_z, uint32_t count, uint8_t * visible) {
+#ifdef TRANSFORM_BATCH_X86
+		if (level == simd_level::avx2) {
+			return cull_aabbs_avx2(planes, center_x, center_y, center_z, extent_x, extent_y, extent_z, count, visible);
+		}
+		if (level == simd_level::sse) {
+			return cull_aabbs_sse(planes, center_x, center_y, center_z, extent_x, extent_y, extent_z, count, visible);
+		}
+#endif
+		return cull_aabbs_scalar(planes, center_x, center_y, center_z, extent_x, extent_y, extent_z, 0, count, visible);
+	}
+
+	uint32_t store_transforms(simd_level level, const transform_soa& in, uint32_t first, uint32_t count, const uint8_t * visible, float * out) {
+		assert(first + count <= in.size());
+#ifdef TRANSFORM_BATCH_X86
+		// The store is bound by memory bandwidth; wider registers don't help.
+		if (level != simd_level::scalar) {
+			return store_transforms_sse(in, first, first + count, visible, out);
+		}
+#endif
+		return store_transforms_scalar(in, visible, first, first + count, out);
+	}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace vulkan {
+
+	// Which kernels the batch functions below run. scalar is the reference the
+	// others are checked against; detect_simd_level picks the best the CPU and
+	// OS support.
+	enum class simd_level {
+		scalar,
+		sse,
+		avx2,
+	};
+
+	simd_level detect_simd_level();
+	const char * simd_level_name(simd_level level);
+
+	// Column-major 4x4 matrices (the glm layout) stored structure-of-arrays:
+	// element(c, r)[i] is column c, row r of matrix i. Each of the sixteen
+	// arrays is contiguous, so a kernel works on 4 or 8 matrices per
+	// instruction without shuffling.
+	class transform_soa {
+	public:
+		void resize(uint32_t count);
+
+		uint32_t size() const {
+			return _count;
+		}
+
+		float * element(int column, int row) {
+			return _elements[column * 4 + row].data();
+		}
+
+		const float * element(int column, int row) const {
+			return _elements[column * 4 + row].data();
+		}
+
+		void set(uint32_t index, const float matrix[16]);
+		void get(uint32_t index, float matrix[16]) const;
+
+	private:
+		uint32_t _count = 0;
+		std::vector<float> _elements[16];
+	};
+
+	// out[i] = translate(x[i], y[i], z[i]) * shared.
+	void compose_translations(simd_level level, const float shared[16], const float * x, const float * y, const float * z, uint32_t count, transform_soa& out);
+
+	// out[i] = lhs * in[i]; with lhs = VP this composes every MVP. out may be in.
+	void multiply_transforms(simd_level level, const float lhs[16], const transform_soa& in, transform_soa& out);
+
+	// Gribb/Hartmann: the frustum planes of a column-major clip matrix, as
+	// (nx, ny, nz, d) with normals pointing inward, normalised so distances
+	// come out in world units.
+	void extract_frustum_planes(const float clip[16], float planes[6][4]);
+
+	// visible[i] is set to 1 or 0; returns the number of visible objects.
+	uint32_t cull_spheres(simd_level level, const float planes[6][4], const float * x, const float * y, const float * z, const float * radius, uint32_t count, uint8_t * visible);
+	uint32_t cull_aabbs(simd_level level, const float planes[6][4], const float * center_x, const float * center_y, const float * center_z,
+		const float * extent_x, const float * extent_y, const float * extent_z, uint32_t count, uint8_t * visible);
+
+	// Writes matrices [first, first + count) back out array-of-structures (16
+	// floats each) for upload, skipping those with visible[i] == 0 when
+	// visible is given. Returns the number written.
+	uint32_t store_transforms(simd_level level, const transform_soa& in, uint32_t first, uint32_t count, const uint8_t * visible, float * out);
+
+}
@@ -0,0 +1,283 @@
+
+#include <assert.h>
+
+#include "vulkan_allocator.hpp"
+
+namespace vulkan {
+
+	struct memory_block {
+		VkDeviceMemory device_memory = VK_NULL_HANDLE;
+		uint8_t * mapped = nullptr;
+		uint32_t memory_type = 0;
+		bool buddy = false;
+
+		std::unique_ptr<sub_block> placement;
+	};
+
+	memory_allocator::memory_allocator() {
+	}
+
+	memory_allocator::~memory_allocator() {
+		destroy();
+	}
+
+	void memory_allocator::init(VkPhysicalDevice physical_device, VkDevice vulkan_device) {
+		_vulkan_device = vulkan_device;
+
+		vkGetPhysicalDeviceMemoryProperties(physical_device, &_memory_properties);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+		_buffer_image_granularity = properties.limits.bufferImageGranularity > 0 ? properties.limits.bufferImageGranularity : 1;
+		_non_coherent_atom_size = properties.limits.nonCoherentAtomSize > 0 ? properties.limits.nonCoherentAtomSize : 1;
+	}
+
+	void memory_allocator::destroy() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_vulkan_device == VK_NULL_HANDLE) {
+			return;
+		}
+
+		for (auto& block : _blocks) {
+			if (block->mapped != nullptr) {
+				vkUnmapMemory(_vulkan_device, block->device_memory);
+			}
+			vkFreeMemory(_vulkan_device, block->device_memory, NULL);
+		}
+		_blocks.clear();
+
+		for (auto& dedicated : _dedicated) {
+			if (dedicated.second.mapped != nullptr) {
+				vkUnmapMemory(_vulkan_device, dedicated.first);
+			}
+			vkFreeMemory(_vulkan_device, dedicated.first, NULL);
+		}
+		_dedicated.clear();
+		_dedicated_bytes = 0;
+
+		_vulkan_device = VK_NULL_HANDLE;
+	}
+
+	bool memory_allocator::find_memory_type(uint32_t type_bits, VkFlags required_properties, uint32_t& type_index) const {
+		for (uint32_t i = 0; i < _memory_properties.memoryTypeCount; i++) {
+			if ((type_bits & (1u << i)) && (_memory_properties.memoryTypes[i].propertyFlags & required_properties) == required_properties) {
+				type_index = i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	VkDeviceSize memory_allocator::block_size_for_type(uint32_t memory_type) const {
+		// Don't let one block eat a small heap (e.g. a 256MB BAR window).
+		const VkDeviceSize heap_size = _memory_properties.memoryHeaps[_memory_properties.memoryTypes[memory_type].heapIndex].size;
+
+		VkDeviceSize size = block_size;
+		if (heap_size / 8 < size) {
+			size = heap_size / 8;
+		}
+
+		// Buddy blocks need a power of two; keep free-list blocks the same size.
+		VkDeviceSize power = 1;
+		while (power * 2 <= size) {
+			power *= 2;
+		}
+		return power;
+	}
+
+	memory_block * memory_allocator::create_block(uint32_t memory_type, bool buddy) {
+		auto block = std::unique_ptr<memory_block>(new memory_block());
+		block->memory_type = memory_type;
+		block->buddy = buddy;
+
+		const VkDeviceSize size = block_size_for_type(memory_type);
+
+		VkMemoryAllocateInfo memory_allocation_info;
+		memory_allocation_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memory_allocation_info.pNext = NULL;
+		memory_allocation_info.allocationSize = size;
+		memory_allocation_info.memoryTypeIndex = memory_type;
+
+		VkResult err = vkAllocateMemory(_vulkan_device, &memory_allocation_info, NULL, &block->device_memory);
+		assert(!err);
+		_device_allocation_calls++;
+
+		// Host-visible blocks are mapped once for their whole lifetime; a
+		// VkDeviceMemory can only be mapped once, so sub-allocations share it.
+		if (_memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			err = vkMapMemory(_vulkan_device, block->device_memory, 0, VK_WHOLE_SIZE, 0, (void **)&block->mapped);
+			assert(!err);
+		}
+
+		if (buddy) {
+			VkDeviceSize min_node = buddy_min_node > _buffer_image_granularity ? buddy_min_node : _buffer_image_granularity;
+			block->placement = std::unique_ptr<sub_block>(new buddy_block(size, min_node));
+		} else {
+			block->placement = std::unique_ptr<sub_block>(new free_list_block(size, _buffer_image_granularity));
+		}
+
+		_blocks.push_back(std::move(block));
+		return _blocks.back().get();
+	}
+
+	void memory_allocator::release_block(memory_block * block) {
+		for (auto it = _blocks.begin(); it != _blocks.end(); ++it) {
+			if (it->get() == block) {
+				if (block->mapped != nullptr) {
+					vkUnmapMemory(_vulkan_device, block->device_memory);
+				}
+				vkFreeMemory(_vulkan_device, block->device_memory, NULL);
+				_blocks.erase(it);
+				return;
+			}
+		}
+	}
+
+	memory_allocation memory_allocator::allocate(const VkMemoryRequirements& requirements, VkFlags required_properties, resource_kind kind) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		memory_allocation allocation;
+
+		bool pass = find_memory_type(requirements.memoryTypeBits, required_properties, allocation.memory_type);
+		assert(pass);
+
+		const VkMemoryPropertyFlags type_properties = _memory_properties.memoryTypes[allocation.memory_type].propertyFlags;
+
+		VkDeviceSize alignment = requirements.alignment > 0 ? requirements.alignment : 1;
+		VkDeviceSize size = requirements.size;
+
+		// Keep non-coherent allocations on their own atoms so flushing one
+		// never touches a neighbour's bytes.
+		if ((type_properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(type_properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			alignment = align_up(alignment, _non_coherent_atom_size);
+			size = align_up(size, _non_coherent_atom_size);
+		}
+
+		allocation.size = size;
+
+		// Dedicated path for anything that would take over half a block.
+		if (size > block_size_for_type(allocation.memory_type) / 2) {
+			VkMemoryAllocateInfo memory_allocation_info;
+			memory_allocation_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memory_allocation_info.pNext = NULL;
+			memory_allocation_info.allocationSize = size;
+			memory_allocation_info.memoryTypeIndex = allocation.memory_type;
+
+			VkResult err = vkAllocateMemory(_vulkan_device, &memory_allocation_info, NULL, &allocation.device_memory);
+			assert(!err);
+			_device_allocation_calls++;
+
+			if (type_properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+				err = vkMapMemory(_vulkan_device, allocation.device_memory, 0, VK_WHOLE_SIZE, 0, (void **)&allocation.mapped);
+				assert(!err);
+			}
+
+			_dedicated[allocation.device_memory] = allocation;
+			_dedicated_bytes += size;
+			return allocation;
+		}
+
+		const bool buddy = size <= buddy_max_size;
+
+		for (auto& block : _blocks) {
+			if (block->memory_type != allocation.memory_type || block->buddy != buddy) {
+				continue;
+			}
+
+			uint64_t offset;
+			if (block->placement->allocate(size, alignment, kind, offset)) {
+				allocation.block = block.get();
+				allocation.offset = offset;
+				break;
+			}
+		}
+
+		if (allocation.block == nullptr) {
+			memory_block * block = create_block(allocation.memory_type, buddy);
+
+			uint64_t offset = 0;
+			pass = block->placement->allocate(size, alignment, kind, offset);
+			assert(pass);
+
+			allocation.block = block;
+			allocation.offset = offset;
+		}
+
+		allocation.device_memory = allocation.block->device_memory;
+		if (allocation.block->mapped != nullptr) {
+			allocation.mapped = allocation.block->mapped + allocation.offset;
+		}
+
+		return allocation;
+	}
+
+	void memory_allocator::free(memory_allocation& allocation) {
+		if (allocation.device_memory == VK_NULL_HANDLE) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (allocation.block == nullptr) {
+			if (allocation.mapped != nullptr) {
+				vkUnmapMemory(_vulkan_device, allocation.device_memory);
+			}
+			vkFreeMemory(_vulkan_device, allocation.device_memory, NULL);
+
+			_dedicated.erase(allocation.device_memory);
+			_dedicated_bytes -= allocation.size;
+		} else {
+			memory_block * block = allocation.block;
+			block->placement->free(allocation.offset);
+
+			// Give empty blocks back, but keep one per pool so a resource that is
+			// repeatedly created and destroyed doesn't hit the driver each time.
+			if (block->placement->empty()) {
+				for (auto& other : _blocks) {
+					if (other.get() != block && other->memory_type == block->memory_type && other->buddy == block->buddy) {
+						release_block(block);
+						break;
+					}
+				}
+			}
+		}
+
+		allocation = memory_allocation();
+	}
+
+	allocator_stats memory_allocator::get_stats() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		allocator_stats stats;
+		stats.block_count = (uint32_t)_blocks.size();
+		stats.dedicated_count = (uint32_t)_dedicated.size();
+		stats.allocation_count = (uint32_t)_dedicated.size();
+		stats.device_allocation_calls = _device_allocation_calls;
+
+		stats.device_bytes = _dedicated_bytes;
+		stats.used_bytes = _dedicated_bytes;
+		stats.requested_bytes = _dedicated_bytes;
+
+		for (auto& block : _blocks) {
+			block_stats block_stats = block->placement->get_stats();
+
+			stats.allocation_count += block_stats.allocation_count;
+			stats.device_bytes += block_stats.size;
+			stats.used_bytes += block_stats.used;
+			stats.requested_bytes += block_stats.requested;
+
+			if (block_stats.largest_free > stats.largest_free) {
+				stats.largest_free = block_stats.largest_free;
+			}
+
+			if (block_stats.fragmentation() > stats.fragmentation) {
+				stats.fragmentation = block_stats.fragmentation();
+			}
+		}
+
+		return stats;
+	}
+
+}
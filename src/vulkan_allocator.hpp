@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "block_allocator.hpp"
+
+namespace vulkan {
+
+	struct memory_block;
+
+	// A range of device memory handed out by memory_allocator. Bind resources at
+	// device_memory + offset; mapped is non-null for host-visible memory, which
+	// the allocator keeps persistently mapped per block.
+	struct memory_allocation {
+		VkDeviceMemory device_memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memory_type = 0;
+		uint8_t * mapped = nullptr;
+
+		memory_block * block = nullptr;		// null for dedicated allocations
+	};
+
+	struct allocator_stats {
+		uint32_t block_count = 0;
+		uint32_t dedicated_count = 0;
+		uint32_t allocation_count = 0;
+		uint32_t device_allocation_calls = 0;	// lifetime vkAllocateMemory calls
+
+		VkDeviceSize device_bytes = 0;		// currently allocated from the driver
+		VkDeviceSize used_bytes = 0;		// handed out to resources, incl. rounding
+		VkDeviceSize requested_bytes = 0;	// what resources asked for
+		VkDeviceSize largest_free = 0;
+
+		float fragmentation = 0.0f;			// worst block, see block_stats::fragmentation
+	};
+
+	// Sub-allocates resources out of large per-memory-type blocks instead of
+	// one vkAllocateMemory per resource. Small requests go to buddy blocks,
+	// medium ones to best-fit free-list blocks, and anything over the dedicated
+	// threshold gets its own allocation.
+	class memory_allocator {
+	public:
+		memory_allocator();
+		~memory_allocator();
+
+		void init(VkPhysicalDevice physical_device, VkDevice vulkan_device);
+		void destroy();
+
+		memory_allocation allocate(const VkMemoryRequirements& requirements, VkFlags required_properties, resource_kind kind);
+		void free(memory_allocation& allocation);
+
+		bool find_memory_type(uint32_t type_bits, VkFlags required_properties, uint32_t& type_index) const;
+
+		bool is_coherent(const memory_allocation& allocation) const {
+			return (_memory_properties.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+		}
+
+		allocator_stats get_stats() const;
+
+		// Tuning knobs; set before the first allocation.
+		VkDeviceSize block_size = 64 * 1024 * 1024;
+		VkDeviceSize buddy_max_size = 256 * 1024;
+		VkDeviceSize buddy_min_node = 256;
+
+	private:
+		memory_block * create_block(uint32_t memory_type, bool buddy);
+		void release_block(memory_block * block);
+
+		VkDeviceSize block_size_for_type(uint32_t memory_type) const;
+
+		VkDevice _vulkan_device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties _memory_properties;
+		VkDeviceSize _buffer_image_granularity = 1;
+		VkDeviceSize _non_coherent_atom_size = 1;
+
+		std::vector<std::unique_ptr<memory_block>> _blocks;
+
+		// Live dedicated allocations, so destroy can release any still held.
+		std::map<VkDeviceMemory, memory_allocation> _dedicated;
+		VkDeviceSize _dedicated_bytes = 0;
+		uint32_t _device_allocation_calls = 0;
+
+		mutable std::mutex _mutex;
+	};
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <utility>
+
+namespace vulkan {
+
+	// Destroys objects the GPU may still be using once it is done with them,
+	// instead of waiting for the device to go idle first. Each entry carries
+	// the serial of the last submission that could reference it; collect runs
+	// every entry whose serial has completed. Serials must be retired in
+	// non-decreasing order. Render thread only.
+	class deletion_queue {
+	public:
+		void retire(uint64_t serial, std::function<void()> destroy) {
+			_entries.emplace_back(serial, std::move(destroy));
+		}
+
+		// Returns the number of entries destroyed.
+		size_t collect(uint64_t completed_serial) {
+			size_t destroyed = 0;
+			while (!_entries.empty() && _entries.front().first <= completed_serial) {
+				_entries.front().second();
+				_entries.pop_front();
+				destroyed++;
+			}
+			return destroyed;
+		}
+
+		// Only once the device is idle.
+		void flush() {
+			collect(UINT64_MAX);
+		}
+
+		size_t size() const {
+			return _entries.size();
+		}
+
+	private:
+		std::deque<std::pair<uint64_t, std::function<void()>>> _entries;
+	};
+
+}
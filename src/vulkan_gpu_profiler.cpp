@@ -0,0 +1,226 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "vulkan_gpu_profiler.hpp"
+
+namespace vulkan {
+
+	namespace {
+
+		// Order of the results, which follows the bit order.
+		const VkQueryPipelineStatisticFlags statistics_flags =
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+	}
+
+	double percentile(const std::vector<double>& sorted, double fraction) {
+		const size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+		return sorted[(std::min)(index, sorted.size() - 1)];
+	}
+
+	gpu_profiler::~gpu_profiler() {
+		destroy();
+	}
+
+	void gpu_profiler::init(const gpu_profiler_context& context) {
+		_context = context;
+
+		VkResult err;
+
+		if (_context.timestamp_bits > 0) {
+			_timestamp_mask = _context.timestamp_bits >= 64 ? UINT64_MAX : ((uint64_t)1 << _context.timestamp_bits) - 1;
+
+			const VkQueryPoolCreateInfo query_pool_info = {
+				VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				NULL,
+				0,
+				VK_QUERY_TYPE_TIMESTAMP,
+				_context.frames * gpu_profiler_max_passes * 2,
+				0,
+			};
+
+			err = vkCreateQueryPool(_context.device, &query_pool_info, NULL, &_timestamp_pool);
+			assert(!err);
+		}
+
+		if (_context.pipeline_statistics) {
+			const VkQueryPoolCreateInfo query_pool_info = {
+				VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				NULL,
+				0,
+				VK_QUERY_TYPE_PIPELINE_STATISTICS,
+				_context.frames,
+				statistics_flags,
+			};
+
+			err = vkCreateQueryPool(_context.device, &query_pool_info, NULL, &_statistics_pool);
+			assert(!err);
+		}
+	}
+
+	void gpu_profiler::destroy() {
+		if (_timestamp_pool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(_context.device, _timestamp_pool, NULL);
+			_timestamp_pool = VK_NULL_HANDLE;
+		}
+
+		if (_statistics_pool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(_context.device, _statistics_pool, NULL);
+			_statistics_pool = VK_NULL_HANDLE;
+		}
+	}
+
+	void gpu_profiler::reset(VkCommandBuffer command_buffer, uint32_t slot) {
+		// Anything the command buffer does not write stays unavailable, and
+		// resolve skips it.
+		if (_timestamp_pool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(command_buffer, _timestamp_pool, slot * gpu_profiler_max_passes * 2, gpu_profiler_max_passes * 2);
+		}
+
+		if (_statistics_pool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(command_buffer, _statistics_pool, slot, 1);
+		}
+	}
+
+	uint32_t gpu_profiler::find_pass(const char * name) {
+		for (uint32_t i = 0; i < _passes.size(); i++) {
+			if (_passes[i].name == name) {
+				return i;
+			}
+		}
+
+		if (_passes.size() == gpu_profiler_max_passes) {
+			return UINT32_MAX;
+		}
+
+		pass_history pass;
+		pass.name = name;
+		pass.window.reserve(gpu_profiler_window);
+		_passes.push_back(pass);
+		return (uint32_t)_passes.size() - 1;
+	}
+
+	uint32_t gpu_profiler::begin_pass(VkCommandBuffer command_buffer, uint32_t slot, const char * name) {
+		if (_timestamp_pool == VK_NULL_HANDLE) {
+			return UINT32_MAX;
+		}
+
+		const uint32_t pass = find_pass(name);
+		if (pass != UINT32_MAX) {
+			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestamp_pool, (slot * gpu_profiler_max_passes + pass) * 2);
+		}
+		return pass;
+	}
+
+	void gpu_profiler::end_pass(VkCommandBuffer command_buffer, uint32_t slot, uint32_t pass) {
+		if (_timestamp_pool == VK_NULL_HANDLE || pass == UINT32_MAX) {
+			return;
+		}
+
+		vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestamp_pool, (slot * gpu_profiler_max_passes + pass) * 2 + 1);
+	}
+
+	void gpu_profiler::begin_statistics(VkCommandBuffer command_buffer, uint32_t slot) {
+		if (_statistics_pool != VK_NULL_HANDLE) {
+			vkCmdBeginQuery(command_buffer, _statistics_pool, slot, 0);
+		}
+	}
+
+	void gpu_profiler::end_statistics(VkCommandBuffer command_buffer, uint32_t slot) {
+		if (_statistics_pool != VK_NULL_HANDLE) {
+			vkCmdEndQuery(command_buffer, _statistics_pool, slot);
+		}
+	}
+
+	void gpu_profiler::resolve(uint32_t slot) {
+		VkResult err;
+
+		// Each result is followed by its availability word; VK_NOT_READY just
+		// means some of them are still 0, which the loops below check for.
+		if (_timestamp_pool != VK_NULL_HANDLE && !_passes.empty()) {
+			const uint32_t count = (uint32_t)_passes.size();
+			uint64_t results[gpu_profiler_max_passes * 2][2];
+
+			err = vkGetQueryPoolResults(_context.device, _timestamp_pool, slot * gpu_profiler_max_passes * 2, count * 2,
+				sizeof(results), results, sizeof(results[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+			assert(err == VK_SUCCESS || err == VK_NOT_READY);
+
+			for (uint32_t pass = 0; pass < count; pass++) {
+				const uint64_t * begin = results[pass * 2];
+				const uint64_t * end = results[pass * 2 + 1];
+
+				if (begin[1] == 0 || end[1] == 0) {
+					_results_not_ready += (begin[1] != 0 || end[1] != 0) ? 1 : 0;
+					continue;
+				}
+
+				const uint64_t ticks = ((end[0] & _timestamp_mask) - (begin[0] & _timestamp_mask)) & _timestamp_mask;
+				const double ms = ticks * (double)_context.timestamp_period * 1e-6;
+
+				auto& history = _passes[pass];
+				if (history.window.size() < gpu_profiler_window) {
+					history.window.push_back(ms);
+				} else {
+					history.window[history.samples % gpu_profiler_window] = ms;
+				}
+				history.samples++;
+				history.last_ms = ms;
+			}
+		}
+
+		if (_statistics_pool != VK_NULL_HANDLE) {
+			uint64_t results[4];
+
+			err = vkGetQueryPoolResults(_context.device, _statistics_pool, slot, 1, sizeof(results), results, sizeof(results),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+			assert(err == VK_SUCCESS || err == VK_NOT_READY);
+
+			if (results[3] != 0) {
+				_pipeline.valid = true;
+				_pipeline.vertex_invocations = results[0];
+				_pipeline.fragment_invocations = results[1];
+				_pipeline.compute_invocations = results[2];
+			}
+		}
+
+		_frames_resolved++;
+	}
+
+	gpu_profiler_stats gpu_profiler::get_stats() const {
+		gpu_profiler_stats stats;
+		stats.timestamps = timestamps();
+		stats.frames_resolved = _frames_resolved;
+		stats.results_not_ready = _results_not_ready;
+		stats.pipeline = _pipeline;
+
+		for (auto& history : _passes) {
+			gpu_pass_stats pass;
+			pass.name = history.name;
+			pass.samples = history.samples;
+			pass.last_ms = history.last_ms;
+
+			if (!history.window.empty()) {
+				std::vector<double> sorted = history.window;
+				std::sort(sorted.begin(), sorted.end());
+
+				double total = 0.0;
+				for (double ms : sorted) {
+					total += ms;
+				}
+
+				pass.avg_ms = total / sorted.size();
+				pass.p50_ms = percentile(sorted, 0.50);
+				pass.p95_ms = percentile(sorted, 0.95);
+				pass.p99_ms = percentile(sorted, 0.99);
+				pass.max_ms = sorted.back();
+			}
+
+			stats.passes.push_back(pass);
+		}
+
+		return stats;
+	}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace vulkan {
+
+	// Everything the profiler needs from the wrapper. timestamp_bits is the
+	// graphics family's timestampValidBits; 0 disables timing. Pipeline
+	// statistics need the pipelineStatisticsQuery feature enabled on the
+	// device.
+	struct gpu_profiler_context {
+		VkDevice device = VK_NULL_HANDLE;
+		uint32_t frames = 2;				// frame slots, each with its own queries
+		float timestamp_period = 1.0f;		// ns per tick
+		uint32_t timestamp_bits = 0;
+		bool pipeline_statistics = false;
+	};
+
+	// Over the last gpu_profiler_window frames that wrote this pass.
+	struct gpu_pass_stats {
+		std::string name;
+		uint64_t samples = 0;
+		double last_ms = 0.0;
+		double avg_ms = 0.0;
+		double p50_ms = 0.0;
+		double p95_ms = 0.0;
+		double p99_ms = 0.0;
+		double max_ms = 0.0;
+	};
+
+	// Invocations in the last resolved frame.
+	struct gpu_pipeline_stats {
+		bool valid = false;
+		uint64_t vertex_invocations = 0;
+		uint64_t fragment_invocations = 0;
+		uint64_t compute_invocations = 0;
+	};
+
+	struct gpu_profiler_stats {
+		bool timestamps = false;
+		uint64_t frames_resolved = 0;
+		uint64_t results_not_ready = 0;		// queries a resolve found still pending and skipped
+		std::vector<gpu_pass_stats> passes;
+		gpu_pipeline_stats pipeline;
+	};
+
+	const uint32_t gpu_profiler_max_passes = 16;
+	const uint32_t gpu_profiler_window = 240;
+
+	// Of an ascending, non-empty list, by nearest rank, so every reported time
+	// is one that was measured. Shared with the frame benchmark.
+	double percentile(const std::vector<double>& sorted, double fraction);
+
+	// Timestamp and pipeline-statistics queries, one set per frame slot.
+	// A slot's queries are reset at the top of its command buffers and only
+	// read back once the slot's fence has signalled, frames_in_flight frames
+	// later, and then without VK_QUERY_RESULT_WAIT_BIT, so profiling never
+	// stalls the CPU. Pre-recorded command buffers work as they are: every
+	// submission resets and rewrites the same queries. Render thread only.
+	class gpu_profiler {
+	public:
+		gpu_profiler() {}
+		~gpu_profiler();
+
+		void init(const gpu_profiler_context& context);
+		void destroy();
+
+		bool timestamps() const {
+			return _timestamp_pool != VK_NULL_HANDLE;
+		}
+
+		bool pipeline_statistics() const {
+			return _statistics_pool != VK_NULL_HANDLE;
+		}
+
+		// Outside a render pass, before any other query in this slot.
+		void reset(VkCommandBuffer command_buffer, uint32_t slot);
+
+		// Passes are found by name, so a pass keeps its statistics across
+		// re-recording. Returns the pass for end_pass.
+		uint32_t begin_pass(VkCommandBuffer command_buffer, uint32_t slot, const char * name);
+		void end_pass(VkCommandBuffer command_buffer, uint32_t slot, uint32_t pass);
+
+		// Counts everything recorded between the two; outside a render pass,
+		// and with no secondary command buffers executed in between.
+		void begin_statistics(VkCommandBuffer command_buffer, uint32_t slot);
+		void end_statistics(VkCommandBuffer command_buffer, uint32_t slot);
+
+		// Once the slot's fence has signalled.
+		void resolve(uint32_t slot);
+
+		gpu_profiler_stats get_stats() const;
+
+	private:
+		struct pass_history {
+			std::string name;
+			uint64_t samples = 0;
+			double last_ms = 0.0;
+			std::vector<double> window;		// ring of gpu_profiler_window
+		};
+
+		uint32_t find_pass(const char * name);
+
+		gpu_profiler_context _context;
+		VkQueryPool _timestamp_pool = VK_NULL_HANDLE;
+		VkQueryPool _statistics_pool = VK_NULL_HANDLE;
+		uint64_t _timestamp_mask = 0;
+
+		std::vector<pass_history> _passes;
+		gpu_pipeline_stats _pipeline;
+		uint64_t _frames_resolved = 0;
+		uint64_t _results_not_ready = 0;
+	};
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vulkan {
+
+	// 64-bit FNV-1a. Not cryptographic; used to key and checksum blobs on disk.
+	inline uint64_t fnv1a(const void * data, size_t size, uint64_t hash = 14695981039346656037ull) {
+		const uint8_t * bytes = (const uint8_t *)data;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+}
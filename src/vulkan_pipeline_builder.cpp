@@ -0,0 +1,279 @@
+
+#include <assert.h>
+#include <string.h>
+#include <iostream>
+
+#include "vulkan_pipeline_builder.hpp"
+#include "cpu_profiler.hpp"
+
+namespace vulkan {
+
+	pipeline_builder::~pipeline_builder() {
+		finish();
+	}
+
+	void pipeline_builder::init(VkDevice vulkan_device, shader_library * shaders, VkPipelineCache target_cache, uint32_t thread_count) {
+		assert(_workers.empty());
+
+		_vulkan_device = vulkan_device;
+		_shaders = shaders;
+		_target_cache = target_cache;
+		_quit = false;
+
+		if (thread_count == 0) {
+			const uint32_t hardware = std::thread::hardware_concurrency();
+			thread_count = hardware > 1 ? hardware - 1 : 1;
+			if (thread_count > 8) {
+				thread_count = 8;
+			}
+		}
+
+		// Seed every worker with what the target already holds so a warm start
+		// stays warm on all threads.
+		std::vector<uint8_t> seed;
+		size_t seed_size = 0;
+		if (vkGetPipelineCacheData(_vulkan_device, _target_cache, &seed_size, NULL) == VK_SUCCESS && seed_size > 0) {
+			seed.resize(seed_size);
+			if (vkGetPipelineCacheData(_vulkan_device, _target_cache, &seed_size, seed.data()) != VK_SUCCESS) {
+				seed.clear();
+			}
+		}
+
+		VkPipelineCacheCreateInfo pipeline_cache_create_info;
+		memset(&pipeline_cache_create_info, 0, sizeof(pipeline_cache_create_info));
+		pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		pipeline_cache_create_info.initialDataSize = seed.size();
+		pipeline_cache_create_info.pInitialData = seed.size() > 0 ? seed.data() : NULL;
+
+		_workers.resize(thread_count);
+		for (auto& worker : _workers) {
+			VkResult err = vkCreatePipelineCache(_vulkan_device, &pipeline_cache_create_info, NULL, &worker.cache);
+			assert(!err);
+		}
+
+		// Start threads only once _workers has stopped moving.
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			_workers[i].thread = std::thread(&pipeline_builder::run, this, i);
+		}
+
+		_stats.threads = thread_count;
+	}
+
+	pipeline_handle pipeline_builder::submit(const graphics_pipeline_description& description) {
+		assert(!_workers.empty());
+
+		build_job job;
+		job.description = description;
+		pipeline_handle handle(job.promise.get_future().share());
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobs.push_back(std::move(job));
+			_stats.submitted++;
+		}
+		_condition.notify_one();
+
+		return handle;
+	}
+
+	bool pipeline_builder::idle() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _jobs.empty() && _in_flight == 0;
+	}
+
+	void pipeline_builder::finish() {
+		if (_workers.empty()) {
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_idle_condition.wait(lock, [this] { return _jobs.empty() && _in_flight == 0; });
+			_quit = true;
+		}
+		_condition.notify_all();
+
+		std::vector<VkPipelineCache> caches;
+		for (auto& worker : _workers) {
+			worker.thread.join();
+			caches.push_back(worker.cache);
+		}
+
+		auto merge_start = std::chrono::high_resolution_clock::now();
+		VkResult err = vkMergePipelineCaches(_vulkan_device, _target_cache, (uint32_t)caches.size(), caches.data());
+		assert(!err);
+		_stats.merge_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - merge_start).count();
+
+		for (auto cache : caches) {
+			vkDestroyPipelineCache(_vulkan_device, cache, NULL);
+		}
+		_workers.clear();
+	}
+
+	pipeline_builder_stats pipeline_builder::get_stats() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+	void pipeline_builder::run(uint32_t worker_index) {
+		const VkPipelineCache cache = _workers[worker_index].cache;
+
+		cpu_profiler::get().set_thread_name("pipeline builder");
+
+		for (;;) {
+			build_job job;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, [this] { return _quit || !_jobs.empty(); });
+				if (_jobs.empty()) {
+					return;
+				}
+				job = std::move(_jobs.front());
+				_jobs.pop_front();
+				_in_flight++;
+			}
+
+			auto compile_start = std::chrono::high_resolution_clock::now();
+			VkPipeline pipeline;
+			{
+				cpu_scope scope("compile_pipeline");
+				pipeline = compile(job.description, cache);
+			}
+			const double compile_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - compile_start).count();
+
+			job.promise.set_value(pipeline);
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_in_flight--;
+				if (pipeline != VK_NULL_HANDLE) {
+					_stats.compiled++;
+				} else {
+					_stats.failed++;
+				}
+				_stats.compile_ms += compile_ms;
+			}
+			_idle_condition.notify_all();
+		}
+	}
+
+	VkPipeline pipeline_builder::compile(const graphics_pipeline_description& description, VkPipelineCache cache) {
+		VkPipelineVertexInputStateCreateInfo vi;
+		VkPipelineInputAssemblyStateCreateInfo ia;
+		VkPipelineRasterizationStateCreateInfo rs;
+		VkPipelineColorBlendStateCreateInfo cb;
+		VkPipelineDepthStencilStateCreateInfo ds;
+		VkPipelineViewportStateCreateInfo vp;
+		VkPipelineMultisampleStateCreateInfo ms;
+		VkDynamicState dynamicStateEnables[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState;
+
+		memset(&dynamicState, 0, sizeof dynamicState);
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = 2;
+		dynamicState.pDynamicStates = dynamicStateEnables;
+
+		memset(&vi, 0, sizeof(vi));
+		vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vi.vertexBindingDescriptionCount = (uint32_t)description.bindings.size();
+		vi.pVertexBindingDescriptions = description.bindings.data();
+		vi.vertexAttributeDescriptionCount = (uint32_t)description.attributes.size();
+		vi.pVertexAttributeDescriptions = description.attributes.data();
+
+		memset(&ia, 0, sizeof(ia));
+		ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		ia.topology = description.topology;
+
+		memset(&rs, 0, sizeof(rs));
+		rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rs.polygonMode = description.polygon_mode;
+		rs.cullMode = description.cull_mode;
+		rs.frontFace = description.front_face;
+		rs.depthClampEnable = VK_FALSE;
+		rs.rasterizerDiscardEnable = VK_FALSE;
+		rs.depthBiasEnable = VK_FALSE;
+		rs.lineWidth = 1.0f;
+
+		memset(&cb, 0, sizeof(cb));
+		cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		VkPipelineColorBlendAttachmentState att_state[1];
+		memset(att_state, 0, sizeof(att_state));
+		att_state[0].colorWriteMask = 0xf;
+		att_state[0].blendEnable = description.blend ? VK_TRUE : VK_FALSE;
+		att_state[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		att_state[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		att_state[0].colorBlendOp = VK_BLEND_OP_ADD;
+		att_state[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		att_state[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		att_state[0].alphaBlendOp = VK_BLEND_OP_ADD;
+		cb.attachmentCount = 1;
+		cb.pAttachments = att_state;
+
+		memset(&vp, 0, sizeof(vp));
+		vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		vp.viewportCount = 1;
+		vp.scissorCount = 1;
+
+		memset(&ds, 0, sizeof(ds));
+		ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		ds.depthTestEnable = description.depth_test ? VK_TRUE : VK_FALSE;
+		ds.depthWriteEnable = description.depth_write ? VK_TRUE : VK_FALSE;
+		ds.depthCompareOp = description.depth_compare;
+		ds.depthBoundsTestEnable = VK_FALSE;
+		ds.back.failOp = VK_STENCIL_OP_KEEP;
+		ds.back.passOp = VK_STENCIL_OP_KEEP;
+		ds.back.compareOp = VK_COMPARE_OP_ALWAYS;
+		ds.stencilTestEnable = VK_FALSE;
+		ds.front = ds.back;
+
+		memset(&ms, 0, sizeof(ms));
+		ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		ms.pSampleMask = NULL;
+		ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineShaderStageCreateInfo shaderStages[2];
+		memset(&shaderStages, 0, 2 * sizeof(VkPipelineShaderStageCreateInfo));
+
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = _shaders->get(description.vertex_shader);
+		shaderStages[0].pName = "main";
+
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = _shaders->get(description.fragment_shader);
+		shaderStages[1].pName = "main";
+
+		if (shaderStages[0].module == VK_NULL_HANDLE || shaderStages[1].module == VK_NULL_HANDLE) {
+			return VK_NULL_HANDLE;
+		}
+
+		VkGraphicsPipelineCreateInfo pipeline_create_info;
+		memset(&pipeline_create_info, 0, sizeof(pipeline_create_info));
+		pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipeline_create_info.layout = description.layout;
+		pipeline_create_info.stageCount = 2;
+
+		pipeline_create_info.pVertexInputState = &vi;
+		pipeline_create_info.pInputAssemblyState = &ia;
+		pipeline_create_info.pRasterizationState = &rs;
+		pipeline_create_info.pColorBlendState = &cb;
+		pipeline_create_info.pMultisampleState = &ms;
+		pipeline_create_info.pViewportState = &vp;
+		pipeline_create_info.pDepthStencilState = &ds;
+		pipeline_create_info.pStages = shaderStages;
+		pipeline_create_info.renderPass = description.render_pass;
+		pipeline_create_info.subpass = description.subpass;
+		pipeline_create_info.pDynamicState = &dynamicState;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkResult err = vkCreateGraphicsPipelines(_vulkan_device, cache, 1, &pipeline_create_info, NULL, &pipeline);
+		if (err) {
+			std::cerr << "Pipeline compile failed for " << description.vertex_shader << " + " << description.fragment_shader << std::endl;
+			return VK_NULL_HANDLE;
+		}
+
+		return pipeline;
+	}
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vulkan_shader_library.hpp"
+
+namespace vulkan {
+
+	// Everything needed to build one graphics pipeline, held by value so it can
+	// be handed to another thread. Defaults match the demo cube pipeline.
+	struct graphics_pipeline_description {
+		std::string vertex_shader;
+		std::string fragment_shader;
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkRenderPass render_pass = VK_NULL_HANDLE;
+		uint32_t subpass = 0;
+
+		std::vector<VkVertexInputBindingDescription> bindings;
+		std::vector<VkVertexInputAttributeDescription> attributes;
+
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+		bool depth_test = true;
+		bool depth_write = true;
+		VkCompareOp depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		bool blend = false;
+	};
+
+	// A pipeline that may still be compiling. ready() never blocks, get() does.
+	class pipeline_handle {
+	public:
+		pipeline_handle() {}
+		explicit pipeline_handle(std::shared_future<VkPipeline> future) : _future(future) {}
+
+		bool valid() const {
+			return _future.valid();
+		}
+
+		bool ready() const {
+			return _future.valid() && _future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		}
+
+		VkPipeline get() const {
+			return _future.get();
+		}
+
+	private:
+		std::shared_future<VkPipeline> _future;
+	};
+
+	struct pipeline_builder_stats {
+		uint32_t threads = 0;
+		uint32_t submitted = 0;
+		uint32_t compiled = 0;
+		uint32_t failed = 0;
+		double compile_ms = 0.0;	// summed across workers
+		double merge_ms = 0.0;
+	};
+
+	// Compiles pipelines on a small thread pool. Pipeline caches need external
+	// synchronisation, so each worker compiles into a private cache seeded from
+	// the target; finish() merges them all back with vkMergePipelineCaches.
+	class pipeline_builder {
+	public:
+		pipeline_builder() {}
+		~pipeline_builder();
+
+		// thread_count 0 picks one per spare hardware thread.
+		void init(VkDevice vulkan_device, shader_library * shaders, VkPipelineCache target_cache, uint32_t thread_count = 0);
+
+		pipeline_handle submit(const graphics_pipeline_description& description);
+
+		// True once every submitted pipeline has finished compiling.
+		bool idle() const;
+
+		// Waits for outstanding work, merges the worker caches into the target
+		// and stops the threads. Nothing may be submitted afterwards.
+		void finish();
+
+		bool running() const {
+			return !_workers.empty();
+		}
+
+		pipeline_builder_stats get_stats() const;
+
+	private:
+		struct build_job {
+			graphics_pipeline_description description;
+			std::promise<VkPipeline> promise;
+		};
+
+		struct worker {
+			std::thread thread;
+			VkPipelineCache cache = VK_NULL_HANDLE;
+		};
+
+		void run(uint32_t worker_index);
+		VkPipeline compile(const graphics_pipeline_description& description, VkPipelineCache cache);
+
+		VkDevice _vulkan_device = VK_NULL_HANDLE;
+		shader_library * _shaders = nullptr;
+		VkPipelineCache _target_cache = VK_NULL_HANDLE;
+
+		std::vector<worker> _workers;
+
+		mutable std::mutex _mutex;
+		std::condition_variable _condition;
+		std::condition_variable _idle_condition;
+		std::deque<build_job> _jobs;
+		uint32_t _in_flight = 0;
+		bool _quit = false;
+
+		pipeline_builder_stats _stats;
+	};
+
+}
@@ -0,0 +1,190 @@
+
+#include <assert.h>
+#include <string.h>
+#include <cstdio>
+#include <iostream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "vulkan_hash.hpp"
+#include "vulkan_pipeline_cache.hpp"
+
+namespace vulkan {
+
+	namespace {
+
+		// Our own header in front of the driver blob, so a truncated or
+		// bit-rotted file is caught before the driver ever sees it.
+		struct pipeline_cache_file_header {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t data_size;
+			uint64_t data_hash;
+		};
+
+		const uint32_t pipeline_cache_file_magic = 0x43504b56;	// "VKPC"
+		const uint32_t pipeline_cache_file_version = 1;
+
+		// Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE.
+		const size_t pipeline_cache_header_size = 16 + VK_UUID_SIZE;
+
+		uint32_t read_u32(const uint8_t * data) {
+			uint32_t value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+	}
+
+	bool validate_pipeline_cache_data(const uint8_t * data, size_t size, const VkPhysicalDeviceProperties& properties, const char *& reason) {
+		if (size < pipeline_cache_header_size) {
+			reason = "truncated header";
+			return false;
+		}
+
+		const uint32_t header_length = read_u32(data);
+		const uint32_t header_version = read_u32(data + 4);
+		const uint32_t vendor_id = read_u32(data + 8);
+		const uint32_t device_id = read_u32(data + 12);
+
+		if (header_length < pipeline_cache_header_size || header_length > size) {
+			reason = "bad header length";
+			return false;
+		}
+
+		if (header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+			reason = "unknown header version";
+			return false;
+		}
+
+		if (vendor_id != properties.vendorID || device_id != properties.deviceID) {
+			reason = "different device";
+			return false;
+		}
+
+		if (memcmp(data + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			reason = "different driver";
+			return false;
+		}
+
+		return true;
+	}
+
+	VkPipelineCache load_pipeline_cache(VkDevice vulkan_device, const VkPhysicalDeviceProperties& properties, const std::string& path, pipeline_cache_stats& stats) {
+		std::vector<uint8_t> data;
+
+		FILE *fp = fopen(path.c_str(), "rb");
+		if (fp) {
+			pipeline_cache_file_header header;
+			if (fread(&header, sizeof(header), 1, fp) != 1) {
+				stats.rejected = "truncated file";
+			} else if (header.magic != pipeline_cache_file_magic || header.version != pipeline_cache_file_version) {
+				stats.rejected = "not a pipeline cache";
+			} else {
+				fseek(fp, 0L, SEEK_END);
+				const long file_size = ftell(fp);
+				fseek(fp, (long)sizeof(header), SEEK_SET);
+
+				if (file_size < 0 || (uint64_t)file_size - sizeof(header) != header.data_size) {
+					stats.rejected = "truncated file";
+				} else {
+					data.resize((size_t)header.data_size);
+					if (data.size() > 0 && fread(data.data(), data.size(), 1, fp) != 1) {
+						stats.rejected = "read error";
+					} else if (fnv1a(data.data(), data.size()) != header.data_hash) {
+						stats.rejected = "checksum mismatch";
+					} else {
+						validate_pipeline_cache_data(data.data(), data.size(), properties, stats.rejected);
+					}
+				}
+			}
+			fclose(fp);
+
+			if (stats.rejected != nullptr) {
+				std::cerr << "Discarding pipeline cache " << path << ": " << stats.rejected << std::endl;
+				data.clear();
+			}
+		}
+
+		VkPipelineCacheCreateInfo pipeline_cache_create_info;
+		memset(&pipeline_cache_create_info, 0, sizeof(pipeline_cache_create_info));
+		pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		pipeline_cache_create_info.initialDataSize = data.size();
+		pipeline_cache_create_info.pInitialData = data.size() > 0 ? data.data() : NULL;
+
+		VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+		VkResult err = vkCreatePipelineCache(vulkan_device, &pipeline_cache_create_info, NULL, &pipeline_cache);
+
+		if (err && data.size() > 0) {
+			// Passed our checks but the driver still refused it; start cold.
+			stats.rejected = "rejected by driver";
+			data.clear();
+
+			pipeline_cache_create_info.initialDataSize = 0;
+			pipeline_cache_create_info.pInitialData = NULL;
+			err = vkCreatePipelineCache(vulkan_device, &pipeline_cache_create_info, NULL, &pipeline_cache);
+		}
+		assert(!err);
+
+		stats.warm = data.size() > 0;
+		stats.loaded_bytes = data.size();
+
+		return pipeline_cache;
+	}
+
+	bool save_pipeline_cache(VkDevice vulkan_device, VkPipelineCache pipeline_cache, const std::string& path, pipeline_cache_stats& stats) {
+		size_t size = 0;
+		VkResult err = vkGetPipelineCacheData(vulkan_device, pipeline_cache, &size, NULL);
+		if (err || size == 0) {
+			return false;
+		}
+
+		std::vector<uint8_t> data(size);
+		err = vkGetPipelineCacheData(vulkan_device, pipeline_cache, &size, data.data());
+		if (err) {
+			return false;
+		}
+		data.resize(size);
+
+		pipeline_cache_file_header header;
+		header.magic = pipeline_cache_file_magic;
+		header.version = pipeline_cache_file_version;
+		header.data_size = data.size();
+		header.data_hash = fnv1a(data.data(), data.size());
+
+		const std::string temp_path = path + ".tmp";
+
+		FILE *fp = fopen(temp_path.c_str(), "wb");
+		if (!fp) {
+			std::cerr << "Could not write pipeline cache " << temp_path << std::endl;
+			return false;
+		}
+
+		bool written = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(data.data(), data.size(), 1, fp) == 1;
+		written = fflush(fp) == 0 && written;
+		written = fclose(fp) == 0 && written;
+
+		if (!written) {
+			std::cerr << "Could not write pipeline cache " << temp_path << std::endl;
+			remove(temp_path.c_str());
+			return false;
+		}
+
+#ifdef _WIN32
+		const bool renamed = MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		const bool renamed = rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+		if (!renamed) {
+			std::cerr << "Could not replace pipeline cache " << path << std::endl;
+			remove(temp_path.c_str());
+			return false;
+		}
+
+		stats.saved_bytes = data.size();
+		return true;
+	}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace vulkan {
+
+	struct pipeline_cache_stats {
+		bool warm = false;					// started from a blob on disk
+		const char * rejected = nullptr;	// why a blob on disk was thrown away
+		size_t loaded_bytes = 0;
+		size_t saved_bytes = 0;
+		double create_ms = 0.0;				// pipeline creation time this run
+	};
+
+	// Checks the VkPipelineCacheHeaderVersionOne a driver puts at the front of
+	// vkGetPipelineCacheData against the device we are running on. Blobs from
+	// another GPU or driver build are valid data, just useless; feeding them
+	// back is allowed but some drivers handle it badly, so we never do.
+	bool validate_pipeline_cache_data(const uint8_t * data, size_t size, const VkPhysicalDeviceProperties& properties, const char *& reason);
+
+	// Creates a pipeline cache seeded from path if it holds a valid blob for
+	// this device, otherwise an empty one.
+	VkPipelineCache load_pipeline_cache(VkDevice vulkan_device, const VkPhysicalDeviceProperties& properties, const std::string& path, pipeline_cache_stats& stats);
+
+	// Writes the cache to a temporary file next to path and renames it over the
+	// old one, so a crash mid-write can never leave a torn cache behind.
+	bool save_pipeline_cache(VkDevice vulkan_device, VkPipelineCache pipeline_cache, const std::string& path, pipeline_cache_stats& stats);
+
+}
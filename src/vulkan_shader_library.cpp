@@ -0,0 +1,180 @@
+
+#include <assert.h>
+#include <iostream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "vulkan_hash.hpp"
+#include "vulkan_shader_library.hpp"
+
+namespace vulkan {
+
+	namespace {
+
+		// Read-only view of a whole file. The mapping is page aligned, which
+		// satisfies the 4-byte alignment vkCreateShaderModule wants for pCode.
+		class mapped_file {
+		public:
+			explicit mapped_file(const char * filename) {
+#ifdef _WIN32
+				_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+				if (_file == INVALID_HANDLE_VALUE) {
+					return;
+				}
+
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+					return;
+				}
+
+				_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (_mapping == NULL) {
+					return;
+				}
+
+				_data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+				if (_data != NULL) {
+					_size = (size_t)size.QuadPart;
+				}
+#else
+				_file = open(filename, O_RDONLY);
+				if (_file < 0) {
+					return;
+				}
+
+				struct stat info;
+				if (fstat(_file, &info) != 0 || info.st_size == 0) {
+					return;
+				}
+
+				void * data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, _file, 0);
+				if (data != MAP_FAILED) {
+					_data = data;
+					_size = (size_t)info.st_size;
+				}
+#endif
+			}
+
+			~mapped_file() {
+#ifdef _WIN32
+				if (_data != NULL) {
+					UnmapViewOfFile(_data);
+				}
+				if (_mapping != NULL) {
+					CloseHandle(_mapping);
+				}
+				if (_file != INVALID_HANDLE_VALUE) {
+					CloseHandle(_file);
+				}
+#else
+				if (_data != NULL) {
+					munmap(_data, _size);
+				}
+				if (_file >= 0) {
+					close(_file);
+				}
+#endif
+			}
+
+			mapped_file(const mapped_file&) = delete;
+			mapped_file& operator=(const mapped_file&) = delete;
+
+			const void * data() const { return _data; }
+			size_t size() const { return _size; }
+
+		private:
+#ifdef _WIN32
+			HANDLE _file = INVALID_HANDLE_VALUE;
+			HANDLE _mapping = NULL;
+#else
+			int _file = -1;
+#endif
+			void * _data = NULL;
+			size_t _size = 0;
+		};
+
+	}
+
+	shader_library::~shader_library() {
+		destroy();
+	}
+
+	void shader_library::init(VkDevice vulkan_device) {
+		_vulkan_device = vulkan_device;
+	}
+
+	void shader_library::destroy() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_vulkan_device == VK_NULL_HANDLE) {
+			return;
+		}
+
+		for (auto& module : _by_content) {
+			vkDestroyShaderModule(_vulkan_device, module.second, NULL);
+		}
+		_by_content.clear();
+		_by_name.clear();
+		_stats.modules = 0;
+
+		_vulkan_device = VK_NULL_HANDLE;
+	}
+
+	VkShaderModule shader_library::get(const std::string& filename) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		auto named = _by_name.find(filename);
+		if (named != _by_name.end()) {
+			_stats.name_hits++;
+			return named->second;
+		}
+
+		mapped_file file(filename.c_str());
+		if (file.data() == NULL || file.size() % 4 != 0) {
+			std::cerr << "Could not load SPIR-V from " << filename << std::endl;
+			return VK_NULL_HANDLE;
+		}
+		_stats.files_mapped++;
+
+		shader_key key;
+		key.hash = fnv1a(file.data(), file.size());
+		key.size = file.size();
+
+		auto existing = _by_content.find(key);
+		if (existing != _by_content.end()) {
+			_stats.content_hits++;
+			_by_name[filename] = existing->second;
+			return existing->second;
+		}
+
+		VkShaderModuleCreateInfo module_create_info;
+		module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		module_create_info.pNext = NULL;
+		module_create_info.flags = 0;
+		module_create_info.codeSize = file.size();
+		module_create_info.pCode = (const uint32_t *)file.data();
+
+		VkShaderModule module;
+		VkResult err = vkCreateShaderModule(_vulkan_device, &module_create_info, NULL, &module);
+		assert(!err);
+
+		_by_content[key] = module;
+		_by_name[filename] = module;
+		_stats.modules++;
+
+		return module;
+	}
+
+	shader_library_stats shader_library::get_stats() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+}
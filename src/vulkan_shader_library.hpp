@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace vulkan {
+
+	struct shader_library_stats {
+		uint32_t modules = 0;		// live VkShaderModules
+		uint32_t files_mapped = 0;	// SPIR-V files read from disk
+		uint32_t name_hits = 0;		// requests served without touching disk
+		uint32_t content_hits = 0;	// different files with identical SPIR-V
+	};
+
+	// Owns every VkShaderModule. Files are memory-mapped once, modules are keyed
+	// by a hash of their SPIR-V and live until destroy(), so rebuilding a
+	// pipeline (resize, a new variant) costs no file I/O and no module creation.
+	// Safe to call from several threads.
+	class shader_library {
+	public:
+		shader_library() {}
+		~shader_library();
+
+		void init(VkDevice vulkan_device);
+		void destroy();
+
+		// Returns VK_NULL_HANDLE if the file can't be read.
+		VkShaderModule get(const std::string& filename);
+
+		shader_library_stats get_stats() const;
+
+	private:
+		struct shader_key {
+			uint64_t hash;
+			size_t size;
+
+			bool operator<(const shader_key& other) const {
+				return hash < other.hash || (hash == other.hash && size < other.size);
+			}
+		};
+
+		VkDevice _vulkan_device = VK_NULL_HANDLE;
+
+		mutable std::mutex _mutex;
+		std::map<std::string, VkShaderModule> _by_name;
+		std::map<shader_key, VkShaderModule> _by_content;
+
+		shader_library_stats _stats;
+	};
+
+}
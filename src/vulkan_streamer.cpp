@@ -0,0 +1,487 @@
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include "vulkan_streamer.hpp"
+#include "cpu_profiler.hpp"
+#include "pngReader.hpp"
+
+namespace vulkan {
+
+	streamer::~streamer() {
+		destroy();
+	}
+
+	void streamer::init(const streamer_context& context) {
+		_context = context;
+
+		const VkCommandPoolCreateInfo command_pool_create_info = {
+			VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			NULL,
+			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			_context.queue_family,
+		};
+
+		VkResult err = vkCreateCommandPool(_context.device, &command_pool_create_info, NULL, &_command_pool);
+		assert(!err);
+
+		_quit = false;
+		_decodes_ahead = 0;
+		_thread = std::thread(&streamer::run, this);
+	}
+
+	void streamer::destroy() {
+		if (!_thread.joinable()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_quit = true;
+		}
+		_condition.notify_all();
+		_thread.join();
+
+		// Uploads nobody picked up. Their submissions have retired, so the
+		// semaphores are signalled but no longer referenced by the GPU.
+		for (auto& resource : _completed) {
+			if (resource.image != VK_NULL_HANDLE) {
+				vkDestroyImage(_context.device, resource.image, NULL);
+			}
+			if (resource.buffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(_context.device, resource.buffer, NULL);
+			}
+			_context.allocator->free(resource.memory);
+			if (resource.ready != VK_NULL_HANDLE) {
+				vkDestroySemaphore(_context.device, resource.ready, NULL);
+			}
+		}
+		_completed.clear();
+
+		// Requests that never ran may still be decoding into staging.
+		for (auto& request : _requests) {
+			release_decoded(request);
+		}
+		_requests.clear();
+
+		vkDestroyCommandPool(_context.device, _command_pool, NULL);
+		_command_pool = VK_NULL_HANDLE;
+	}
+
+	uint64_t streamer::request_texture(const std::string& filename) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		stream_request request;
+		request.id = _next_id++;
+		request.filename = filename;
+		request.decoded = std::make_shared<decoded_texture>();
+
+		_requests.push_back(std::move(request));
+		_stats.requested++;
+
+		// Start decoding now, so it overlaps the uploads queued ahead of it.
+		if (_context.decoder != nullptr) {
+			if (_decodes_ahead >= _context.max_decodes_ahead) {
+				_stats.decodes_deferred++;
+			}
+			start_decodes();
+		}
+		_condition.notify_one();
+
+		return _requests.back().id;
+	}
+
+	uint64_t streamer::request_buffer(const void * data, VkDeviceSize size, VkBufferUsageFlags usage) {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		stream_request request;
+		request.id = _next_id++;
+		request.data.assign((const uint8_t *)data, (const uint8_t *)data + size);
+		request.usage = usage;
+
+		_requests.push_back(std::move(request));
+		_stats.requested++;
+		_condition.notify_one();
+
+		return _requests.back().id;
+	}
+
+	std::vector<streamed_resource> streamer::take_completed() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		std::vector<streamed_resource> completed;
+		completed.swap(_completed);
+		return completed;
+	}
+
+	streamer_stats streamer::get_stats() const {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _stats;
+	}
+
+	void streamer::run() {
+		cpu_profiler::get().set_thread_name("streamer");
+
+		while (true) {
+			stream_request request;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+
+				if (_requests.empty() && !_quit) {
+					if (_submissions.size() > 0) {
+						// Nothing new to do; block on the GPU instead of the queue
+						// so staging memory goes back as soon as possible.
+						lock.unlock();
+						retire(true);
+						continue;
+					}
+
+					_condition.wait(lock, [this] { return _quit || !_requests.empty(); });
+				}
+
+				if (_quit) {
+					break;
+				}
+
+				request = std::move(_requests.front());
+				_requests.pop_front();
+
+				if (request.decoded != nullptr && request.decoded->done.valid()) {
+					_decodes_ahead--;
+					start_decodes();
+				}
+			}
+
+			{
+				cpu_scope scope("stream_upload");
+				process(request);
+			}
+			retire(false);
+		}
+
+		retire(true);
+	}
+
+	void streamer::start_decodes() {
+		// Called with _mutex held. Decodes start in request order, so every
+		// request not yet started is behind every one that has.
+		for (auto& request : _requests) {
+			if (_decodes_ahead >= _context.max_decodes_ahead) {
+				break;
+			}
+			if (request.decoded == nullptr || request.decoded->done.valid()) {
+				continue;
+			}
+
+			request.decoded->done = _context.decoder->submit(request.filename, staging_sink(request.decoded));
+			_decodes_ahead++;
+			_stats.decodes_ahead_high_water = (std::max)(_stats.decodes_ahead_high_water, _decodes_ahead);
+		}
+	}
+
+	void streamer::retire(bool wait) {
+		for (auto it = _submissions.begin(); it != _submissions.end();) {
+			VkResult err;
+
+			if (wait) {
+				err = vkWaitForFences(_context.device, 1, &it->fence, VK_TRUE, UINT64_MAX);
+				assert(!err);
+			} else if (vkGetFenceStatus(_context.device, it->fence) != VK_SUCCESS) {
+				++it;
+				continue;
+			}
+
+			vkDestroyBuffer(_context.device, it->staging_buffer, NULL);
+			_context.allocator->free(it->staging_memory);
+
+			vkFreeCommandBuffers(_context.device, _command_pool, 1, &it->command_buffer);
+			_context.sync->release_fence(it->fence);
+
+			it = _submissions.erase(it);
+		}
+	}
+
+	VkCommandBuffer streamer::begin_commands() {
+		VkResult err;
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+
+		const VkCommandBufferAllocateInfo command_allocate_info = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			NULL,
+			_command_pool,
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			1,
+		};
+
+		err = vkAllocateCommandBuffers(_context.device, &command_allocate_info, &command_buffer);
+		assert(!err);
+
+		const VkCommandBufferBeginInfo command_buffer_begin_info = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			NULL,
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			NULL,
+		};
+
+		err = vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+		assert(!err);
+
+		return command_buffer;
+	}
+
+	VkBuffer streamer::create_staging(VkDeviceSize size, memory_allocation& memory) {
+		VkBuffer buffer = VK_NULL_HANDLE;
+
+		VkBufferCreateInfo buffer_create_info;
+		memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+
+		buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		buffer_create_info.size = size;
+
+		VkResult err = vkCreateBuffer(_context.device, &buffer_create_info, NULL, &buffer);
+		assert(!err);
+
+		VkMemoryRequirements memory_requirements;
+		vkGetBufferMemoryRequirements(_context.device, buffer, &memory_requirements);
+
+		memory = _context.allocator->allocate(memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, resource_kind::linear);
+
+		err = vkBindBufferMemory(_context.device, buffer, memory.device_memory, memory.offset);
+		assert(!err);
+
+		return buffer;
+	}
+
+	load_image::png_sink streamer::staging_sink(std::shared_ptr<decoded_texture> decoded) {
+		// Runs on whichever thread decodes; the allocator is safe to call from
+		// any of them.
+		load_image::png_sink sink;
+		sink.begin = [this, decoded](unsigned int width, unsigned int height) {
+			decoded->width = width;
+			decoded->height = height;
+			decoded->staging_buffer = create_staging((VkDeviceSize)width * height * 4, decoded->staging_memory);
+		};
+		sink.row = [decoded](unsigned int y, const uint8_t * row) {
+			const size_t row_bytes = (size_t)decoded->width * 4;
+			memcpy((uint8_t *)decoded->staging_memory.mapped + y * row_bytes, row, row_bytes);
+		};
+		return sink;
+	}
+
+	void streamer::release_decoded(stream_request& request) {
+		if (request.decoded == nullptr) {
+			return;
+		}
+		if (request.decoded->done.valid()) {
+			request.decoded->done.get();
+		}
+		if (request.decoded->staging_buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(_context.device, request.decoded->staging_buffer, NULL);
+			_context.allocator->free(request.decoded->staging_memory);
+			request.decoded->staging_buffer = VK_NULL_HANDLE;
+		}
+	}
+
+	void streamer::process(stream_request& request) {
+		VkResult err;
+
+		streamed_resource resource;
+		resource.id = request.id;
+
+		stream_submission submission;
+
+		const bool separate = separate_queue();
+		const uint32_t src_family = separate ? _context.queue_family : VK_QUEUE_FAMILY_IGNORED;
+		const uint32_t dst_family = separate ? _context.graphics_queue_family : VK_QUEUE_FAMILY_IGNORED;
+
+		if (!request.filename.empty()) {
+			bool decoded = true;
+			if (request.decoded->done.valid()) {
+				cpu_scope scope("stream_wait_decode");
+				decoded = request.decoded->done.get();
+			} else {
+				try {
+					load_image::png_rows(request.filename.c_str(), staging_sink(request.decoded));
+				} catch (std::exception& e) {
+					std::cerr << "Failed to stream texture: " << e.what() << std::endl;
+					decoded = false;
+				}
+			}
+
+			if (!decoded) {
+				release_decoded(request);
+
+				// Still report it, so the caller is not left waiting forever.
+				std::lock_guard<std::mutex> lock(_mutex);
+				_completed.push_back(resource);
+				_stats.completed++;
+				return;
+			}
+
+			resource.width = request.decoded->width;
+			resource.height = request.decoded->height;
+			submission.staging_buffer = request.decoded->staging_buffer;
+			submission.staging_memory = request.decoded->staging_memory;
+			request.decoded = nullptr;
+
+			const VkImageCreateInfo image_create_info = {
+				VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+				NULL,
+				0,
+				VK_IMAGE_TYPE_2D,
+				VK_FORMAT_R8G8B8A8_UNORM,
+				{ resource.width, resource.height, 1 },
+				1,
+				1,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				VK_SHARING_MODE_EXCLUSIVE,
+				0,
+				nullptr,
+				VK_IMAGE_LAYOUT_UNDEFINED
+			};
+
+			err = vkCreateImage(_context.device, &image_create_info, NULL, &resource.image);
+			assert(!err);
+
+			VkMemoryRequirements memory_requirements;
+			vkGetImageMemoryRequirements(_context.device, resource.image, &memory_requirements);
+
+			resource.memory = _context.allocator->allocate(memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource_kind::optimal);
+
+			err = vkBindImageMemory(_context.device, resource.image, resource.memory.device_memory, resource.memory.offset);
+			assert(!err);
+
+			submission.command_buffer = begin_commands();
+
+			VkImageMemoryBarrier image_memory_barrier = {
+				VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				NULL,
+				0,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_QUEUE_FAMILY_IGNORED,
+				VK_QUEUE_FAMILY_IGNORED,
+				resource.image,
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } };
+
+			vkCmdPipelineBarrier(submission.command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
+
+			const VkBufferImageCopy copy_region = {
+				0,
+				0,
+				0,
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+				{ 0, 0, 0 },
+				{ resource.width, resource.height, 1 },
+			};
+
+			vkCmdCopyBufferToImage(submission.command_buffer, submission.staging_buffer, resource.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+
+			// On a separate family this is the release half of the ownership
+			// transfer; the graphics side records the identical acquire.
+			image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			image_memory_barrier.dstAccessMask = separate ? 0 : VK_ACCESS_SHADER_READ_BIT;
+			image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			image_memory_barrier.srcQueueFamilyIndex = src_family;
+			image_memory_barrier.dstQueueFamilyIndex = dst_family;
+
+			vkCmdPipelineBarrier(submission.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, separate ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
+		} else {
+			resource.size = request.data.size();
+			resource.usage = request.usage;
+
+			submission.staging_buffer = create_staging(resource.size, submission.staging_memory);
+			memcpy(submission.staging_memory.mapped, request.data.data(), request.data.size());
+			request.data.clear();
+
+			VkBufferCreateInfo buffer_create_info;
+			memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+
+			buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_create_info.usage = resource.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			buffer_create_info.size = resource.size;
+
+			err = vkCreateBuffer(_context.device, &buffer_create_info, NULL, &resource.buffer);
+			assert(!err);
+
+			VkMemoryRequirements memory_requirements;
+			vkGetBufferMemoryRequirements(_context.device, resource.buffer, &memory_requirements);
+
+			resource.memory = _context.allocator->allocate(memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource_kind::linear);
+
+			err = vkBindBufferMemory(_context.device, resource.buffer, resource.memory.device_memory, resource.memory.offset);
+			assert(!err);
+
+			submission.command_buffer = begin_commands();
+
+			const VkBufferCopy copy_region = { 0, 0, resource.size };
+			vkCmdCopyBuffer(submission.command_buffer, submission.staging_buffer, resource.buffer, 1, &copy_region);
+
+			const VkBufferMemoryBarrier buffer_memory_barrier = {
+				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				NULL,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				separate ? 0 : buffer_access_for_usage(resource.usage),
+				src_family,
+				dst_family,
+				resource.buffer,
+				0,
+				VK_WHOLE_SIZE };
+
+			vkCmdPipelineBarrier(submission.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, separate ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 1, &buffer_memory_barrier, 0, NULL);
+		}
+
+		submit(submission, resource);
+	}
+
+	void streamer::submit(stream_submission& submission, streamed_resource& resource) {
+		VkResult err;
+
+		err = vkEndCommandBuffer(submission.command_buffer);
+		assert(!err);
+
+		submission.fence = _context.sync->acquire_fence();
+
+		if (separate_queue()) {
+			resource.ready = _context.sync->acquire_semaphore();
+		}
+
+		VkSubmitInfo submit_info = {
+			VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			NULL,
+			0,
+			NULL,
+			NULL,
+			1,
+			&submission.command_buffer,
+			resource.ready != VK_NULL_HANDLE ? 1u : 0u,
+			&resource.ready };
+
+		if (_context.queue_mutex != nullptr) {
+			std::lock_guard<std::mutex> lock(*_context.queue_mutex);
+			err = vkQueueSubmit(_context.queue, 1, &submit_info, submission.fence);
+		} else {
+			err = vkQueueSubmit(_context.queue, 1, &submit_info, submission.fence);
+		}
+		assert(!err);
+
+		_submissions.push_back(submission);
+
+		// Only published after the submit, so anything the render thread queues
+		// with this resource is ordered behind the upload.
+		std::lock_guard<std::mutex> lock(_mutex);
+		_completed.push_back(resource);
+		_stats.completed++;
+		_stats.submits++;
+		_stats.bytes += submission.staging_memory.size;
+	}
+
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vulkan_allocator.hpp"
+#include "vulkan_sync_pool.hpp"
+#include "texture_decoder.hpp"
+
+namespace vulkan {
+
+	// Everything the streaming thread needs from the wrapper. When the device has
+	// no separate transfer/compute family, queue is the graphics queue and
+	// queue_mutex guards it against the render loop.
+	struct streamer_context {
+		VkDevice device = VK_NULL_HANDLE;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t queue_family = 0;
+		uint32_t graphics_queue_family = 0;
+		std::mutex * queue_mutex = nullptr;
+
+		memory_allocator * allocator = nullptr;
+		sync_pool * sync = nullptr;
+
+		// Decodes textures as they are requested, ahead of the streaming
+		// thread; without one they decode on the streaming thread in turn.
+		texture_decoder * decoder = nullptr;
+
+		// Each decode ahead holds a full staging image until the streaming
+		// thread gets to it, so only this many run ahead; the rest start as
+		// earlier ones are taken.
+		uint32_t max_decodes_ahead = 4;
+	};
+
+	// A finished upload, handed back to the render thread. When the upload ran on
+	// another queue family the resource has been released by that family; the
+	// render thread must record the matching acquire barrier in a submission
+	// that waits on ready before using it. On a shared queue ready is null and
+	// the resource is already in its final layout.
+	struct streamed_resource {
+		uint64_t id = 0;
+
+		VkImage image = VK_NULL_HANDLE;
+		uint32_t width = 0, height = 0;
+
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkBufferUsageFlags usage = 0;
+
+		memory_allocation memory;
+		VkSemaphore ready = VK_NULL_HANDLE;
+	};
+
+	struct streamer_stats {
+		uint32_t requested = 0;
+		uint32_t completed = 0;
+		uint32_t submits = 0;
+		VkDeviceSize bytes = 0;
+		uint32_t decodes_deferred = 0;			// held back by max_decodes_ahead
+		uint32_t decodes_ahead_high_water = 0;
+	};
+
+	// Background thread that decodes and uploads textures and buffers on its own
+	// queue so rendering never stalls behind a large asset.
+	class streamer {
+	public:
+		streamer() {}
+		~streamer();
+
+		void init(const streamer_context& context);
+		void destroy();
+
+		bool separate_queue() const {
+			return _context.queue_family != _context.graphics_queue_family;
+		}
+
+		uint64_t request_texture(const std::string& filename);
+		uint64_t request_buffer(const void * data, VkDeviceSize size, VkBufferUsageFlags usage);
+
+		std::vector<streamed_resource> take_completed();
+
+		streamer_stats get_stats() const;
+
+	private:
+		// A texture decoded straight into its staging buffer, which exists
+		// once the size is known.
+		struct decoded_texture {
+			uint32_t width = 0, height = 0;
+			VkBuffer staging_buffer = VK_NULL_HANDLE;
+			memory_allocation staging_memory;
+			decode_handle done;
+		};
+
+		struct stream_request {
+			uint64_t id = 0;
+			std::string filename;
+			std::shared_ptr<decoded_texture> decoded;
+			std::vector<uint8_t> data;
+			VkBufferUsageFlags usage = 0;
+		};
+
+		// A submitted upload whose staging memory is still being read.
+		struct stream_submission {
+			VkFence fence = VK_NULL_HANDLE;
+			VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+			VkBuffer staging_buffer = VK_NULL_HANDLE;
+			memory_allocation staging_memory;
+		};
+
+		void run();
+		void start_decodes();
+		void process(stream_request& request);
+		void retire(bool wait);
+
+		VkCommandBuffer begin_commands();
+		VkBuffer create_staging(VkDeviceSize size, memory_allocation& memory);
+		load_image::png_sink staging_sink(std::shared_ptr<decoded_texture> decoded);
+		void release_decoded(stream_request& request);
+		void submit(stream_submission& submission, streamed_resource& resource);
+
+		streamer_context _context;
+		VkCommandPool _command_pool = VK_NULL_HANDLE;
+
+		std::thread _thread;
+		mutable std::mutex _mutex;
+		std::condition_variable _condition;
+		bool _quit = false;
+
+		std::deque<stream_request> _requests;
+		std::vector<streamed_resource> _completed;
+		std::vector<stream_submission> _submissions;	// streaming thread only
+
+		uint32_t _decodes_ahead = 0;	// started but not yet taken by run
+		uint64_t _next_id = 1;
+		streamer_stats _stats;
+	};
+
+	// Access the uploaded data will see once acquired, by buffer usage.
+	inline VkAccessFlags buffer_access_for_usage(VkBufferUsageFlags usage) {
+		VkAccessFlags access = 0;
+		if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+			access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		}
+		if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+			access |= VK_ACCESS_INDEX_READ_BIT;
+		}
+		if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+			access |= VK_ACCESS_UNIFORM_READ_BIT;
+		}
+		if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+			access |= VK_ACCESS_SHADER_READ_BIT;
+		}
+		if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) {
+			access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		}
+		return access != 0 ? access : (VkAccessFlags)VK_ACCESS_MEMORY_READ_BIT;
+	}
+
+}
@@ -0,0 +1,400 @@
+#include <assert.h>
+#include <algorithm>
+
+#include "vulkan_swapchain.hpp"
+
+namespace vulkan {
+
+	const char * present_mode_name(VkPresentModeKHR mode) {
+		switch (mode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR:
+			return "immediate";
+		case VK_PRESENT_MODE_MAILBOX_KHR:
+			return "mailbox";
+		case VK_PRESENT_MODE_FIFO_KHR:
+			return "fifo";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+			return "fifo relaxed";
+		default:
+			return "unknown";
+		}
+	}
+
+	swapchain::~swapchain() {
+		destroy();
+	}
+
+	void swapchain::init(const swapchain_context& context, const swapchain_policy& policy) {
+		_context = context;
+		_policy = policy;
+
+		_intervals.assign(present_stats_window, 0.0);
+
+		if (headless()) {
+			assert(_context.allocator != nullptr);
+			return;
+		}
+
+		fpGetPhysicalDeviceSurfaceCapabilitiesKHR = (PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR)vkGetInstanceProcAddr(_context.instance, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+		fpGetPhysicalDeviceSurfacePresentModesKHR = (PFN_vkGetPhysicalDeviceSurfacePresentModesKHR)vkGetInstanceProcAddr(_context.instance, "vkGetPhysicalDeviceSurfacePresentModesKHR");
+
+		auto fpGetDeviceProcAddr = (PFN_vkGetDeviceProcAddr)vkGetInstanceProcAddr(_context.instance, "vkGetDeviceProcAddr");
+
+		fpCreateSwapchainKHR = (PFN_vkCreateSwapchainKHR)fpGetDeviceProcAddr(_context.device, "vkCreateSwapchainKHR");
+		fpDestroySwapchainKHR = (PFN_vkDestroySwapchainKHR)fpGetDeviceProcAddr(_context.device, "vkDestroySwapchainKHR");
+		fpGetSwapchainImagesKHR = (PFN_vkGetSwapchainImagesKHR)fpGetDeviceProcAddr(_context.device, "vkGetSwapchainImagesKHR");
+		fpAcquireNextImageKHR = (PFN_vkAcquireNextImageKHR)fpGetDeviceProcAddr(_context.device, "vkAcquireNextImageKHR");
+		fpQueuePresentKHR = (PFN_vkQueuePresentKHR)fpGetDeviceProcAddr(_context.device, "vkQueuePresentKHR");
+	}
+
+	void swapchain::destroy() {
+		if (headless()) {
+			destroy_offscreen();
+			return;
+		}
+
+		if (_swapchain == VK_NULL_HANDLE) {
+			return;
+		}
+
+		// Destroying the swapchain also releases its images.
+		fpDestroySwapchainKHR(_context.device, _swapchain, NULL);
+		_swapchain = VK_NULL_HANDLE;
+		_images.clear();
+	}
+
+	VkSwapchainKHR swapchain::create(uint32_t width, uint32_t height) {
+		if (headless()) {
+			create_offscreen(width, height);
+			return VK_NULL_HANDLE;
+		}
+
+		VkResult err;
+
+		VkSurfaceCapabilitiesKHR surface_capabilities;
+		err = fpGetPhysicalDeviceSurfaceCapabilitiesKHR(_context.physical_device, _context.surface, &surface_capabilities);
+		assert(!err);
+
+		uint32_t present_modes_count = 0;
+		err = fpGetPhysicalDeviceSurfacePresentModesKHR(_context.physical_device, _context.surface, &present_modes_count, NULL);
+		assert(!err);
+
+		std::vector<VkPresentModeKHR> present_modes(present_modes_count);
+		err = fpGetPhysicalDeviceSurfacePresentModesKHR(_context.physical_device, _context.surface, &present_modes_count, present_modes.data());
+		assert(!err);
+
+		// width and height are either both -1, or both not -1.
+		if (surface_capabilities.currentExtent.width == (uint32_t)-1) {
+			// If the surface size is undefined, the size is set to
+			// the size of the images requested.
+			_width = (std::min)((std::max)(width, surface_capabilities.minImageExtent.width), surface_capabilities.maxImageExtent.width);
+			_height = (std::min)((std::max)(height, surface_capabilities.minImageExtent.height), surface_capabilities.maxImageExtent.height);
+		} else {
+			// If the surface size is defined, the swap chain size must match
+			_width = surface_capabilities.currentExtent.width;
+			_height = surface_capabilities.currentExtent.height;
+		}
+
+		// First preference the surface supports; FIFO is always there.
+		_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		for (auto mode : _policy.present_modes) {
+			if (std::find(present_modes.begin(), present_modes.end(), mode) != present_modes.end()) {
+				_present_mode = mode;
+				break;
+			}
+		}
+
+		// Beyond the minimum, each extra image is one more frame the
+		// application can render while others are queued for display.
+		uint32_t image_count_target = surface_capabilities.minImageCount + _policy.extra_images;
+		if ((surface_capabilities.maxImageCount > 0) && (image_count_target > surface_capabilities.maxImageCount)) {
+			// Application must settle for fewer images than desired:
+			image_count_target = surface_capabilities.maxImageCount;
+		}
+
+		VkSurfaceTransformFlagsKHR surface_pretransform;
+		if (surface_capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) {
+			surface_pretransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+		} else {
+			surface_pretransform = surface_capabilities.currentTransform;
+		}
+
+		VkSwapchainKHR old_swapchain = _swapchain;
+
+		const VkSwapchainCreateInfoKHR swapchain_create_info = {
+			VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+			NULL,
+			0,
+			_context.surface,
+			image_count_target,
+			_context.format,
+			_context.color_space,
+			{ _width, _height, },
+			1,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0,
+			NULL,
+			(VkSurfaceTransformFlagBitsKHR)surface_pretransform,
+			VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+			_present_mode,
+			true,
+			old_swapchain
+		};
+
+		err = fpCreateSwapchainKHR(_context.device, &swapchain_create_info, NULL, &_swapchain);
+		assert(!err);
+
+		uint32_t image_count = 0;
+		err = fpGetSwapchainImagesKHR(_context.device, _swapchain, &image_count, NULL);
+		assert(!err);
+
+		_images = std::vector<VkImage>(image_count);
+		err = fpGetSwapchainImagesKHR(_context.device, _swapchain, &image_count, _images.data());
+		assert(!err);
+
+		if (old_swapchain != VK_NULL_HANDLE) {
+			_stats.recreated++;
+		}
+
+		note_recreate();
+
+		return old_swapchain;
+	}
+
+	void swapchain::note_recreate() {
+		// Presents from before the recreate say nothing about the new mode.
+		_needs_recreate = false;
+		_has_last_present = false;
+		_intervals.assign(present_stats_window, 0.0);
+		_interval_next = 0;
+	}
+
+	void swapchain::create_offscreen(uint32_t width, uint32_t height) {
+		VkResult err;
+
+		// There is nothing to retire the old images to, but a resize is rare
+		// headless, so wait for their last frames and destroy them now.
+		const bool recreate = !_images.empty();
+		destroy_offscreen();
+
+		_width = width > 0 ? width : 1;
+		_height = height > 0 ? height : 1;
+
+		// Nothing paces to a display; each frame's image is free as soon as
+		// the frame that drew it has finished.
+		_present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+		const uint32_t image_count = headless_min_images + _policy.extra_images;
+
+		const VkImageCreateInfo image_info = {
+			VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			NULL,
+			0,
+			VK_IMAGE_TYPE_2D,
+			_context.format,
+			{ _width, _height, 1 },
+			1,
+			1,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0,
+			nullptr,
+			VK_IMAGE_LAYOUT_UNDEFINED
+		};
+
+		// Created signalled, so the first acquire of each image does not wait.
+		const VkFenceCreateInfo fence_info = {
+			VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			NULL,
+			VK_FENCE_CREATE_SIGNALED_BIT,
+		};
+
+		for (uint32_t i = 0; i < image_count; i++) {
+			VkImage image = VK_NULL_HANDLE;
+			err = vkCreateImage(_context.device, &image_info, NULL, &image);
+			assert(!err);
+
+			VkMemoryRequirements memory_requirements;
+			vkGetImageMemoryRequirements(_context.device, image, &memory_requirements);
+
+			auto allocation = _context.allocator->allocate(memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource_kind::optimal);
+			err = vkBindImageMemory(_context.device, image, allocation.device_memory, allocation.offset);
+			assert(!err);
+
+			VkFence fence = VK_NULL_HANDLE;
+			err = vkCreateFence(_context.device, &fence_info, NULL, &fence);
+			assert(!err);
+
+			_images.push_back(image);
+			_offscreen_memory.push_back(allocation);
+			_offscreen_fences.push_back(fence);
+		}
+
+		_offscreen_next = 0;
+
+		if (recreate) {
+			_stats.recreated++;
+		}
+
+		note_recreate();
+	}
+
+	void swapchain::destroy_offscreen() {
+		if (!_offscreen_fences.empty()) {
+			VkResult err = vkWaitForFences(_context.device, (uint32_t)_offscreen_fences.size(), _offscreen_fences.data(), VK_TRUE, UINT64_MAX);
+			assert(!err);
+		}
+
+		for (size_t i = 0; i < _images.size(); i++) {
+			vkDestroyImage(_context.device, _images[i], NULL);
+			_context.allocator->free(_offscreen_memory[i]);
+			vkDestroyFence(_context.device, _offscreen_fences[i], NULL);
+		}
+
+		_images.clear();
+		_offscreen_memory.clear();
+		_offscreen_fences.clear();
+	}
+
+	void swapchain::submit_empty(VkSemaphore wait, VkSemaphore signal, VkFence fence) {
+		const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+		const VkSubmitInfo submit_info = {
+			VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			NULL,
+			wait != VK_NULL_HANDLE ? 1u : 0u,
+			&wait,
+			&wait_stage,
+			0,
+			NULL,
+			signal != VK_NULL_HANDLE ? 1u : 0u,
+			&signal
+		};
+
+		VkResult err;
+		if (_context.queue_mutex != nullptr) {
+			std::lock_guard<std::mutex> lock(*_context.queue_mutex);
+			err = vkQueueSubmit(_context.queue, 1, &submit_info, fence);
+		} else {
+			err = vkQueueSubmit(_context.queue, 1, &submit_info, fence);
+		}
+		assert(!err);
+	}
+
+	void swapchain::destroy_retired(VkSwapchainKHR retired) {
+		if (retired != VK_NULL_HANDLE) {
+			fpDestroySwapchainKHR(_context.device, retired, NULL);
+		}
+	}
+
+	void swapchain::note_status(VkResult err) {
+		if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+			// The surface changed under us (e.g. the window was resized).
+			_stats.out_of_date++;
+			_needs_recreate = true;
+		} else if (err == VK_SUBOPTIMAL_KHR) {
+			// The platform's presentation engine will still present the image
+			// correctly, but no longer matches the surface exactly.
+			_stats.suboptimal++;
+			_needs_recreate = true;
+		} else {
+			assert(!err);
+		}
+	}
+
+	swapchain_status swapchain::acquire(VkSemaphore image_acquired, uint32_t& image_index) {
+		if (headless()) {
+			image_index = _offscreen_next;
+			_offscreen_next = (_offscreen_next + 1) % get_image_count();
+
+			VkFence fence = _offscreen_fences[image_index];
+			VkResult err = vkWaitForFences(_context.device, 1, &fence, VK_TRUE, UINT64_MAX);
+			assert(!err);
+			err = vkResetFences(_context.device, 1, &fence);
+			assert(!err);
+
+			submit_empty(VK_NULL_HANDLE, image_acquired, VK_NULL_HANDLE);
+			return swapchain_status::ok;
+		}
+
+		VkResult err = fpAcquireNextImageKHR(_context.device, _swapchain, UINT64_MAX, image_acquired, (VkFence)0, &image_index);
+		note_status(err);
+
+		if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+			return swapchain_status::out_of_date;
+		}
+		return err == VK_SUBOPTIMAL_KHR ? swapchain_status::suboptimal : swapchain_status::ok;
+	}
+
+	swapchain_status swapchain::present(VkSemaphore wait, uint32_t image_index) {
+		if (headless()) {
+			submit_empty(wait, VK_NULL_HANDLE, _offscreen_fences[image_index]);
+			note_present();
+			return swapchain_status::ok;
+		}
+
+		VkPresentInfoKHR present_info = {
+			VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+			NULL,
+			1,
+			&wait,
+			1,
+			&_swapchain,
+			&image_index,
+			NULL
+		};
+
+		VkResult err;
+		if (_context.queue_mutex != nullptr) {
+			std::lock_guard<std::mutex> lock(*_context.queue_mutex);
+			err = fpQueuePresentKHR(_context.queue, &present_info);
+		} else {
+			err = fpQueuePresentKHR(_context.queue, &present_info);
+		}
+		note_status(err);
+
+		if (err == VK_ERROR_OUT_OF_DATE_KHR) {
+			return swapchain_status::out_of_date;
+		}
+
+		note_present();
+
+		return err == VK_SUBOPTIMAL_KHR ? swapchain_status::suboptimal : swapchain_status::ok;
+	}
+
+	void swapchain::note_present() {
+		_stats.presents++;
+
+		auto now = std::chrono::high_resolution_clock::now();
+		if (_has_last_present) {
+			_intervals[_interval_next % present_stats_window] = std::chrono::duration<double, std::milli>(now - _last_present).count();
+			_interval_next++;
+		}
+		_last_present = now;
+		_has_last_present = true;
+	}
+
+	present_stats swapchain::get_stats() const {
+		present_stats stats = _stats;
+		stats.present_mode = _present_mode;
+		stats.image_count = get_image_count();
+
+		const uint32_t count = (std::min)(_interval_next, present_stats_window);
+		if (count > 0) {
+			double total = 0.0;
+			stats.interval_min_ms = _intervals[0];
+			stats.interval_max_ms = _intervals[0];
+			for (uint32_t i = 0; i < count; i++) {
+				total += _intervals[i];
+				stats.interval_min_ms = (std::min)(stats.interval_min_ms, _intervals[i]);
+				stats.interval_max_ms = (std::max)(stats.interval_max_ms, _intervals[i]);
+			}
+			stats.interval_ms = total / count;
+		}
+		return stats;
+	}
+
+}
@@ -1,26 +1,219 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <chrono>
+#include <mutex>
 #include <tuple>
+#include <vector>
+
+#include "vulkan_allocator.hpp"
 
 namespace vulkan {
+
+	// What the swapchain needs from the wrapper. queue_mutex, when set, is held
+	// around every present since the queue is shared with other submitters.
+	// Without a surface the swapchain is headless, and its images come from
+	// allocator instead.
+	struct swapchain_context {
+		VkInstance instance = VK_NULL_HANDLE;
+		VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+		VkDevice device = VK_NULL_HANDLE;
+		VkSurfaceKHR surface = VK_NULL_HANDLE;
+		VkQueue queue = VK_NULL_HANDLE;
+		std::mutex * queue_mutex = nullptr;
+		memory_allocator * allocator = nullptr;
+
+		VkFormat format = VK_FORMAT_B8G8R8A8_UNORM;
+		VkColorSpaceKHR color_space = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+	};
+
+	// Latency against throughput. The first present mode in the list that the
+	// surface supports is used, falling back to FIFO, which always is. Images
+	// are requested on top of the surface's minimum, clamped to its maximum;
+	// frames_in_flight is how far the CPU may run ahead of the GPU, which the
+	// wrapper sizes its frame ring from.
+	struct swapchain_policy {
+		std::vector<VkPresentModeKHR> present_modes;
+		uint32_t extra_images = 1;
+		uint32_t frames_in_flight = 2;
+
+		// Newest frame wins, CPU at most one frame ahead.
+		static swapchain_policy low_latency() {
+			swapchain_policy policy;
+			policy.present_modes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+			policy.extra_images = 1;
+			policy.frames_in_flight = 1;
+			return policy;
+		}
+
+		// Mailbox, else immediate, one spare image; what the demo always did.
+		static swapchain_policy balanced() {
+			swapchain_policy policy;
+			policy.present_modes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+			policy.extra_images = 1;
+			policy.frames_in_flight = 2;
+			return policy;
+		}
+
+		// Never wait on the display; deeper queue so the GPU is never starved.
+		static swapchain_policy throughput() {
+			swapchain_policy policy;
+			policy.present_modes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+			policy.extra_images = 2;
+			policy.frames_in_flight = 3;
+			return policy;
+		}
+
+		// Tear-free and paced to the display.
+		static swapchain_policy vsync() {
+			swapchain_policy policy;
+			policy.present_modes = { VK_PRESENT_MODE_FIFO_KHR };
+			policy.extra_images = 1;
+			policy.frames_in_flight = 2;
+			return policy;
+		}
+	};
+
+	enum class swapchain_status {
+		ok,
+		suboptimal,		// the image is still usable, but recreate when convenient
+		out_of_date,	// nothing was acquired or presented; recreate first
+	};
+
+	// Intervals are between successive successful presents as seen by the CPU,
+	// over the last present_stats_window presents.
+	struct present_stats {
+		uint64_t presents = 0;
+		uint32_t suboptimal = 0;
+		uint32_t out_of_date = 0;
+		uint32_t recreated = 0;
+
+		VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		uint32_t image_count = 0;
+
+		double interval_ms = 0.0;
+		double interval_min_ms = 0.0;
+		double interval_max_ms = 0.0;
+	};
+
+	const uint32_t present_stats_window = 120;
+
+	// Headless image count before the policy's extra_images; stands in for a
+	// surface's minImageCount.
+	const uint32_t headless_min_images = 2;
+
+	const char * present_mode_name(VkPresentModeKHR mode);
+
+	// Owns the VkSwapchainKHR and its images, picks the present mode and image
+	// count from a policy, and wraps acquire and present. Neither recreates
+	// anything itself: they report what happened and raise needs_recreate,
+	// and the owner rebuilds at a point where that is safe. Render thread only.
+	//
+	// Headless, the images are plain offscreen images handed out round-robin.
+	// Acquire waits on the image's fence and signals the semaphore with an
+	// empty submit; present waits on the rendering with another that signals
+	// the fence, so an image is never handed out while still being drawn.
 	class swapchain {
 	public:
-		swapchain(VkDevice vulkan_device);
+		swapchain() {}
 		~swapchain();
 
-		void init();
+		void init(const swapchain_context& context, const swapchain_policy& policy);
+		void destroy();
+
+		// Takes effect from the next create.
+		void set_policy(const swapchain_policy& policy) {
+			_policy = policy;
+		}
+
+		const swapchain_policy& get_policy() const {
+			return _policy;
+		}
+
+		// (Re)creates the swapchain; width and height are only used when the
+		// surface leaves the size up to us. Returns the previous swapchain, if
+		// any, which is retired but may still be presenting: hand it to
+		// destroy_retired once the frames that used it are done.
+		VkSwapchainKHR create(uint32_t width, uint32_t height);
+		void destroy_retired(VkSwapchainKHR retired);
+
+		swapchain_status acquire(VkSemaphore image_acquired, uint32_t& image_index);
+		swapchain_status present(VkSemaphore wait, uint32_t image_index);
+
+		bool needs_recreate() const {
+			return _needs_recreate;
+		}
+
+		bool headless() const {
+			return _context.surface == VK_NULL_HANDLE;
+		}
+
+		// What images are left in once rendered: ready for the presentation
+		// engine, or headless for copying out.
+		VkImageLayout get_present_layout() const {
+			return headless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		}
+
+		VkSwapchainKHR get_handle() const {
+			return _swapchain;
+		}
+
+		const std::vector<VkImage>& get_images() const {
+			return _images;
+		}
+
+		uint32_t get_image_count() const {
+			return (uint32_t)_images.size();
+		}
+
+		VkPresentModeKHR get_present_mode() const {
+			return _present_mode;
+		}
 
 		std::pair<uint32_t, uint32_t> get_surface_dimensions() const {
 			return{ _width, _height };
 		}
 
+		present_stats get_stats() const;
+
 	private:
-		VkDevice _vulkan_device;
+		void note_status(VkResult err);
+		void note_present();
+		void note_recreate();
+
+		void create_offscreen(uint32_t width, uint32_t height);
+		void destroy_offscreen();
+		void submit_empty(VkSemaphore wait, VkSemaphore signal, VkFence fence);
+
+		swapchain_context _context;
+		swapchain_policy _policy;
+
 		VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
+		std::vector<VkImage> _images;
+		VkPresentModeKHR _present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		bool _needs_recreate = false;
 
 		uint32_t _width = 1, _height = 1;
 
+		// Headless only.
+		std::vector<memory_allocation> _offscreen_memory;
+		std::vector<VkFence> _offscreen_fences;		// signalled once the image's last frame is done
+		uint32_t _offscreen_next = 0;
+
+		present_stats _stats;
+		std::chrono::high_resolution_clock::time_point _last_present;
+		bool _has_last_present = false;
+		std::vector<double> _intervals;		// ring of present_stats_window
+		uint32_t _interval_next = 0;
+
+		PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR fpGetPhysicalDeviceSurfaceCapabilitiesKHR = nullptr;
+		PFN_vkGetPhysicalDeviceSurfacePresentModesKHR fpGetPhysicalDeviceSurfacePresentModesKHR = nullptr;
+
+		PFN_vkCreateSwapchainKHR fpCreateSwapchainKHR = nullptr;
+		PFN_vkDestroySwapchainKHR fpDestroySwapchainKHR = nullptr;
+		PFN_vkGetSwapchainImagesKHR fpGetSwapchainImagesKHR = nullptr;
+		PFN_vkAcquireNextImageKHR fpAcquireNextImageKHR = nullptr;
+		PFN_vkQueuePresentKHR fpQueuePresentKHR = nullptr;
 	};
 
-}
\ No newline at end of file
+}
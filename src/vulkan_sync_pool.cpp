@@ -0,0 +1,126 @@
+
+#include <assert.h>
+#include <algorithm>
+
+#include "vulkan_sync_pool.hpp"
+
+namespace vulkan {
+
+	sync_pool::~sync_pool() {
+		destroy();
+	}
+
+	void sync_pool::init(VkDevice vulkan_device) {
+		_vulkan_device = vulkan_device;
+	}
+
+	void sync_pool::destroy() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_vulkan_device == VK_NULL_HANDLE) {
+			return;
+		}
+
+		// Anything still checked out is the owner's responsibility.
+		for (auto semaphore : _free_semaphores) {
+			vkDestroySemaphore(_vulkan_device, semaphore, NULL);
+		}
+		_free_semaphores.clear();
+
+		for (auto fence : _free_fences) {
+			vkDestroyFence(_vulkan_device, fence, NULL);
+		}
+		_free_fences.clear();
+
+		_vulkan_device = VK_NULL_HANDLE;
+	}
+
+	VkSemaphore sync_pool::acquire_semaphore() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+
+		if (_free_semaphores.size() > 0) {
+			semaphore = _free_semaphores.back();
+			_free_semaphores.pop_back();
+		} else {
+			const VkSemaphoreCreateInfo semaphore_create_info = {
+				VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+				NULL,
+				0,
+			};
+
+			VkResult err = vkCreateSemaphore(_vulkan_device, &semaphore_create_info, NULL, &semaphore);
+			assert(!err);
+
+			_stats.semaphores_created++;
+		}
+
+		_semaphores_in_use++;
+		_stats.semaphores_high_water = std::max(_stats.semaphores_high_water, _semaphores_in_use);
+		_stats.semaphores_free = _free_semaphores.size();
+
+		return semaphore;
+	}
+
+	void sync_pool::release_semaphore(VkSemaphore semaphore) {
+		if (semaphore == VK_NULL_HANDLE) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		assert(_semaphores_in_use > 0);
+		_semaphores_in_use--;
+
+		_free_semaphores.push_back(semaphore);
+		_stats.semaphores_free = _free_semaphores.size();
+	}
+
+	VkFence sync_pool::acquire_fence() {
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		VkFence fence = VK_NULL_HANDLE;
+
+		if (_free_fences.size() > 0) {
+			fence = _free_fences.back();
+			_free_fences.pop_back();
+		} else {
+			const VkFenceCreateInfo fence_create_info = {
+				VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+				NULL,
+				0,
+			};
+
+			VkResult err = vkCreateFence(_vulkan_device, &fence_create_info, NULL, &fence);
+			assert(!err);
+
+			_stats.fences_created++;
+		}
+
+		_fences_in_use++;
+		_stats.fences_high_water = std::max(_stats.fences_high_water, _fences_in_use);
+		_stats.fences_free = _free_fences.size();
+
+		return fence;
+	}
+
+	void sync_pool::release_fence(VkFence fence) {
+		if (fence == VK_NULL_HANDLE) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		assert(_fences_in_use > 0);
+		_fences_in_use--;
+
+		// Reset on the way in so acquire_fence never has to.
+		VkResult err = vkResetFences(_vulkan_device, 1, &fence);
+		assert(!err);
+
+		_free_fences.push_back(fence);
+		_stats.fences_free = _free_fences.size();
+	}
+
+}
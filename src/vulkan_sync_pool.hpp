@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <vector>
+
+namespace vulkan {
+
+	struct sync_pool_stats {
+		size_t semaphores_created = 0;
+		size_t semaphores_free = 0;
+		size_t semaphores_high_water = 0;
+
+		size_t fences_created = 0;
+		size_t fences_free = 0;
+		size_t fences_high_water = 0;
+	};
+
+	// Recycles semaphores and fences instead of creating and destroying them
+	// every frame. Objects must only be released once the GPU work that used
+	// them has retired (i.e. the fence guarding that work has signalled).
+	// Safe to share between the render loop and the streaming thread.
+	class sync_pool {
+	public:
+		sync_pool() {}
+		~sync_pool();
+
+		void init(VkDevice vulkan_device);
+		void destroy();
+
+		VkSemaphore acquire_semaphore();
+		void release_semaphore(VkSemaphore semaphore);
+
+		// Fences are always handed out unsignalled.
+		VkFence acquire_fence();
+		void release_fence(VkFence fence);
+
+		sync_pool_stats get_stats() const {
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _stats;
+		}
+
+	private:
+		VkDevice _vulkan_device = VK_NULL_HANDLE;
+
+		std::vector<VkSemaphore> _free_semaphores;
+		std::vector<VkFence> _free_fences;
+
+		size_t _semaphores_in_use = 0;
+		size_t _fences_in_use = 0;
+
+		sync_pool_stats _stats;
+
+		mutable std::mutex _mutex;
+	};
+
+}
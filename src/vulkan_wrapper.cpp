@@ -1,22 +1,80 @@
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 // #define VK_PROTOTYPES
 
 #include <iostream>
 #include <vector>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <tuple>
+#include <algorithm>
 #include <assert.h>
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_sdk_platform.h>
 
 
+#include "cpu_profiler.hpp"
+#include "ktx2.hpp"
 #include "pngReader.hpp"
 #include "vulkan_wrapper.hpp"
 
 namespace vulkan {
 
+	// Front of every instance ring slice. The draw command feeds the CPU path;
+	// the rest is read by shaders/cull.comp, which declares the same layout.
+	struct instance_slice_header {
+		VkDispatchIndirectCommand dispatch;
+		uint32_t count;
+		float radius;
+		uint32_t pad[3];
+		float planes[6][4];
+	};
+
+	static_assert(sizeof(instance_slice_header) == 128, "instance_slice_header must match shaders/cull.comp");
+
+	// Visible instances start this far into each cull output slice, after the
+	// draw command the cull pass fills in.
+	static const VkDeviceSize cull_output_data_offset = 64;
+
+	static const uint32_t cull_group_size = 64;
+
+	// Upper bound for the anisotropic preset, below whatever the device allows.
+	static const float texture_max_anisotropy = 16.0f;
+
+	// Decodes a PNG to RGBA8, or on failure reports it and hands back a single
+	// magenta texel, so the texture is still a valid image to create, upload
+	// and sample, and the missing file is obvious on screen.
+	static std::shared_ptr<uint8_t> load_png_or_placeholder(const char * filename, uint32_t& width, uint32_t& height) {
+		try {
+			return load_image::png(filename, width, height);
+		} catch (std::exception& e) {
+			std::cerr << "Failed to load textures: " << e.what() << std::endl;
+		}
+
+		width = 1;
+		height = 1;
+		std::shared_ptr<uint8_t> placeholder(new uint8_t[4], std::default_delete<uint8_t[]>());
+		placeholder.get()[0] = 255;
+		placeholder.get()[1] = 0;
+		placeholder.get()[2] = 255;
+		placeholder.get()[3] = 255;
+		return placeholder;
+	}
+
+	const char * sampler_filter_name(sampler_filter filter) {
+		switch (filter) {
+		case sampler_filter::nearest: return "nearest";
+		case sampler_filter::bilinear: return "bilinear";
+		case sampler_filter::trilinear: return "trilinear";
+		case sampler_filter::anisotropic: return "anisotropic";
+		}
+		return "unknown";
+	}
 
 	static VkBool32 demo_check_layers(uint32_t check_count, char **check_names, uint32_t layer_count, VkLayerProperties *layers) {
 		for (uint32_t i = 0; i < check_count; i++) {
@@ -51,60 +109,217 @@ namespace vulkan {
 		return false;
 	}
 
-	std::pair<VkDeviceMemory, VkMemoryAllocateInfo> wrapper::allocate_image_memory(VkImage image, VkFlags required_properties) {
+	memory_allocation wrapper::allocate_image_memory(VkImage image, VkFlags required_properties, VkImageTiling tiling) {
 		VkMemoryRequirements memory_requirements;
 
 		vkGetImageMemoryRequirements(_vulkan_device, image, &memory_requirements);
 
-		VkMemoryAllocateInfo memory_allocation_info;
-		memory_allocation_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memory_allocation_info.pNext = NULL;
-		memory_allocation_info.allocationSize = memory_requirements.size;
-		memory_allocation_info.memoryTypeIndex = 0;
-
-		bool pass = memory_type_from_properties(memory_requirements.memoryTypeBits, required_properties, &memory_allocation_info.memoryTypeIndex);
-		assert(pass);
-
-		/* allocate memory */
-		VkDeviceMemory device_memory;
-		VkResult err = vkAllocateMemory(_vulkan_device, &memory_allocation_info, NULL, &device_memory);
-		assert(!err);
+		/* sub-allocate memory */
+		auto allocation = _allocator.allocate(memory_requirements, required_properties, tiling == VK_IMAGE_TILING_LINEAR ? resource_kind::linear : resource_kind::optimal);
 
 		/* bind memory */
-		err = vkBindImageMemory(_vulkan_device, image, device_memory, 0);
+		VkResult err = vkBindImageMemory(_vulkan_device, image, allocation.device_memory, allocation.offset);
 		assert(!err);
 
-		return { device_memory, memory_allocation_info };
+		return allocation;
 	}
 
-	std::pair<VkDeviceMemory, VkMemoryAllocateInfo> wrapper::allocate_buffer_memory(VkBuffer buffer, VkFlags required_properties) {
+	memory_allocation wrapper::allocate_buffer_memory(VkBuffer buffer, VkFlags required_properties) {
 		VkMemoryRequirements memory_requirements;
 
 		vkGetBufferMemoryRequirements(_vulkan_device, buffer, &memory_requirements);
 
-		VkMemoryAllocateInfo memory_allocation_info;
-		memory_allocation_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memory_allocation_info.pNext = NULL;
-		memory_allocation_info.allocationSize = memory_requirements.size;
-		memory_allocation_info.memoryTypeIndex = 0;
+		/* sub-allocate memory */
+		auto allocation = _allocator.allocate(memory_requirements, required_properties, resource_kind::linear);
+
+		/* bind memory */
+		VkResult err = vkBindBufferMemory(_vulkan_device, buffer, allocation.device_memory, allocation.offset);
+		assert(!err);
+
+		return allocation;
+	}
+
+	vulkan_buffer wrapper::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkFlags required_properties) {
+		vulkan_buffer return_buffer;
 
-		bool pass = memory_type_from_properties(memory_requirements.memoryTypeBits, required_properties, &memory_allocation_info.memoryTypeIndex);
-		assert(pass);
+		VkBufferCreateInfo buffer_create_info;
+		memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+
+		buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.usage = usage;
+		buffer_create_info.size = size;
 
-		/* allocate memory */
-		VkDeviceMemory device_memory;
-		VkResult err = vkAllocateMemory(_vulkan_device, &memory_allocation_info, NULL, &device_memory);
+		VkResult err = vkCreateBuffer(_vulkan_device, &buffer_create_info, NULL, &return_buffer.buffer);
 		assert(!err);
 
-		/* bind memory */
-		err = vkBindBufferMemory(_vulkan_device, buffer, device_memory, 0);
+		return_buffer.memory = allocate_buffer_memory(return_buffer.buffer, required_properties);
+
+		return_buffer.info.buffer = return_buffer.buffer;
+		return_buffer.info.offset = 0;
+		return_buffer.info.range = size;
+
+		return return_buffer;
+	}
+
+	void wrapper::destroy_buffer(vulkan_buffer& buffer) {
+		if (buffer.buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(_vulkan_device, buffer.buffer, NULL);
+			buffer.buffer = VK_NULL_HANDLE;
+		}
+
+		_allocator.free(buffer.memory);
+	}
+
+	vulkan_buffer wrapper::create_device_buffer(const void * data, VkDeviceSize size, VkBufferUsageFlags usage, vulkan_upload_batch& batch) {
+		vulkan_buffer buffer = create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		vulkan_buffer staging_buffer = create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		assert(staging_buffer.memory.mapped != nullptr);
+		memcpy(staging_buffer.memory.mapped, data, (size_t)size);
+
+		const VkBufferCopy copy_region = { 0, 0, size };
+		vkCmdCopyBuffer(batch.command_buffer, staging_buffer.buffer, buffer.buffer, 1, &copy_region);
+
+		const VkBufferMemoryBarrier buffer_memory_barrier = {
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			buffer_access_for_usage(usage),
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			buffer.buffer,
+			0,
+			VK_WHOLE_SIZE };
+
+		vkCmdPipelineBarrier(batch.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 1, &buffer_memory_barrier, 0, NULL);
+
+		add_staging(batch, staging_buffer);
+		batch.resource_count++;
+
+		return buffer;
+	}
+
+	vulkan_mesh wrapper::create_mesh(const std::vector<vulkan_vertex>& vertices, const std::vector<uint32_t>& indices, vulkan_upload_batch& batch) {
+		vulkan_mesh mesh;
+
+		mesh.vertices = create_device_buffer(vertices.data(), vertices.size() * sizeof(vulkan_vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, batch);
+		mesh.index_count = (uint32_t)indices.size();
+
+		// Half the index bandwidth whenever the mesh is small enough.
+		if (vertices.size() <= 0xffff) {
+			std::vector<uint16_t> short_indices(indices.begin(), indices.end());
+			mesh.index_type = VK_INDEX_TYPE_UINT16;
+			mesh.indices = create_device_buffer(short_indices.data(), short_indices.size() * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, batch);
+		} else {
+			mesh.index_type = VK_INDEX_TYPE_UINT32;
+			mesh.indices = create_device_buffer(indices.data(), indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, batch);
+		}
+
+		return mesh;
+	}
+
+	void wrapper::destroy_mesh(vulkan_mesh& mesh) {
+		destroy_buffer(mesh.vertices);
+		destroy_buffer(mesh.indices);
+		mesh.index_count = 0;
+	}
+
+	vulkan_uniform_ring wrapper::create_uniform_ring(VkDeviceSize slice_size, uint32_t slice_count, VkBufferUsageFlags usage) {
+		VkResult err;
+		vulkan_uniform_ring ring;
+
+		// Slices must be valid dynamic offsets, and when we have to flush by hand
+		// they must not share a nonCoherentAtomSize block with their neighbours.
+		VkDeviceSize alignment = _device_properties.limits.minUniformBufferOffsetAlignment;
+		if ((usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) && _device_properties.limits.minStorageBufferOffsetAlignment > alignment) {
+			alignment = _device_properties.limits.minStorageBufferOffsetAlignment;
+		}
+		if (_device_properties.limits.nonCoherentAtomSize > alignment) {
+			alignment = _device_properties.limits.nonCoherentAtomSize;
+		}
+
+		ring.slice_size = slice_size;
+		ring.slice_stride = slice_size;
+		if (alignment > 0) {
+			ring.slice_stride = (slice_size + alignment - 1) & ~(alignment - 1);
+		}
+		ring.slice_count = slice_count;
+
+		VkBufferCreateInfo buffer_create_info;
+		memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+
+		buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.usage = usage;
+		buffer_create_info.size = ring.slice_stride * slice_count;
+
+		err = vkCreateBuffer(_vulkan_device, &buffer_create_info, NULL, &ring.buffer.buffer);
 		assert(!err);
 
-		return{ device_memory, memory_allocation_info };
+		// Prefer coherent memory so a write is just a memcpy; otherwise settle
+		// for any host-visible type and flush explicitly.
+		VkMemoryRequirements memory_requirements;
+		vkGetBufferMemoryRequirements(_vulkan_device, ring.buffer.buffer, &memory_requirements);
+
+		uint32_t type_index = 0;
+		VkFlags required_properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		if (!memory_type_from_properties(memory_requirements.memoryTypeBits, required_properties, &type_index)) {
+			required_properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		}
+
+		ring.buffer.memory = allocate_buffer_memory(ring.buffer.buffer, required_properties);
+		ring.coherent = _allocator.is_coherent(ring.buffer.memory);
+
+		// Host-visible allocations come back persistently mapped.
+		ring.mapped = ring.buffer.memory.mapped;
+		assert(ring.mapped != nullptr);
+
+		ring.buffer.info.buffer = ring.buffer.buffer;
+		ring.buffer.info.offset = 0;
+		ring.buffer.info.range = slice_size;
+
+		return ring;
+	}
+
+	void wrapper::write_uniform_ring(vulkan_uniform_ring& ring, uint32_t slice, VkDeviceSize offset, const void * data, VkDeviceSize size) {
+		assert(slice < ring.slice_count);
+		assert(offset + size <= ring.slice_size);
+
+		memcpy(ring.mapped + ring.get_offset(slice) + offset, data, (size_t)size);
+
+		flush_uniform_ring(ring, slice);
+	}
+
+	void wrapper::flush_uniform_ring(vulkan_uniform_ring& ring, uint32_t slice) {
+		if (!ring.coherent) {
+			// slice_stride is a multiple of nonCoherentAtomSize and the allocator
+			// atom-aligns non-coherent allocations, so the whole slice is always
+			// a legal flush range.
+			const VkMappedMemoryRange range = {
+				VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+				NULL,
+				ring.buffer.memory.device_memory,
+				ring.buffer.memory.offset + ring.get_offset(slice),
+				ring.slice_stride,
+			};
+
+			VkResult err = vkFlushMappedMemoryRanges(_vulkan_device, 1, &range);
+			assert(!err);
+		}
 	}
 
+	void wrapper::destroy_uniform_ring(vulkan_uniform_ring& ring) {
+		ring.mapped = nullptr;
 
-	 void wrapper::set_image_layout(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout old_image_layout, VkImageLayout new_image_layout, VkAccessFlagBits srcAccessMask) {
+		vkDestroyBuffer(_vulkan_device, ring.buffer.buffer, NULL);
+		_allocator.free(ring.buffer.memory);
+	}
+
+
+	void wrapper::set_image_layout(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout old_image_layout, VkImageLayout new_image_layout, VkAccessFlagBits srcAccessMask) {
+		set_image_layout(_vulkan_command_buffer, image, aspectMask, old_image_layout, new_image_layout, srcAccessMask);
+	}
+
+	void wrapper::set_image_layout(VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags aspectMask, VkImageLayout old_image_layout, VkImageLayout new_image_layout, VkAccessFlagBits srcAccessMask) {
 		/*
 		typedef struct VkImageMemoryBarrier {
 			VkStructureType            sType;
@@ -129,11 +344,11 @@ namespace vulkan {
 			0,
 			0,
 			image,
-			{ aspectMask, 0, 1, 0, 1 } };
+			{ aspectMask, 0, VK_REMAINING_MIP_LEVELS, 0, 1 } };
 
 		if (new_image_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
 			/* Make sure anything that was copying from this image has completed */
-			image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		}
 
 		if (new_image_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
@@ -157,20 +372,87 @@ namespace vulkan {
 		VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 		VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 
-		vkCmdPipelineBarrier(_vulkan_command_buffer, src_stages, dst_stages, 0, 0, NULL, 0,
+		/* Copies into the image have to land before anyone samples it */
+		if (srcAccessMask & VK_ACCESS_TRANSFER_WRITE_BIT) {
+			src_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		} else if (srcAccessMask & VK_ACCESS_HOST_WRITE_BIT) {
+			src_stages = VK_PIPELINE_STAGE_HOST_BIT;
+		}
+
+		if (new_image_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+			dst_stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		} else if (new_image_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+			dst_stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		}
+
+		vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 0, NULL, 0,
 			NULL, 1, pmemory_barrier);
 	}
 
-	wrapper::wrapper(bool validate) : _validate(validate) {
-
+	wrapper::wrapper(bool validate, uint32_t frames_in_flight) : _validate(validate), _frames_in_flight(frames_in_flight) {
+		assert(_frames_in_flight >= 1);
 	}
 
 	wrapper::~wrapper() {
+		_pipeline_builder.finish();
+		_recording_group.finish();
+
+		// Swapchains, views, framebuffers and command buffers retired by
+		// resizes may still be queued; once the last frames are done with
+		// them nothing else will collect them.
+		if (_vulkan_device != VK_NULL_HANDLE) {
+			wait_frames_idle();
+			_deletion_queue.flush();
+
+			// Every buffer they handed out is either freed above or idle;
+			// destroying the pools frees the rest.
+			for (auto pool : _frame_command_pools) {
+				vkDestroyCommandPool(_vulkan_device, pool, NULL);
+			}
+			_frame_command_pools.clear();
+			for (auto pool : _recording_pools) {
+				vkDestroyCommandPool(_vulkan_device, pool, NULL);
+			}
+			_recording_pools.clear();
+		}
 
+		if (_pipeline_cache != VK_NULL_HANDLE && !_pipeline_cache_path.empty()) {
+			save_pipeline_cache(_vulkan_device, _pipeline_cache, _pipeline_cache_path, _pipeline_cache_stats);
+		}
 	}
 
+#ifdef _WIN32
 	void wrapper::init(HWND hw, HINSTANCE hi) {
+		init_device([hw, hi](VkInstance instance) {
+			// Create a WSI surface for the window:
+			VkWin32SurfaceCreateInfoKHR createInfo;
+			createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+			createInfo.pNext = NULL;
+			createInfo.flags = 0;
+			createInfo.hinstance = hi;
+			createInfo.hwnd = hw;
+
+			VkSurfaceKHR surface = VK_NULL_HANDLE;
+			VkResult err = vkCreateWin32SurfaceKHR(instance, &createInfo, NULL, &surface);
+			assert(!err);
+
+			return surface;
+		});
+	}
+#endif
+
+	void wrapper::init_headless(uint32_t width, uint32_t height) {
+		_surface_width = width > 0 ? width : 1;
+		_surface_height = height > 0 ? height : 1;
+		init_device(nullptr);
+	}
+
+	void wrapper::init_device(const std::function<VkSurfaceKHR(VkInstance)>& create_surface) {
 		VkResult err;
+
+		// Without a surface nothing is presented, so neither the surface nor the
+		// swapchain extensions are enabled, and any graphics queue will do.
+		_headless = !create_surface;
 		uint32_t instance_extension_count = 0;
 		uint32_t instance_layer_count = 0;
 		uint32_t validation_layer_count = 0;
@@ -240,22 +522,24 @@ namespace vulkan {
 			assert(!err);
 
 			for (uint32_t i = 0; i < instance_extension_count; i++) {
-				if (!strcmp(VK_KHR_SURFACE_EXTENSION_NAME,
+				if (_headless) {
+					// Only the debug report extension is wanted.
+				} else if (!strcmp(VK_KHR_SURFACE_EXTENSION_NAME,
 					instance_extensions[i].extensionName)) {
 					surfaceExtFound = 1;
 					enabledExtensionCount++;
 					extension_names.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 					//demo->extension_names[demo->enabled_extension_count++] = VK_KHR_SURFACE_EXTENSION_NAME;
 				}
-				//#if defined(VK_USE_PLATFORM_WIN32_KHR)
-				if (!strcmp(VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+				if (!_headless && !strcmp(VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
 					instance_extensions[i].extensionName)) {
 					platformSurfaceExtFound = 1;
 					enabledExtensionCount++;
 					extension_names.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 					//demo->extension_names[demo->enabled_extension_count++] = VK_KHR_WIN32_SURFACE_EXTENSION_NAME;
 				}
-				//#endif
+#endif
 				if (!strcmp(VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
 					instance_extensions[i].extensionName)) {
 					if (_validate) {
@@ -270,11 +554,11 @@ namespace vulkan {
 			free(instance_extensions);
 		}
 
-		if (!surfaceExtFound) {
+		if (!surfaceExtFound && !_headless) {
 			std::cerr << "vkEnumerateInstanceExtensionProperties failed to find the " VK_KHR_SURFACE_EXTENSION_NAME " extension." << std::endl;
 		}
 
-		if (!platformSurfaceExtFound) {
+		if (!platformSurfaceExtFound && !_headless) {
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 			std::cerr << "vkEnumerateInstanceExtensionProperties failed to find the " VK_KHR_WIN32_SURFACE_EXTENSION_NAME " extension." << std::endl;
 #endif
@@ -346,7 +630,6 @@ namespace vulkan {
 		VkInstance _vulkan_instance = nullptr;
 		//VkPhysicalDevice _vulkan_physical_device = nullptr;
 
-		VkPhysicalDeviceProperties vulkan_device_props;
 		uint32_t vulkan_device_count = 0;
 
 		err = vkCreateInstance(&instance_info, NULL, &_vulkan_instance);
@@ -390,7 +673,7 @@ namespace vulkan {
 			assert(!err);
 
 			for (uint32_t i = 0; i < device_extension_count; i++) {
-				if (!strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+				if (!_headless && !strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 					device_extensions[i].extensionName)) {
 					device_extension_names.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 					device_enabled_extension_count++;
@@ -401,7 +684,7 @@ namespace vulkan {
 			free(device_extensions);
 		}
 
-		if (device_extension_names.size() == 0) {
+		if (device_extension_names.size() == 0 && !_headless) {
 			std::cerr << "vkEnumerateDeviceExtensionProperties failed to find the " VK_KHR_SWAPCHAIN_EXTENSION_NAME " extension." << std::endl;
 		}
 
@@ -457,7 +740,7 @@ namespace vulkan {
 		}
 		*/
 
-		vkGetPhysicalDeviceProperties(_vulkan_physical_device, &vulkan_device_props);
+		vkGetPhysicalDeviceProperties(_vulkan_physical_device, &_device_properties);
 
 		uint32_t vulkan_device_queue_count = 0;
 
@@ -485,35 +768,24 @@ namespace vulkan {
 		vkGetPhysicalDeviceFeatures(_vulkan_physical_device, &physDevFeatures);
 
 
-		fpGetPhysicalDeviceSurfaceSupportKHR = (PFN_vkGetPhysicalDeviceSurfaceSupportKHR)vkGetInstanceProcAddr(_vulkan_instance, "vkGetPhysicalDeviceSurfaceSupportKHR");
-		fpGetPhysicalDeviceSurfaceCapabilitiesKHR = (PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR)vkGetInstanceProcAddr(_vulkan_instance, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
-		fpGetPhysicalDeviceSurfaceFormatsKHR = (PFN_vkGetPhysicalDeviceSurfaceFormatsKHR)vkGetInstanceProcAddr(_vulkan_instance, "vkGetPhysicalDeviceSurfaceFormatsKHR");
-		fpGetPhysicalDeviceSurfacePresentModesKHR = (PFN_vkGetPhysicalDeviceSurfacePresentModesKHR)vkGetInstanceProcAddr(_vulkan_instance, "vkGetPhysicalDeviceSurfacePresentModesKHR");
-		//auto fpGetSwapchainImagesKHR = (PFN_vkGetSwapchainImagesKHR)vkGetInstanceProcAddr(vulkan_instance, "vkGetSwapchainImagesKHR");
-
 		uint32_t i;
 
-		// Create a WSI surface for the window:
-		//#if defined(VK_USE_PLATFORM_WIN32_KHR)
-
-		VkWin32SurfaceCreateInfoKHR createInfo;
-		createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-		createInfo.pNext = NULL;
-		createInfo.flags = 0;
-		createInfo.hinstance = hi;
-		createInfo.hwnd = hw;
-
-		//VkSurfaceKHR _vulkan_surface = nullptr;
+		if (!_headless) {
+			fpGetPhysicalDeviceSurfaceSupportKHR = (PFN_vkGetPhysicalDeviceSurfaceSupportKHR)vkGetInstanceProcAddr(_vulkan_instance, "vkGetPhysicalDeviceSurfaceSupportKHR");
+			fpGetPhysicalDeviceSurfaceFormatsKHR = (PFN_vkGetPhysicalDeviceSurfaceFormatsKHR)vkGetInstanceProcAddr(_vulkan_instance, "vkGetPhysicalDeviceSurfaceFormatsKHR");
 
-		err = vkCreateWin32SurfaceKHR(_vulkan_instance, &createInfo, NULL, &_vulkan_surface);
-		//#endif
-
-		assert(!err);
+			_vulkan_surface = create_surface(_vulkan_instance);
+		}
 
-		// Iterate over each queue to learn whether it supports presenting:
+		// Iterate over each queue to learn whether it supports presenting; with
+		// no surface every queue "presents", since presenting is just a submit.
 		auto is_presentable_queue = (VkBool32 *)malloc(vulkan_device_queue_count * sizeof(VkBool32));
 		for (i = 0; i < vulkan_device_queue_count; i++) {
-			fpGetPhysicalDeviceSurfaceSupportKHR(_vulkan_physical_device, i, _vulkan_surface, &is_presentable_queue[i]);
+			if (_headless) {
+				is_presentable_queue[i] = VK_TRUE;
+			} else {
+				fpGetPhysicalDeviceSurfaceSupportKHR(_vulkan_physical_device, i, _vulkan_surface, &is_presentable_queue[i]);
+			}
 		}
 
 		// Search for a graphics and a present queue in the array of queue
@@ -522,9 +794,9 @@ namespace vulkan {
 		uint32_t graphics_queue_id = UINT32_MAX;
 		for (auto id : graphics_queue_ids) {
 			if ((vulkan_device_queue_properties[id].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0) {
-				if (is_presentable_queue[i] == VK_TRUE) {
-					presentable_queue_index = i;
-					graphics_queue_id = i;
+				if (is_presentable_queue[id] == VK_TRUE) {
+					presentable_queue_index = id;
+					graphics_queue_id = id;
 					break;
 				}
 			}
@@ -563,6 +835,37 @@ namespace vulkan {
 			std::cerr << "Could not find a common graphics and a present queue." << std::endl;
 		}
 
+		// Streaming uploads go to a transfer-only family (a DMA engine) if there
+		// is one, otherwise to an async compute family, otherwise they share the
+		// graphics queue.
+		uint32_t transfer_queue_id = graphics_queue_id;
+		for (uint32_t id = 0; id < vulkan_device_queue_count; id++) {
+			const VkQueueFlags flags = vulkan_device_queue_properties[id].queueFlags;
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				transfer_queue_id = id;
+				break;
+			}
+		}
+		if (transfer_queue_id == graphics_queue_id) {
+			for (uint32_t id = 0; id < vulkan_device_queue_count; id++) {
+				const VkQueueFlags flags = vulkan_device_queue_properties[id].queueFlags;
+				if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+					transfer_queue_id = id;
+					break;
+				}
+			}
+		}
+
+		if (graphics_queue_id != UINT32_MAX) {
+			_graphics_queue_compute = (vulkan_device_queue_properties[graphics_queue_id].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+			_graphics_timestamp_bits = vulkan_device_queue_properties[graphics_queue_id].timestampValidBits;
+		}
+
+		free(vulkan_device_queue_properties);
+
+		_graphics_queue_family = graphics_queue_id;
+		_transfer_queue_family = transfer_queue_id;
+
 		// CREATE DEVICE
 
 		float queue_priorities[1] = { 0.0 };
@@ -578,13 +881,24 @@ namespace vulkan {
 		} VkDeviceQueueCreateInfo;
 		*/
 
-		const VkDeviceQueueCreateInfo vulkan_queue_create_info = {
-			VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-			NULL,
-			0,
-			graphics_queue_id,
-			1,
-			queue_priorities };
+		const VkDeviceQueueCreateInfo vulkan_queue_create_info[2] = {
+			{
+				VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+				NULL,
+				0,
+				graphics_queue_id,
+				1,
+				queue_priorities
+			},
+			{
+				VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+				NULL,
+				0,
+				transfer_queue_id,
+				1,
+				queue_priorities
+			},
+		};
 
 		/*
 		typedef struct VkDeviceCreateInfo {
@@ -601,17 +915,47 @@ namespace vulkan {
 		} VkDeviceCreateInfo;
 		*/
 
+		VkPhysicalDeviceFeatures enabled_features = {};
+		if (_gpu_pipeline_statistics) {
+			if (physDevFeatures.pipelineStatisticsQuery) {
+				enabled_features.pipelineStatisticsQuery = VK_TRUE;
+			} else {
+				std::cerr << "Pipeline statistics queries are not supported; not counting invocations." << std::endl;
+				_gpu_pipeline_statistics = false;
+			}
+		}
+
+		if (_texture_filter == sampler_filter::anisotropic) {
+			if (physDevFeatures.samplerAnisotropy) {
+				enabled_features.samplerAnisotropy = VK_TRUE;
+				_max_anisotropy = (std::min)(texture_max_anisotropy, _device_properties.limits.maxSamplerAnisotropy);
+			} else {
+				std::cerr << "Anisotropic filtering is not supported; sampling trilinear." << std::endl;
+				_texture_filter = sampler_filter::trilinear;
+			}
+		}
+
+		if (_compressed_textures) {
+			_texture_compression_bc = physDevFeatures.textureCompressionBC == VK_TRUE;
+			_texture_compression_etc2 = physDevFeatures.textureCompressionETC2 == VK_TRUE;
+			enabled_features.textureCompressionBC = physDevFeatures.textureCompressionBC;
+			enabled_features.textureCompressionETC2 = physDevFeatures.textureCompressionETC2;
+			if (!_texture_compression_bc && !_texture_compression_etc2) {
+				std::cerr << "Neither BC nor ETC2 textures are supported; loading PNGs." << std::endl;
+			}
+		}
+
 		VkDeviceCreateInfo vulkan_device_create_info = {
 			VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
 			NULL,
 			0,
-			1,
-			&vulkan_queue_create_info,
+			transfer_queue_id != graphics_queue_id ? 2u : 1u,
+			vulkan_queue_create_info,
 			0,
 			NULL,
 			device_enabled_extension_count,
 			(const char * const *)device_extension_names.data(),
-			NULL, // If specific features are required, pass them in here
+			&enabled_features,
 		};
 
 		//VkDevice _vulkan_device = nullptr;
@@ -619,46 +963,53 @@ namespace vulkan {
 		err = vkCreateDevice(_vulkan_physical_device, &vulkan_device_create_info, NULL, &_vulkan_device);
 		assert(!err);
 
-		fpGetDeviceProcAddr = (PFN_vkGetDeviceProcAddr)vkGetInstanceProcAddr(_vulkan_instance, "vkGetDeviceProcAddr");
-
-		fpCreateSwapchainKHR = (PFN_vkCreateSwapchainKHR)fpGetDeviceProcAddr(_vulkan_device, "vkCreateSwapchainKHR");
-		fpDestroySwapchainKHR = (PFN_vkDestroySwapchainKHR)fpGetDeviceProcAddr(_vulkan_device, "vkDestroySwapchainKHR");
-		fpGetSwapchainImagesKHR = (PFN_vkGetSwapchainImagesKHR)fpGetDeviceProcAddr(_vulkan_device, "vkGetSwapchainImagesKHR"); // ???
-		fpAcquireNextImageKHR = (PFN_vkAcquireNextImageKHR)fpGetDeviceProcAddr(_vulkan_device, "vkAcquireNextImageKHR");
-		fpQueuePresentKHR = (PFN_vkQueuePresentKHR)fpGetDeviceProcAddr(_vulkan_device, "vkQueuePresentKHR");
-
 		//VkQueue _vulkan_queue = nullptr;
 		vkGetDeviceQueue(_vulkan_device, graphics_queue_id, 0, &_vulkan_queue);
 
-		// Get the list of VkFormat's that are supported:
-		uint32_t surface_format_count;
-		err = fpGetPhysicalDeviceSurfaceFormatsKHR(_vulkan_physical_device, _vulkan_surface, &surface_format_count, NULL);
-		assert(!err);
+		if (transfer_queue_id != graphics_queue_id) {
+			vkGetDeviceQueue(_vulkan_device, transfer_queue_id, 0, &_transfer_queue);
+		} else {
+			_transfer_queue = _vulkan_queue;
+		}
 
-		//auto surface_formats = (VkSurfaceFormatKHR *)malloc(surface_format_count * sizeof(VkSurfaceFormatKHR));
-		std::vector<VkSurfaceFormatKHR> surface_formats(surface_format_count);
-		err = fpGetPhysicalDeviceSurfaceFormatsKHR(_vulkan_physical_device, _vulkan_surface, &surface_format_count, surface_formats.data());
+		if (_headless) {
+			// Offscreen images; B8G8R8A8 is a mandatory colour attachment format.
+			_vulkan_format = VK_FORMAT_B8G8R8A8_UNORM;
+			_vulkan_colorspace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+		} else {
+			// Get the list of VkFormat's that are supported:
+			uint32_t surface_format_count;
+			err = fpGetPhysicalDeviceSurfaceFormatsKHR(_vulkan_physical_device, _vulkan_surface, &surface_format_count, NULL);
+			assert(!err);
 
-		assert(!err);
+			//auto surface_formats = (VkSurfaceFormatKHR *)malloc(surface_format_count * sizeof(VkSurfaceFormatKHR));
+			std::vector<VkSurfaceFormatKHR> surface_formats(surface_format_count);
+			err = fpGetPhysicalDeviceSurfaceFormatsKHR(_vulkan_physical_device, _vulkan_surface, &surface_format_count, surface_formats.data());
 
-		// If the format list includes just one entry of VK_FORMAT_UNDEFINED,
-		// the surface has no preferred format.  Otherwise, at least one
-		// supported format will be returned.
+			assert(!err);
 
-		//VkFormat _vulkan_format;
+			// If the format list includes just one entry of VK_FORMAT_UNDEFINED,
+			// the surface has no preferred format.  Otherwise, at least one
+			// supported format will be returned.
 
-		if (surface_format_count == 1 && surface_formats[0].format == VK_FORMAT_UNDEFINED) {
-			_vulkan_format = VK_FORMAT_B8G8R8A8_UNORM;
-		} else {
-			assert(surface_format_count >= 1);
-			_vulkan_format = surface_formats[0].format;
+			//VkFormat _vulkan_format;
+
+			if (surface_format_count == 1 && surface_formats[0].format == VK_FORMAT_UNDEFINED) {
+				_vulkan_format = VK_FORMAT_B8G8R8A8_UNORM;
+			} else {
+				assert(surface_format_count >= 1);
+				_vulkan_format = surface_formats[0].format;
+			}
+			/*VkColorSpaceKHR*/ _vulkan_colorspace = surface_formats[0].colorSpace;
 		}
-		/*VkColorSpaceKHR*/ _vulkan_colorspace = surface_formats[0].colorSpace;
 
 		// Get Memory information and properties
 		//VkPhysicalDeviceMemoryProperties memory_properties;
 		vkGetPhysicalDeviceMemoryProperties(_vulkan_physical_device, &_device_memory_properties);
 
+		_allocator.init(_vulkan_physical_device, _vulkan_device);
+		_shaders.init(_vulkan_device);
+
 
 		// PREPARE ??? 
 		/*
@@ -673,14 +1024,59 @@ typedef struct VkCommandPoolCreateInfo {
 		const VkCommandPoolCreateInfo command_pool_create_info = {
 			VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 			NULL,
-			graphics_queue_id,
 			0,
+			graphics_queue_id,
 		};
 
 		//VkCommandPool _vulkan_command_pool = nullptr;
 		err = vkCreateCommandPool(_vulkan_device, &command_pool_create_info, NULL, &_vulkan_command_pool);
 		assert(!err);
 
+		create_frames();
+
+		if (_gpu_timestamps || _gpu_pipeline_statistics) {
+			gpu_profiler_context profiler_context;
+			profiler_context.device = _vulkan_device;
+			profiler_context.frames = _frames_in_flight;
+			profiler_context.timestamp_period = _device_properties.limits.timestampPeriod;
+			profiler_context.timestamp_bits = _gpu_timestamps ? _graphics_timestamp_bits : 0;
+			profiler_context.pipeline_statistics = _gpu_pipeline_statistics;
+
+			if (_gpu_timestamps && _graphics_timestamp_bits == 0) {
+				std::cerr << "The graphics queue does not support timestamps; not timing passes." << std::endl;
+			}
+
+			_gpu_profiler.init(profiler_context);
+		}
+
+		streamer_context stream_context;
+		stream_context.device = _vulkan_device;
+		stream_context.queue = _transfer_queue;
+		stream_context.queue_family = _transfer_queue_family;
+		stream_context.graphics_queue_family = _graphics_queue_family;
+		stream_context.queue_mutex = _transfer_queue == _vulkan_queue ? &_queue_mutex : nullptr;
+		stream_context.allocator = &_allocator;
+		stream_context.sync = &_sync_pool;
+
+		_texture_decoder.init(_decode_threads);
+		stream_context.decoder = &_texture_decoder;
+		stream_context.max_decodes_ahead = 2 * _texture_decoder.get_stats().threads;
+
+		_streamer.init(stream_context);
+
+		swapchain_context present_context;
+		present_context.instance = _vulkan_instance;
+		present_context.physical_device = _vulkan_physical_device;
+		present_context.device = _vulkan_device;
+		present_context.surface = _vulkan_surface;
+		present_context.queue = _vulkan_queue;
+		present_context.queue_mutex = &_queue_mutex;
+		present_context.format = _vulkan_format;
+		present_context.color_space = _vulkan_colorspace;
+		present_context.allocator = &_allocator;
+
+		_swapchain.init(present_context, _swapchain_policy);
+
 		/*
 typedef struct VkCommandBufferAllocateInfo {
 		VkStructureType         sType;
@@ -703,13 +1099,21 @@ typedef struct VkCommandBufferAllocateInfo {
 
 		create_surface_depth_image();
 
-		_demo_texture = create_texture("test.png");
-		
-		demo_setup_cube();
+		auto upload = begin_upload_batch();
+
+		_demo_texture = _compressed_textures ? create_compressed_texture("test", &upload) : create_texture("test.png", false, &upload);
+
+		demo_setup_cube(upload);
+
+		submit_upload_batch(upload);
 
 		demo_build_render_pass();
 
 		demo_build_pipeline();
+
+		if (_gpu_culling) {
+			demo_build_cull();
+		}
 		/*
 		demo_prepare_textures(demo);
 		demo_prepare_cube_data_buffer(demo);
@@ -723,15 +1127,15 @@ typedef struct VkCommandBufferAllocateInfo {
 
 		demo_prepare_pipeline_descriptors();
 
+		create_framebuffers();
+
 		/*
 		demo_prepare_descriptor_pool(demo);
 		demo_prepare_descriptor_set(demo);
 
 		demo_prepare_framebuffers(demo);
 		*/
-		for (uint32_t i = 0; i < _swapchain_image_count; i++) {
-			demo_perform_first_render(i);
-		}
+		record_swapchain_command_buffers();
 
 		flush_command_buffer();
 
@@ -746,156 +1150,73 @@ typedef struct VkCommandBufferAllocateInfo {
 	}
 
 	void wrapper::create_swapchain() {
-		VkResult err;
-
-		VkSwapchainKHR oldSwapchain = _vulkan_swapchain;
-
-		// Check the surface capabilities and formats
-		VkSurfaceCapabilitiesKHR surface_capabilities;
-		err = fpGetPhysicalDeviceSurfaceCapabilitiesKHR(_vulkan_physical_device, _vulkan_surface, &surface_capabilities);
-		assert(!err);
-
-		uint32_t present_modes_count = 0;
-		err = fpGetPhysicalDeviceSurfacePresentModesKHR(_vulkan_physical_device, _vulkan_surface, &present_modes_count, NULL);
-		assert(!err);
-
-		auto present_modes = (VkPresentModeKHR *)malloc(present_modes_count * sizeof(VkPresentModeKHR));
-		assert(present_modes);
-
-		err = fpGetPhysicalDeviceSurfacePresentModesKHR(_vulkan_physical_device, _vulkan_surface, &present_modes_count, present_modes);
-		assert(!err);
-
-		VkExtent2D swapchain_size;
-		// width and height are either both -1, or both not -1.
-		if (surface_capabilities.currentExtent.width == (uint32_t)-1) {
-			// If the surface size is undefined, the size is set to
-			// the size of the images requested.
-			swapchain_size.width = _surface_width;
-			swapchain_size.height = _surface_height;
-		} else {
-			// If the surface size is defined, the swap chain size must match
-			swapchain_size = surface_capabilities.currentExtent;
-			_surface_width = surface_capabilities.currentExtent.width;
-			_surface_height = surface_capabilities.currentExtent.height;
+		// If we just re-created an existing swapchain, we should destroy the old
+		// swapchain once the frames still in flight are done presenting from it.
+		// Note: destroying the swapchain also cleans up all its associated
+		// presentable images once the platform is done with them.
+		VkSwapchainKHR old_swapchain = _swapchain.create(_surface_width, _surface_height);
+		if (old_swapchain != VK_NULL_HANDLE) {
+			_deletion_queue.retire(_submit_serial, [this, old_swapchain]() {
+				_swapchain.destroy_retired(old_swapchain);
+			});
 		}
 
-		// If mailbox mode is available, use it, as is the lowest-latency non-
-		// tearing mode.  If not, try IMMEDIATE which will usually be available,
-		// and is fastest (though it tears).  If not, fall back to FIFO which is
-		// always available.
+		auto dimensions = _swapchain.get_surface_dimensions();
+		_surface_width = dimensions.first;
+		_surface_height = dimensions.second;
 
-		VkPresentModeKHR swapchain_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+		_swapchain_images = _swapchain.get_images();
+		_swapchain_image_count = _swapchain.get_image_count();
 
-		for (size_t i = 0; i < present_modes_count; i++) {
-			if (present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-				swapchain_present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
-				break;
-			}
+		_swapchain_views.clear();
 
-			if ((swapchain_present_mode != VK_PRESENT_MODE_MAILBOX_KHR) && (present_modes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR)) {
-				swapchain_present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-			}
+		for (uint32_t i = 0; i < _swapchain_image_count; i++) {
+			VkImageView view = create_image_view(create_image_view_defaults(_swapchain_images[i], _vulkan_format));
+			_swapchain_views.push_back(view);
 		}
+	}
 
-		// Determine the number of VkImage's to use in the swap chain (we desire to
-		// own only 1 image at a time, besides the images being displayed and
-		// queued for display):
+	void wrapper::create_frames() {
+		_sync_pool.init(_vulkan_device);
 
-		uint32_t swapchain_image_count_target = surface_capabilities.minImageCount + 1;
-		if ((surface_capabilities.maxImageCount > 0) && (swapchain_image_count_target > surface_capabilities.maxImageCount)) {
-			// Application must settle for fewer images than desired:
-			swapchain_image_count_target = surface_capabilities.maxImageCount;
-		}
+		_frames = std::vector<vulkan_frame>(_frames_in_flight);
+		_frame_index = 0;
+	}
 
-		// looks like we're telling vulkan to fuck off with it's surface transformations
-		VkSurfaceTransformFlagsKHR surface_pretransform;
-		if (surface_capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) {
-			surface_pretransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-		} else {
-			surface_pretransform = surface_capabilities.currentTransform;
+	void wrapper::retire_frame(vulkan_frame& frame) {
+		if (frame.fence == VK_NULL_HANDLE) {
+			return;
 		}
 
-		/*
-typedef struct VkSwapchainCreateInfoKHR {
-	VkStructureType                  sType;
-	const void*                      pNext;
-	VkSwapchainCreateFlagsKHR        flags;
-	VkSurfaceKHR                     surface;
-	uint32_t                         minImageCount;
-	VkFormat                         imageFormat;
-	VkColorSpaceKHR                  imageColorSpace;
-	VkExtent2D                       imageExtent;
-	uint32_t                         imageArrayLayers;
-	VkImageUsageFlags                imageUsage;
-	VkSharingMode                    imageSharingMode;
-	uint32_t                         queueFamilyIndexCount;
-	const uint32_t*                  pQueueFamilyIndices;
-	VkSurfaceTransformFlagBitsKHR    preTransform;
-	VkCompositeAlphaFlagBitsKHR      compositeAlpha;
-	VkPresentModeKHR                 presentMode;
-	VkBool32                         clipped;
-	VkSwapchainKHR                   oldSwapchain;
-} VkSwapchainCreateInfoKHR;
-
-		*/
-		const VkSwapchainCreateInfoKHR swapchain_create_info = {
-		VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-		NULL,
-		0,
-		_vulkan_surface,
-		swapchain_image_count_target,
-		_vulkan_format,
-		_vulkan_colorspace,
-		{swapchain_size.width, swapchain_size.height, },
-		1,
-		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		VK_SHARING_MODE_EXCLUSIVE,
-		0,
-		NULL,
-		(VkSurfaceTransformFlagBitsKHR)surface_pretransform,
-		VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		swapchain_present_mode,
-		true,
-		oldSwapchain
-		};
-
-		uint32_t i;
-
-		err = fpCreateSwapchainKHR(_vulkan_device, &swapchain_create_info, NULL, &_vulkan_swapchain);
-		assert(!err);
-
-		// If we just re-created an existing swapchain, we should destroy the old
-		// swapchain at this point.
-		// Note: destroying the swapchain also cleans up all its associated
-		// presentable images once the platform is done with them.
-		if (oldSwapchain != VK_NULL_HANDLE) {
-			fpDestroySwapchainKHR(_vulkan_device, oldSwapchain, NULL);
+		{
+			cpu_scope scope("wait_fence");
+			VkResult err = vkWaitForFences(_vulkan_device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+			assert(!err);
 		}
 
-		//uint32_t 
-		_swapchain_image_count = 0;
-
-		err = fpGetSwapchainImagesKHR(_vulkan_device, _vulkan_swapchain, &_swapchain_image_count, NULL);
-		assert(!err);
-
-		_swapchain_images = std::vector<VkImage>(_swapchain_image_count);
-
-		err = fpGetSwapchainImagesKHR(_vulkan_device, _vulkan_swapchain, &_swapchain_image_count, _swapchain_images.data());
-		assert(!err);
+		// One queue, so everything submitted before this frame is done too.
+		_completed_serial = (std::max)(_completed_serial, frame.serial);
 
-		_swapchain_views.clear();
+		_sync_pool.release_fence(frame.fence);
+		_sync_pool.release_semaphore(frame.image_acquired);
+		_sync_pool.release_semaphore(frame.draw_complete);
 
-		//auto swapchain_buffers = (SwapchainBuffers *)malloc(sizeof(SwapchainBuffers) * swapchain_image_count);
-		//assert(swapchain_buffers);
+		frame.fence = VK_NULL_HANDLE;
+		frame.image_acquired = VK_NULL_HANDLE;
+		frame.draw_complete = VK_NULL_HANDLE;
+	}
 
-		for (i = 0; i < _swapchain_image_count; i++) {
-			VkImageView view = create_image_view(create_image_view_defaults(_swapchain_images[i], _vulkan_format));
-			_swapchain_views.push_back(view);
+	void wrapper::wait_frames_idle() {
+		std::vector<VkFence> fences;
+		for (auto& frame : _frames) {
+			if (frame.fence != VK_NULL_HANDLE) {
+				fences.push_back(frame.fence);
+			}
 		}
 
-
-		if (NULL != present_modes) {
-			free(present_modes);
+		if (fences.size() > 0) {
+			VkResult err = vkWaitForFences(_vulkan_device, (uint32_t)fences.size(), fences.data(), VK_TRUE, UINT64_MAX);
+			assert(!err);
 		}
 	}
 
@@ -943,20 +1264,21 @@ typedef struct VkSwapchainCreateInfoKHR {
 
 	}
 
-	void wrapper::create_surface_depth_image() {
+	void wrapper::create_surface_depth_image(vulkan_upload_batch * batch) {
 		auto image_info = create_image_defaults(_surface_width, _surface_height, _depth_format);
 		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
 		
 		/* VkImage */_depth_image = create_image(image_info);
 
-		VkMemoryAllocateInfo depth_memory_allocate_info;
-
-		//VkDeviceMemory _depth_device_memory = nullptr;
-
-		std::tie(_depth_device_memory, depth_memory_allocate_info) = allocate_image_memory(_depth_image, 0);
+		_depth_memory = allocate_image_memory(_depth_image, 0);
 
 
-		set_image_layout(_depth_image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, (VkAccessFlagBits)0);
+		if (batch != nullptr) {
+			set_image_layout(batch->command_buffer, _depth_image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, (VkAccessFlagBits)0);
+			batch->resource_count++;
+		} else {
+			set_image_layout(_depth_image, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, (VkAccessFlagBits)0);
+		}
 		
 		auto image_view_info = create_image_view_defaults(_depth_image, _depth_format);
 		image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
@@ -964,71 +1286,320 @@ typedef struct VkSwapchainCreateInfoKHR {
 		/*VkImageView*/ _depth_view = create_image_view(image_view_info);
 	}
 
-	vulkan_texture wrapper::create_texture(const char * filename, bool stage_textures) {
+	vulkan_texture wrapper::create_texture(const char * filename, bool stage_textures, vulkan_upload_batch * batch) {
 		const VkFormat texture_format = VK_FORMAT_R8G8B8A8_UNORM;
 		VkFormatProperties props;
 
 		vulkan_texture return_texture;
 
+		vulkan_upload_batch local_batch;
+		vulkan_upload_batch * upload = batch;
+		if (upload == nullptr) {
+			local_batch = begin_upload_batch();
+			upload = &local_batch;
+		}
+
 		vkGetPhysicalDeviceFormatProperties(_vulkan_physical_device, texture_format, &props);
 
-		if ((props.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) && !stage_textures) {
-			return_texture = load_texture(filename, VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		// Linear-tiled images only have the one level, so a mip chain always
+		// goes through staging.
+		if ((props.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) && !stage_textures && !_texture_mipmaps) {
+			return_texture = load_texture(upload->command_buffer, filename, VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 		} else if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) {
 
-			/* Must use staging buffer to copy linear texture to optimized */
-
-			auto staging_texture = load_texture(filename, VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			/* Decode once, copy the texels into a host-visible staging buffer and
+			* let the transfer engine lay them out into the optimal-tiled image. */
+
+			std::shared_ptr<uint8_t> raw_image = load_png_or_placeholder(filename, return_texture.width, return_texture.height);
+
+			const VkDeviceSize image_size = (VkDeviceSize)return_texture.width * return_texture.height * 4;
+
+			// Blit the chain on the GPU where the format can be a linearly
+			// filtered blit source and destination; otherwise build it on the
+			// CPU in ordinary memory, copy it into staging, and upload every
+			// level at once.
+			const VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+			return_texture.mip_levels = _texture_mipmaps ? mip_level_count(return_texture.width, return_texture.height) : 1;
+			const bool blit = return_texture.mip_levels > 1 && (props.optimalTilingFeatures & blit_features) == blit_features;
+
+			std::vector<mip_level> levels;
+			const VkDeviceSize chain_size = mip_chain_layout(return_texture.width, return_texture.height, blit ? 1 : return_texture.mip_levels, levels);
+
+			auto staging_buffer = create_buffer(chain_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			assert(staging_buffer.memory.mapped != nullptr);
+
+			if (levels.size() > 1) {
+				// Staging memory may be write-combined and slow to read back,
+				// so filter in ordinary memory and copy the chain across once.
+				auto mip_start = std::chrono::high_resolution_clock::now();
+				std::vector<uint8_t> chain((size_t)chain_size);
+				memcpy(chain.data(), raw_image.get(), (size_t)image_size);
+				generate_mip_chain_rgba8(_simd_level, chain.data(), levels);
+				memcpy(staging_buffer.memory.mapped, chain.data(), (size_t)chain_size);
+				_texture_stats.cpu_mip_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mip_start).count();
+				_texture_stats.mip_chains_cpu++;
+			} else {
+				memcpy(staging_buffer.memory.mapped, raw_image.get(), (size_t)image_size);
+				_texture_stats.mip_chains_blitted += blit ? 1 : 0;
+			}
+			raw_image = nullptr;
 
-			return_texture = load_texture(filename, VK_IMAGE_TILING_OPTIMAL, (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			std::vector<mip_level> full_chain;
+			_texture_stats.bytes += mip_chain_layout(return_texture.width, return_texture.height, return_texture.mip_levels, full_chain);
 
-			set_image_layout(staging_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, staging_texture.imageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, (VkAccessFlagBits)0);
+			auto image_info = create_image_defaults(return_texture.width, return_texture.height, texture_format, return_texture.mip_levels);
+			image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			if (blit) {
+				image_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			}
 
-			set_image_layout(return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, return_texture.imageLayout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (VkAccessFlagBits)0);
+			return_texture.image = create_image(image_info);
+			return_texture.memory = allocate_image_memory(return_texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			return_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
+			set_image_layout(upload->command_buffer, return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (VkAccessFlagBits)0);
 
 			/*
-typedef struct VkImageCopy {
-	VkImageSubresourceLayers    srcSubresource;
-	VkOffset3D                  srcOffset;
-	VkImageSubresourceLayers    dstSubresource;
-	VkOffset3D                  dstOffset;
-	VkExtent3D                  extent;
-} VkImageCopy;
+typedef struct VkBufferImageCopy {
+	VkDeviceSize                bufferOffset;
+	uint32_t                    bufferRowLength;
+	uint32_t                    bufferImageHeight;
+	VkImageSubresourceLayers    imageSubresource;
+	VkOffset3D                  imageOffset;
+	VkExtent3D                  imageExtent;
+} VkBufferImageCopy;
 */
-			VkImageCopy copy_region = {
-				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
-				{ 0, 0, 0 },
-				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
-				{ 0, 0, 0 },
-				{ staging_texture.width, staging_texture.height, 1 },
-			};
-
-			vkCmdCopyImage(_vulkan_command_buffer, staging_texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, return_texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+			std::vector<VkBufferImageCopy> copy_regions;
+			for (uint32_t i = 0; i < levels.size(); i++) {
+				const VkBufferImageCopy copy_region = {
+					levels[i].offset,
+					0,
+					0,
+					{ VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 },
+					{ 0, 0, 0 },
+					{ levels[i].width, levels[i].height, 1 },
+				};
+				copy_regions.push_back(copy_region);
+			}
 
-			set_image_layout(return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, return_texture.imageLayout, (VkAccessFlagBits)0);
+			vkCmdCopyBufferToImage(upload->command_buffer, staging_buffer.buffer, return_texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)copy_regions.size(), copy_regions.data());
 
-			reset_command_buffer(); // flush + recreate
+			if (blit) {
+				generate_mipmaps(upload->command_buffer, return_texture.image, return_texture.width, return_texture.height, return_texture.mip_levels);
+			} else {
+				set_image_layout(upload->command_buffer, return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, return_texture.imageLayout, VK_ACCESS_TRANSFER_WRITE_BIT);
+			}
 
-			destroy_vulkan_texture(staging_texture);
+			// Freed when the batch's fence signals, not here.
+			add_staging(*upload, staging_buffer);
 
 		} else {
 			/* Can't support VK_FORMAT_R8G8B8A8_UNORM !? */
 			assert(!"No support for R8G8B8A8_UNORM as texture image format");
 		}
-		auto sampler_info = create_sampler_defaults();
+
+		upload->resource_count++;
+		_texture_stats.textures++;
+
+		if (batch == nullptr) {
+			finish_upload_batch(local_batch);
+		}
+
+		auto sampler_info = create_sampler_preset(_texture_filter, return_texture.mip_levels, _max_anisotropy);
 		return_texture.sampler = create_sampler(sampler_info);
 
-		auto view_info = create_image_view_defaults(return_texture.image, texture_format);
+		auto view_info = create_image_view_defaults(return_texture.image, texture_format, return_texture.mip_levels);
 		return_texture.view = create_image_view(view_info);
 		return return_texture;
 	}
 
+	vulkan_texture wrapper::create_compressed_texture(const char * name, vulkan_upload_batch * batch) {
+		// Best quality first, then each opaque format ahead of its alpha
+		// variant, which encodes colour the same way in twice the space.
+		const block_format preference[] = { block_format::bc7, block_format::bc1, block_format::bc3, block_format::etc2, block_format::etc2a };
+
+		ktx2_texture file;
+		bool found = false;
+
+		for (block_format format : preference) {
+			const bool bc = format == block_format::bc1 || format == block_format::bc3 || format == block_format::bc7;
+			if (!(bc ? _texture_compression_bc : _texture_compression_etc2)) {
+				continue;
+			}
+
+			VkFormatProperties props;
+			vkGetPhysicalDeviceFormatProperties(_vulkan_physical_device, block_format_vk_format(format), &props);
+			if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+				continue;
+			}
+
+			// Not every format is converted; only complain about files that
+			// are there but won't load.
+			const std::string path = std::string(name) + "." + block_format_name(format) + ".ktx2";
+			FILE * fp = fopen(path.c_str(), "rb");
+			if (!fp) {
+				continue;
+			}
+			fclose(fp);
+
+			try {
+				file = read_ktx2(path.c_str());
+			} catch (std::exception& e) {
+				std::cerr << "Failed to load textures: " << e.what() << std::endl;
+				continue;
+			}
+
+			if (file.format != block_format_vk_format(format)) {
+				std::cerr << "Failed to load textures: " << path << " doesn't hold " << block_format_name(format) << " blocks" << std::endl;
+				continue;
+			}
+
+			found = true;
+			break;
+		}
 
-	vulkan_texture wrapper::load_texture(const char *filename, VkImageTiling tiling, VkImageUsageFlags usage, VkFlags required_properties) {
+		if (!found) {
+			return create_texture((std::string(name) + ".png").c_str(), false, batch);
+		}
+
+		vulkan_texture return_texture;
+		return_texture.format = file.format;
+		return_texture.width = file.width;
+		return_texture.height = file.height;
+		return_texture.mip_levels = _texture_mipmaps ? (uint32_t)file.levels.size() : 1;
+
+		vulkan_upload_batch local_batch;
+		vulkan_upload_batch * upload = batch;
+		if (upload == nullptr) {
+			local_batch = begin_upload_batch();
+			upload = &local_batch;
+		}
+
+		// The blocks go up exactly as they were encoded; there's nothing to
+		// decode or filter at load time.
+		const ktx2_level& last_level = file.levels[return_texture.mip_levels - 1];
+		const VkDeviceSize data_size = last_level.offset + last_level.size;
+
+		auto staging_buffer = create_buffer(data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		assert(staging_buffer.memory.mapped != nullptr);
+		memcpy(staging_buffer.memory.mapped, file.data.data(), (size_t)data_size);
+
+		auto image_info = create_image_defaults(return_texture.width, return_texture.height, return_texture.format, return_texture.mip_levels);
+		image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+		return_texture.image = create_image(image_info);
+		return_texture.memory = allocate_image_memory(return_texture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		return_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		set_image_layout(upload->command_buffer, return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (VkAccessFlagBits)0);
+
+		// Extents are in texels; levels smaller than a block still copy the
+		// whole block.
+		std::vector<VkBufferImageCopy> copy_regions;
+		for (uint32_t i = 0; i < return_texture.mip_levels; i++) {
+			const VkBufferImageCopy copy_region = {
+				file.levels[i].offset,
+				0,
+				0,
+				{ VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 },
+				{ 0, 0, 0 },
+				{ file.levels[i].width, file.levels[i].height, 1 },
+			};
+			copy_regions.push_back(copy_region);
+			_texture_stats.bytes += file.levels[i].size;
+		}
+
+		vkCmdCopyBufferToImage(upload->command_buffer, staging_buffer.buffer, return_texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)copy_regions.size(), copy_regions.data());
+
+		set_image_layout(upload->command_buffer, return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, return_texture.imageLayout, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+		// Freed when the batch's fence signals, not here.
+		add_staging(*upload, staging_buffer);
+
+		upload->resource_count++;
+		_texture_stats.textures++;
+		_texture_stats.compressed++;
+
+		if (batch == nullptr) {
+			finish_upload_batch(local_batch);
+		}
+
+		auto sampler_info = create_sampler_preset(_texture_filter, return_texture.mip_levels, _max_anisotropy);
+		return_texture.sampler = create_sampler(sampler_info);
+
+		auto view_info = create_image_view_defaults(return_texture.image, return_texture.format, return_texture.mip_levels);
+		return_texture.view = create_image_view(view_info);
+		return return_texture;
+	}
+
+
+	void wrapper::generate_mipmaps(VkCommandBuffer command_buffer, VkImage image, uint32_t width, uint32_t height, uint32_t mip_levels) {
+		VkImageMemoryBarrier barrier = {
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			NULL,
+			0,
+			0,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			image,
+			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } };
+
+		int32_t level_width = (int32_t)width, level_height = (int32_t)height;
+
+		for (uint32_t i = 1; i < mip_levels; i++) {
+			// The level above is written; make it the blit source.
+			barrier.subresourceRange.baseMipLevel = i - 1;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+			const int32_t next_width = (std::max)(1, level_width / 2);
+			const int32_t next_height = (std::max)(1, level_height / 2);
+
+			/*
+			typedef struct VkImageBlit {
+				VkImageSubresourceLayers    srcSubresource;
+				VkOffset3D                  srcOffsets[2];
+				VkImageSubresourceLayers    dstSubresource;
+				VkOffset3D                  dstOffsets[2];
+			} VkImageBlit;
+			*/
+			const VkImageBlit blit = {
+				{ VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 },
+				{ { 0, 0, 0 }, { level_width, level_height, 1 } },
+				{ VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 },
+				{ { 0, 0, 0 }, { next_width, next_height, 1 } },
+			};
+
+			vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+			// Nothing else reads the level above; hand it to the shaders.
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+			level_width = next_width;
+			level_height = next_height;
+		}
+
+		// The last level was only ever a blit destination.
+		barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+	}
+
+	vulkan_texture wrapper::load_texture(VkCommandBuffer command_buffer, const char *filename, VkImageTiling tiling, VkImageUsageFlags usage, VkFlags required_properties) {
 
 		const VkFormat tex_format = VK_FORMAT_R8G8B8A8_UNORM;
-		VkResult err;
 
 		vulkan_texture return_texture;
 
@@ -1055,11 +1626,7 @@ typedef struct VkImageCopy {
 		raw_image[14] = 255;
 		raw_image[15] = 255;
 		*/
-		try {
-			raw_image = load_image::png(filename, return_texture.width, return_texture.height);
-		} catch (std::exception& e) {
-			std::cerr << "Failed to load textures: " << e.what() << std::endl;
-		}
+		raw_image = load_png_or_placeholder(filename, return_texture.width, return_texture.height);
 
 		auto image_info = wrapper::create_image_defaults(return_texture.width, return_texture.height, tex_format);
 		image_info.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
@@ -1068,7 +1635,7 @@ typedef struct VkImageCopy {
 		
 		return_texture.image = create_image(image_info);
 
-		std::tie(return_texture.device_memory, return_texture.memory_allocation_info) = allocate_image_memory(return_texture.image, required_properties);
+		return_texture.memory = allocate_image_memory(return_texture.image, required_properties, tiling);
 
 		
 		if (required_properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
@@ -1078,8 +1645,9 @@ typedef struct VkImageCopy {
 
 			vkGetImageSubresourceLayout(_vulkan_device, return_texture.image, &subres, &layout);
 
-			err = vkMapMemory(_vulkan_device, return_texture.device_memory, 0, return_texture.memory_allocation_info.allocationSize, 0, &data);
-			assert(!err);
+			// Host-visible allocations come back persistently mapped.
+			data = return_texture.memory.mapped;
+			assert(data != NULL);
 
 			/*
 			if (!loadTexture(filename, data, &layout, &tex_width, &tex_height)) {
@@ -1102,14 +1670,12 @@ typedef struct VkImageCopy {
 				std::cout << i << ": " << (int)img[i] << std::endl;
 			}
 
-
-			vkUnmapMemory(_vulkan_device, return_texture.device_memory);
 		}
 
 
 		return_texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		set_image_layout(return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_PREINITIALIZED, return_texture.imageLayout, VK_ACCESS_HOST_WRITE_BIT);
+		set_image_layout(command_buffer, return_texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_PREINITIALIZED, return_texture.imageLayout, VK_ACCESS_HOST_WRITE_BIT);
 
 		/* setting the image layout does not reference the actual memory so no need
 		* to add a mem ref */
@@ -1117,9 +1683,412 @@ typedef struct VkImageCopy {
 	}
 
 
-	void wrapper::demo_setup_cube() {
+	void wrapper::add_staging(vulkan_upload_batch& batch, const vulkan_buffer& staging) {
+		batch.staging.push_back(staging);
+
+		_upload_stats.staging_bytes_pending += staging.memory.size;
+		if (_upload_stats.staging_bytes_pending > _upload_stats.staging_bytes_high_water) {
+			_upload_stats.staging_bytes_high_water = _upload_stats.staging_bytes_pending;
+		}
+	}
+
+	vulkan_upload_batch wrapper::begin_upload_batch() {
+		VkResult err;
+		vulkan_upload_batch batch;
+
+		const VkCommandBufferAllocateInfo command_allocate_info = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			NULL,
+			_vulkan_command_pool,
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			1,
+		};
+
+		err = vkAllocateCommandBuffers(_vulkan_device, &command_allocate_info, &batch.command_buffer);
+		assert(!err);
+
+		const VkCommandBufferBeginInfo command_buffer_begin_info = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			NULL,
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			NULL,
+		};
+
+		err = vkBeginCommandBuffer(batch.command_buffer, &command_buffer_begin_info);
+		assert(!err);
+
+		return batch;
+	}
+
+	void wrapper::submit_upload_batch(vulkan_upload_batch& batch) {
 		VkResult err;
 
+		err = vkEndCommandBuffer(batch.command_buffer);
+		assert(!err);
+
+		batch.fence = _sync_pool.acquire_fence();
+
+		assert(batch.wait_semaphores.size() == batch.wait_stages.size());
+
+		VkSubmitInfo submit_info = {
+			VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			NULL,
+			(uint32_t)batch.wait_semaphores.size(),
+			batch.wait_semaphores.data(),
+			batch.wait_stages.data(),
+			1,
+			&batch.command_buffer,
+			0,
+			NULL };
+
+		{
+			std::lock_guard<std::mutex> lock(_queue_mutex);
+			err = vkQueueSubmit(_vulkan_queue, 1, &submit_info, batch.fence);
+		}
+		assert(!err);
+
+		_upload_stats.batches++;
+		_upload_stats.submits++;
+		_upload_stats.resources += batch.resource_count;
+		if (batch.resource_count > 0) {
+			_upload_stats.submits_avoided += batch.resource_count - 1;
+			_upload_stats.waits_avoided += batch.resource_count;
+		}
+
+		_pending_uploads.push_back(std::move(batch));
+		batch = vulkan_upload_batch();
+	}
+
+	void wrapper::finish_upload_batch(vulkan_upload_batch& batch) {
+		submit_upload_batch(batch);
+
+		VkFence fence = _pending_uploads.back().fence;
+		VkResult err = vkWaitForFences(_vulkan_device, 1, &fence, VK_TRUE, UINT64_MAX);
+		assert(!err);
+		_upload_stats.waits++;
+		if (_upload_stats.waits_avoided > 0) {
+			_upload_stats.waits_avoided--;
+		}
+
+		// Retires this batch, along with any others that happen to be done.
+		collect_upload_batches(false);
+	}
+
+	void wrapper::collect_upload_batches(bool wait) {
+		cpu_scope scope("collect_uploads");
+
+		for (auto it = _pending_uploads.begin(); it != _pending_uploads.end();) {
+			VkResult err;
+
+			if (wait) {
+				err = vkGetFenceStatus(_vulkan_device, it->fence);
+				if (err == VK_NOT_READY) {
+					err = vkWaitForFences(_vulkan_device, 1, &it->fence, VK_TRUE, UINT64_MAX);
+					assert(!err);
+					_upload_stats.waits++;
+					if (_upload_stats.waits_avoided > 0) {
+						_upload_stats.waits_avoided--;
+					}
+				}
+			} else if (vkGetFenceStatus(_vulkan_device, it->fence) != VK_SUCCESS) {
+				++it;
+				continue;
+			}
+
+			for (auto& staging : it->staging) {
+				_upload_stats.staging_bytes_pending -= staging.memory.size;
+				destroy_buffer(staging);
+			}
+
+			for (auto semaphore : it->wait_semaphores) {
+				_sync_pool.release_semaphore(semaphore);
+			}
+
+			vkFreeCommandBuffers(_vulkan_device, _vulkan_command_pool, 1, &it->command_buffer);
+			_sync_pool.release_fence(it->fence);
+
+			it = _pending_uploads.erase(it);
+		}
+	}
+
+	uint64_t wrapper::stream_texture(const char * filename) {
+		return _streamer.request_texture(filename);
+	}
+
+	uint64_t wrapper::stream_buffer(const void * data, VkDeviceSize size, VkBufferUsageFlags usage) {
+		return _streamer.request_buffer(data, size, usage);
+	}
+
+	void wrapper::poll_streaming() {
+		cpu_scope scope("poll_streaming");
+
+		auto completed = _streamer.take_completed();
+		if (completed.size() == 0) {
+			return;
+		}
+
+		vulkan_upload_batch acquire;
+
+		for (auto& resource : completed) {
+			if (resource.ready != VK_NULL_HANDLE) {
+				// Acquire half of the ownership transfer, matching the release
+				// recorded on the transfer queue.
+				if (acquire.command_buffer == VK_NULL_HANDLE) {
+					acquire = begin_upload_batch();
+				}
+
+				if (resource.image != VK_NULL_HANDLE) {
+					const VkImageMemoryBarrier image_memory_barrier = {
+						VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+						NULL,
+						0,
+						VK_ACCESS_SHADER_READ_BIT,
+						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+						_transfer_queue_family,
+						_graphics_queue_family,
+						resource.image,
+						{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } };
+
+					vkCmdPipelineBarrier(acquire.command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
+				} else {
+					const VkBufferMemoryBarrier buffer_memory_barrier = {
+						VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+						NULL,
+						0,
+						buffer_access_for_usage(resource.usage),
+						_transfer_queue_family,
+						_graphics_queue_family,
+						resource.buffer,
+						0,
+						VK_WHOLE_SIZE };
+
+					vkCmdPipelineBarrier(acquire.command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 1, &buffer_memory_barrier, 0, NULL);
+				}
+
+				acquire.wait_semaphores.push_back(resource.ready);
+				acquire.wait_stages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+				acquire.resource_count++;
+			}
+
+			if (resource.image != VK_NULL_HANDLE) {
+				vulkan_texture texture;
+				texture.image = resource.image;
+				texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				texture.memory = resource.memory;
+				texture.width = resource.width;
+				texture.height = resource.height;
+
+				// Streamed on the transfer queue, which can't blit, so one level.
+				auto sampler_info = create_sampler_preset(_texture_filter, 1, _max_anisotropy);
+				texture.sampler = create_sampler(sampler_info);
+
+				auto view_info = create_image_view_defaults(texture.image, VK_FORMAT_R8G8B8A8_UNORM);
+				texture.view = create_image_view(view_info);
+
+				_streamed_textures[resource.id] = texture;
+			} else if (resource.buffer != VK_NULL_HANDLE) {
+				vulkan_buffer buffer;
+				buffer.buffer = resource.buffer;
+				buffer.memory = resource.memory;
+				buffer.info.buffer = resource.buffer;
+				buffer.info.offset = 0;
+				buffer.info.range = resource.size;
+
+				_streamed_buffers[resource.id] = buffer;
+			}
+		}
+
+		if (acquire.command_buffer != VK_NULL_HANDLE) {
+			submit_upload_batch(acquire);
+		}
+	}
+
+	const vulkan_texture * wrapper::get_streamed_texture(uint64_t id) const {
+		auto it = _streamed_textures.find(id);
+		return it != _streamed_textures.end() ? &it->second : nullptr;
+	}
+
+	const vulkan_buffer * wrapper::get_streamed_buffer(uint64_t id) const {
+		auto it = _streamed_buffers.find(id);
+		return it != _streamed_buffers.end() ? &it->second : nullptr;
+	}
+
+	void wrapper::create_swapchain_command_buffers() {
+		VkResult err;
+
+		// Re-recorded frames only ever need one primary per slot, from a pool
+		// that is reset wholesale every frame.
+		const VkCommandPoolCreateFlags pool_flags = _rerecord_frames ? VK_COMMAND_POOL_CREATE_TRANSIENT_BIT : 0;
+		const uint32_t buffers_per_frame = _rerecord_frames ? 1 : _swapchain_image_count;
+
+		if (_rerecord_frames && _frame_command_pools.empty()) {
+			const VkCommandPoolCreateInfo command_pool_create_info = {
+				VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				NULL,
+				pool_flags,
+				_graphics_queue_family,
+			};
+
+			_frame_command_pools.resize(_frames_in_flight);
+			for (auto& pool : _frame_command_pools) {
+				err = vkCreateCommandPool(_vulkan_device, &command_pool_create_info, NULL, &pool);
+				assert(!err);
+			}
+		}
+
+		for (uint32_t f = 0; f < _frames_in_flight; f++) {
+			const VkCommandBufferAllocateInfo command_allocate_info = {
+				VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+				NULL,
+				_rerecord_frames ? _frame_command_pools[f] : _vulkan_command_pool,
+				VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+				1,
+			};
+			for (uint32_t i = 0; i < buffers_per_frame; i++) {
+				VkCommandBuffer command_buffer;
+
+				err = vkAllocateCommandBuffers(_vulkan_device, &command_allocate_info, &command_buffer);
+				assert(!err);
+
+				_swapchain_command_buffers.push_back(command_buffer);
+			}
+		}
+
+		if (_recording_workers == 0) {
+			return;
+		}
+
+		if (_recording_group.size() != _recording_workers) {
+			_recording_group.finish();
+			_recording_group.init(_recording_workers, "record");
+		}
+
+		if (_recording_pools.empty()) {
+			const VkCommandPoolCreateInfo command_pool_create_info = {
+				VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				NULL,
+				pool_flags,
+				_graphics_queue_family,
+			};
+
+			_recording_pools.resize(_frames_in_flight * _recording_workers);
+			for (auto& pool : _recording_pools) {
+				err = vkCreateCommandPool(_vulkan_device, &command_pool_create_info, NULL, &pool);
+				assert(!err);
+			}
+		}
+
+		_secondary_command_buffers.resize(_frames_in_flight * buffers_per_frame * _recording_workers);
+		for (uint32_t f = 0; f < _frames_in_flight; f++) {
+			for (uint32_t w = 0; w < _recording_workers; w++) {
+				const VkCommandBufferAllocateInfo secondary_allocate_info = {
+					VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+					NULL,
+					_recording_pools[f * _recording_workers + w],
+					VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+					1,
+				};
+				for (uint32_t i = 0; i < buffers_per_frame; i++) {
+					err = vkAllocateCommandBuffers(_vulkan_device, &secondary_allocate_info, &_secondary_command_buffers[(f * buffers_per_frame + i) * _recording_workers + w]);
+					assert(!err);
+				}
+			}
+		}
+	}
+
+	void wrapper::retire_swapchain_command_buffers(uint64_t serial) {
+		// Re-recorded frames keep their buffers; they don't depend on the
+		// swapchain and their pools are reset every frame anyway.
+		if (_rerecord_frames) {
+			return;
+		}
+
+		// Frames in flight may still be executing these, so they are freed
+		// once those frames retire rather than now.
+		const uint32_t image_count = _swapchain_image_count;
+		_deletion_queue.retire(serial, [this, image_count, primaries = std::move(_swapchain_command_buffers), secondaries = std::move(_secondary_command_buffers)]() {
+			if (primaries.size() > 0) {
+				vkFreeCommandBuffers(_vulkan_device, _vulkan_command_pool, (uint32_t)primaries.size(), primaries.data());
+			}
+
+			for (uint32_t f = 0; f < _frames_in_flight && !secondaries.empty(); f++) {
+				for (uint32_t w = 0; w < _recording_workers; w++) {
+					for (uint32_t i = 0; i < image_count; i++) {
+						vkFreeCommandBuffers(_vulkan_device, _recording_pools[f * _recording_workers + w], 1, &secondaries[(f * image_count + i) * _recording_workers + w]);
+					}
+				}
+			}
+		});
+
+		_swapchain_command_buffers.clear();
+		_secondary_command_buffers.clear();
+	}
+
+	void wrapper::record_swapchain_command_buffers() {
+		// Nothing to pre-record; demo_draw records each frame as it goes.
+		if (_rerecord_frames) {
+			return;
+		}
+
+		cpu_scope scope("record_all");
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		if (_recording_workers > 0) {
+			// Each worker records its share of the draw list for every (frame,
+			// image) pair; the primaries then just execute the results.
+			_recording_group.run([this](uint32_t w) {
+				for (uint32_t f = 0; f < _frames_in_flight; f++) {
+					for (uint32_t i = 0; i < _swapchain_image_count; i++) {
+						demo_record_secondary(f, i, w);
+					}
+				}
+			});
+		}
+
+		for (uint32_t f = 0; f < _frames_in_flight; f++) {
+			for (uint32_t i = 0; i < _swapchain_image_count; i++) {
+				demo_perform_first_render(f, i);
+			}
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		_recording_stats.threads = _recording_workers;
+		_recording_stats.draws = _draw_batch_count;
+		_recording_stats.command_buffers = (uint32_t)(_swapchain_command_buffers.size() + _secondary_command_buffers.size());
+		_recording_stats.record_ms = std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	void wrapper::record_frame(uint32_t frame_id, uint32_t swapchain_id) {
+		cpu_scope scope("record");
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// The slot's fence has retired, so nothing from these pools is still
+		// pending; one reset recycles every buffer they handed out.
+		VkResult err = vkResetCommandPool(_vulkan_device, _frame_command_pools[frame_id], 0);
+		assert(!err);
+
+		if (_recording_workers > 0) {
+			_recording_group.run([this, frame_id, swapchain_id](uint32_t w) {
+				VkResult err = vkResetCommandPool(_vulkan_device, _recording_pools[frame_id * _recording_workers + w], 0);
+				assert(!err);
+
+				demo_record_secondary(frame_id, swapchain_id, w);
+			});
+		}
+
+		demo_perform_first_render(frame_id, swapchain_id);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		_recording_stats.frames_recorded++;
+		_recording_stats.frame_record_ms = std::chrono::duration<double, std::milli>(end - start).count();
+		_recording_stats.frame_record_ms_total += _recording_stats.frame_record_ms;
+	}
+
+	void wrapper::demo_setup_cube(vulkan_upload_batch& upload) {
 		glm::vec3 eye = { 0.0f, 3.0f, 5.0f };
 		glm::vec3 origin = { 0, 0, 0 };
 		glm::vec3 up = { 0.0f, 1.0f, 0.0 };
@@ -1128,23 +2097,9 @@ typedef struct VkImageCopy {
 		_view = glm::lookAt(eye, origin, up);
 		_model = glm::mat4(1.0f);
 
-		glm::mat4x4 MVP, VP;
-
-		struct vktexcube_vs_uniform {
-			// Must start with MVP
-			float mvp[4][4];
-			float position[12 * 3][4];
-			float attr[12 * 3][4];
-		};
-
-		struct vktexcube_vs_uniform data;
-
 		_VP = _projection * _view;
 		_MVP = _VP * _model;
 
-		memcpy(data.mvp, &_MVP, sizeof(_MVP));
-		//    dumpMatrix("MVP", MVP);
-
 		const float g_vertex_buffer_data[] = {
 			-1.0f,-1.0f,-1.0f,  // -X side
 			-1.0f,-1.0f, 1.0f,
@@ -1233,46 +2188,150 @@ typedef struct VkImageCopy {
 			1.0f, 1.0f,
 		};
 
+		// The tables repeat each corner once per triangle; weld matching
+		// position/uv pairs so the index buffer does the repeating instead.
+		std::vector<vulkan_vertex> vertices;
+		std::vector<uint32_t> indices;
+
 		for (int i = 0; i < 12 * 3; i++) {
-			data.position[i][0] = g_vertex_buffer_data[i * 3];
-			data.position[i][1] = g_vertex_buffer_data[i * 3 + 1];
-			data.position[i][2] = g_vertex_buffer_data[i * 3 + 2];
-			data.position[i][3] = 1.0f;
-			data.attr[i][0] = g_uv_buffer_data[2 * i];
-			data.attr[i][1] = g_uv_buffer_data[2 * i + 1];
-			data.attr[i][2] = 0;
-			data.attr[i][3] = 0;
+			vulkan_vertex vertex;
+			vertex.position[0] = g_vertex_buffer_data[i * 3];
+			vertex.position[1] = g_vertex_buffer_data[i * 3 + 1];
+			vertex.position[2] = g_vertex_buffer_data[i * 3 + 2];
+			vertex.uv[0] = g_uv_buffer_data[2 * i];
+			vertex.uv[1] = g_uv_buffer_data[2 * i + 1];
+
+			uint32_t index = 0;
+			while (index < vertices.size() && memcmp(&vertices[index], &vertex, sizeof(vertex)) != 0) {
+				index++;
+			}
+			if (index == vertices.size()) {
+				vertices.push_back(vertex);
+			}
+			indices.push_back(index);
+		}
+
+		_cube_mesh = create_mesh(vertices, indices, upload);
+
+		// One slice of the uniform buffer per frame in flight, so the CPU never
+		// writes a matrix the GPU may still be reading.
+		_cube_uniforms = create_uniform_ring(sizeof(_VP), _frames_in_flight);
+
+		for (uint32_t i = 0; i < _frames_in_flight; i++) {
+			write_uniform_ring(_cube_uniforms, i, 0, &_VP[0][0], sizeof(_VP));
+		}
+
+		// Same again for the instance transforms and the indirect draw that
+		// consumes them, so the instance count can change every frame while the
+		// command buffers stay pre-recorded.
+		if (_gpu_culling && !_graphics_queue_compute) {
+			std::cerr << "GPU culling needs a graphics queue with compute; drawing everything." << std::endl;
+			_gpu_culling = false;
+		}
+
+		// Inline recording draws the whole stream at once. Parallel recording
+		// cuts it into batches for the workers to share out; the cull pass
+		// compacts into one list, so with it there is only ever one draw.
+		if (_recording_threads == 0 || _gpu_culling || _draw_batch_size > _instance_capacity) {
+			_draw_batch_size = _instance_capacity;
+		}
+		_draw_batch_count = (_instance_capacity + _draw_batch_size - 1) / _draw_batch_size;
+		_recording_workers = _recording_threads < _draw_batch_count ? _recording_threads : _draw_batch_count;
+
+		_instance_data_offset = sizeof(instance_slice_header);
+		_draw_list_offset = _instance_data_offset + (VkDeviceSize)_instance_capacity * sizeof(glm::mat4x4);
+		_instance_ring = create_uniform_ring(_draw_list_offset + _draw_batch_count * sizeof(VkDrawIndexedIndirectCommand), _frames_in_flight,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | (_gpu_culling ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0));
+
+		if (_gpu_culling) {
+			// Only the GPU touches this, so it lives in device-local memory.
+			const VkDeviceSize output_size = cull_output_data_offset + (VkDeviceSize)_instance_capacity * sizeof(glm::mat4x4);
+			const VkDeviceSize alignment = _device_properties.limits.minStorageBufferOffsetAlignment > 0 ? _device_properties.limits.minStorageBufferOffsetAlignment : 1;
+			_cull_output_stride = (output_size + alignment - 1) / alignment * alignment;
+			_cull_output = create_buffer(_cull_output_stride * _frames_in_flight,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			_cull_output.info.range = output_size;
+		}
+
+		set_instance_count(_instance_count);
+
+		for (uint32_t i = 0; i < _frames_in_flight; i++) {
+			write_instances(i);
 		}
+	}
 
-		VkBufferCreateInfo buffer_create_info;
-		memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+	void wrapper::set_instance_count(uint32_t count) {
+		_instance_count = count < 1 ? 1 : (count > _instance_capacity ? _instance_capacity : count);
 
-		buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		buffer_create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-		buffer_create_info.size = sizeof(data);
+		// Lay the instances out on a cube-shaped grid that always fills the same
+		// volume the single cube does, shrinking each cube to fit.
+		uint32_t side = 1;
+		while (side * side * side < _instance_count) {
+			side++;
+		}
 
-		//vulkan_buffer _cube_buffer;
+		const float extent = 1.5f;
+		const float spacing = 2.0f * extent / side;
+		_instance_scale = side > 1 ? spacing * 0.35f : 1.0f;
+
+		_instance_x.resize(_instance_count);
+		_instance_y.resize(_instance_count);
+		_instance_z.resize(_instance_count);
+		for (uint32_t i = 0; i < _instance_count; i++) {
+			const uint32_t x = i % side, y = (i / side) % side, z = i / (side * side);
+			_instance_x[i] = side > 1 ? -extent + spacing * (x + 0.5f) : 0.0f;
+			_instance_y[i] = side > 1 ? -extent + spacing * (y + 0.5f) : 0.0f;
+			_instance_z[i] = side > 1 ? -extent + spacing * (z + 0.5f) : 0.0f;
+		}
 
-		err = vkCreateBuffer(_vulkan_device, &buffer_create_info, NULL, &_cube_buffer.buffer);
-		assert(!err);
+		// The cube spans [-1, 1] on each axis before scaling.
+		_instance_radius.assign(_instance_count, 1.7320508f * _instance_scale);
+		_instance_visible.assign(_instance_count, 1);
+		_instance_models.resize(_instance_count);
+	}
 
-		std::tie(_cube_buffer.device_memory, _cube_buffer.memory_allocation_info) = allocate_buffer_memory(_cube_buffer.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		
-		uint8_t *pData;
+	void wrapper::write_instances(uint32_t slice) {
+		cpu_scope scope("write_instances");
 
-		err = vkMapMemory(_vulkan_device, _cube_buffer.device_memory, 0, _cube_buffer.memory_allocation_info.allocationSize, 0, (void **)&pData);
-		assert(!err);
+		uint8_t * mapped = _instance_ring.mapped + _instance_ring.get_offset(slice);
 
-		memcpy(pData, &data, sizeof(data));
+		instance_slice_header header;
+		memset(&header, 0, sizeof(header));
+		extract_frustum_planes(&_VP[0][0], header.planes);
 
-		vkUnmapMemory(_vulkan_device, _cube_buffer.device_memory);
+		// Every cube shares the spin and scale; only the translation differs.
+		const glm::mat4x4 model = glm::scale(_model, glm::vec3(_instance_scale));
+		compose_translations(_simd_level, &model[0][0], _instance_x.data(), _instance_y.data(), _instance_z.data(), _instance_count, _instance_models);
+
+		float * instances = (float *)(mapped + _instance_data_offset);
+		if (_gpu_culling) {
+			// The compute pass does the culling and writes the draw; hand it
+			// everything.
+			_visible_instance_count = store_transforms(_simd_level, _instance_models, 0, _instance_count, nullptr, instances);
+		} else {
+			// The spin leaves the centres where they were, so test the grid
+			// positions directly and only upload what survives.
+			cull_spheres(_simd_level, header.planes, _instance_x.data(), _instance_y.data(), _instance_z.data(), _instance_radius.data(), _instance_count, _instance_visible.data());
+
+			VkDrawIndexedIndirectCommand * draws = (VkDrawIndexedIndirectCommand *)(mapped + _draw_list_offset);
+			_visible_instance_count = 0;
+			for (uint32_t b = 0; b < _draw_batch_count; b++) {
+				const uint32_t first = b * _draw_batch_size;
+				const uint32_t count = first < _instance_count ? (std::min)(_draw_batch_size, _instance_count - first) : 0;
+				const uint32_t written = count > 0 ? store_transforms(_simd_level, _instance_models, first, count, _instance_visible.data(), instances + first * 16) : 0;
+
+				draws[b] = { _cube_mesh.index_count, written, 0, 0, 0 };
+				_visible_instance_count += written;
+			}
+		}
 
-		//err = vkBindBufferMemory(_vulkan_device, buffer.buffer, buffer.device_memory, 0);
-		//assert(!err);
+		header.dispatch = { (_instance_count + cull_group_size - 1) / cull_group_size, 1, 1 };
+		header.count = _instance_count;
+		header.radius = _instance_radius.empty() ? 0.0f : _instance_radius[0];
+		memcpy(mapped, &header, sizeof(header));
 
-		_cube_buffer.info.buffer = _cube_buffer.buffer;
-		_cube_buffer.info.offset = 0;
-		_cube_buffer.info.range = sizeof(data);
+		flush_uniform_ring(_instance_ring, slice);
 	}
 
 	void wrapper::demo_build_render_pass() {
@@ -1300,7 +2359,7 @@ typedef struct VkImageCopy {
 		const VkDescriptorSetLayoutBinding layout_bindings[2] = {
 			{
 				0,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 				1,
 				VK_SHADER_STAGE_VERTEX_BIT,
 				NULL,
@@ -1475,7 +2534,7 @@ typedef struct VkImageCopy {
 
 		const VkDescriptorPoolSize type_counts[2] = {
 			{
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 				1,
 			},
 			{
@@ -1541,8 +2600,8 @@ typedef struct VkImageCopy {
 		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writes[0].dstSet = _descriptor_set;
 		writes[0].descriptorCount = 1;
-		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writes[0].pBufferInfo = &_cube_buffer.info;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writes[0].pBufferInfo = &_cube_uniforms.buffer.info;
 
 		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writes[1].dstSet = _descriptor_set;
@@ -1552,7 +2611,10 @@ typedef struct VkImageCopy {
 		writes[1].pImageInfo = texture_descriptors;
 
 		vkUpdateDescriptorSets(_vulkan_device, 2, writes, 0, NULL);
+	}
 
+	void wrapper::create_framebuffers() {
+		VkResult err;
 
 		VkImageView attachments[2];
 		attachments[1] = _depth_view;
@@ -1593,125 +2655,298 @@ typedef struct VkImageCopy {
 	}
 
 	void wrapper::demo_build_pipeline() {
-		VkPipelineVertexInputStateCreateInfo vi;
-		VkPipelineInputAssemblyStateCreateInfo ia;
-		VkPipelineRasterizationStateCreateInfo rs;
-		VkPipelineColorBlendStateCreateInfo cb;
-		VkPipelineDepthStencilStateCreateInfo ds;
-		VkPipelineViewportStateCreateInfo vp;
-		VkPipelineMultisampleStateCreateInfo ms;
-		VkDynamicState dynamicStateEnables[VK_DYNAMIC_STATE_RANGE_SIZE];
-		VkPipelineDynamicStateCreateInfo dynamicState;
 		VkResult err;
 
-		memset(dynamicStateEnables, 0, sizeof dynamicStateEnables);
-		memset(&dynamicState, 0, sizeof dynamicState);
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.pDynamicStates = dynamicStateEnables;
-
-		memset(&vi, 0, sizeof(vi));
-		vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-		memset(&ia, 0, sizeof(ia));
-		ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		ia.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-		memset(&rs, 0, sizeof(rs));
-		rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rs.polygonMode = VK_POLYGON_MODE_FILL;
-		rs.cullMode = VK_CULL_MODE_BACK_BIT;
-		rs.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rs.depthClampEnable = VK_FALSE;
-		rs.rasterizerDiscardEnable = VK_FALSE;
-		rs.depthBiasEnable = VK_FALSE;
-		rs.lineWidth = 1.0f;
-
-		memset(&cb, 0, sizeof(cb));
-		cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		VkPipelineColorBlendAttachmentState att_state[1];
-		memset(att_state, 0, sizeof(att_state));
-		att_state[0].colorWriteMask = 0xf;
-		att_state[0].blendEnable = VK_FALSE;
-		cb.attachmentCount = 1;
-		cb.pAttachments = att_state;
-
-		memset(&vp, 0, sizeof(vp));
-		vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		vp.viewportCount = 1;
-		dynamicStateEnables[dynamicState.dynamicStateCount++] = VK_DYNAMIC_STATE_VIEWPORT;
-		vp.scissorCount = 1;
-		dynamicStateEnables[dynamicState.dynamicStateCount++] = VK_DYNAMIC_STATE_SCISSOR;
-
-		memset(&ds, 0, sizeof(ds));
-		ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		ds.depthTestEnable = VK_TRUE;
-		ds.depthWriteEnable = VK_TRUE;
-		ds.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		ds.depthBoundsTestEnable = VK_FALSE;
-		ds.back.failOp = VK_STENCIL_OP_KEEP;
-		ds.back.passOp = VK_STENCIL_OP_KEEP;
-		ds.back.compareOp = VK_COMPARE_OP_ALWAYS;
-		ds.stencilTestEnable = VK_FALSE;
-		ds.front = ds.back;
-
-		memset(&ms, 0, sizeof(ms));
-		ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		ms.pSampleMask = NULL;
-		ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-		// Two stages: vs and fs
-
-		VkPipelineShaderStageCreateInfo shaderStages[2];
-		memset(&shaderStages, 0, 2 * sizeof(VkPipelineShaderStageCreateInfo));
-
-		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-
-		auto vert_shader_module = create_shader_module("cube-vert.spv");
-
-		shaderStages[0].module = vert_shader_module;
-		shaderStages[0].pName = "main";
-
-		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-		VkShaderModule frag_shader_module = create_shader_module("cube-frag.spv");
-
-		shaderStages[1].module = frag_shader_module;
-		shaderStages[1].pName = "main";
-
-		VkPipelineCacheCreateInfo pipeline_cache_create_info;
-		memset(&pipeline_cache_create_info, 0, sizeof(pipeline_cache_create_info));
-		pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-
-		err = vkCreatePipelineCache(_vulkan_device, &pipeline_cache_create_info, NULL, &_pipeline_cache);
+		if (_pipeline_cache_path.empty()) {
+			VkPipelineCacheCreateInfo pipeline_cache_create_info;
+			memset(&pipeline_cache_create_info, 0, sizeof(pipeline_cache_create_info));
+			pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+			err = vkCreatePipelineCache(_vulkan_device, &pipeline_cache_create_info, NULL, &_pipeline_cache);
+			assert(!err);
+		} else {
+			_pipeline_cache = load_pipeline_cache(_vulkan_device, _device_properties, _pipeline_cache_path, _pipeline_cache_stats);
+		}
+
+		_pipeline_builder.init(_vulkan_device, &_shaders, _pipeline_cache);
+
+		graphics_pipeline_description description;
+		description.vertex_shader = "cube-vert.spv";
+		description.fragment_shader = "cube-frag.spv";
+		description.layout = _pipeline_layout;
+		description.render_pass = _render_pass;
+
+		/*
+typedef struct VkVertexInputAttributeDescription {
+	uint32_t    location;
+	uint32_t    binding;
+	VkFormat    format;
+	uint32_t    offset;
+} VkVertexInputAttributeDescription;
+		*/
+		description.bindings.push_back({ 0, sizeof(vulkan_vertex), VK_VERTEX_INPUT_RATE_VERTEX });
+		description.attributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(vulkan_vertex, position) });
+		description.attributes.push_back({ 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(vulkan_vertex, uv) });
+
+		// Per-instance model matrix, one column per location.
+		description.bindings.push_back({ 1, sizeof(glm::mat4x4), VK_VERTEX_INPUT_RATE_INSTANCE });
+		for (uint32_t column = 0; column < 4; column++) {
+			description.attributes.push_back({ 2 + column, 1, VK_FORMAT_R32G32B32A32_SFLOAT, column * (uint32_t)sizeof(glm::vec4) });
+		}
+
+		auto create_start = std::chrono::high_resolution_clock::now();
+		pipeline_handle cube = _pipeline_builder.submit(description);
+
+		// Variants keep compiling on the workers while we start drawing the cube;
+		// demo_begin_frame merges the caches once they are all done.
+		const VkCullModeFlags cull_modes[] = { VK_CULL_MODE_NONE, VK_CULL_MODE_FRONT_BIT, VK_CULL_MODE_BACK_BIT };
+		const VkCompareOp depth_compares[] = { VK_COMPARE_OP_LESS, VK_COMPARE_OP_LESS_OR_EQUAL, VK_COMPARE_OP_GREATER, VK_COMPARE_OP_ALWAYS };
+		for (uint32_t i = 0; i < _pipeline_variant_count; ++i) {
+			graphics_pipeline_description variant = description;
+			variant.cull_mode = cull_modes[i % 3];
+			variant.depth_compare = depth_compares[(i / 3) % 4];
+			variant.blend = ((i / 12) % 2) != 0;
+			variant.depth_write = ((i / 24) % 2) == 0;
+			_pipeline_variants.push_back(_pipeline_builder.submit(variant));
+		}
+
+		_pipeline = cube.get();
+		assert(_pipeline != VK_NULL_HANDLE);
+		_pipeline_cache_stats.create_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - create_start).count();
+	}
+
+	void wrapper::demo_build_cull() {
+		VkResult err;
+
+		/*
+typedef struct VkDescriptorSetLayoutBinding {
+	uint32_t              binding;
+	VkDescriptorType      descriptorType;
+	uint32_t              descriptorCount;
+	VkShaderStageFlags    stageFlags;
+	const VkSampler*      pImmutableSamplers;
+} VkDescriptorSetLayoutBinding;
+		*/
+		const VkDescriptorSetLayoutBinding layout_bindings[2] = {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL },
+		};
+
+		const VkDescriptorSetLayoutCreateInfo descriptor_layout = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			NULL,
+			0,
+			2,
+			layout_bindings,
+		};
+
+		err = vkCreateDescriptorSetLayout(_vulkan_device, &descriptor_layout, NULL, &_cull_descriptor_set_layout);
+		assert(!err);
+
+		const VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			NULL,
+			0,
+			1,
+			&_cull_descriptor_set_layout,
+			0,
+			NULL,
+		};
+
+		err = vkCreatePipelineLayout(_vulkan_device, &pipeline_layout_create_info, NULL, &_cull_pipeline_layout);
+		assert(!err);
+
+		// A pool of its own, so swapchain rebuilds never touch the cull set.
+		const VkDescriptorPoolSize pool_size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2 };
+
+		const VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			NULL,
+			0,
+			1,
+			1,
+			&pool_size,
+		};
+
+		err = vkCreateDescriptorPool(_vulkan_device, &descriptor_pool_create_info, NULL, &_cull_descriptor_pool);
+		assert(!err);
+
+		const VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+			VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			NULL,
+			_cull_descriptor_pool,
+			1,
+			&_cull_descriptor_set_layout,
+		};
+
+		err = vkAllocateDescriptorSets(_vulkan_device, &descriptor_set_allocate_info, &_cull_descriptor_set);
 		assert(!err);
 
-		VkGraphicsPipelineCreateInfo pipeline_create_info;
+		// Both bindings address slice 0; the frame is picked with dynamic offsets.
+		VkDescriptorBufferInfo scene_info = _instance_ring.buffer.info;
+		scene_info.range = _instance_ring.slice_size;
+		const VkDescriptorBufferInfo visible_info = _cull_output.info;
+
+		VkWriteDescriptorSet writes[2];
+		memset(writes, 0, sizeof(writes));
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = _cull_descriptor_set;
+		writes[0].dstBinding = 0;
+		writes[0].descriptorCount = 1;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		writes[0].pBufferInfo = &scene_info;
+
+		writes[1] = writes[0];
+		writes[1].dstBinding = 1;
+		writes[1].pBufferInfo = &visible_info;
+
+		vkUpdateDescriptorSets(_vulkan_device, 2, writes, 0, NULL);
+
+		VkComputePipelineCreateInfo pipeline_create_info;
 		memset(&pipeline_create_info, 0, sizeof(pipeline_create_info));
-		pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipeline_create_info.layout = _pipeline_layout;
-		pipeline_create_info.stageCount = 2;
-
-		pipeline_create_info.pVertexInputState = &vi;
-		pipeline_create_info.pInputAssemblyState = &ia;
-		pipeline_create_info.pRasterizationState = &rs;
-		pipeline_create_info.pColorBlendState = &cb;
-		pipeline_create_info.pMultisampleState = &ms;
-		pipeline_create_info.pViewportState = &vp;
-		pipeline_create_info.pDepthStencilState = &ds;
-		pipeline_create_info.pStages = shaderStages;
-		pipeline_create_info.renderPass = _render_pass;
-		pipeline_create_info.pDynamicState = &dynamicState;
-
-		err = vkCreateGraphicsPipelines(_vulkan_device, _pipeline_cache, 1, &pipeline_create_info, NULL, &_pipeline);
+		pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeline_create_info.stage.module = _shaders.get("cull-comp.spv");
+		pipeline_create_info.stage.pName = "main";
+		pipeline_create_info.layout = _cull_pipeline_layout;
+
+		err = vkCreateComputePipelines(_vulkan_device, _pipeline_cache, 1, &pipeline_create_info, NULL, &_cull_pipeline);
+		assert(!err);
+	}
+
+	void wrapper::demo_record_cull(VkCommandBuffer command_buffer, uint32_t frame_id) {
+		const VkDeviceSize output_offset = frame_id * _cull_output_stride;
+
+		// Start from an empty draw; the cull pass counts survivors into it.
+		const VkDrawIndexedIndirectCommand empty_draw = { _cube_mesh.index_count, 0, 0, 0, 0 };
+		vkCmdUpdateBuffer(command_buffer, _cull_output.buffer, output_offset, sizeof(empty_draw), (const uint32_t *)&empty_draw);
+
+		VkBufferMemoryBarrier buffer_memory_barrier = {
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			_cull_output.buffer,
+			output_offset,
+			_cull_output_stride };
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1, &buffer_memory_barrier, 0, NULL);
+
+		const uint32_t dynamic_offsets[2] = { (uint32_t)_instance_ring.get_offset(frame_id), (uint32_t)output_offset };
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline_layout, 0, 1, &_cull_descriptor_set, 2, dynamic_offsets);
+
+		// The CPU sizes the dispatch for this frame's instance count.
+		vkCmdDispatchIndirect(command_buffer, _instance_ring.buffer.buffer, _instance_ring.get_offset(frame_id) + offsetof(instance_slice_header, dispatch));
+
+		buffer_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		buffer_memory_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, NULL, 1, &buffer_memory_barrier, 0, NULL);
+	}
+
+	void wrapper::demo_record_draws(VkCommandBuffer command_buffer, uint32_t frame_id, uint32_t first_batch, uint32_t batch_count) {
+		//VkPipeline pipeline;
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+		const uint32_t uniform_offset = (uint32_t)_cube_uniforms.get_offset(frame_id);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline_layout, 0, 1, &_descriptor_set, 1,
+			&uniform_offset);
+		VkViewport viewport;
+		memset(&viewport, 0, sizeof(viewport));
+		viewport.height = (float)_surface_height;
+		viewport.width = (float)_surface_width;
+		viewport.minDepth = (float)0.0f;
+		viewport.maxDepth = (float)1.0f;
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+		VkRect2D scissor;
+		memset(&scissor, 0, sizeof(scissor));
+		scissor.extent.width = _surface_width;
+		scissor.extent.height = _surface_height;
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+		vkCmdBindIndexBuffer(command_buffer, _cube_mesh.indices.buffer, 0, _cube_mesh.index_type);
+
+		// The instance counts live in this frame's slice of the instance ring
+		// (or are written by the cull pass), so they can change every frame
+		// without re-recording.
+		for (uint32_t b = first_batch; b < first_batch + batch_count; b++) {
+			VkBuffer instance_buffer = _instance_ring.buffer.buffer;
+			VkDeviceSize draw_offset = _instance_ring.get_offset(frame_id) + _draw_list_offset + b * sizeof(VkDrawIndexedIndirectCommand);
+			VkDeviceSize instance_offset = _instance_ring.get_offset(frame_id) + _instance_data_offset + (VkDeviceSize)b * _draw_batch_size * sizeof(glm::mat4x4);
+			if (_gpu_culling) {
+				instance_buffer = _cull_output.buffer;
+				draw_offset = frame_id * _cull_output_stride;
+				instance_offset = draw_offset + cull_output_data_offset;
+			}
+
+			const VkBuffer vertex_buffers[2] = { _cube_mesh.vertices.buffer, instance_buffer };
+			const VkDeviceSize vertex_offsets[2] = { 0, instance_offset };
+			vkCmdBindVertexBuffers(command_buffer, 0, 2, vertex_buffers, vertex_offsets);
+			vkCmdDrawIndexedIndirect(command_buffer, instance_buffer, draw_offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+
+	void wrapper::demo_record_secondary(uint32_t frame_id, uint32_t swapchain_id, uint32_t worker) {
+		cpu_scope scope("record_secondary");
+
+		VkCommandBuffer command_buffer = get_secondary_command_buffer(frame_id, swapchain_id, worker);
+
+		// Split the batches as evenly as possible; _recording_workers never
+		// exceeds the batch count, so nobody gets an empty share.
+		const uint32_t first_batch = worker * _draw_batch_count / _recording_workers;
+		const uint32_t last_batch = (worker + 1) * _draw_batch_count / _recording_workers;
+
+		/*
+typedef struct VkCommandBufferInheritanceInfo {
+	VkStructureType                  sType;
+	const void*                      pNext;
+	VkRenderPass                     renderPass;
+	uint32_t                         subpass;
+	VkFramebuffer                    framebuffer;
+	VkBool32                         occlusionQueryEnable;
+	VkQueryControlFlags              queryFlags;
+	VkQueryPipelineStatisticFlags    pipelineStatistics;
+} VkCommandBufferInheritanceInfo;
+		*/
+		const VkCommandBufferInheritanceInfo inheritance_info = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+			NULL,
+			_render_pass,
+			0,
+			_swapchain_framebuffers[swapchain_id],
+			VK_FALSE,
+			0,
+			0,
+		};
+
+		const VkCommandBufferBeginInfo command_buffer_info = {
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			NULL,
+			(VkCommandBufferUsageFlags)(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | (_rerecord_frames ? VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : 0)),
+			&inheritance_info,
+		};
+
+		VkResult err = vkBeginCommandBuffer(command_buffer, &command_buffer_info);
 		assert(!err);
 
-		vkDestroyShaderModule(_vulkan_device, frag_shader_module, NULL);
-		vkDestroyShaderModule(_vulkan_device, vert_shader_module, NULL);
+		demo_record_draws(command_buffer, frame_id, first_batch, last_batch - first_batch);
+
+		err = vkEndCommandBuffer(command_buffer);
+		assert(!err);
 	}
 
-	void wrapper::demo_perform_first_render(uint32_t swapchain_id) {
+	void wrapper::demo_perform_first_render(uint32_t frame_id, uint32_t swapchain_id) {
+		cpu_scope scope("record_primary");
+
+		VkCommandBuffer command_buffer = get_swapchain_command_buffer(frame_id, swapchain_id);
+
 		VkClearValue clear_values[2];
 		clear_values[0].color.float32[0] = 0.2f;
 		clear_values[0].color.float32[1] = 0.2f;
@@ -1755,14 +2990,22 @@ typedef struct VkImageCopy {
 		const VkCommandBufferBeginInfo command_buffer_info = {
 			VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 			NULL,
-			0,
+			_rerecord_frames ? (VkCommandBufferUsageFlags)VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : 0,
 			NULL,
 		};
 
 		VkResult err;
-		err = vkBeginCommandBuffer(_swapchain_command_buffers[swapchain_id], &command_buffer_info);
+		err = vkBeginCommandBuffer(command_buffer, &command_buffer_info);
 		assert(!err);
 
+		_gpu_profiler.reset(command_buffer, frame_id);
+		const uint32_t frame_pass = _gpu_profiler.begin_pass(command_buffer, frame_id, "frame");
+
+		const bool statistics = _recording_workers == 0;
+		if (statistics) {
+			_gpu_profiler.begin_statistics(command_buffer, frame_id);
+		}
+
 		/*
 		// We can use LAYOUT_UNDEFINED as a wildcard here because we don't care what
 		// happens to the previous contents of the image
@@ -1791,33 +3034,35 @@ typedef struct VkImageCopy {
 			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
 		};
 
+		// Source stage matches the acquire semaphore's wait stage, so the
+		// transition happens after the presentation engine releases the image.
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
 
-		vkCmdPipelineBarrier(_swapchain_command_buffers[swapchain_id], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
+		if (_gpu_culling) {
+			const uint32_t cull_pass = _gpu_profiler.begin_pass(command_buffer, frame_id, "cull");
+			demo_record_cull(command_buffer, frame_id);
+			_gpu_profiler.end_pass(command_buffer, frame_id, cull_pass);
+		}
 
-		vkCmdBeginRenderPass(_swapchain_command_buffers[swapchain_id], &render_pass_begin, VK_SUBPASS_CONTENTS_INLINE);
+		const uint32_t draw_pass = _gpu_profiler.begin_pass(command_buffer, frame_id, "draw");
 
-		//VkPipeline pipeline;
-		vkCmdBindPipeline(_swapchain_command_buffers[swapchain_id], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
-		vkCmdBindDescriptorSets(_swapchain_command_buffers[swapchain_id], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline_layout, 0, 1, &_descriptor_set, 0,
-			NULL);
-		VkViewport viewport;
-		memset(&viewport, 0, sizeof(viewport));
-		viewport.height = (float)_surface_height;
-		viewport.width = (float)_surface_width;
-		viewport.minDepth = (float)0.0f;
-		viewport.maxDepth = (float)1.0f;
-		vkCmdSetViewport(_swapchain_command_buffers[swapchain_id], 0, 1, &viewport);
+		if (_recording_workers > 0) {
+			vkCmdBeginRenderPass(command_buffer, &render_pass_begin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-		VkRect2D scissor;
-		memset(&scissor, 0, sizeof(scissor));
-		scissor.extent.width = _surface_width;
-		scissor.extent.height = _surface_height;
-		scissor.offset.x = 0;
-		scissor.offset.y = 0;
+			std::vector<VkCommandBuffer> secondaries(_recording_workers);
+			for (uint32_t w = 0; w < _recording_workers; w++) {
+				secondaries[w] = get_secondary_command_buffer(frame_id, swapchain_id, w);
+			}
+			vkCmdExecuteCommands(command_buffer, _recording_workers, secondaries.data());
+		} else {
+			vkCmdBeginRenderPass(command_buffer, &render_pass_begin, VK_SUBPASS_CONTENTS_INLINE);
 
-		vkCmdSetScissor(_swapchain_command_buffers[swapchain_id], 0, 1, &scissor);
-		vkCmdDraw(_swapchain_command_buffers[swapchain_id], 12 * 3, 1, 0, 0);
-		vkCmdEndRenderPass(_swapchain_command_buffers[swapchain_id]);
+			demo_record_draws(command_buffer, frame_id, 0, _draw_batch_count);
+		}
+
+		vkCmdEndRenderPass(command_buffer);
+
+		_gpu_profiler.end_pass(command_buffer, frame_id, draw_pass);
 		/*
 		VkImageMemoryBarrier prePresentBarrier = {
 			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
@@ -1837,20 +3082,29 @@ typedef struct VkImageCopy {
 		    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 			VK_ACCESS_MEMORY_READ_BIT,
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			_swapchain.get_present_layout(),
 			VK_QUEUE_FAMILY_IGNORED,
 			VK_QUEUE_FAMILY_IGNORED,
 			_swapchain_images[swapchain_id],
 			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } };
 
-		vkCmdPipelineBarrier(_swapchain_command_buffers[swapchain_id], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &pre_present_barrier);
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &pre_present_barrier);
+
+		if (statistics) {
+			_gpu_profiler.end_statistics(command_buffer, frame_id);
+		}
+		_gpu_profiler.end_pass(command_buffer, frame_id, frame_pass);
 
-		err = vkEndCommandBuffer(_swapchain_command_buffers[swapchain_id]);
+		err = vkEndCommandBuffer(command_buffer);
 		assert(!err);
 	}
 
 	void wrapper::demo_tick() {
+		cpu_scope scope("tick");
+
 		//vkDeviceWaitIdle(_vulkan_device);
+		demo_begin_frame();
+
 		demo_update();
 
 		demo_draw();
@@ -1859,67 +3113,84 @@ typedef struct VkImageCopy {
 		//vkDeviceWaitIdle(_vulkan_device);
 
 		_tick++;
-		//if (demo->frameCount != INT_MAX && demo->curFrame == demo->frameCount) {
-		//	PostQuitMessage(validation_error);
-		//}
 	}
 
-	void wrapper::demo_update() {
-		glm::mat4x4 MVP, model, VP;
-		int matrixSize = sizeof(MVP);
-		uint8_t * pData;
-		VkResult err;
+	void wrapper::demo_begin_frame() {
+		cpu_scope scope("begin_frame");
 
-		// Rotate 22.5 degrees around the Y axis
-		model = _model;
-		_model = glm::rotate(model, 0.5f, { 0.0f, 1.0f, 0.0f });
-		MVP = _VP * _model;
-		
-		err = vkMapMemory(_vulkan_device, _cube_buffer.device_memory, 0, _cube_buffer.memory_allocation_info.allocationSize, 0, (void **)&pData);
-		assert(!err);
+		// Only block on the slot we are about to overwrite; the other slots may
+		// still be queued or executing on the GPU.
+		const bool submitted = _frames[_frame_index].fence != VK_NULL_HANDLE;
+		retire_frame(_frames[_frame_index]);
+
+		{
+			cpu_scope deletions_scope("collect_deletions");
+			_deletion_queue.collect(_completed_serial);
+		}
 
-		memcpy(pData, (const void *)&MVP[0][0], matrixSize);
+		// This slot's queries are complete now that its fence has signalled,
+		// so reading them back never waits.
+		if (submitted) {
+			cpu_scope queries_scope("resolve_queries");
+			_gpu_profiler.resolve(_frame_index);
+		}
 
-		vkUnmapMemory(_vulkan_device, _cube_buffer.device_memory);
-		
+		// Out of date or suboptimal at the last acquire or present; rebuild
+		// here, between frames, rather than from inside demo_draw.
+		if (_swapchain.needs_recreate()) {
+			demo_resize();
+		}
+
+		// Pick up anything the streaming thread finished, and release staging
+		// memory from finished uploads; never block on either.
+		poll_streaming();
+		collect_upload_batches(false);
+
+		// Background pipeline builds are done; fold their caches into ours.
+		if (_pipeline_builder.running() && _pipeline_builder.idle()) {
+			cpu_scope pipelines_scope("merge_pipeline_caches");
+			_pipeline_builder.finish();
+		}
 	}
 
-	void wrapper::demo_draw() {
-		VkResult err;
-		VkSemaphore imageAcquiredSemaphore, drawCompleteSemaphore;
+	void wrapper::demo_update() {
+		cpu_scope scope("update");
 
-		VkSemaphoreCreateInfo semaphoreCreateInfo = {
-			VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-			NULL,
-			0,
-		};
+		// One step per frame around the Y axis, counting this one. Wrapped in
+		// double so long runs don't lose precision.
+		const double angle = fmod((double)(_tick + 1) * _rotation_step, 2.0 * 3.14159265358979323846);
+		_model = glm::rotate(glm::mat4(1.0f), (float)angle, { 0.0f, 1.0f, 0.0f });
+		_MVP = _VP * _model;
 
-		VkFence nullFence = VK_NULL_HANDLE;
+		// Both rings stay mapped, so these are plain writes into this frame's slice.
+		write_uniform_ring(_cube_uniforms, _frame_index, 0, (const void *)&_VP[0][0], sizeof(_VP));
+		write_instances(_frame_index);
+	}
 
-		err = vkCreateSemaphore(_vulkan_device, &semaphoreCreateInfo, NULL, &imageAcquiredSemaphore);
-		assert(!err);
+	void wrapper::demo_draw() {
+		cpu_scope scope("draw");
 
-		err = vkCreateSemaphore(_vulkan_device, &semaphoreCreateInfo, NULL, &drawCompleteSemaphore);
-		assert(!err);
+		VkResult err;
+		auto& frame = _frames[_frame_index];
+		assert(frame.fence == VK_NULL_HANDLE);
+
+		frame.image_acquired = _sync_pool.acquire_semaphore();
 
 		// Get the index of the next available swapchain image:
 		uint32_t current_swapchain = 0;
-		// no fencing
-		err = fpAcquireNextImageKHR(_vulkan_device, _vulkan_swapchain, UINT64_MAX, imageAcquiredSemaphore, (VkFence)0, &current_swapchain);
-		
-		if (err == VK_ERROR_OUT_OF_DATE_KHR) {
-			// demo->swapchain is out of date (e.g. the window was resized) and
-			// must be recreated:
-			demo_resize();
-			demo_draw();
-			vkDestroySemaphore(_vulkan_device, imageAcquiredSemaphore, NULL);
-			vkDestroySemaphore(_vulkan_device, drawCompleteSemaphore, NULL);
+		swapchain_status acquired;
+		{
+			cpu_scope acquire_scope("acquire");
+			acquired = _swapchain.acquire(frame.image_acquired, current_swapchain);
+		}
+		if (acquired == swapchain_status::out_of_date) {
+			// Nothing was acquired and the semaphore was never signalled, so it
+			// can go straight back to the pool; the slot is reused next tick,
+			// after demo_begin_frame has recreated the swapchain. A suboptimal
+			// image is still drawn and presented.
+			_sync_pool.release_semaphore(frame.image_acquired);
+			frame.image_acquired = VK_NULL_HANDLE;
 			return;
-		} else if (err == VK_SUBOPTIMAL_KHR) {
-			// demo->swapchain is not as optimal as it could be, but the platform's
-			// presentation engine will still present the image correctly.
-		} else {
-			assert(!err);
 		}
 
 		//flush_command_buffer();
@@ -1927,9 +3198,11 @@ typedef struct VkImageCopy {
 		// Wait for the present complete semaphore to be signaled to ensure
 		// that the image won't be rendered to until the presentation
 		// engine has fully released ownership to the application, and it is
-		// okay to render to the image.
+		// okay to render to the image. Only colour output has to wait; the
+		// frame's layout transition is chained to the same stage, and the
+		// cull pass ahead of it runs regardless.
 
-		VkPipelineStageFlags pipe_stage_flags = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		VkPipelineStageFlags pipe_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		/*
 		VkSubmitInfo submit_info = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 			.pNext = NULL,
@@ -1943,18 +3216,32 @@ typedef struct VkImageCopy {
 			.pSignalSemaphores = &drawCompleteSemaphore };
 			*/
 
+		if (_rerecord_frames) {
+			record_frame(_frame_index, current_swapchain);
+		}
+
+		VkCommandBuffer command_buffer = get_swapchain_command_buffer(_frame_index, current_swapchain);
+
+		frame.draw_complete = _sync_pool.acquire_semaphore();
+		frame.fence = _sync_pool.acquire_fence();
+		frame.serial = ++_submit_serial;
+
 		VkSubmitInfo submit_info = { 
 			VK_STRUCTURE_TYPE_SUBMIT_INFO,
 			NULL,
 			1,
-			&imageAcquiredSemaphore,
+			&frame.image_acquired,
 			&pipe_stage_flags,
 			1,
-			&_swapchain_command_buffers[current_swapchain],
+			&command_buffer,
 			1,
-			&drawCompleteSemaphore };
+			&frame.draw_complete };
 
-		err = vkQueueSubmit(_vulkan_queue, 1, &submit_info, nullFence);
+		{
+			cpu_scope submit_scope("submit");
+			std::lock_guard<std::mutex> lock(_queue_mutex);
+			err = vkQueueSubmit(_vulkan_queue, 1, &submit_info, frame.fence);
+		}
 		assert(!err);
 		/*
 		VkPresentInfoKHR present = {
@@ -1967,110 +3254,63 @@ typedef struct VkImageCopy {
 			.pWaitSemaphores = &drawCompleteSemaphore,
 		};
 		*/
-		VkPresentInfoKHR present_info = {
-			VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-			NULL,
-			1,
-			&drawCompleteSemaphore,
-			1,
-			&_vulkan_swapchain,
-			&current_swapchain,
-			NULL
-		};
-
-		// TBD/TODO: SHOULD THE "present" PARAMETER BE "const" IN THE HEADER?
-		err = fpQueuePresentKHR(_vulkan_queue, &present_info);
-		if (err == VK_ERROR_OUT_OF_DATE_KHR) {
-			// demo->swapchain is out of date (e.g. the window was resized) and
-			// must be recreated:
-			demo_resize();
-		} else if (err == VK_SUBOPTIMAL_KHR) {
-			// demo->swapchain is not as optimal as it could be, but the platform's
-			// presentation engine will still present the image correctly.
-		} else {
-			assert(!err);
-		}
+		_frame_index = (_frame_index + 1) % _frames_in_flight;
 
-		err = vkQueueWaitIdle(_vulkan_queue);
-		assert(err == VK_SUCCESS);
-
-		vkDestroySemaphore(_vulkan_device, imageAcquiredSemaphore, NULL);
-		vkDestroySemaphore(_vulkan_device, drawCompleteSemaphore, NULL);
+		// Out of date or suboptimal is picked up by the next demo_begin_frame.
+		cpu_scope present_scope("present");
+		_swapchain.present(frame.draw_complete, current_swapchain);
 	}
 
 	void wrapper::demo_resize() {
-
-		// In order to properly resize the window, we must re-create the swapchain
-		// AND redo the command buffers, etc.
-		//
-		// First, perform part of the demo_cleanup() function:
-
-		for (uint32_t i = 0; i < _swapchain_image_count; i++) {
-			vkDestroyFramebuffer(_vulkan_device, _swapchain_framebuffers[i], NULL);
-		}
+		cpu_scope scope("resize");
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// Only the swapchain, its views and framebuffers, the depth buffer and
+		// the command buffers that point at them depend on the surface size.
+		// Descriptors, pipelines and the uniform rings stay as they are. Frames
+		// still in flight may be using the old objects, so they go on the
+		// deletion queue tagged with the last submission, and are destroyed
+		// once that retires, rather than waiting for the GPU to drain here.
+		const uint64_t serial = _submit_serial;
+
+		_deletion_queue.retire(serial, [this, framebuffers = std::move(_swapchain_framebuffers), views = std::move(_swapchain_views),
+			depth_image = _depth_image, depth_view = _depth_view, depth_memory = _depth_memory]() mutable {
+			for (auto framebuffer : framebuffers) {
+				vkDestroyFramebuffer(_vulkan_device, framebuffer, NULL);
+			}
+			for (auto view : views) {
+				vkDestroyImageView(_vulkan_device, view, NULL);
+			}
+			vkDestroyImageView(_vulkan_device, depth_view, NULL);
+			vkDestroyImage(_vulkan_device, depth_image, NULL);
+			free_memory(depth_memory);
+		});
 		_swapchain_framebuffers.clear();
-		
-		//vkDestroyDescriptorPool(_vulkan_device, _descriptor_pool, NULL);
-
-		//vkDestroyPipeline(_vulkan_device, _pipeline, NULL);
-		//vkDestroyPipelineCache(_vulkan_device, _pipeline_cache, NULL);
-		//vkDestroyRenderPass(_vulkan_device, _render_pass, NULL);
-		//vkDestroyPipelineLayout(_vulkan_device, _pipeline_layout, NULL);
-		//vkDestroyDescriptorSetLayout(_vulkan_device, _descriptor_set_layout, NULL);
-
-		/*
-		vkDestroyImageView(_vulkan_device, _demo_texture.view, NULL);
-		vkDestroyImage(_vulkan_device, _demo_texture.image, NULL);
-		vkFreeMemory(_vulkan_device, _demo_texture.device_memory, NULL);
-		vkDestroySampler(_vulkan_device, _demo_texture.sampler, NULL);
-		*/
-
-		vkDestroyImageView(_vulkan_device, _depth_view, NULL);
-		vkDestroyImage(_vulkan_device, _depth_image, NULL);
-		vkFreeMemory(_vulkan_device, _depth_device_memory, NULL);
-
-		/*
-		vkDestroyBuffer(_vulkan_device, _cube_buffer.buffer, NULL);
-		vkFreeMemory(_vulkan_device, _cube_buffer.device_memory, NULL);
-		*/
-
-		for (uint32_t i = 0; i < _swapchain_image_count; i++) {
-			vkDestroyImageView(_vulkan_device, _swapchain_views[i], NULL);
-			vkFreeCommandBuffers(_vulkan_device, _vulkan_command_pool, 1, &_swapchain_command_buffers[i]);
-		}
-
 		_swapchain_views.clear();
-		_swapchain_command_buffers.clear();
-		//vkDestroyCommandPool(_vulkan_device, _vulkan_command_pool, NULL);
-
 
-		// Second, re-perform the demo_prepare() function, which will re-create the
-		// swapchain:
+		retire_swapchain_command_buffers(serial);
 
 		create_swapchain();
 
-		create_command_buffer();
-
-		create_surface_depth_image();
-
-		//_demo_texture = create_texture("test.png");
-
-		//demo_setup_cube();
-
-		//demo_build_render_pass();
+		// The depth transition goes out as an upload batch, which is fenced
+		// and collected later, instead of a submit and vkQueueWaitIdle.
+		auto upload = begin_upload_batch();
+		create_surface_depth_image(&upload);
+		submit_upload_batch(upload);
 
-		//demo_build_pipeline();
+		create_framebuffers();
 
-		create_swapchain_command_buffers();
+		if (!_rerecord_frames) {
+			create_swapchain_command_buffers();
+		}
 
-		demo_prepare_pipeline_descriptors();
+		record_swapchain_command_buffers();
 
-		
-		for (uint32_t i = 0; i < _swapchain_image_count; i++) {
-			demo_perform_first_render(i);
-		}
-		
+		auto end = std::chrono::high_resolution_clock::now();
 
-		flush_command_buffer();
+		_resize_stats.resizes++;
+		_resize_stats.last_ms = std::chrono::duration<double, std::milli>(end - start).count();
+		_resize_stats.max_ms = (std::max)(_resize_stats.max_ms, _resize_stats.last_ms);
 	}
 }
\ No newline at end of file
@@ -1,8 +1,13 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <vulkan/vulkan.h>
 #include <assert.h>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <vector>
 
 #include <glm/mat4x4.hpp>
@@ -11,6 +16,21 @@
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/glm.hpp>
 
+#include "vulkan_allocator.hpp"
+#include "vulkan_deletion_queue.hpp"
+#include "vulkan_gpu_profiler.hpp"
+#include "vulkan_pipeline_builder.hpp"
+#include "vulkan_pipeline_cache.hpp"
+#include "vulkan_shader_library.hpp"
+#include "vulkan_streamer.hpp"
+#include "texture_decoder.hpp"
+#include "vulkan_swapchain.hpp"
+#include "vulkan_sync_pool.hpp"
+#include "transform_batch.hpp"
+#include "mipmap.hpp"
+#include "texture_codec.hpp"
+#include "worker_group.hpp"
+
 namespace vulkan {
 
 	struct vulkan_texture {
@@ -19,30 +39,165 @@ namespace vulkan {
 		VkImage image = VK_NULL_HANDLE;
 		VkImageLayout imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-		VkMemoryAllocateInfo memory_allocation_info;
-		VkDeviceMemory device_memory = VK_NULL_HANDLE;
+		memory_allocation memory;
 		VkImageView view = VK_NULL_HANDLE;
 		uint32_t width = 0, height = 0;
+		uint32_t mip_levels = 1;
+		VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	};
+
+	// How textures are sampled. Trilinear blends between mip levels;
+	// anisotropic adds up to 16x anisotropy on top, where the device has the
+	// feature, and is trilinear otherwise.
+	enum class sampler_filter {
+		nearest,
+		bilinear,
+		trilinear,
+		anisotropic,
 	};
 
+	const char * sampler_filter_name(sampler_filter filter);
+
 	struct vulkan_buffer {
-		VkBuffer buffer;
-		VkMemoryAllocateInfo memory_allocation_info;
-		VkDeviceMemory device_memory;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		memory_allocation memory;
 		VkDescriptorBufferInfo info;
 	};
 
+	// Interleaved vertex layout of the demo meshes; must match the vertex input
+	// in demo_build_pipeline and shaders/cube.vert.
+	struct vulkan_vertex {
+		float position[3];
+		float uv[2];
+	};
+
+	// Vertex and index data in device-local memory. Indices are 16-bit unless
+	// the mesh has more vertices than that can address.
+	struct vulkan_mesh {
+		vulkan_buffer vertices;
+		vulkan_buffer indices;
+		uint32_t index_count = 0;
+		VkIndexType index_type = VK_INDEX_TYPE_UINT16;
+	};
+
+	// One slot of the frames-in-flight ring. The CPU only waits on the fence of
+	// the slot it is about to reuse, so up to N frames can be queued on the GPU.
+	// The sync objects are borrowed from the wrapper's sync_pool for the lifetime
+	// of one submission and handed back once the fence retires.
+	struct vulkan_frame {
+		VkFence fence = VK_NULL_HANDLE;
+		VkSemaphore image_acquired = VK_NULL_HANDLE;
+		VkSemaphore draw_complete = VK_NULL_HANDLE;
+		uint64_t serial = 0;			// submission number, for the deletion queue
+	};
+
+	// A single uniform buffer split into one aligned slice per frame in flight.
+	// It is mapped once at creation and stays mapped; slices are selected with a
+	// dynamic descriptor offset. When the memory is not host-coherent, writes are
+	// followed by an explicit vkFlushMappedMemoryRanges over the touched slice.
+	struct vulkan_uniform_ring {
+		vulkan_buffer buffer;
+		uint8_t * mapped = nullptr;
+		bool coherent = true;
+
+		VkDeviceSize slice_size = 0;
+		VkDeviceSize slice_stride = 0;
+		uint32_t slice_count = 0;
+
+		VkDeviceSize get_offset(uint32_t slice) const {
+			return slice * slice_stride;
+		}
+	};
+
+	// Copies and layout transitions for any number of resources, recorded into
+	// one command buffer and submitted once with a fence. Staging buffers are
+	// owned by the batch and only freed once that fence has signalled.
+	struct vulkan_upload_batch {
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		std::vector<vulkan_buffer> staging;
+		uint32_t resource_count = 0;
+
+		// Released to the sync pool along with the fence.
+		std::vector<VkSemaphore> wait_semaphores;
+		std::vector<VkPipelineStageFlags> wait_stages;
+	};
+
+	struct upload_stats {
+		uint32_t batches = 0;
+		uint32_t resources = 0;
+		uint32_t submits = 0;
+		uint32_t waits = 0;				// blocking fence waits
+
+		// Against one submit + vkQueueWaitIdle per resource.
+		uint32_t submits_avoided = 0;
+		uint32_t waits_avoided = 0;
+
+		VkDeviceSize staging_bytes_pending = 0;
+		VkDeviceSize staging_bytes_high_water = 0;
+	};
+
+	struct texture_stats {
+		uint32_t textures = 0;
+		uint32_t mip_chains_blitted = 0;	// generated on the GPU with vkCmdBlitImage
+		uint32_t mip_chains_cpu = 0;		// box-filtered into the staging buffer
+		double cpu_mip_ms = 0.0;
+		uint32_t compressed = 0;			// block data loaded from KTX2
+		VkDeviceSize bytes = 0;				// texel data across every level
+	};
+
+	struct recording_stats {
+		uint32_t threads = 0;			// 0 when recorded inline
+		uint32_t draws = 0;				// indirect draws per frame
+		uint32_t command_buffers = 0;	// primary and secondary
+		double record_ms = 0.0;			// last full re-record
+
+		// Re-recording every frame.
+		uint64_t frames_recorded = 0;
+		double frame_record_ms = 0.0;			// last frame
+		double frame_record_ms_total = 0.0;
+	};
+
+	struct resize_stats {
+		uint32_t resizes = 0;
+		double last_ms = 0.0;
+		double max_ms = 0.0;
+		size_t deletions_pending = 0;	// retired objects still waiting on the GPU
+	};
+
 	class wrapper {
 	public:
-		wrapper(bool validate);
+		wrapper(bool validate, uint32_t frames_in_flight = 2);
 		~wrapper();
 
+#ifdef _WIN32
 		void init(HWND hw, HINSTANCE hi);
+#endif
+		// No window, surface or WSI extensions: frames are rendered into a
+		// pseudo-swapchain of offscreen images and "presented" by a submit
+		// that fences the image, so the same frame loop runs anywhere there
+		// is a graphics queue, software ICDs included.
+		void init_headless(uint32_t width, uint32_t height);
+
+		// create_surface is empty for headless.
+		void init_device(const std::function<VkSurfaceKHR(VkInstance)>& create_surface);
+
+		bool is_headless() const {
+			return _headless;
+		}
 
 		void create_swapchain();
+		// Fills levels 1 onward by blitting each level into the next. Expects
+		// every level in TRANSFER_DST_OPTIMAL with level 0 written, and leaves
+		// them all in SHADER_READ_ONLY_OPTIMAL. Graphics queue only.
+		void generate_mipmaps(VkCommandBuffer command_buffer, VkImage image, uint32_t width, uint32_t height, uint32_t mip_levels);
 		void set_image_layout(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout old_image_layout, VkImageLayout new_image_layout, VkAccessFlagBits srcAccessMask);
+		void set_image_layout(VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags aspectMask, VkImageLayout old_image_layout, VkImageLayout new_image_layout, VkAccessFlagBits srcAccessMask);
 		void create_command_buffer();
-		void create_surface_depth_image();
+		// With a batch the layout transition rides along with it rather than
+		// going through the blocking setup command buffer.
+		void create_surface_depth_image(vulkan_upload_batch * batch = nullptr);
+		void create_framebuffers();
 
 		void destroy_vulkan_texture(vulkan_texture& texture) {
 			if (texture.sampler != VK_NULL_HANDLE) {
@@ -57,16 +212,203 @@ namespace vulkan {
 				vkDestroyImageView(_vulkan_device, texture.view, NULL);
 			}
 
-			if (texture.device_memory != VK_NULL_HANDLE) {
-				vkFreeMemory(_vulkan_device, texture.device_memory, NULL);
+			_allocator.free(texture.memory);
+		}
+
+		vulkan_texture load_texture(VkCommandBuffer command_buffer, const char *filename, VkImageTiling tiling, VkImageUsageFlags usage, VkFlags required_properties);
+
+		// Without a batch the texture is uploaded and waited on immediately.
+		vulkan_texture create_texture(const char * filename, bool stage_textures = false, vulkan_upload_batch * batch = nullptr);
+
+		// Looks for <name>.<format>.ktx2, as written by --convert-texture, in
+		// the best block format the device can sample and uploads its levels
+		// as they are. Falls back to create_texture on <name>.png.
+		vulkan_texture create_compressed_texture(const char * name, vulkan_upload_batch * batch = nullptr);
+
+		vulkan_upload_batch begin_upload_batch();
+		void submit_upload_batch(vulkan_upload_batch& batch);
+		void collect_upload_batches(bool wait);
+
+		// Submits the batch and blocks until it, and only it, has completed;
+		// other uploads in flight carry on.
+		void finish_upload_batch(vulkan_upload_batch& batch);
+
+		// Hands a staging buffer to the batch, to be freed once its fence signals.
+		void add_staging(vulkan_upload_batch& batch, const vulkan_buffer& staging);
+
+		const upload_stats& get_upload_stats() const {
+			return _upload_stats;
+		}
+
+		// Background uploads on the transfer queue. Results show up in
+		// get_streamed_* once poll_streaming has acquired them, which
+		// demo_begin_frame does every frame.
+		uint64_t stream_texture(const char * filename);
+		uint64_t stream_buffer(const void * data, VkDeviceSize size, VkBufferUsageFlags usage);
+		void poll_streaming();
+
+		const vulkan_texture * get_streamed_texture(uint64_t id) const;
+		const vulkan_buffer * get_streamed_buffer(uint64_t id) const;
+
+		streamer_stats get_streamer_stats() const {
+			return _streamer.get_stats();
+		}
+
+		// Threads decoding streamed textures, each file on one of them; 0
+		// picks one per spare hardware thread. Set before init.
+		void set_decode_threads(uint32_t count) {
+			_decode_threads = count;
+		}
+
+		texture_decoder_stats get_decoder_stats() const {
+			return _texture_decoder.get_stats();
+		}
+
+		bool has_transfer_queue() const {
+			return _transfer_queue_family != _graphics_queue_family;
+		}
+
+		// Where the pipeline cache is loaded from at init and saved to on
+		// shutdown; set before init. An empty path disables it.
+		void set_pipeline_cache_path(const std::string& path) {
+			_pipeline_cache_path = path;
+		}
+
+		const pipeline_cache_stats& get_pipeline_cache_stats() const {
+			return _pipeline_cache_stats;
+		}
+
+		// Upper bound on instances drawn per frame; sizes the instance ring, so
+		// set before init.
+		void set_instance_capacity(uint32_t capacity) {
+			_instance_capacity = capacity > 0 ? capacity : 1;
+		}
+
+		// Takes effect on the next frame without re-recording anything.
+		void set_instance_count(uint32_t count);
+
+		// Cull instances against the view frustum in a compute pass and draw
+		// the survivors indirectly; set before init. Ignored if the graphics
+		// queue cannot run compute.
+		void set_gpu_culling(bool enabled) {
+			_gpu_culling = enabled;
+		}
+
+		bool get_gpu_culling() const {
+			return _gpu_culling;
+		}
+
+		uint32_t get_instance_count() const {
+			return _instance_count;
+		}
+
+		// Instances that passed the CPU frustum test last frame; everything
+		// when culling runs on the GPU instead.
+		uint32_t get_visible_instance_count() const {
+			return _visible_instance_count;
+		}
+
+		// Kernels used for the CPU-side instance update; defaults to the best
+		// the machine supports.
+		void set_simd_level(simd_level level) {
+			_simd_level = level;
+		}
+
+		simd_level get_simd_level() const {
+			return _simd_level;
+		}
+
+		// Give create_texture's textures a full mip chain, blitted on the GPU
+		// where the format allows linear blits and box-filtered on the CPU
+		// otherwise. Set before init.
+		void set_texture_mipmaps(bool enabled) {
+			_texture_mipmaps = enabled;
+		}
+
+		// Sampler for textures; set before init.
+		void set_texture_filter(sampler_filter filter) {
+			_texture_filter = filter;
+		}
+
+		sampler_filter get_texture_filter() const {
+			return _texture_filter;
+		}
+
+		// Load the demo texture through create_compressed_texture, enabling
+		// whichever of BC and ETC2 the device supports. Set before init.
+		void set_compressed_textures(bool enabled) {
+			_compressed_textures = enabled;
+		}
+
+		const texture_stats& get_texture_stats() const {
+			return _texture_stats;
+		}
+
+		// Record the swapchain command buffers on this many threads, each
+		// drawing its share of the draw batches into secondary command buffers
+		// from its own per-frame pools; 0 records everything inline on the
+		// calling thread. Set before init.
+		void set_recording_threads(uint32_t threads) {
+			_recording_threads = threads;
+		}
+
+		// Instances per indirect draw when recording in parallel; the draw
+		// list is the instance stream cut into batches of this size. Set
+		// before init.
+		void set_draw_batch_size(uint32_t size) {
+			_draw_batch_size = size > 0 ? size : 1;
+		}
+
+		// Record each frame's command buffers just before submitting it, from
+		// transient per-frame pools that are reset whole every frame, instead
+		// of pre-recording one per swapchain image. Lets the scene change
+		// freely between frames and makes resize cheaper. Set before init.
+		void set_rerecord_frames(bool enabled) {
+			_rerecord_frames = enabled;
+		}
+
+		bool get_rerecord_frames() const {
+			return _rerecord_frames;
+		}
+
+		// Radians the scene turns per frame. The angle is worked out from the
+		// frame number rather than accumulated, so frame N always draws the
+		// same scene however long the frames before it took.
+		void set_rotation_step(float radians) {
+			_rotation_step = radians;
+		}
+
+		const recording_stats& get_recording_stats() const {
+			return _recording_stats;
+		}
+
+		// Extra pipelines compiled in the background at init to exercise the
+		// build queue; set before init.
+		void set_pipeline_variant_count(uint32_t count) {
+			_pipeline_variant_count = count;
+		}
+
+		pipeline_builder_stats get_pipeline_builder_stats() const {
+			return _pipeline_builder.get_stats();
+		}
+
+		uint32_t get_pipeline_variants_ready() const {
+			uint32_t ready = 0;
+			for (auto& variant : _pipeline_variants) {
+				ready += variant.ready() ? 1 : 0;
 			}
+			return ready;
 		}
 
-		vulkan_texture wrapper::load_texture(const char *filename, VkImageTiling tiling, VkImageUsageFlags usage, VkFlags required_properties);
+		shader_library& get_shader_library() {
+			return _shaders;
+		}
 
-		vulkan_texture create_texture(const char * filename, bool stage_textures = false);
+		shader_library_stats get_shader_library_stats() const {
+			return _shaders.get_stats();
+		}
 
-		static VkImageCreateInfo create_image_defaults(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM) {
+		static VkImageCreateInfo create_image_defaults(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, uint32_t mip_levels = 1) {
 			return {
 				VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 				NULL,
@@ -74,7 +416,7 @@ namespace vulkan {
 				VK_IMAGE_TYPE_2D,
 				format,
 				{ width, height, 1 },
-				1,
+				mip_levels,
 				1,
 				VK_SAMPLE_COUNT_1_BIT,
 				VK_IMAGE_TILING_OPTIMAL,
@@ -114,10 +456,34 @@ namespace vulkan {
 			return image;
 		}
 
-		std::pair<VkDeviceMemory, VkMemoryAllocateInfo> allocate_image_memory(VkImage image, VkFlags required_properties);
-		std::pair<VkDeviceMemory, VkMemoryAllocateInfo> allocate_buffer_memory(VkBuffer buffer, VkFlags required_properties);
+		memory_allocation allocate_image_memory(VkImage image, VkFlags required_properties, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL);
+		memory_allocation allocate_buffer_memory(VkBuffer buffer, VkFlags required_properties);
+
+		void free_memory(memory_allocation& allocation) {
+			_allocator.free(allocation);
+		}
+
+		allocator_stats get_allocator_stats() const {
+			return _allocator.get_stats();
+		}
+
+		vulkan_buffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkFlags required_properties);
+		void destroy_buffer(vulkan_buffer& buffer);
+
+		// A device-local buffer filled through a staging copy recorded into batch;
+		// usable by anything submitted after the batch.
+		vulkan_buffer create_device_buffer(const void * data, VkDeviceSize size, VkBufferUsageFlags usage, vulkan_upload_batch& batch);
+
+		vulkan_mesh create_mesh(const std::vector<vulkan_vertex>& vertices, const std::vector<uint32_t>& indices, vulkan_upload_batch& batch);
+		void destroy_mesh(vulkan_mesh& mesh);
+
+		vulkan_uniform_ring create_uniform_ring(VkDeviceSize slice_size, uint32_t slice_count, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+		void write_uniform_ring(vulkan_uniform_ring& ring, uint32_t slice, VkDeviceSize offset, const void * data, VkDeviceSize size);
+		// For callers that write through ring.mapped directly.
+		void flush_uniform_ring(vulkan_uniform_ring& ring, uint32_t slice);
+		void destroy_uniform_ring(vulkan_uniform_ring& ring);
 
-		static VkImageViewCreateInfo create_image_view_defaults(VkImage image = VK_NULL_HANDLE, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM) {
+		static VkImageViewCreateInfo create_image_view_defaults(VkImage image = VK_NULL_HANDLE, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, uint32_t mip_levels = 1) {
 			return {
 				VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
 				NULL,
@@ -126,7 +492,7 @@ namespace vulkan {
 				VK_IMAGE_VIEW_TYPE_2D,
 				format,
 				{ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
-				{ VK_IMAGE_ASPECT_COLOR_BIT, 0,  1, 0,  1 }
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0,  mip_levels, 0,  1 }
 			};
 		}
 
@@ -182,6 +548,30 @@ namespace vulkan {
 			};
 		}
 
+		// The defaults with filter applied, sampling all of mip_levels.
+		// max_anisotropy only matters for anisotropic, which also needs the
+		// samplerAnisotropy feature enabled.
+		static VkSamplerCreateInfo create_sampler_preset(sampler_filter filter, uint32_t mip_levels, float max_anisotropy) {
+			auto info = create_sampler_defaults();
+
+			if (filter != sampler_filter::nearest) {
+				info.magFilter = VK_FILTER_LINEAR;
+				info.minFilter = VK_FILTER_LINEAR;
+			}
+
+			if (filter == sampler_filter::trilinear || filter == sampler_filter::anisotropic) {
+				info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			}
+
+			if (filter == sampler_filter::anisotropic && max_anisotropy > 1.0f) {
+				info.anisotropyEnable = VK_TRUE;
+				info.maxAnisotropy = max_anisotropy;
+			}
+
+			info.maxLod = (float)(mip_levels - 1);
+			return info;
+		}
+
 		VkSampler create_sampler(VkSamplerCreateInfo& info) {
 			VkSampler sampler;
 			VkResult err;
@@ -235,105 +625,138 @@ namespace vulkan {
 				0,
 				NULL };
 
-			err = vkQueueSubmit(_vulkan_queue, 1, &submit_info, nullFence);
-			assert(!err);
+			{
+				std::lock_guard<std::mutex> lock(_queue_mutex);
 
-			err = vkQueueWaitIdle(_vulkan_queue);
-			assert(!err);
+				err = vkQueueSubmit(_vulkan_queue, 1, &submit_info, nullFence);
+				assert(!err);
+
+				err = vkQueueWaitIdle(_vulkan_queue);
+				assert(!err);
+			}
 
 			vkFreeCommandBuffers(_vulkan_device, _vulkan_command_pool, 1, command_buffers);
 			_vulkan_command_buffer = VK_NULL_HANDLE;
 		}
 
-		void create_swapchain_command_buffers() {
-			VkResult err;
-			const VkCommandBufferAllocateInfo command_allocate_info = {
-				VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-				NULL,
-				_vulkan_command_pool,
-				VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-				1,
-			};
-			for (uint32_t i = 0; i < _swapchain_image_count; i++) {
-				VkCommandBuffer command_buffer;
-
-				err = vkAllocateCommandBuffers(_vulkan_device, &command_allocate_info, &command_buffer);
-				assert(!err);
-
-				_swapchain_command_buffers.push_back(command_buffer);
-			}
+		// Re-recorded frames have one buffer per slot, whichever image it draws.
+		VkCommandBuffer get_swapchain_command_buffer(uint32_t frame_id, uint32_t swapchain_id) const {
+			return _swapchain_command_buffers[_rerecord_frames ? frame_id : frame_id * _swapchain_image_count + swapchain_id];
 		}
 
-		VkShaderModule create_shader_module(const char * filename) {
-
-			auto load_code = [](const char * filename, size_t& psize) -> void * {
-				long int size;
-				size_t retval;
-				void * shader_code;
+		VkCommandBuffer get_secondary_command_buffer(uint32_t frame_id, uint32_t swapchain_id, uint32_t worker) const {
+			const uint32_t buffer = _rerecord_frames ? frame_id : frame_id * _swapchain_image_count + swapchain_id;
+			return _secondary_command_buffers[buffer * _recording_workers + worker];
+		}
 
-				FILE *fp = fopen(filename, "rb");
-				if (!fp)
-					return NULL;
+		// One command buffer per (frame slot, swapchain image) pair, so a buffer is
+		// never resubmitted while an earlier submission of it is still pending.
+		// In parallel mode each pair also gets one secondary per worker.
+		void create_swapchain_command_buffers();
+		void retire_swapchain_command_buffers(uint64_t serial);
+		void record_swapchain_command_buffers();
+		void record_frame(uint32_t frame_id, uint32_t swapchain_id);
 
-				fseek(fp, 0L, SEEK_END);
-				size = ftell(fp);
+		void demo_setup_cube(vulkan_upload_batch& upload);
 
-				fseek(fp, 0L, SEEK_SET);
+		void demo_build_render_pass();
+		void demo_build_pipeline();
+		void demo_build_cull();
+		void demo_record_cull(VkCommandBuffer command_buffer, uint32_t frame_id);
+		void demo_record_draws(VkCommandBuffer command_buffer, uint32_t frame_id, uint32_t first_batch, uint32_t batch_count);
+		void demo_record_secondary(uint32_t frame_id, uint32_t swapchain_id, uint32_t worker);
+		void demo_prepare_pipeline_descriptors();
 
-				shader_code = malloc(size);
-				retval = fread(shader_code, size, 1, fp);
-				assert(retval == 1);
+		void demo_perform_first_render(uint32_t frame_id, uint32_t swapchain_id);
 
-				psize = size;
+		bool memory_type_from_properties(uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex);
 
-				fclose(fp);
-				return shader_code;
-			};
+		void create_frames();
+		void retire_frame(vulkan_frame& frame);
+		void wait_frames_idle();
 
-			VkShaderModule vert_shader_module;
-			{
-				size_t size;
+		void demo_tick();
+		void demo_begin_frame();
+		void demo_update();
+		void write_instances(uint32_t slice);
+		void demo_draw();
 
-				void * vert_shader_code = load_code(filename, size);
+		// Rebuilds only what depends on the surface size; the old objects are
+		// retired through the deletion queue instead of draining the GPU.
+		// demo_begin_frame calls it whenever the swapchain reports it is out of
+		// date or suboptimal.
+		void demo_resize();
 
-				VkShaderModuleCreateInfo module_create_info;
-				VkResult err;
+		// Present mode, swapchain image count and frames in flight; set before
+		// init. Overrides the frames_in_flight given to the constructor.
+		void set_swapchain_policy(const swapchain_policy& policy) {
+			_swapchain_policy = policy;
+			_frames_in_flight = policy.frames_in_flight > 0 ? policy.frames_in_flight : 1;
+		}
 
-				module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-				module_create_info.pNext = NULL;
+		present_stats get_present_stats() const {
+			return _swapchain.get_stats();
+		}
 
-				module_create_info.codeSize = size;
-				module_create_info.pCode = (uint32_t *)vert_shader_code;
-				module_create_info.flags = 0;
+		// Time the frame, cull and draw passes with timestamp queries, and
+		// optionally count shader invocations with a pipeline-statistics
+		// query; set before init. Statistics need the pipelineStatisticsQuery
+		// feature and are only gathered when recording inline, since queries
+		// may not stay active across secondary command buffers.
+		void set_gpu_profiling(bool timestamps, bool pipeline_statistics) {
+			_gpu_timestamps = timestamps;
+			_gpu_pipeline_statistics = pipeline_statistics;
+		}
 
-				err = vkCreateShaderModule(_vulkan_device, &module_create_info, NULL, &vert_shader_module);
-				assert(!err);
+		gpu_profiler_stats get_gpu_profiler_stats() const {
+			return _gpu_profiler.get_stats();
+		}
 
-				free(vert_shader_code);
+		resize_stats get_resize_stats() const {
+			resize_stats stats = _resize_stats;
+			stats.deletions_pending = _deletion_queue.size();
+			return stats;
+		}
 
-			}
+		uint32_t get_frames_in_flight() const {
+			return _frames_in_flight;
+		}
 
-			return vert_shader_module;
+		uint32_t get_tick() const {
+			return _tick;
 		}
 
-		void demo_setup_cube();
+		sync_pool_stats get_sync_pool_stats() const {
+			return _sync_pool.get_stats();
+		}
+	private:
+		uint32_t _tick = 0;
+		bool _validate;
+		bool _headless = false;
 
-		void demo_build_render_pass();
-		void demo_build_pipeline();
-		void demo_prepare_pipeline_descriptors();
+		uint32_t _frames_in_flight = 2;
+		uint32_t _frame_index = 0;
+		std::vector<vulkan_frame> _frames;
+		sync_pool _sync_pool;
 
-		void demo_perform_first_render(uint32_t swapchain_id);
+		// Serial of the last frame submitted, and of the newest one known to
+		// have finished on the GPU.
+		uint64_t _submit_serial = 0;
+		uint64_t _completed_serial = 0;
+		deletion_queue _deletion_queue;
+		resize_stats _resize_stats;
 
-		bool memory_type_from_properties(uint32_t typeBits, VkFlags requirements_mask, uint32_t *typeIndex);
+		std::vector<vulkan_upload_batch> _pending_uploads;
+		upload_stats _upload_stats;
 
-		void demo_tick();
-		void demo_update();
-		void demo_draw();
+		bool _texture_mipmaps = true;
+		sampler_filter _texture_filter = sampler_filter::trilinear;
+		float _max_anisotropy = 1.0f;		// 1 unless samplerAnisotropy was enabled
+		texture_stats _texture_stats;
 
-		void demo_resize();
-	private:
-		uint32_t _tick = 0;
-		bool _validate;
+		bool _compressed_textures = false;
+		bool _texture_compression_bc = false;	// enabled on the device
+		bool _texture_compression_etc2 = false;
 
 		uint32_t _surface_width = 1280, _surface_height = 720;
 
@@ -344,6 +767,9 @@ namespace vulkan {
 		VkCommandBuffer _vulkan_command_buffer = VK_NULL_HANDLE;
 
 		VkPhysicalDeviceMemoryProperties _device_memory_properties;
+		VkPhysicalDeviceProperties _device_properties;
+		memory_allocator _allocator;
+		shader_library _shaders;
 
 		VkSurfaceKHR _vulkan_surface = nullptr;
 		VkFormat _vulkan_format;
@@ -352,15 +778,41 @@ namespace vulkan {
 		VkFormat _depth_format = VK_FORMAT_D16_UNORM;
 		VkImageView _depth_view;
 		VkImage _depth_image;
-		VkDeviceMemory _depth_device_memory;
+		memory_allocation _depth_memory;
 		VkQueue _vulkan_queue = nullptr;
+		VkQueue _transfer_queue = nullptr;
+		uint32_t _graphics_queue_family = 0;
+		uint32_t _transfer_queue_family = 0;
+		bool _graphics_queue_compute = false;
+		uint32_t _graphics_timestamp_bits = 0;
+		std::mutex _queue_mutex;				// _vulkan_queue is shared with the streamer without a transfer family
+
+		swapchain _swapchain;
+
+		bool _gpu_timestamps = false;
+		bool _gpu_pipeline_statistics = false;
+		gpu_profiler _gpu_profiler;
 
-		VkSwapchainKHR _vulkan_swapchain = nullptr;
+		swapchain_policy _swapchain_policy = swapchain_policy::balanced();
 		uint32_t _swapchain_image_count = 0;
 
 		std::vector<VkImage> _swapchain_images;
 		std::vector<VkImageView> _swapchain_views;
 		std::vector<VkCommandBuffer> _swapchain_command_buffers;
+
+		// Parallel recording: one pool per (frame slot, worker), so a worker
+		// only ever allocates from and records into pools no other thread
+		// touches. The workers are started with the first command buffers and
+		// woken for each recording.
+		uint32_t _recording_threads = 0;
+		uint32_t _recording_workers = 0;
+		worker_group _recording_group;
+		std::vector<VkCommandPool> _recording_pools;
+		std::vector<VkCommandBuffer> _secondary_command_buffers;
+		recording_stats _recording_stats;
+
+		bool _rerecord_frames = false;
+		std::vector<VkCommandPool> _frame_command_pools;
 		std::vector<VkFramebuffer> _swapchain_framebuffers;
 
 		VkDescriptorPool _descriptor_pool;
@@ -369,8 +821,15 @@ namespace vulkan {
 
 		VkPipelineLayout _pipeline_layout;
 		VkRenderPass _render_pass;
-		VkPipelineCache _pipeline_cache;
+		VkPipelineCache _pipeline_cache = VK_NULL_HANDLE;
 		VkPipeline _pipeline;
+
+		std::string _pipeline_cache_path = "pipeline_cache.bin";
+		pipeline_cache_stats _pipeline_cache_stats;
+
+		pipeline_builder _pipeline_builder;
+		std::vector<pipeline_handle> _pipeline_variants;
+		uint32_t _pipeline_variant_count = 0;
 		/*
 		typedef struct {
 			VkImage image;
@@ -379,21 +838,55 @@ namespace vulkan {
 		} SwapchainBuffers;
 		*/
 		PFN_vkGetPhysicalDeviceSurfaceSupportKHR fpGetPhysicalDeviceSurfaceSupportKHR = nullptr;
-		PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR fpGetPhysicalDeviceSurfaceCapabilitiesKHR = nullptr;
 		PFN_vkGetPhysicalDeviceSurfaceFormatsKHR fpGetPhysicalDeviceSurfaceFormatsKHR = nullptr;
-		PFN_vkGetPhysicalDeviceSurfacePresentModesKHR fpGetPhysicalDeviceSurfacePresentModesKHR = nullptr;
-
-		PFN_vkGetDeviceProcAddr fpGetDeviceProcAddr = nullptr;
-
-		PFN_vkCreateSwapchainKHR fpCreateSwapchainKHR = nullptr;
-		PFN_vkDestroySwapchainKHR fpDestroySwapchainKHR = nullptr;
-		PFN_vkGetSwapchainImagesKHR fpGetSwapchainImagesKHR = nullptr; // ???
-		PFN_vkAcquireNextImageKHR fpAcquireNextImageKHR = nullptr;
-		PFN_vkQueuePresentKHR fpQueuePresentKHR = nullptr;
 
 		glm::mat4x4 _projection, _view, _model, _MVP, _VP;
-		vulkan_buffer _cube_buffer;
+		vulkan_uniform_ring _cube_uniforms;
+
+		// Each slice holds this frame's cull parameters, one model matrix per
+		// instance (read as an instance-rate vertex stream) and the draw list:
+		// one VkDrawIndexedIndirectCommand per batch of _draw_batch_size
+		// instances. Batch b's survivors are packed from instance slot
+		// b * _draw_batch_size.
+		vulkan_uniform_ring _instance_ring;
+		VkDeviceSize _instance_data_offset = 0;
+		VkDeviceSize _draw_list_offset = 0;
+		uint32_t _draw_batch_size = 1024;
+		uint32_t _draw_batch_count = 1;
+		uint32_t _instance_capacity = 1;
+		uint32_t _instance_count = 1;
+		float _instance_scale = 1.0f;
+		float _rotation_step = 0.5f;
+
+		// Per-instance state kept structure-of-arrays for the batch kernels in
+		// transform_batch; written out to the ring each frame.
+		simd_level _simd_level = detect_simd_level();
+		std::vector<float> _instance_x, _instance_y, _instance_z, _instance_radius;
+		std::vector<uint8_t> _instance_visible;
+		transform_soa _instance_models;
+		uint32_t _visible_instance_count = 1;
+
+		// GPU culling: reads the instance ring, writes the visible instances and
+		// their draw command into one device-local slice per frame.
+		bool _gpu_culling = false;
+		vulkan_buffer _cull_output;
+		VkDeviceSize _cull_output_stride = 0;
+		VkDescriptorSetLayout _cull_descriptor_set_layout = VK_NULL_HANDLE;
+		VkDescriptorPool _cull_descriptor_pool = VK_NULL_HANDLE;
+		VkDescriptorSet _cull_descriptor_set = VK_NULL_HANDLE;
+		VkPipelineLayout _cull_pipeline_layout = VK_NULL_HANDLE;
+		VkPipeline _cull_pipeline = VK_NULL_HANDLE;
 		vulkan_texture _demo_texture;
+		vulkan_mesh _cube_mesh;
+
+		std::map<uint64_t, vulkan_texture> _streamed_textures;
+		std::map<uint64_t, vulkan_buffer> _streamed_buffers;
+
+		// Last, so the threads are joined before anything they use goes away;
+		// the streamer waits on the decoder, so it goes first.
+		uint32_t _decode_threads = 0;
+		texture_decoder _texture_decoder;
+		streamer _streamer;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include <assert.h>
+
+#include "worker_group.hpp"
+#include "cpu_profiler.hpp"
+
+namespace vulkan {
+
+	worker_group::~worker_group() {
+		finish();
+	}
+
+	void worker_group::init(uint32_t thread_count, const std::string& name) {
+		assert(_threads.empty());
+
+		_name = name;
+		_quit = false;
+		_pending = 0;
+
+		for (uint32_t i = 0; i < thread_count; ++i) {
+			_threads.push_back(std::thread(&worker_group::thread_main, this, i, _generation));
+		}
+	}
+
+	void worker_group::run(const std::function<void(uint32_t worker)>& job) {
+		if (_threads.empty()) {
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_job = &job;
+		_pending = (uint32_t)_threads.size();
+		_generation++;
+		_start_condition.notify_all();
+
+		// job lives on our stack, so nobody may still be running it when we
+		// return.
+		_done_condition.wait(lock, [this] { return _pending == 0; });
+		_job = nullptr;
+	}
+
+	void worker_group::finish() {
+		if (_threads.empty()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_quit = true;
+		}
+		_start_condition.notify_all();
+
+		for (auto& thread : _threads) {
+			thread.join();
+		}
+		_threads.clear();
+	}
+
+	void worker_group::thread_main(uint32_t index, uint64_t seen) {
+		cpu_profiler::get().set_thread_name((_name + " " + std::to_string(index)).c_str());
+
+		for (;;) {
+			const std::function<void(uint32_t)> * job;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_start_condition.wait(lock, [this, seen] { return _quit || _generation != seen; });
+				if (_quit) {
+					return;
+				}
+				seen = _generation;
+				job = _job;
+			}
+
+			(*job)(index);
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_pending--;
+				if (_pending == 0) {
+					_done_condition.notify_one();
+				}
+			}
+		}
+	}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vulkan {
+
+	// A fixed set of threads that each run the same job, with their own index,
+	// whenever run is called, and sleep in between. For fork/join work done
+	// every frame, such as recording secondaries, where starting and joining
+	// threads each time would cost more than the work.
+	class worker_group {
+	public:
+		worker_group() {}
+		~worker_group();
+
+		void init(uint32_t thread_count, const std::string& name);
+
+		// Calls job(i) on worker i for every worker and returns once all of
+		// them have. Render thread only.
+		void run(const std::function<void(uint32_t worker)>& job);
+
+		// Stops and joins the threads. init may be called again afterwards.
+		void finish();
+
+		uint32_t size() const {
+			return (uint32_t)_threads.size();
+		}
+
+	private:
+		// seen is the generation at start, so only later runs wake it.
+		void thread_main(uint32_t index, uint64_t seen);
+
+		std::string _name;
+		std::vector<std::thread> _threads;
+
+		std::mutex _mutex;
+		std::condition_variable _start_condition;
+		std::condition_variable _done_condition;
+		const std::function<void(uint32_t)> * _job = nullptr;
+		uint64_t _generation = 0;		// bumped by every run
+		uint32_t _pending = 0;			// workers still on this generation
+		bool _quit = false;
+	};
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <iostream>
+
+// Just enough of a harness for the CPU-only parts of the renderer: each test
+// is a plain executable that reports failed checks and returns non-zero if
+// there were any, which is all ctest needs.
+
+namespace check {
+
+	inline int& failures() {
+		static int count = 0;
+		return count;
+	}
+
+	inline void fail(const char * file, int line, const char * expression) {
+		std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+		failures()++;
+	}
+
+	inline int result(const char * name) {
+		if (failures() > 0) {
+			std::cerr << name << ": " << failures() << " checks failed" << std::endl;
+			return 1;
+		}
+		std::cout << name << ": passed" << std::endl;
+		return 0;
+	}
+
+}
+
+#define CHECK(expression) ((expression) ? (void)0 : check::fail(__FILE__, __LINE__, #expression))
+#define CHECK_EQUAL(a, b) CHECK((a) == (b))
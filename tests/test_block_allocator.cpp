@@ -0,0 +1,220 @@
+
+#include <vector>
+
+#include "block_allocator.hpp"
+#include "check.hpp"
+
+using namespace vulkan;
+
+namespace {
+
+	void test_free_list_alignment() {
+		free_list_block block(4096, 1);
+		uint64_t a, b, c;
+
+		CHECK(block.allocate(10, 1, resource_kind::linear, a));
+		CHECK_EQUAL(a, 0u);
+		CHECK(block.allocate(10, 64, resource_kind::linear, b));
+		CHECK_EQUAL(b, 64u);
+
+		// The padding in front of b stays free, and best fit reuses it.
+		auto stats = block.get_stats();
+		CHECK_EQUAL(stats.free_range_count, 2u);
+		CHECK(block.allocate(20, 1, resource_kind::linear, c));
+		CHECK_EQUAL(c, 10u);
+
+		uint64_t d;
+		CHECK(block.allocate(1, 256, resource_kind::linear, d));
+		CHECK_EQUAL(d % 256, 0u);
+
+		CHECK(!block.allocate(0, 1, resource_kind::linear, d));
+	}
+
+	void test_free_list_granularity() {
+		free_list_block block(1024, 256);
+		uint64_t linear, optimal, small_linear, small_optimal;
+
+		CHECK(block.allocate(100, 4, resource_kind::linear, linear));
+		CHECK_EQUAL(linear, 0u);
+
+		// Would share the linear allocation's page, so moves to the next.
+		CHECK(block.allocate(100, 4, resource_kind::optimal, optimal));
+		CHECK_EQUAL(optimal, 256u);
+
+		// Same kind as its neighbour before, other kind after but on a
+		// different page: fits in the gap.
+		CHECK(block.allocate(16, 1, resource_kind::linear, small_linear));
+		CHECK_EQUAL(small_linear, 100u);
+
+		// The gap's remainder shares a page with linear data.
+		CHECK(block.allocate(16, 1, resource_kind::optimal, small_optimal));
+		CHECK_EQUAL(small_optimal, 356u);
+	}
+
+	void test_free_list_granularity_after() {
+		free_list_block block(1024, 256);
+		uint64_t first, second, optimal;
+
+		CHECK(block.allocate(300, 1, resource_kind::linear, first));
+		CHECK(block.allocate(100, 1, resource_kind::linear, second));
+		CHECK_EQUAL(second, 300u);
+		block.free(first);
+
+		// [0, 300) is free, but an optimal image ending on page 1 would share
+		// it with the linear allocation starting at 300.
+		CHECK(block.allocate(280, 1, resource_kind::optimal, optimal));
+		CHECK_EQUAL(optimal, 512u);
+		block.free(optimal);
+
+		// One that ends on page 0 is fine.
+		CHECK(block.allocate(200, 1, resource_kind::optimal, optimal));
+		CHECK_EQUAL(optimal, 0u);
+	}
+
+	void test_free_list_coalescing() {
+		free_list_block block(1024, 1);
+		uint64_t offsets[4];
+
+		for (auto& offset : offsets) {
+			CHECK(block.allocate(256, 1, resource_kind::linear, offset));
+		}
+
+		block.free(offsets[1]);
+		block.free(offsets[3]);
+
+		auto stats = block.get_stats();
+		CHECK_EQUAL(stats.free_range_count, 2u);
+		CHECK_EQUAL(stats.largest_free, 256u);
+		CHECK_EQUAL(stats.fragmentation(), 0.5f);
+
+		// Merges with the ranges on both sides.
+		block.free(offsets[2]);
+		stats = block.get_stats();
+		CHECK_EQUAL(stats.free_range_count, 1u);
+		CHECK_EQUAL(stats.largest_free, 768u);
+
+		block.free(offsets[0]);
+		stats = block.get_stats();
+		CHECK(block.empty());
+		CHECK_EQUAL(stats.free_range_count, 1u);
+		CHECK_EQUAL(stats.largest_free, 1024u);
+		CHECK_EQUAL(stats.fragmentation(), 0.0f);
+	}
+
+	void test_free_list_exhaustion() {
+		free_list_block block(1024, 1);
+		uint64_t offset, other;
+
+		CHECK(block.allocate(1024, 1, resource_kind::linear, offset));
+		CHECK(!block.allocate(1, 1, resource_kind::linear, other));
+
+		auto stats = block.get_stats();
+		CHECK_EQUAL(stats.used, 1024u);
+		CHECK_EQUAL(stats.requested, 1024u);
+		CHECK_EQUAL(stats.allocation_count, 1u);
+		CHECK_EQUAL(stats.free_range_count, 0u);
+		CHECK_EQUAL(stats.fragmentation(), 0.0f);
+
+		block.free(offset);
+		CHECK(!block.allocate(1025, 1, resource_kind::linear, offset));
+		CHECK(block.allocate(1024, 1, resource_kind::linear, offset));
+	}
+
+	void test_buddy_split_and_merge() {
+		buddy_block block(1024, 64);
+		uint64_t a, b, c;
+
+		CHECK(block.allocate(64, 1, resource_kind::linear, a));
+		CHECK_EQUAL(a, 0u);
+
+		// Splitting 1024 down to 64 leaves one free node at each level.
+		auto stats = block.get_stats();
+		CHECK_EQUAL(stats.free_range_count, 4u);
+		CHECK_EQUAL(stats.largest_free, 512u);
+
+		CHECK(block.allocate(100, 1, resource_kind::optimal, b));
+		CHECK_EQUAL(b, 128u);
+		CHECK(block.allocate(1, 256, resource_kind::linear, c));
+		CHECK_EQUAL(c, 256u);
+
+		stats = block.get_stats();
+		CHECK_EQUAL(stats.used, 64u + 128u + 256u);
+		CHECK_EQUAL(stats.requested, 64u + 100u + 1u);
+		CHECK_EQUAL(stats.allocation_count, 3u);
+
+		block.free(b);
+		block.free(a);
+		block.free(c);
+
+		// Everything merges back into the root.
+		stats = block.get_stats();
+		CHECK(block.empty());
+		CHECK_EQUAL(stats.free_range_count, 1u);
+		CHECK_EQUAL(stats.largest_free, 1024u);
+		CHECK_EQUAL(stats.fragmentation(), 0.0f);
+	}
+
+	void test_buddy_alignment() {
+		buddy_block block(4096, 64);
+		uint64_t a, b;
+
+		CHECK(block.allocate(64, 1, resource_kind::linear, a));
+		CHECK(block.allocate(64, 1024, resource_kind::optimal, b));
+		CHECK_EQUAL(b % 1024, 0u);
+		CHECK(a != b);
+
+		// Rounded up to a power of two, and never below the minimum node.
+		CHECK_EQUAL(block.get_min_node_size(), 64u);
+		buddy_block odd(4096, 48);
+		CHECK_EQUAL(odd.get_min_node_size(), 64u);
+	}
+
+	void test_buddy_exhaustion() {
+		// Only the largest power of two that fits is used.
+		buddy_block block(1000, 64);
+		uint64_t offset;
+
+		CHECK_EQUAL(block.get_stats().size, 512u);
+		CHECK(!block.allocate(513, 1, resource_kind::linear, offset));
+
+		std::vector<uint64_t> offsets;
+		while (block.allocate(64, 1, resource_kind::linear, offset)) {
+			offsets.push_back(offset);
+		}
+		CHECK_EQUAL(offsets.size(), 8u);
+
+		auto stats = block.get_stats();
+		CHECK_EQUAL(stats.used, 512u);
+		CHECK_EQUAL(stats.free_range_count, 0u);
+
+		// Freeing every other node leaves space but no node bigger than 64.
+		for (size_t i = 0; i < offsets.size(); i += 2) {
+			block.free(offsets[i]);
+		}
+		stats = block.get_stats();
+		CHECK_EQUAL(stats.free_range_count, 4u);
+		CHECK_EQUAL(stats.largest_free, 64u);
+		CHECK_EQUAL(stats.fragmentation(), 0.75f);
+		CHECK(!block.allocate(128, 1, resource_kind::linear, offset));
+
+		for (size_t i = 1; i < offsets.size(); i += 2) {
+			block.free(offsets[i]);
+		}
+		CHECK(block.allocate(512, 1, resource_kind::linear, offset));
+		CHECK_EQUAL(offset, 0u);
+	}
+
+}
+
+int main() {
+	test_free_list_alignment();
+	test_free_list_granularity();
+	test_free_list_granularity_after();
+	test_free_list_coalescing();
+	test_free_list_exhaustion();
+	test_buddy_split_and_merge();
+	test_buddy_alignment();
+	test_buddy_exhaustion();
+
+	return check::result("block_allocator");
+}
@@ -0,0 +1,77 @@
+
+#include <iostream>
+#include <vector>
+
+#include "mipmap.hpp"
+#include "check.hpp"
+
+using namespace vulkan;
+
+namespace {
+
+	void test_level_count() {
+		CHECK_EQUAL(mip_level_count(1, 1), 1u);
+		CHECK_EQUAL(mip_level_count(256, 256), 9u);
+		CHECK_EQUAL(mip_level_count(300, 7), 9u);
+		CHECK_EQUAL(mip_level_count(1, 1024), 11u);
+	}
+
+	// Every width up to a few vector widths, odd ones included, so each
+	// kernel's clamped scalar tail is run.
+	void test_downsample(simd_level level) {
+		uint32_t seed = 1;
+		for (uint32_t width = 1; width < 80; width++) {
+			for (uint32_t height = 1; height < 6; height++) {
+				std::vector<uint8_t> src((size_t)width * height * 4);
+				for (auto& byte : src) {
+					seed = seed * 1664525u + 1013904223u;
+					byte = (uint8_t)(seed >> 24);
+				}
+
+				const uint32_t dst_width = width > 1 ? width / 2 : 1;
+				const uint32_t dst_height = height > 1 ? height / 2 : 1;
+
+				// A texel of slack to catch writes past the end.
+				std::vector<uint8_t> expected((size_t)dst_width * dst_height * 4 + 4, 0xcd), actual(expected);
+				downsample_rgba8(simd_level::scalar, src.data(), width, height, expected.data());
+				downsample_rgba8(level, src.data(), width, height, actual.data());
+
+				CHECK(expected == actual);
+			}
+		}
+	}
+
+	void test_scalar_filter() {
+		// 3x2: the last column is left out.
+		const uint8_t src[3 * 2 * 4] = {
+			0, 10, 255, 1,   4, 20, 255, 2,   99, 99, 99, 99,
+			1, 30, 255, 3,   1, 41, 254, 4,   99, 99, 99, 99,
+		};
+		uint8_t dst[4];
+		downsample_rgba8(simd_level::scalar, src, 3, 2, dst);
+
+		CHECK_EQUAL(dst[0], 2);		// (0 + 4 + 1 + 1 + 2) / 4
+		CHECK_EQUAL(dst[1], 25);	// (10 + 20 + 30 + 41 + 2) / 4
+		CHECK_EQUAL(dst[2], 255);
+		CHECK_EQUAL(dst[3], 3);
+	}
+
+}
+
+int main() {
+	test_level_count();
+	test_scalar_filter();
+
+	const simd_level best = detect_simd_level();
+	const simd_level levels[] = { simd_level::sse, simd_level::avx2 };
+
+	for (simd_level level : levels) {
+		if (level > best) {
+			std::cout << "mipmap: " << simd_level_name(level) << " not supported here, skipped" << std::endl;
+			continue;
+		}
+		test_downsample(level);
+	}
+
+	return check::result("mipmap");
+}
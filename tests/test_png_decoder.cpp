@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <png.h>
+
+#include "pngReader.hpp"
+#include "texture_decoder.hpp"
+#include "check.hpp"
+
+using namespace vulkan;
+
+namespace {
+
+	// A file written with libpng alongside the RGBA8 png_rows should turn it
+	// into. Sizes are odd so Adam7's passes don't divide them evenly.
+	struct test_image {
+		std::string filename;
+		uint32_t width;
+		uint32_t height;
+		std::vector<uint8_t> rgba;
+	};
+
+	struct png_layout {
+		int color_type;
+		int bit_depth;
+		int interlace;
+		bool palette;
+		bool grey_key;		// tRNS marking one grey value transparent
+	};
+
+	const uint8_t transparent_grey = 0x40;
+
+	uint8_t sample(uint32_t x, uint32_t y, uint32_t c) {
+		return (uint8_t)(x * 3 + y * 5 + c * 50);
+	}
+
+	// Writes the file and works out what each pixel should decode to.
+	test_image write_png(const std::string& filename, uint32_t width, uint32_t height, const png_layout& layout) {
+		test_image image;
+		image.filename = filename;
+		image.width = width;
+		image.height = height;
+		image.rgba.resize((size_t)width * height * 4);
+
+		const int channels = layout.color_type == PNG_COLOR_TYPE_RGB_ALPHA ? 4 : layout.color_type == PNG_COLOR_TYPE_RGB ? 3 : 1;
+		const int sample_bytes = layout.bit_depth / 8;
+		std::vector<std::vector<uint8_t>> rows(height, std::vector<uint8_t>((size_t)width * channels * sample_bytes));
+
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				uint8_t * expected = &image.rgba[((size_t)y * width + x) * 4];
+				uint8_t * pixel = &rows[y][(size_t)x * channels * sample_bytes];
+
+				if (layout.palette) {
+					const uint8_t index = sample(x, y, 0);
+					pixel[0] = index;
+					expected[0] = index;
+					expected[1] = 255 - index;
+					expected[2] = index / 2;
+					expected[3] = 255;
+				} else if (channels == 1) {
+					const uint8_t grey = sample(x, y, 0);
+					pixel[0] = grey;
+					expected[0] = expected[1] = expected[2] = grey;
+					expected[3] = layout.grey_key && grey == transparent_grey ? 0 : 255;
+				} else {
+					for (int c = 0; c < channels; c++) {
+						const uint8_t high = sample(x, y, c);
+						pixel[c * sample_bytes] = high;
+						if (sample_bytes == 2) {
+							// Stripping to 8 bits keeps only the high byte.
+							pixel[c * sample_bytes + 1] = (uint8_t)(x * 11 + c);
+						}
+						expected[c] = high;
+					}
+					if (channels == 3) {
+						expected[3] = 255;
+					}
+				}
+			}
+		}
+
+		FILE * fp = fopen(filename.c_str(), "wb");
+		CHECK(fp != NULL);
+		if (fp == NULL) {
+			return image;
+		}
+
+		png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+		png_infop info_ptr = png_create_info_struct(png_ptr);
+		png_init_io(png_ptr, fp);
+		png_set_IHDR(png_ptr, info_ptr, width, height, layout.bit_depth, layout.color_type, layout.interlace, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+		if (layout.palette) {
+			png_color palette[256];
+			for (int i = 0; i < 256; i++) {
+				palette[i].red = (png_byte)i;
+				palette[i].green = (png_byte)(255 - i);
+				palette[i].blue = (png_byte)(i / 2);
+			}
+			png_set_PLTE(png_ptr, info_ptr, palette, 256);
+		}
+		if (layout.grey_key) {
+			png_color_16 key = {};
+			key.gray = transparent_grey;
+			png_set_tRNS(png_ptr, info_ptr, NULL, 0, &key);
+		}
+
+		png_write_info(png_ptr, info_ptr);
+		std::vector<png_bytep> row_pointers(height);
+		for (uint32_t y = 0; y < height; y++) {
+			row_pointers[y] = rows[y].data();
+		}
+		png_write_image(png_ptr, row_pointers.data());
+		png_write_end(png_ptr, NULL);
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		fclose(fp);
+
+		return image;
+	}
+
+	std::vector<test_image> write_images() {
+		const png_layout palette = { PNG_COLOR_TYPE_PALETTE, 8, PNG_INTERLACE_NONE, true, false };
+		const png_layout grey_key = { PNG_COLOR_TYPE_GRAY, 8, PNG_INTERLACE_NONE, false, true };
+		const png_layout rgb16 = { PNG_COLOR_TYPE_RGB, 16, PNG_INTERLACE_NONE, false, false };
+		const png_layout adam7 = { PNG_COLOR_TYPE_RGB_ALPHA, 8, PNG_INTERLACE_ADAM7, false, false };
+
+		std::vector<test_image> images;
+		images.push_back(write_png("test_png_palette.png", 37, 23, palette));
+		images.push_back(write_png("test_png_grey_trns.png", 41, 19, grey_key));
+		images.push_back(write_png("test_png_rgb16.png", 29, 17, rgb16));
+		images.push_back(write_png("test_png_adam7.png", 37, 23, adam7));
+		return images;
+	}
+
+	// Records what reaches a sink, and whether it came in the promised
+	// order: begin first, then every row exactly once from the top.
+	struct sink_capture {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t begins = 0;
+		uint32_t next_row = 0;
+		bool in_order = true;
+		std::vector<uint8_t> rgba;
+
+		load_image::png_sink sink() {
+			load_image::png_sink sink;
+			sink.begin = [this](unsigned int w, unsigned int h) {
+				begins++;
+				width = w;
+				height = h;
+				rgba.assign((size_t)w * h * 4, 0xcd);
+			};
+			sink.row = [this](unsigned int y, const uint8_t * row) {
+				in_order = in_order && begins == 1 && y == next_row;
+				next_row = y + 1;
+				if (y < height) {
+					memcpy(&rgba[(size_t)y * width * 4], row, (size_t)width * 4);
+				}
+			};
+			return sink;
+		}
+
+		bool matches(const test_image& image) const {
+			return begins == 1 && in_order && width == image.width && height == image.height && next_row == image.height && rgba == image.rgba;
+		}
+	};
+
+	void test_png_rows(const std::vector<test_image>& images) {
+		for (auto& image : images) {
+			sink_capture capture;
+			load_image::png_rows(image.filename.c_str(), capture.sink());
+			CHECK(capture.matches(image));
+		}
+	}
+
+	// Cuts the last third off a copy of the file, so libpng runs out of data
+	// partway through the image.
+	std::string write_truncated(const test_image& image) {
+		std::vector<uint8_t> bytes;
+		FILE * fp = fopen(image.filename.c_str(), "rb");
+		CHECK(fp != NULL);
+		if (fp != NULL) {
+			uint8_t buffer[4096];
+			size_t read;
+			while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+				bytes.insert(bytes.end(), buffer, buffer + read);
+			}
+			fclose(fp);
+		}
+
+		const std::string filename = "test_png_truncated.png";
+		fp = fopen(filename.c_str(), "wb");
+		CHECK(fp != NULL);
+		if (fp != NULL) {
+			fwrite(bytes.data(), 1, bytes.size() * 2 / 3, fp);
+			fclose(fp);
+		}
+		return filename;
+	}
+
+	void test_decoder(const std::vector<test_image>& images, const std::string& truncated) {
+		texture_decoder decoder;
+		decoder.init(2);
+
+		std::vector<sink_capture> captures(images.size() + 1);
+		std::vector<decode_handle> handles;
+		for (size_t i = 0; i < images.size(); i++) {
+			handles.push_back(decoder.submit(images[i].filename, captures[i].sink()));
+		}
+		decode_handle bad = decoder.submit(truncated, captures.back().sink());
+
+		uint64_t bytes = 0;
+		for (size_t i = 0; i < images.size(); i++) {
+			CHECK(handles[i].valid());
+			CHECK(handles[i].get());
+			CHECK(handles[i].ready());
+			CHECK(captures[i].matches(images[i]));
+			bytes += images[i].rgba.size();
+		}
+		CHECK(!bad.get());
+
+		// Every file's result is counted by the time its get() returns,
+		// without waiting for the pool to go idle.
+		const texture_decoder_stats stats = decoder.get_stats();
+		CHECK_EQUAL(stats.threads, 2u);
+		CHECK_EQUAL(stats.submitted, (uint32_t)images.size() + 1);
+		CHECK_EQUAL(stats.decoded, (uint32_t)images.size());
+		CHECK_EQUAL(stats.failed, 1u);
+		CHECK_EQUAL(stats.bytes, bytes);
+
+		decoder.finish();
+		CHECK(!decoder.running());
+	}
+
+	void test_truncated_rows(const std::string& truncated) {
+		sink_capture capture;
+		bool threw = false;
+		try {
+			load_image::png_rows(truncated.c_str(), capture.sink());
+		} catch (std::exception&) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+}
+
+int main() {
+	const std::vector<test_image> images = write_images();
+	const std::string truncated = write_truncated(images.back());
+
+	test_png_rows(images);
+	test_truncated_rows(truncated);
+	test_decoder(images, truncated);
+
+	for (auto& image : images) {
+		remove(image.filename.c_str());
+	}
+	remove(truncated.c_str());
+
+	return check::result("png_decoder");
+}
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "texture_codec.hpp"
+#include "ktx2.hpp"
+#include "check.hpp"
+
+using namespace vulkan;
+
+namespace {
+
+	std::mt19937 generator(4321);
+
+	int random_int(int low, int high) {
+		return std::uniform_int_distribution<int>(low, high)(generator);
+	}
+
+	// A 4x4 RGBA8 block, texel (x, y) at [y * 4 + x], which is also how
+	// encode_blocks reads a 4x4 image.
+	struct block {
+		uint8_t texels[16][4];
+	};
+
+	void random_color(uint8_t color[4]) {
+		for (int c = 0; c < 4; c++) {
+			color[c] = (uint8_t)random_int(0, 255);
+		}
+	}
+
+	block solid_block(const uint8_t color[4]) {
+		block b;
+		for (int i = 0; i < 16; i++) {
+			memcpy(b.texels[i], color, 4);
+		}
+		return b;
+	}
+
+	// Texels a or b at random, with texel 0 given first so callers can decide
+	// which end of the line it sits at.
+	block two_color_block(const uint8_t first[4], const uint8_t second[4]) {
+		block b;
+		memcpy(b.texels[0], first, 4);
+		for (int i = 1; i < 16; i++) {
+			memcpy(b.texels[i], random_int(0, 1) ? first : second, 4);
+		}
+		return b;
+	}
+
+	// first on one side of the ETC split, second on the other.
+	block half_block(const uint8_t first[4], const uint8_t second[4], bool flip) {
+		block b;
+		for (int y = 0; y < 4; y++) {
+			for (int x = 0; x < 4; x++) {
+				memcpy(b.texels[y * 4 + x], (flip ? y : x) < 2 ? first : second, 4);
+			}
+		}
+		return b;
+	}
+
+	// Largest difference in each channel, [first, first + count).
+	void max_error(const block& source, const block& decoded, int first, int count, int error[4]) {
+		for (int c = first; c < first + count; c++) {
+			error[c] = 0;
+			for (int i = 0; i < 16; i++) {
+				error[c] = (std::max)(error[c], abs(source.texels[i][c] - decoded.texels[i][c]));
+			}
+		}
+	}
+
+	bool within(const block& source, const block& decoded, int first, int count, int bound) {
+		int error[4];
+		max_error(source, decoded, first, count, error);
+		for (int c = first; c < first + count; c++) {
+			if (error[c] > bound) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Reference decoders, written from the format specs rather than the
+	// encoder, so a mistake in one isn't repeated in the other.
+
+	uint64_t little_endian(const uint8_t * bytes, int count) {
+		uint64_t value = 0;
+		for (int b = count; b-- > 0;) {
+			value = (value << 8) | bytes[b];
+		}
+		return value;
+	}
+
+	uint64_t big_endian(const uint8_t * bytes, int count) {
+		uint64_t value = 0;
+		for (int b = 0; b < count; b++) {
+			value = (value << 8) | bytes[b];
+		}
+		return value;
+	}
+
+	void expand_565(uint16_t packed, int color[3]) {
+		const int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// BC1 colour; BC3's colour half always uses the four-colour palette.
+	void decode_bc1(const uint8_t in[8], bool four_color, block& out) {
+		const uint16_t color0 = (uint16_t)little_endian(in, 2);
+		const uint16_t color1 = (uint16_t)little_endian(in + 2, 2);
+
+		int palette[4][3];
+		expand_565(color0, palette[0]);
+		expand_565(color1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			if (four_color || color0 > color1) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			} else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+
+		const uint32_t indices = (uint32_t)little_endian(in + 4, 4);
+		for (int i = 0; i < 16; i++) {
+			const int k = (indices >> (i * 2)) & 3;
+			for (int c = 0; c < 3; c++) {
+				out.texels[i][c] = (uint8_t)palette[k][c];
+			}
+			out.texels[i][3] = 255;
+		}
+	}
+
+	void decode_bc3_alpha(const uint8_t in[8], block& out) {
+		const int alpha0 = in[0], alpha1 = in[1];
+		int palette[8] = { alpha0, alpha1 };
+		if (alpha0 > alpha1) {
+			for (int k = 1; k < 7; k++) {
+				palette[k + 1] = ((7 - k) * alpha0 + k * alpha1) / 7;
+			}
+		} else {
+			for (int k = 1; k < 5; k++) {
+				palette[k + 1] = ((5 - k) * alpha0 + k * alpha1) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		const uint64_t indices = little_endian(in + 2, 6);
+		for (int i = 0; i < 16; i++) {
+			out.texels[i][3] = (uint8_t)palette[(indices >> (i * 3)) & 7];
+		}
+	}
+
+	struct bit_reader {
+		const uint8_t * in;
+		uint32_t position;
+
+		uint32_t read(uint32_t bits) {
+			uint32_t value = 0;
+			for (uint32_t b = 0; b < bits; b++, position++) {
+				value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << b;
+			}
+			return value;
+		}
+	};
+
+	// Mode 6 only; false for any other mode.
+	bool decode_bc7_mode6(const uint8_t in[16], block& out) {
+		bit_reader reader = { in, 0 };
+		int mode = 0;
+		while (mode < 8 && reader.read(1) == 0) {
+			mode++;
+		}
+		if (mode != 6) {
+			return false;
+		}
+
+		int endpoints[2][4];
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] = reader.read(7) << 1;
+			endpoints[1][c] = reader.read(7) << 1;
+		}
+		const uint32_t p0 = reader.read(1), p1 = reader.read(1);
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] |= p0;
+			endpoints[1][c] |= p1;
+		}
+
+		static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		for (int i = 0; i < 16; i++) {
+			// The anchor index is stored without its top bit, which is zero.
+			const int index = reader.read(i == 0 ? 3 : 4);
+			for (int c = 0; c < 4; c++) {
+				out.texels[i][c] = (uint8_t)(((64 - weights[index]) * endpoints[0][c] + weights[index] * endpoints[1][c] + 32) >> 6);
+			}
+		}
+		return reader.position == 128;
+	}
+
+	int clamp_byte(int value) {
+		return value < 0 ? 0 : (value > 255 ? 255 : value);
+	}
+
+	// ETC1 individual and differential modes, which is all the encoder
+	// writes; false for a differential block that would mean one of ETC2's
+	// extra modes.
+	bool decode_etc1(const uint8_t in[8], block& out) {
+		static const int modifiers[8][2] = {
+			{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+		};
+
+		const uint64_t bits = big_endian(in, 8);
+		const bool differential = (bits >> 33) & 1;
+		const bool flip = (bits >> 32) & 1;
+
+		int base[2][3];
+		for (int c = 0; c < 3; c++) {
+			const int shift = 56 - c * 8;
+			if (differential) {
+				const int first = (int)((bits >> (shift + 3)) & 31);
+				int delta = (int)((bits >> shift) & 7);
+				delta = delta >= 4 ? delta - 8 : delta;
+				const int second = first + delta;
+				if (second < 0 || second > 31) {
+					return false;
+				}
+				base[0][c] = (first << 3) | (first >> 2);
+				base[1][c] = (second << 3) | (second >> 2);
+			} else {
+				base[0][c] = (int)((bits >> (shift + 4)) & 15) * 17;
+				base[1][c] = (int)((bits >> shift) & 15) * 17;
+			}
+		}
+		const int tables[2] = { (int)((bits >> 37) & 7), (int)((bits >> 34) & 7) };
+
+		for (int y = 0; y < 4; y++) {
+			for (int x = 0; x < 4; x++) {
+				const int half = (flip ? y : x) >= 2;
+				const int bit = x * 4 + y;
+				const int high = (int)((bits >> (16 + bit)) & 1), low = (int)((bits >> bit) & 1);
+				const int magnitude = modifiers[tables[half]][low];
+				const int modifier = high ? -magnitude : magnitude;
+				for (int c = 0; c < 3; c++) {
+					out.texels[y * 4 + x][c] = (uint8_t)clamp_byte(base[half][c] + modifier);
+				}
+				out.texels[y * 4 + x][3] = 255;
+			}
+		}
+		return true;
+	}
+
+	void decode_eac_alpha(const uint8_t in[8], block& out) {
+		static const int modifiers[16][8] = {
+			{ -3, -6, -9, -15, 2, 5, 8, 14 },
+			{ -3, -7, -10, -13, 2, 6, 9, 12 },
+			{ -2, -5, -8, -13, 1, 4, 7, 12 },
+			{ -2, -4, -6, -13, 1, 3, 5, 12 },
+			{ -3, -6, -8, -12, 2, 5, 7, 11 },
+			{ -3, -7, -9, -11, 2, 6, 8, 10 },
+			{ -4, -7, -8, -11, 3, 6, 7, 10 },
+			{ -3, -5, -8, -11, 2, 4, 7, 10 },
+			{ -2, -6, -8, -10, 1, 5, 7, 9 },
+			{ -2, -5, -8, -10, 1, 4, 7, 9 },
+			{ -2, -4, -8, -10, 1, 3, 7, 9 },
+			{ -2, -5, -7, -10, 1, 4, 6, 9 },
+			{ -3, -4, -7, -10, 2, 3, 6, 9 },
+			{ -1, -2, -3, -10, 0, 1, 2, 9 },
+			{ -4, -6, -8, -9, 3, 5, 7, 8 },
+			{ -3, -5, -7, -9, 2, 4, 6, 8 },
+		};
+
+		const int base = in[0];
+		const int multiplier = in[1] >> 4;
+		const int table = in[1] & 15;
+		const uint64_t selectors = big_endian(in + 2, 6);
+		for (int y = 0; y < 4; y++) {
+			for (int x = 0; x < 4; x++) {
+				const int selector = (int)((selectors >> (45 - (x * 4 + y) * 3)) & 7);
+				out.texels[y * 4 + x][3] = (uint8_t)clamp_byte(base + modifiers[table][selector] * multiplier);
+			}
+		}
+	}
+
+	std::vector<uint8_t> encode(block_format format, const block& source) {
+		std::vector<uint8_t> encoded(block_format_block_bytes(format), 0xcd);
+		encode_blocks(format, &source.texels[0][0], 4, 4, encoded.data());
+		return encoded;
+	}
+
+	const int trials = 2000;
+
+	// Pairs of colours whose channel differences sum to zero, which a line
+	// fit started along (1, 1, 1) took for a flat block.
+	const uint8_t balanced_pairs[][2][4] = {
+		{ { 107, 225, 82, 10 }, { 194, 125, 95, 30 } },
+		{ { 245, 102, 49, 200 }, { 139, 32, 225, 180 } },
+	};
+
+	// As well as random colours, so they're always covered.
+	void next_pair(int trial, uint8_t first[4], uint8_t second[4]) {
+		const int balanced = sizeof(balanced_pairs) / sizeof(balanced_pairs[0]);
+		if (trial < balanced) {
+			memcpy(first, balanced_pairs[trial][0], 4);
+			memcpy(second, balanced_pairs[trial][1], 4);
+		} else {
+			random_color(first);
+			random_color(second);
+		}
+	}
+
+	// Within 565's rounding: 4 in red and blue, 2 in green.
+	bool within_565(const block& source, const block& decoded) {
+		int error[4];
+		max_error(source, decoded, 0, 3, error);
+		return error[0] <= 4 && error[1] <= 2 && error[2] <= 4;
+	}
+
+	// One or two colours are the ends of the line, so either way BC1 only
+	// loses what 565 does.
+	void test_bc1() {
+		for (int trial = 0; trial < trials; trial++) {
+			uint8_t first[4], second[4];
+			next_pair(trial, first, second);
+
+			const block solid = solid_block(first);
+			block decoded;
+			decode_bc1(encode(block_format::bc1, solid).data(), false, decoded);
+			CHECK(within_565(solid, decoded));
+
+			const block two = two_color_block(first, second);
+			decode_bc1(encode(block_format::bc1, two).data(), false, decoded);
+			CHECK(within_565(two, decoded));
+		}
+	}
+
+	// Alpha endpoints are the block's extremes, so one or two alphas come
+	// back exactly.
+	void test_bc3() {
+		for (int trial = 0; trial < trials; trial++) {
+			uint8_t first[4], second[4];
+			next_pair(trial, first, second);
+
+			const block solid = solid_block(first);
+			std::vector<uint8_t> encoded = encode(block_format::bc3, solid);
+			block decoded;
+			decode_bc1(encoded.data() + 8, true, decoded);
+			decode_bc3_alpha(encoded.data(), decoded);
+			CHECK(within_565(solid, decoded));
+			CHECK(within(solid, decoded, 3, 1, 0));
+
+			const block two = two_color_block(first, second);
+			encoded = encode(block_format::bc3, two);
+			decode_bc1(encoded.data() + 8, true, decoded);
+			decode_bc3_alpha(encoded.data(), decoded);
+			CHECK(within_565(two, decoded));
+			CHECK(within(two, decoded, 3, 1, 0));
+		}
+	}
+
+	// Mode 6 endpoints are 7 bits plus a p-bit shared by all four channels,
+	// which costs at most 1 whether a colour is an endpoint or both are.
+	void test_bc7() {
+		for (int trial = 0; trial < trials; trial++) {
+			uint8_t first[4], second[4];
+			next_pair(trial, first, second);
+
+			const block solid = solid_block(first);
+			std::vector<uint8_t> encoded = encode(block_format::bc7, solid);
+			block decoded;
+			CHECK_EQUAL(encoded[0] & 0x7f, 0x40);
+			CHECK(decode_bc7_mode6(encoded.data(), decoded));
+			CHECK(within(solid, decoded, 0, 4, 1));
+
+			// Texel 0 at either end of the line: the encoder has to swap the
+			// endpoints whenever it would otherwise need index 0's top bit,
+			// or the 3-bit anchor decodes to the wrong end.
+			for (int order = 0; order < 2; order++) {
+				const block two = order ? two_color_block(second, first) : two_color_block(first, second);
+				encoded = encode(block_format::bc7, two);
+				CHECK_EQUAL(encoded[0] & 0x7f, 0x40);
+				CHECK(decode_bc7_mode6(encoded.data(), decoded));
+				CHECK(within(two, decoded, 0, 4, 1));
+			}
+		}
+	}
+
+	// Each half's colour is a 4- or 5-bit base moved by one modifier in all
+	// three channels, so what the base can't hold costs a few steps; halves
+	// too far apart for differential mode only get 4 bits.
+	void test_etc2() {
+		for (int trial = 0; trial < trials; trial++) {
+			uint8_t first[4], second[4];
+			next_pair(trial, first, second);
+
+			const block solid = solid_block(first);
+			block decoded;
+			CHECK(decode_etc1(encode(block_format::etc2, solid).data(), decoded));
+			CHECK(within(solid, decoded, 0, 3, 6));
+
+			for (int flip = 0; flip < 2; flip++) {
+				const block halves = half_block(first, second, flip != 0);
+				CHECK(decode_etc1(encode(block_format::etc2, halves).data(), decoded));
+				CHECK(within(halves, decoded, 0, 3, 11));
+			}
+		}
+	}
+
+	// A solid alpha is the base with a zero modifier. Two alphas rarely sit
+	// exactly on one table's spacing, so they can be a few off.
+	void test_etc2a() {
+		for (int trial = 0; trial < trials; trial++) {
+			uint8_t first[4], second[4];
+			next_pair(trial, first, second);
+
+			const block solid = solid_block(first);
+			std::vector<uint8_t> encoded = encode(block_format::etc2a, solid);
+			block decoded;
+			CHECK(decode_etc1(encoded.data() + 8, decoded));
+			decode_eac_alpha(encoded.data(), decoded);
+			CHECK(within(solid, decoded, 0, 3, 6));
+			CHECK(within(solid, decoded, 3, 1, 0));
+
+			const block two = two_color_block(first, second);
+			encoded = encode(block_format::etc2a, two);
+			decode_eac_alpha(encoded.data(), decoded);
+			CHECK(within(two, decoded, 3, 1, 3));
+		}
+	}
+
+	const block_format formats[] = { block_format::bc1, block_format::bc3, block_format::bc7, block_format::etc2, block_format::etc2a };
+
+	const char * const ktx2_file = "test_texture_codec.ktx2";
+
+	// A full mip chain of a size that isn't a multiple of 4, laid out the way
+	// read_ktx2 lays it out, so offsets can be compared directly.
+	ktx2_texture encoded_texture(block_format format) {
+		ktx2_texture texture;
+		texture.format = block_format_vk_format(format);
+		texture.width = 13;
+		texture.height = 9;
+
+		uint32_t width = texture.width, height = texture.height;
+		for (;;) {
+			std::vector<uint8_t> rgba((size_t)width * height * 4);
+			for (auto& byte : rgba) {
+				byte = (uint8_t)random_int(0, 255);
+			}
+
+			ktx2_level level;
+			level.offset = (texture.data.size() + 15) / 16 * 16;
+			level.size = block_format_level_size(format, width, height);
+			level.width = width;
+			level.height = height;
+			texture.data.resize((size_t)(level.offset + level.size), 0);
+			encode_blocks(format, rgba.data(), width, height, texture.data.data() + level.offset);
+			texture.levels.push_back(level);
+
+			if (width == 1 && height == 1) {
+				break;
+			}
+			width = (std::max)(1u, width / 2);
+			height = (std::max)(1u, height / 2);
+		}
+		return texture;
+	}
+
+	void test_ktx2_round_trip(block_format format) {
+		const ktx2_texture written = encoded_texture(format);
+		write_ktx2(ktx2_file, written);
+		const ktx2_texture read = read_ktx2(ktx2_file);
+
+		CHECK_EQUAL(read.format, written.format);
+		CHECK_EQUAL(read.width, written.width);
+		CHECK_EQUAL(read.height, written.height);
+		CHECK_EQUAL(read.levels.size(), written.levels.size());
+		CHECK_EQUAL(ktx2_format_block_bytes(read.format), block_format_block_bytes(format));
+		CHECK(ktx2_format_is_block_compressed(read.format));
+
+		for (size_t i = 0; i < (std::min)(read.levels.size(), written.levels.size()); i++) {
+			const ktx2_level& a = read.levels[i];
+			const ktx2_level& b = written.levels[i];
+			CHECK_EQUAL(a.offset, b.offset);
+			CHECK_EQUAL(a.size, b.size);
+			CHECK_EQUAL(a.width, b.width);
+			CHECK_EQUAL(a.height, b.height);
+			CHECK(a.offset % 16 == 0);
+			CHECK(a.offset + a.size <= read.data.size());
+			CHECK(b.offset + b.size <= written.data.size());
+			if (a.offset + a.size <= read.data.size() && b.offset + b.size <= written.data.size()) {
+				CHECK(memcmp(read.data.data() + a.offset, written.data.data() + b.offset, (size_t)a.size) == 0);
+			}
+		}
+	}
+
+	std::vector<uint8_t> read_file(const char * file_name) {
+		std::vector<uint8_t> bytes;
+		FILE * fp = fopen(file_name, "rb");
+		CHECK(fp != NULL);
+		if (fp != NULL) {
+			uint8_t chunk[4096];
+			size_t read;
+			while ((read = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+				bytes.insert(bytes.end(), chunk, chunk + read);
+			}
+			fclose(fp);
+		}
+		return bytes;
+	}
+
+	bool rejects(const std::vector<uint8_t>& bytes) {
+		FILE * fp = fopen(ktx2_file, "wb");
+		CHECK(fp != NULL);
+		if (fp == NULL) {
+			return false;
+		}
+		fwrite(bytes.data(), 1, bytes.size(), fp);
+		fclose(fp);
+
+		try {
+			read_ktx2(ktx2_file);
+		} catch (std::runtime_error&) {
+			return true;
+		}
+		return false;
+	}
+
+	void test_ktx2_rejects() {
+		write_ktx2(ktx2_file, encoded_texture(block_format::bc7));
+		const std::vector<uint8_t> good = read_file(ktx2_file);
+		CHECK(!rejects(good));
+
+		// Cut into the last level's data, and into the header.
+		std::vector<uint8_t> truncated(good.begin(), good.end() - 1);
+		CHECK(rejects(truncated));
+		truncated.resize(40);
+		CHECK(rejects(truncated));
+
+		std::vector<uint8_t> bad_identifier = good;
+		bad_identifier[1] = 'X';
+		CHECK(rejects(bad_identifier));
+	}
+
+}
+
+int main() {
+	test_bc1();
+	test_bc3();
+	test_bc7();
+	test_etc2();
+	test_etc2a();
+
+	for (block_format format : formats) {
+		test_ktx2_round_trip(format);
+	}
+	test_ktx2_rejects();
+
+	remove(ktx2_file);
+
+	return check::result("texture_codec");
+}
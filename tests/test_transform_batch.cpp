@@ -0,0 +1,398 @@
+
+#include <math.h>
+#include <string.h>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "transform_batch.hpp"
+#include "check.hpp"
+
+using namespace vulkan;
+
+namespace {
+
+	// Not multiples of 4 or 8 as well as ones that are, so every kernel's
+	// scalar tail gets run.
+	const uint32_t counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100 };
+
+	std::mt19937 generator(1234);
+
+	float random_float(float low, float high) {
+		return std::uniform_real_distribution<float>(low, high)(generator);
+	}
+
+	// On a grid of quarters, which together with the planes below keeps every
+	// plane distance exact; the SIMD kernels have to agree with scalar on
+	// objects sitting exactly on a plane, not just near one.
+	float random_quarter(int low, int high) {
+		return std::uniform_int_distribution<int>(low * 4, high * 4)(generator) * 0.25f;
+	}
+
+	std::vector<float> random_floats(uint32_t count, float low, float high) {
+		std::vector<float> values(count);
+		for (auto& value : values) {
+			value = random_float(low, high);
+		}
+		return values;
+	}
+
+	std::vector<float> random_quarters(uint32_t count, int low, int high) {
+		std::vector<float> values(count);
+		for (auto& value : values) {
+			value = random_quarter(low, high);
+		}
+		return values;
+	}
+
+	void random_matrix(float matrix[16]) {
+		for (int e = 0; e < 16; e++) {
+			matrix[e] = random_float(-2.0f, 2.0f);
+		}
+	}
+
+	transform_soa random_transforms(uint32_t count) {
+		transform_soa transforms;
+		transforms.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			float matrix[16];
+			random_matrix(matrix);
+			transforms.set(i, matrix);
+		}
+		return transforms;
+	}
+
+	// FMA rounds once where scalar rounds twice.
+	bool close(float a, float b) {
+		return fabsf(a - b) <= 1e-5f * (1.0f + fabsf(a) + fabsf(b));
+	}
+
+	bool same_transforms(const transform_soa& a, const transform_soa& b, uint32_t count) {
+		for (uint32_t i = 0; i < count; i++) {
+			float ma[16], mb[16];
+			a.get(i, ma);
+			b.get(i, mb);
+			for (int e = 0; e < 16; e++) {
+				if (!close(ma[e], mb[e])) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// A box of +-10 on each axis, with the far plane swapped for a diagonal
+	// one so the culls see a plane with more than one non-zero component.
+	const float planes[6][4] = {
+		{ 1.0f, 0.0f, 0.0f, 10.0f },
+		{ -1.0f, 0.0f, 0.0f, 10.0f },
+		{ 0.0f, 1.0f, 0.0f, 10.0f },
+		{ 0.0f, -1.0f, 0.0f, 10.0f },
+		{ 0.0f, 0.0f, 1.0f, 10.0f },
+		{ 0.5f, -0.5f, -1.0f, 8.0f },
+	};
+
+	void test_compose_translations(simd_level level) {
+		for (uint32_t count : counts) {
+			float shared[16];
+			random_matrix(shared);
+			auto x = random_floats(count, -50.0f, 50.0f);
+			auto y = random_floats(count, -50.0f, 50.0f);
+			auto z = random_floats(count, -50.0f, 50.0f);
+
+			transform_soa expected, actual;
+			expected.resize(count);
+			actual.resize(count);
+			compose_translations(simd_level::scalar, shared, x.data(), y.data(), z.data(), count, expected);
+			compose_translations(level, shared, x.data(), y.data(), z.data(), count, actual);
+
+			CHECK(same_transforms(expected, actual, count));
+		}
+	}
+
+	void test_multiply_transforms(simd_level level) {
+		for (uint32_t count : counts) {
+			float lhs[16];
+			random_matrix(lhs);
+			auto in = random_transforms(count);
+
+			transform_soa expected, actual;
+			expected.resize(count);
+			actual.resize(count);
+			multiply_transforms(simd_level::scalar, lhs, in, expected);
+			multiply_transforms(level, lhs, in, actual);
+			CHECK(same_transforms(expected, actual, count));
+
+			// In place.
+			multiply_transforms(level, lhs, in, in);
+			CHECK(same_transforms(expected, in, count));
+		}
+	}
+
+	void test_cull_spheres(simd_level level) {
+		for (uint32_t count : counts) {
+			auto x = random_quarters(count, -14, 14);
+			auto y = random_quarters(count, -14, 14);
+			auto z = random_quarters(count, -14, 14);
+			auto radius = random_quarters(count, 0, 4);
+
+			std::vector<uint8_t> expected(count + 1, 0xcd), actual(count + 1, 0xcd);
+			const uint32_t expected_count = cull_spheres(simd_level::scalar, planes, x.data(), y.data(), z.data(), radius.data(), count, expected.data());
+			const uint32_t actual_count = cull_spheres(level, planes, x.data(), y.data(), z.data(), radius.data(), count, actual.data());
+
+			CHECK_EQUAL(expected_count, actual_count);
+			CHECK(expected == actual);
+		}
+	}
+
+	void test_cull_aabbs(simd_level level) {
+		for (uint32_t count : counts) {
+			auto cx = random_quarters(count, -14, 14);
+			auto cy = random_quarters(count, -14, 14);
+			auto cz = random_quarters(count, -14, 14);
+			auto ex = random_quarters(count, 0, 4);
+			auto ey = random_quarters(count, 0, 4);
+			auto ez = random_quarters(count, 0, 4);
+
+			std::vector<uint8_t> expected(count + 1, 0xcd), actual(count + 1, 0xcd);
+			const uint32_t expected_count = cull_aabbs(simd_level::scalar, planes, cx.data(), cy.data(), cz.data(), ex.data(), ey.data(), ez.data(), count, expected.data());
+			const uint32_t actual_count = cull_aabbs(level, planes, cx.data(), cy.data(), cz.data(), ex.data(), ey.data(), ez.data(), count, actual.data());
+
+			CHECK_EQUAL(expected_count, actual_count);
+			CHECK(expected == actual);
+		}
+	}
+
+	// Known values, so the kernels aren't only checked against each other.
+
+	void test_identity_frustum() {
+		const float identity[16] = {
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f,
+		};
+		const float expected[6][4] = {
+			{ 1.0f, 0.0f, 0.0f, 1.0f },
+			{ -1.0f, 0.0f, 0.0f, 1.0f },
+			{ 0.0f, 1.0f, 0.0f, 1.0f },
+			{ 0.0f, -1.0f, 0.0f, 1.0f },
+			{ 0.0f, 0.0f, 1.0f, 1.0f },
+			{ 0.0f, 0.0f, -1.0f, 1.0f },
+		};
+
+		float extracted[6][4];
+		extract_frustum_planes(identity, extracted);
+		for (int p = 0; p < 6; p++) {
+			for (int j = 0; j < 4; j++) {
+				CHECK_EQUAL(extracted[p][j], expected[p][j]);
+			}
+		}
+
+		// Scaling x by 2 halves the left and right distances once normalised.
+		float scaled[16];
+		memcpy(scaled, identity, sizeof(scaled));
+		scaled[0] = 2.0f;
+		extract_frustum_planes(scaled, extracted);
+		CHECK_EQUAL(extracted[0][0], 1.0f);
+		CHECK_EQUAL(extracted[0][3], 0.5f);
+		CHECK_EQUAL(extracted[1][0], -1.0f);
+		CHECK_EQUAL(extracted[1][3], 0.5f);
+		CHECK_EQUAL(extracted[2][3], 1.0f);
+	}
+
+	void test_known_compose_translations(simd_level level) {
+		// scale(2, 3, 4) then translate(1, 1, 1).
+		const float shared[16] = {
+			2.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 3.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 4.0f, 0.0f,
+			1.0f, 1.0f, 1.0f, 1.0f,
+		};
+		const uint32_t count = 9;
+		std::vector<float> x(count), y(count), z(count);
+		for (uint32_t i = 0; i < count; i++) {
+			x[i] = (float)i;
+			y[i] = -2.0f * i;
+			z[i] = 0.5f * i;
+		}
+
+		transform_soa out;
+		out.resize(count);
+		compose_translations(level, shared, x.data(), y.data(), z.data(), count, out);
+
+		for (uint32_t i = 0; i < count; i++) {
+			const float expected[16] = {
+				2.0f, 0.0f, 0.0f, 0.0f,
+				0.0f, 3.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, 4.0f, 0.0f,
+				1.0f + x[i], 1.0f + y[i], 1.0f + z[i], 1.0f,
+			};
+			float actual[16];
+			out.get(i, actual);
+			CHECK(memcmp(expected, actual, sizeof(actual)) == 0);
+		}
+	}
+
+	void test_known_multiply_transforms(simd_level level) {
+		// lhs is a shear, y += 2x, followed by translate(1, 2, 3).
+		const float lhs[16] = {
+			1.0f, 2.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			1.0f, 2.0f, 3.0f, 1.0f,
+		};
+
+		// scale(2, 3, 4); a quarter turn about z then translate(5, 0, 0); and
+		// a full matrix with a projective row.
+		const float in[3][16] = {
+			{ 2.0f, 0.0f, 0.0f, 0.0f,   0.0f, 3.0f, 0.0f, 0.0f,   0.0f, 0.0f, 4.0f, 0.0f,   0.0f, 0.0f, 0.0f, 1.0f },
+			{ 0.0f, 1.0f, 0.0f, 0.0f,   -1.0f, 0.0f, 0.0f, 0.0f,   0.0f, 0.0f, 1.0f, 0.0f,   5.0f, 0.0f, 0.0f, 1.0f },
+			{ 1.0f, 2.0f, 3.0f, 4.0f,   5.0f, 6.0f, 7.0f, 8.0f,   9.0f, 10.0f, 11.0f, 12.0f,   13.0f, 14.0f, 15.0f, 16.0f },
+		};
+
+		// Worked by hand: each column of the result is lhs times that column,
+		// (x, y, z, w) -> (x + w, 2x + y + 2w, z + 3w, w).
+		const float expected[3][16] = {
+			{ 2.0f, 4.0f, 0.0f, 0.0f,   0.0f, 3.0f, 0.0f, 0.0f,   0.0f, 0.0f, 4.0f, 0.0f,   1.0f, 2.0f, 3.0f, 1.0f },
+			{ 0.0f, 1.0f, 0.0f, 0.0f,   -1.0f, -2.0f, 0.0f, 0.0f,   0.0f, 0.0f, 1.0f, 0.0f,   6.0f, 12.0f, 3.0f, 1.0f },
+			{ 5.0f, 12.0f, 15.0f, 4.0f,   13.0f, 32.0f, 31.0f, 8.0f,   21.0f, 52.0f, 47.0f, 12.0f,   29.0f, 72.0f, 63.0f, 16.0f },
+		};
+
+		// Enough copies for a full AVX2 batch plus a tail.
+		const uint32_t count = 9;
+		transform_soa transforms;
+		transforms.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			transforms.set(i, in[i % 3]);
+		}
+
+		transform_soa out;
+		out.resize(count);
+		multiply_transforms(level, lhs, transforms, out);
+
+		for (uint32_t i = 0; i < count; i++) {
+			float actual[16];
+			out.get(i, actual);
+			CHECK(memcmp(expected[i % 3], actual, sizeof(actual)) == 0);
+		}
+	}
+
+	// Only the first plane matters; the others are too far away to cull.
+	void single_plane(const float plane[4], float planes[6][4]) {
+		for (int p = 0; p < 6; p++) {
+			for (int j = 0; j < 4; j++) {
+				planes[p][j] = p == 0 ? plane[j] : (j == 3 ? 1000.0f : 0.0f);
+			}
+		}
+	}
+
+	void test_known_culls(simd_level level) {
+		// Keeps x >= 0. Inside, outside, straddling, touching from outside
+		// (still visible) and a quarter clear of it, twice over so the SIMD
+		// kernels see a full batch.
+		const float keep_positive_x[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+		float planes_x[6][4];
+		single_plane(keep_positive_x, planes_x);
+
+		const uint32_t count = 10;
+		const float centers[5] = { 5.0f, -5.0f, -0.5f, -1.0f, -1.25f };
+		const uint8_t expected_visible[5] = { 1, 0, 1, 1, 0 };
+
+		std::vector<float> x(count), zero(count, 0.0f), one(count, 1.0f);
+		std::vector<uint8_t> expected(count);
+		for (uint32_t i = 0; i < count; i++) {
+			x[i] = centers[i % 5];
+			expected[i] = expected_visible[i % 5];
+		}
+
+		std::vector<uint8_t> visible(count, 0xcd);
+		CHECK_EQUAL(cull_spheres(level, planes_x, x.data(), zero.data(), zero.data(), one.data(), count, visible.data()), 6u);
+		CHECK(visible == expected);
+
+		visible.assign(count, 0xcd);
+		CHECK_EQUAL(cull_aabbs(level, planes_x, x.data(), zero.data(), zero.data(), one.data(), one.data(), one.data(), count, visible.data()), 6u);
+		CHECK(visible == expected);
+
+		// A diagonal plane, x + y >= 0, tests the box's nearest corner rather
+		// than its centre: a box centred on (-2, -2) reaches it with extents
+		// of 2 but not 1.75.
+		const float keep_diagonal[4] = { 0.5f, 0.5f, 0.0f, 0.0f };
+		float planes_diagonal[6][4];
+		single_plane(keep_diagonal, planes_diagonal);
+
+		const float cx[2] = { -2.0f, -2.0f };
+		const float extent[2] = { 2.0f, 1.75f };
+		visible.assign(2, 0xcd);
+		CHECK_EQUAL(cull_aabbs(level, planes_diagonal, cx, cx, zero.data(), extent, extent, zero.data(), 2, visible.data()), 1u);
+		CHECK_EQUAL(visible[0], 1);
+		CHECK_EQUAL(visible[1], 0);
+
+		// Distance to the plane is -2, so a radius of 2 just touches it.
+		const float radius[2] = { 2.0f, 1.75f };
+		visible.assign(2, 0xcd);
+		CHECK_EQUAL(cull_spheres(level, planes_diagonal, cx, cx, zero.data(), radius, 2, visible.data()), 1u);
+		CHECK_EQUAL(visible[0], 1);
+		CHECK_EQUAL(visible[1], 0);
+	}
+
+	void test_store_transforms(simd_level level) {
+		const uint32_t total = 40;
+		auto in = random_transforms(total);
+
+		std::vector<uint8_t> visible(total);
+		for (auto& v : visible) {
+			v = std::uniform_int_distribution<int>(0, 1)(generator);
+		}
+
+		const uint32_t firsts[] = { 0, 1, 3, 4, 5 };
+		for (uint32_t first : firsts) {
+			for (uint32_t count : counts) {
+				if (first + count > total) {
+					continue;
+				}
+
+				for (int culled = 0; culled < 2; culled++) {
+					const uint8_t * mask = culled ? visible.data() : nullptr;
+
+					// One matrix of slack to catch writes past the end.
+					std::vector<float> expected((count + 1) * 16, -1.0f), actual((count + 1) * 16, -1.0f);
+					const uint32_t expected_written = store_transforms(simd_level::scalar, in, first, count, mask, expected.data());
+					const uint32_t actual_written = store_transforms(level, in, first, count, mask, actual.data());
+
+					CHECK_EQUAL(expected_written, actual_written);
+					CHECK(expected == actual);
+				}
+			}
+		}
+	}
+
+}
+
+int main() {
+	test_identity_frustum();
+	test_known_compose_translations(simd_level::scalar);
+	test_known_multiply_transforms(simd_level::scalar);
+	test_known_culls(simd_level::scalar);
+
+	const simd_level best = detect_simd_level();
+	const simd_level levels[] = { simd_level::sse, simd_level::avx2 };
+
+	for (simd_level level : levels) {
+		if (level > best) {
+			std::cout << "transform_batch: " << simd_level_name(level) << " not supported here, skipped" << std::endl;
+			continue;
+		}
+
+		test_compose_translations(level);
+		test_multiply_transforms(level);
+		test_cull_spheres(level);
+		test_cull_aabbs(level);
+		test_store_transforms(level);
+		test_known_compose_translations(level);
+		test_known_multiply_transforms(level);
+		test_known_culls(level);
+	}
+
+	return check::result("transform_batch");
+}
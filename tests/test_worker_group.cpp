@@ -0,0 +1,62 @@
+
+#include <atomic>
+#include <vector>
+
+#include "worker_group.hpp"
+#include "check.hpp"
+
+using namespace vulkan;
+
+namespace {
+
+	// Every worker runs every job exactly once, with its own index, and run
+	// doesn't return until they all have.
+	void test_run() {
+		const uint32_t workers = 4;
+		worker_group group;
+		group.init(workers, "test");
+		CHECK_EQUAL(group.size(), workers);
+
+		std::vector<int> runs(workers, 0);
+		for (int frame = 1; frame <= 100; frame++) {
+			group.run([&](uint32_t worker) {
+				runs[worker]++;
+			});
+			for (uint32_t i = 0; i < workers; i++) {
+				CHECK_EQUAL(runs[i], frame);
+			}
+		}
+
+		group.finish();
+		CHECK_EQUAL(group.size(), 0u);
+	}
+
+	// Restarting with a different count, as a swapchain rebuild does, and
+	// running on an empty group is a no-op.
+	void test_reinit() {
+		worker_group group;
+		std::atomic<int> calls(0);
+		auto count = [&](uint32_t) { calls++; };
+
+		group.run(count);
+		CHECK_EQUAL(calls.load(), 0);
+
+		group.init(2, "test");
+		group.run(count);
+		CHECK_EQUAL(calls.load(), 2);
+
+		group.finish();
+		group.init(3, "test");
+		CHECK_EQUAL(calls.load(), 2);
+		group.run(count);
+		CHECK_EQUAL(calls.load(), 5);
+	}
+
+}
+
+int main() {
+	test_run();
+	test_reinit();
+
+	return check::result("worker_group");
+}
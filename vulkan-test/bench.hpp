@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "../src/transform_batch.hpp"
+
+// Shared by the CPU benchmarks: timing, the kernel levels to run, and checking
+// every run against the first.
+
+namespace bench {
+
+	const int bench_iterations = 20;
+
+	// Fastest of iterations runs of f, in milliseconds.
+	template <typename F>
+	double best_of(F f, int iterations = bench_iterations) {
+		double best = 1e30;
+		for (int i = 0; i < iterations; i++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			f();
+			auto end = std::chrono::high_resolution_clock::now();
+			best = (std::min)(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+
+	// Every kernel level the CPU supports, scalar first so it can be the
+	// reference.
+	inline std::vector<vulkan::simd_level> simd_levels() {
+		const vulkan::simd_level best = vulkan::detect_simd_level();
+		std::vector<vulkan::simd_level> levels;
+		for (vulkan::simd_level level : { vulkan::simd_level::scalar, vulkan::simd_level::sse, vulkan::simd_level::avx2 }) {
+			if (level <= best) {
+				levels.push_back(level);
+			}
+		}
+		return levels;
+	}
+
+	// The first result passed to matches becomes the reference and later ones
+	// are compared with it. Remembers whether every check passed, for the
+	// benchmark's exit code.
+	template <typename T>
+	class reference_check {
+	public:
+		template <typename Equal>
+		bool matches(const T& result, Equal equal) {
+			if (!_has_reference) {
+				_reference = result;
+				_has_reference = true;
+				return true;
+			}
+			return expect(equal(result, _reference));
+		}
+
+		bool matches(const T& result) {
+			return matches(result, std::equal_to<T>());
+		}
+
+		// Anything else a run must get right.
+		bool expect(bool ok) {
+			_passed = _passed && ok;
+			return ok;
+		}
+
+		int exit_code() const {
+			return _passed ? 0 : 1;
+		}
+
+	private:
+		T _reference;
+		bool _has_reference = false;
+		bool _passed = true;
+	};
+
+	inline const char * mismatch(bool ok) {
+		return ok ? "" : "  MISMATCH";
+	}
+
+}
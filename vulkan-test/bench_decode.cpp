@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "../src/texture_decoder.hpp"
+#include "bench.hpp"
+#include "vulkan-test.h"
+
+namespace {
+
+	// Each run decodes the whole directory.
+	const int decode_iterations = 3;
+
+	bool is_png(const std::string& name) {
+		if (name.size() < 4) {
+			return false;
+		}
+		std::string extension = name.substr(name.size() - 4);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension == ".png";
+	}
+
+	std::vector<std::string> list_pngs(const std::string& directory) {
+		std::vector<std::string> files;
+#ifdef _WIN32
+		WIN32_FIND_DATAA find_data;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &find_data);
+		if (find != INVALID_HANDLE_VALUE) {
+			do {
+				if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_png(find_data.cFileName)) {
+					files.push_back(directory + "/" + find_data.cFileName);
+				}
+			} while (FindNextFileA(find, &find_data));
+			FindClose(find);
+		}
+#else
+		DIR * dir = opendir(directory.c_str());
+		if (dir != nullptr) {
+			while (dirent * entry = readdir(dir)) {
+				if (is_png(entry->d_name)) {
+					files.push_back(directory + "/" + entry->d_name);
+				}
+			}
+			closedir(dir);
+		}
+#endif
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	// Decodes every file once on an already running pool, into memory
+	// standing in for staging buffers.
+	void decode_all(vulkan::texture_decoder& decoder, const std::vector<std::string>& files, std::vector<std::vector<uint8_t>>& images, uint32_t& failed) {
+		images.assign(files.size(), std::vector<uint8_t>());
+		failed = 0;
+
+		std::vector<vulkan::decode_handle> handles;
+		for (size_t i = 0; i < files.size(); i++) {
+			std::vector<uint8_t> * image = &images[i];
+			auto row_bytes = std::make_shared<uint32_t>(0);
+
+			load_image::png_sink sink;
+			sink.begin = [image, row_bytes](unsigned int width, unsigned int height) {
+				*row_bytes = width * 4;
+				image->resize((size_t)width * height * 4);
+			};
+			sink.row = [image, row_bytes](unsigned int y, const uint8_t * row) {
+				memcpy(image->data() + (size_t)y * *row_bytes, row, *row_bytes);
+			};
+			handles.push_back(decoder.submit(files[i], sink));
+		}
+
+		for (auto& handle : handles) {
+			failed += handle.get() ? 0 : 1;
+		}
+	}
+
+}
+
+// Decodes every PNG in a directory on the texture decoder's pool with 1, 2,
+// 4... threads up to the hardware's, as streamed textures are, and checks
+// each run decodes exactly what the single-threaded one did.
+int bench_decode(const char * directory) {
+	const std::vector<std::string> files = list_pngs(directory);
+	if (files.empty()) {
+		std::cout << "bench-decode: no PNGs in " << directory << std::endl;
+		return 1;
+	}
+
+	const uint32_t hardware = (std::max)(std::thread::hardware_concurrency(), 1u);
+	std::vector<uint32_t> thread_counts;
+	for (uint32_t threads = 1; threads < hardware; threads *= 2) {
+		thread_counts.push_back(threads);
+	}
+	thread_counts.push_back(hardware);
+
+	std::cout << "bench-decode: " << files.size() << " PNGs from " << directory << ", up to " << hardware << " threads, best of " << decode_iterations << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+
+	bench::reference_check<std::vector<std::vector<uint8_t>>> check;
+	double single_ms = 0.0;
+
+	for (uint32_t threads : thread_counts) {
+		// Starting the threads is the streamer's one-off cost, not a
+		// decode's, so it stays out of the timing.
+		vulkan::texture_decoder decoder;
+		decoder.init(threads);
+
+		std::vector<std::vector<uint8_t>> images;
+		uint32_t failed = 0;
+		const double best = bench::best_of([&]() {
+			decode_all(decoder, files, images, failed);
+		}, decode_iterations);
+		decoder.finish();
+
+		uint64_t bytes = 0;
+		for (auto& image : images) {
+			bytes += image.size();
+		}
+
+		if (threads == 1) {
+			single_ms = best;
+		}
+		bool ok = check.matches(images);
+		ok = check.expect(failed == 0) && ok;
+
+		std::cout << "  " << std::setw(2) << threads << " threads " << best << " ms  " << (files.size() / (best / 1000.0)) << " images/s  "
+			<< ((double)bytes / 1e6 / (best / 1000.0)) << " MB/s  " << std::setprecision(2) << (single_ms / best) << "x" << std::setprecision(3)
+			<< (failed > 0 ? "  FAILED" : bench::mismatch(ok)) << std::endl;
+	}
+
+	return check.exit_code();
+}
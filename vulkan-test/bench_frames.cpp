@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "../src/vulkan_gpu_profiler.hpp"
+#include "vulkan-test.h"
+
+using vulkan::percentile;
+
+int write_frame_benchmark(const frame_benchmark& benchmark, const char * path) {
+	std::vector<double> sorted = benchmark.frame_ms;
+	std::sort(sorted.begin(), sorted.end());
+
+	double total_ms = 0.0;
+	for (double ms : sorted) {
+		total_ms += ms;
+	}
+
+	const size_t frames = sorted.size();
+	const double min_ms = frames > 0 ? sorted.front() : 0.0;
+	const double max_ms = frames > 0 ? sorted.back() : 0.0;
+	const double mean_ms = frames > 0 ? total_ms / frames : 0.0;
+	const double p50_ms = frames > 0 ? percentile(sorted, 0.50) : 0.0;
+	const double p95_ms = frames > 0 ? percentile(sorted, 0.95) : 0.0;
+	const double p99_ms = frames > 0 ? percentile(sorted, 0.99) : 0.0;
+	const double fps = total_ms > 0.0 ? frames * 1000.0 / total_ms : 0.0;
+
+	std::cout << "benchmark " << benchmark.scene << ": " << frames << " frames, " << fps << " fps, mean " << mean_ms << "ms, p50 " << p50_ms
+		<< "ms, p95 " << p95_ms << "ms, p99 " << p99_ms << "ms (min " << min_ms << "ms, max " << max_ms << "ms)" << std::endl;
+
+	FILE * fp = fopen(path, "wb");
+	if (!fp) {
+		std::cout << "couldn't write benchmark results to " << path << std::endl;
+		return 1;
+	}
+
+	// Flat and one key per line, so two runs diff cleanly. Names are the
+	// demo's own, so need no escaping.
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"scene\": \"%s\",\n", benchmark.scene.c_str());
+	fprintf(fp, "\t\"width\": %u,\n", benchmark.width);
+	fprintf(fp, "\t\"height\": %u,\n", benchmark.height);
+	fprintf(fp, "\t\"headless\": %s,\n", benchmark.headless ? "true" : "false");
+	fprintf(fp, "\t\"present_policy\": \"%s\",\n", benchmark.present_policy.c_str());
+	fprintf(fp, "\t\"present_mode\": \"%s\",\n", benchmark.present_mode.c_str());
+	fprintf(fp, "\t\"frames_in_flight\": %u,\n", benchmark.frames_in_flight);
+	fprintf(fp, "\t\"instances\": %u,\n", benchmark.instances);
+	fprintf(fp, "\t\"gpu_culling\": %s,\n", benchmark.gpu_culling ? "true" : "false");
+	fprintf(fp, "\t\"simd_level\": \"%s\",\n", benchmark.simd_level.c_str());
+	fprintf(fp, "\t\"texture_filter\": \"%s\",\n", benchmark.texture_filter.c_str());
+	fprintf(fp, "\t\"mipmaps\": %s,\n", benchmark.mipmaps ? "true" : "false");
+	fprintf(fp, "\t\"compressed_textures\": %s,\n", benchmark.compressed_textures ? "true" : "false");
+	fprintf(fp, "\t\"warmup_frames\": %u,\n", benchmark.warmup_frames);
+	fprintf(fp, "\t\"frames\": %u,\n", (uint32_t)frames);
+	fprintf(fp, "\t\"total_ms\": %.4f,\n", total_ms);
+	fprintf(fp, "\t\"fps\": %.4f,\n", fps);
+	fprintf(fp, "\t\"min_ms\": %.4f,\n", min_ms);
+	fprintf(fp, "\t\"mean_ms\": %.4f,\n", mean_ms);
+	fprintf(fp, "\t\"p50_ms\": %.4f,\n", p50_ms);
+	fprintf(fp, "\t\"p95_ms\": %.4f,\n", p95_ms);
+	fprintf(fp, "\t\"p99_ms\": %.4f,\n", p99_ms);
+	fprintf(fp, "\t\"max_ms\": %.4f%s\n", max_ms, benchmark.gpu_passes.empty() ? "" : ",");
+
+	// GPU time is what shows texture bandwidth; frame time may be paced by
+	// presentation instead.
+	for (size_t i = 0; i < benchmark.gpu_passes.size(); i++) {
+		const auto& pass = benchmark.gpu_passes[i];
+		fprintf(fp, "\t\"gpu_%s_avg_ms\": %.4f,\n", pass.name.c_str(), pass.avg_ms);
+		fprintf(fp, "\t\"gpu_%s_p95_ms\": %.4f%s\n", pass.name.c_str(), pass.p95_ms, i + 1 < benchmark.gpu_passes.size() ? "," : "");
+	}
+	fprintf(fp, "}\n");
+
+	const bool ok = ferror(fp) == 0;
+	fclose(fp);
+	if (!ok) {
+		std::cout << "couldn't write benchmark results to " << path << std::endl;
+		return 1;
+	}
+	std::cout << "wrote benchmark results to " << path << std::endl;
+	return 0;
+}
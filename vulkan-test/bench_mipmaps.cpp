@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../src/mipmap.hpp"
+#include "bench.hpp"
+#include "vulkan-test.h"
+
+// Builds a full RGBA8 mip chain for a width x height image with each kernel
+// level the CPU supports, as create_texture does when the format can't be
+// blitted, and checks every level against the scalar reference bit for bit.
+int bench_mipmaps(uint32_t width, uint32_t height) {
+	width = (std::max)(width, 1u);
+	height = (std::max)(height, 1u);
+
+	std::vector<vulkan::mip_level> levels;
+	const uint64_t chain_size = vulkan::mip_chain_layout(width, height, vulkan::mip_level_count(width, height), levels);
+	const uint64_t base_size = (uint64_t)width * height * 4;
+
+	// Noise, so no kernel gets lucky with uniform blocks.
+	std::vector<uint8_t> base((size_t)base_size);
+	uint32_t seed = 1;
+	for (auto& byte : base) {
+		seed = seed * 1664525u + 1013904223u;
+		byte = (uint8_t)(seed >> 24);
+	}
+
+	std::cout << "bench-mipmaps: " << width << "x" << height << ", " << levels.size() << " levels, " << (chain_size - base_size) << " bytes generated, best of " << bench::bench_iterations << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+
+	bench::reference_check<std::vector<uint8_t>> check;
+	double scalar_ms = 0.0;
+
+	for (vulkan::simd_level level : bench::simd_levels()) {
+		std::vector<uint8_t> chain((size_t)chain_size);
+		std::copy(base.begin(), base.end(), chain.begin());
+
+		const double ms = bench::best_of([&]() {
+			vulkan::generate_mip_chain_rgba8(level, chain.data(), levels);
+		});
+
+		if (level == vulkan::simd_level::scalar) {
+			scalar_ms = ms;
+		}
+		const bool ok = check.matches(chain);
+
+		// Read by the first downsample, then everything each level writes.
+		const double gigabytes = (double)(base_size + 2 * (chain_size - base_size)) / 1e9;
+
+		std::cout << "  " << std::left << std::setw(8) << vulkan::simd_level_name(level) << std::right << " " << ms << " ms  " << (gigabytes / (ms / 1000.0)) << " GB/s  "
+			<< std::setprecision(2) << (scalar_ms / ms) << "x" << std::setprecision(3) << bench::mismatch(ok) << std::endl;
+	}
+
+	return check.exit_code();
+}
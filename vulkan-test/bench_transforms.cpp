@@ -0,0 +1,120 @@
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/glm.hpp>
+
+#include "../src/transform_batch.hpp"
+#include "bench.hpp"
+#include "vulkan-test.h"
+
+// One frame's worth of CPU scene update for count objects: compose each model
+// from a shared rotation and its own position, compose the MVP against VP,
+// frustum-test the bounding sphere and pack the survivors for upload. Runs
+// the glm array-of-structures loop, then the batch kernels at every level
+// the CPU supports, checking each against the scalar reference.
+int bench_transforms(uint32_t count) {
+	if (count < 1) {
+		count = 1;
+	}
+
+	const glm::mat4x4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+	const glm::mat4x4 view = glm::lookAt(glm::vec3(0.0f, 3.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	const glm::mat4x4 vp = projection * view;
+	const glm::mat4x4 shared = glm::scale(glm::rotate(glm::mat4x4(1.0f), 0.7f, glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(0.1f));
+
+	float planes[6][4];
+	vulkan::extract_frustum_planes(&vp[0][0], planes);
+
+	// Scatter the objects through a box a little wider than the view, so
+	// the frustum test has real work to do on both sides.
+	std::vector<float> x(count), y(count), z(count), radius(count, 0.18f);
+	uint32_t seed = 1;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) * (1.0f / 16777216.0f);
+	};
+	for (uint32_t i = 0; i < count; i++) {
+		x[i] = random() * 16.0f - 8.0f;
+		y[i] = random() * 16.0f - 8.0f;
+		z[i] = random() * 16.0f - 8.0f;
+	}
+
+	std::vector<glm::mat4x4> glm_out(count);
+	std::vector<uint8_t> glm_visible(count);
+	uint32_t glm_written = 0;
+
+	const double glm_ms = bench::best_of([&]() {
+		glm_written = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			const glm::mat4x4 mvp = vp * (glm::translate(glm::mat4x4(1.0f), glm::vec3(x[i], y[i], z[i])) * shared);
+
+			bool inside = true;
+			for (int p = 0; p < 6; p++) {
+				if (planes[p][0] * x[i] + planes[p][1] * y[i] + planes[p][2] * z[i] + planes[p][3] < -radius[i]) {
+					inside = false;
+				}
+			}
+			glm_visible[i] = inside ? 1 : 0;
+			if (inside) {
+				glm_out[glm_written++] = mvp;
+			}
+		}
+	});
+
+	std::cout << "bench-transforms: " << count << " objects, best of " << bench::bench_iterations << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  glm      " << glm_ms << " ms  " << (glm_ms * 1e6 / count) << " ns/object  " << glm_written << " visible" << std::endl;
+
+	bench::reference_check<std::vector<float>> check;
+
+	for (vulkan::simd_level level : bench::simd_levels()) {
+		vulkan::transform_soa transforms;
+		transforms.resize(count);
+		std::vector<uint8_t> visible(count);
+		std::vector<float> out((size_t)count * 16);
+		uint32_t written = 0;
+
+		const double ms = bench::best_of([&]() {
+			vulkan::compose_translations(level, &shared[0][0], x.data(), y.data(), z.data(), count, transforms);
+			vulkan::multiply_transforms(level, &vp[0][0], transforms, transforms);
+			vulkan::cull_spheres(level, planes, x.data(), y.data(), z.data(), radius.data(), count, visible.data());
+			written = vulkan::store_transforms(level, transforms, 0, count, visible.data(), out.data());
+		});
+
+		uint32_t mismatches = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			mismatches += visible[i] != glm_visible[i] ? 1 : 0;
+		}
+
+		// FMA rounds differently, so compare relative to the magnitude. The
+		// scalar kernels are checked against glm, the rest against scalar.
+		float max_error = 0.0f;
+		if (level == vulkan::simd_level::scalar) {
+			for (uint32_t i = 0; i < written && i < glm_written; i++) {
+				const float * expected = &glm_out[i][0][0];
+				for (int e = 0; e < 16; e++) {
+					max_error = (std::max)(max_error, std::fabs(out[i * 16 + e] - expected[e]) / (1.0f + std::fabs(expected[e])));
+				}
+			}
+		}
+		bool ok = check.matches(out, [&](const std::vector<float>& result, const std::vector<float>& reference) {
+			for (size_t e = 0; e < (size_t)written * 16; e++) {
+				max_error = (std::max)(max_error, std::fabs(result[e] - reference[e]) / (1.0f + std::fabs(reference[e])));
+			}
+			return max_error < 1e-4f;
+		});
+		ok = check.expect(mismatches == 0 && written == glm_written && max_error < 1e-4f) && ok;
+
+		std::cout << "  " << std::left << std::setw(8) << vulkan::simd_level_name(level) << std::right << " " << ms << " ms  " << (ms * 1e6 / count) << " ns/object  "
+			<< std::setprecision(2) << (glm_ms / ms) << "x  " << mismatches << " cull mismatches  max error " << std::scientific << max_error << std::fixed << std::setprecision(3)
+			<< bench::mismatch(ok) << std::endl;
+	}
+
+	return check.exit_code();
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../src/pngReader.hpp"
+#include "../src/mipmap.hpp"
+#include "../src/texture_codec.hpp"
+#include "../src/ktx2.hpp"
+#include "vulkan-test.h"
+
+// Decodes input once, builds its full mip chain with the same box filter
+// create_texture falls back to, then encodes every level into each format
+// in turn. One file per format, so the loader can pick whichever the device
+// samples.
+int convert_texture(const char * input, const char * output, const char * formats) {
+	std::vector<vulkan::block_format> targets;
+	std::string list = formats;
+	size_t start = 0;
+	while (start <= list.size()) {
+		const size_t comma = (std::min)(list.find(',', start), list.size());
+		const std::string name = list.substr(start, comma - start);
+		vulkan::block_format format;
+		if (!vulkan::parse_block_format(name.c_str(), format)) {
+			std::cout << "unknown texture format " << name << ", expected bc1, bc3, bc7, etc2 or etc2a" << std::endl;
+			return 1;
+		}
+		targets.push_back(format);
+		start = comma + 1;
+	}
+
+	unsigned int width = 0, height = 0;
+	std::shared_ptr<uint8_t> raw_image = nullptr;
+	try {
+		raw_image = load_image::png(input, width, height);
+	} catch (std::exception& e) {
+		std::cerr << "Failed to load " << input << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::vector<vulkan::mip_level> levels;
+	const uint64_t chain_size = vulkan::mip_chain_layout(width, height, vulkan::mip_level_count(width, height), levels);
+	std::vector<uint8_t> chain((size_t)chain_size);
+	memcpy(chain.data(), raw_image.get(), (size_t)width * height * 4);
+	raw_image = nullptr;
+	vulkan::generate_mip_chain_rgba8(vulkan::detect_simd_level(), chain.data(), levels);
+
+	std::cout << "convert-texture: " << input << ", " << width << "x" << height << ", " << levels.size() << " levels, " << chain_size << " bytes as RGBA8" << std::endl;
+
+	for (vulkan::block_format format : targets) {
+		auto encode_start = std::chrono::high_resolution_clock::now();
+
+		vulkan::ktx2_texture texture;
+		texture.format = vulkan::block_format_vk_format(format);
+		texture.width = width;
+		texture.height = height;
+
+		for (auto& level : levels) {
+			vulkan::ktx2_level encoded;
+			encoded.offset = texture.data.size();
+			encoded.size = vulkan::block_format_level_size(format, level.width, level.height);
+			encoded.width = level.width;
+			encoded.height = level.height;
+
+			texture.data.resize((size_t)(encoded.offset + encoded.size));
+			vulkan::encode_blocks(format, chain.data() + level.offset, level.width, level.height, texture.data.data() + encoded.offset);
+			texture.levels.push_back(encoded);
+		}
+
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - encode_start).count();
+		const std::string path = std::string(output) + "." + vulkan::block_format_name(format) + ".ktx2";
+
+		try {
+			vulkan::write_ktx2(path.c_str(), texture);
+		} catch (std::exception& e) {
+			std::cerr << "Failed to write " << path << ": " << e.what() << std::endl;
+			return 1;
+		}
+
+		std::cout << "  " << path << ": " << texture.data.size() << " bytes (" << ((double)chain_size / texture.data.size()) << "x smaller), encoded in " << ms << "ms" << std::endl;
+	}
+
+	return 0;
+}
@@ -5,45 +5,339 @@
 #include <SDL2/SDL.h>
 #undef main
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 
 
 #include "../src/vulkan_wrapper.hpp"
+#include "../src/cpu_profiler.hpp"
 #include "vulkan-test.h"
 
 int main(int argc, char ** argv) {
+	uint32_t frames_in_flight = 2;
+	bool frames_in_flight_set = false;
+	const char * present_policy = "balanced";
+	uint32_t stream_count = 0;
+	const char * pipeline_cache_path = "pipeline_cache.bin";
+	uint32_t pipeline_variants = 0;
+	uint32_t instance_count = 1;
+	bool bench_instances = false;
+	bool gpu_cull = false;
+	uint32_t bench_transform_count = 0;
+	uint32_t record_threads = 0;
+	bool rerecord = false;
+	uint32_t draw_batch_size = 1024;
+	bool headless = false;
+	uint32_t width = 512, height = 512;
+	uint32_t frame_limit = 0;
+	bool gpu_profile = false;
+	bool gpu_statistics = false;
+	const char * trace_path = nullptr;
+	uint32_t sleep_ms = 3;
+	const char * bench_scene = nullptr;
+	uint32_t bench_frame_count = 1000;
+	uint32_t bench_warmup = 100;
+	const char * bench_out = "benchmark.json";
+	const char * texture_filter = "trilinear";
+	bool mipmaps = true;
+	uint32_t bench_mipmap_width = 0, bench_mipmap_height = 0;
+	bool compressed_textures = false;
+	const char * convert_input = nullptr;
+	const char * convert_output = nullptr;
+	const char * texture_formats = "bc1,bc7,etc2";
+	const char * bench_decode_directory = nullptr;
+	uint32_t decode_threads = 0;
 
-	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-		std::cout << "SDL_Init Error: " << SDL_GetError() << std::endl;
-		return 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+			frames_in_flight = (uint32_t)atoi(argv[++i]);
+			if (frames_in_flight < 1) {
+				frames_in_flight = 1;
+			}
+			frames_in_flight_set = true;
+		} else if (strcmp(argv[i], "--present-policy") == 0 && i + 1 < argc) {
+			present_policy = argv[++i];
+		} else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			stream_count = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc) {
+			pipeline_cache_path = argv[++i];
+		} else if (strcmp(argv[i], "--no-pipeline-cache") == 0) {
+			pipeline_cache_path = "";
+		} else if (strcmp(argv[i], "--pipeline-variants") == 0 && i + 1 < argc) {
+			pipeline_variants = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			instance_count = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bench-instances") == 0) {
+			bench_instances = true;
+		} else if (strcmp(argv[i], "--gpu-cull") == 0) {
+			gpu_cull = true;
+		} else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+			record_threads = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--rerecord") == 0) {
+			rerecord = true;
+		} else if (strcmp(argv[i], "--draw-batch") == 0 && i + 1 < argc) {
+			draw_batch_size = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bench-transforms") == 0 && i + 1 < argc) {
+			bench_transform_count = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		} else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &width, &height) != 2 || width < 1 || height < 1) {
+				width = 512;
+				height = 512;
+			}
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frame_limit = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--gpu-profile") == 0) {
+			gpu_profile = true;
+		} else if (strcmp(argv[i], "--gpu-stats") == 0) {
+			gpu_statistics = true;
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (strcmp(argv[i], "--sleep") == 0 && i + 1 < argc) {
+			sleep_ms = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+			bench_scene = argv[++i];
+		} else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+			bench_frame_count = (uint32_t)atoi(argv[++i]);
+			if (bench_frame_count < 1) {
+				bench_frame_count = 1;
+			}
+		} else if (strcmp(argv[i], "--bench-warmup") == 0 && i + 1 < argc) {
+			bench_warmup = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+			bench_out = argv[++i];
+		} else if (strcmp(argv[i], "--texture-filter") == 0 && i + 1 < argc) {
+			texture_filter = argv[++i];
+		} else if (strcmp(argv[i], "--no-mipmaps") == 0) {
+			mipmaps = false;
+		} else if (strcmp(argv[i], "--bench-mipmaps") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &bench_mipmap_width, &bench_mipmap_height) != 2) {
+				bench_mipmap_width = bench_mipmap_height = 0;
+			}
+		} else if (strcmp(argv[i], "--compressed-textures") == 0) {
+			compressed_textures = true;
+		} else if (strcmp(argv[i], "--convert-texture") == 0 && i + 2 < argc) {
+			convert_input = argv[++i];
+			convert_output = argv[++i];
+		} else if (strcmp(argv[i], "--texture-formats") == 0 && i + 1 < argc) {
+			texture_formats = argv[++i];
+		} else if (strcmp(argv[i], "--bench-decode") == 0 && i + 1 < argc) {
+			bench_decode_directory = argv[++i];
+		} else if (strcmp(argv[i], "--decode-threads") == 0 && i + 1 < argc) {
+			decode_threads = (uint32_t)atoi(argv[++i]);
+		}
+	}
+
+	// CPU only; no window or device needed.
+	if (bench_transform_count > 0) {
+		return bench_transforms(bench_transform_count);
+	}
+	if (bench_mipmap_width > 0 && bench_mipmap_height > 0) {
+		return bench_mipmaps(bench_mipmap_width, bench_mipmap_height);
+	}
+	// --convert-texture test.png test writes the test.<format>.ktx2 files
+	// --compressed-textures loads in place of test.png.
+	if (convert_input != nullptr) {
+		return convert_texture(convert_input, convert_output, texture_formats);
+	}
+	if (bench_decode_directory != nullptr) {
+		return bench_decode(bench_decode_directory);
 	}
 
-	SDL_Window *window = SDL_CreateWindow("Hello World!", 100, 100, 512, 512, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-	if (window == nullptr) {
-		std::cout << "SDL_CreateWindow Error: " << SDL_GetError() << std::endl;
-		SDL_Quit();
+	// nearest, bilinear, trilinear or anisotropic. Compare --bench instances
+	// with and without --no-mipmaps under --gpu-profile: the minified cubes
+	// read far less texture memory from a mip chain.
+	vulkan::sampler_filter filter = vulkan::sampler_filter::trilinear;
+	if (strcmp(texture_filter, "nearest") == 0) {
+		filter = vulkan::sampler_filter::nearest;
+	} else if (strcmp(texture_filter, "bilinear") == 0) {
+		filter = vulkan::sampler_filter::bilinear;
+	} else if (strcmp(texture_filter, "anisotropic") == 0) {
+		filter = vulkan::sampler_filter::anisotropic;
+	} else if (strcmp(texture_filter, "trilinear") != 0) {
+		std::cout << "unknown texture filter " << texture_filter << ", using trilinear" << std::endl;
+	}
+
+	// Fixed scenes for --bench, so runs from different builds draw the same
+	// thing: the single cube, a CPU-culled grid, and a GPU-culled one.
+	if (bench_scene != nullptr) {
+		if (strcmp(bench_scene, "cube") == 0) {
+			instance_count = 1;
+			gpu_cull = false;
+		} else if (strcmp(bench_scene, "instances") == 0) {
+			instance_count = 10000;
+			gpu_cull = false;
+		} else if (strcmp(bench_scene, "instances-gpu") == 0) {
+			instance_count = 100000;
+			gpu_cull = true;
+		} else {
+			std::cout << "unknown benchmark scene " << bench_scene << ", expected cube, instances or instances-gpu" << std::endl;
+			return 1;
+		}
+		bench_instances = false;
+	}
+
+	// low-latency, balanced, throughput or vsync; --frames-in-flight still
+	// overrides the policy's own.
+	vulkan::swapchain_policy policy = vulkan::swapchain_policy::balanced();
+	if (strcmp(present_policy, "low-latency") == 0) {
+		policy = vulkan::swapchain_policy::low_latency();
+	} else if (strcmp(present_policy, "throughput") == 0) {
+		policy = vulkan::swapchain_policy::throughput();
+	} else if (strcmp(present_policy, "vsync") == 0) {
+		policy = vulkan::swapchain_policy::vsync();
+	} else if (strcmp(present_policy, "balanced") != 0) {
+		std::cout << "unknown present policy " << present_policy << ", using balanced" << std::endl;
+	}
+	if (frames_in_flight_set) {
+		policy.frames_in_flight = frames_in_flight;
+	}
+
+	// Before the wrapper starts any threads, so they all get a lane.
+	if (trace_path != nullptr) {
+		vulkan::cpu_profiler::get().set_enabled(true);
+		vulkan::cpu_profiler::get().set_thread_name("main");
+	}
+
+	vulkan::wrapper vk(true, frames_in_flight);
+	vk.set_swapchain_policy(policy);
+	vk.set_pipeline_cache_path(pipeline_cache_path);
+	vk.set_pipeline_variant_count(pipeline_variants);
+
+	// Step through increasing instance counts, timing each one, then exit.
+	const std::vector<uint32_t> bench_scales = { 1, 1000, 10000, 50000, 100000 };
+	const uint32_t bench_warmup_frames = 30;
+	const double bench_step_seconds = 2.0;
+	size_t bench_step = 0;
+	uint32_t bench_frames = 0;
+	auto bench_start = std::chrono::high_resolution_clock::now();
+
+	vk.set_instance_capacity(bench_instances ? bench_scales.back() : instance_count);
+	vk.set_instance_count(bench_instances ? bench_scales[0] : instance_count);
+	vk.set_gpu_culling(gpu_cull);
+	vk.set_recording_threads(record_threads);
+	vk.set_rerecord_frames(rerecord);
+	vk.set_draw_batch_size(draw_batch_size);
+	vk.set_gpu_profiling(gpu_profile, gpu_statistics);
+	vk.set_texture_mipmaps(mipmaps);
+	vk.set_texture_filter(filter);
+	vk.set_compressed_textures(compressed_textures);
+	vk.set_decode_threads(decode_threads);
+
+	// Headless runs need no window system, so they work on any platform and
+	// on software ICDs; --frames bounds them for automated runs.
+	if (headless) {
+		vk.init_headless(width, height);
+	} else {
+#ifdef _WIN32
+		if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+			std::cout << "SDL_Init Error: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+
+		SDL_Window *window = SDL_CreateWindow("Hello World!", 100, 100, width, height, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+		if (window == nullptr) {
+			std::cout << "SDL_CreateWindow Error: " << SDL_GetError() << std::endl;
+			SDL_Quit();
+			return 1;
+		}
+
+		SDL_SysWMinfo wmInfo;
+		SDL_VERSION(&wmInfo.version);
+		SDL_GetWindowWMInfo(window, &wmInfo);
+		HWND hwnd = wmInfo.info.win.window;
+
+		HINSTANCE hi = (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE);
+
+		vk.init(hwnd, hi);
+#else
+		std::cout << "only --headless is supported on this platform" << std::endl;
 		return 1;
+#endif
 	}
 
-	SDL_SysWMinfo wmInfo;
-	SDL_VERSION(&wmInfo.version);
-	SDL_GetWindowWMInfo(window, &wmInfo);
-	HWND hwnd = wmInfo.info.win.window;
+	// Run twice to compare a cold start against one seeded from the saved cache.
+	auto cache_stats = vk.get_pipeline_cache_stats();
+	std::cout << "pipelines: " << cache_stats.create_ms << "ms, " << (cache_stats.warm ? "warm" : "cold") << " start";
+	if (cache_stats.warm) {
+		std::cout << " from " << cache_stats.loaded_bytes << " bytes";
+	} else if (cache_stats.rejected != nullptr) {
+		std::cout << " (cache discarded: " << cache_stats.rejected << ")";
+	}
+	auto builder_stats = vk.get_pipeline_builder_stats();
+	std::cout << ", " << builder_stats.threads << " build threads, " << vk.get_pipeline_variants_ready() << "/" << pipeline_variants << " variants ready" << std::endl;
+
+	std::cout << "instances: " << vk.get_instance_count() << ", culled on the " << (vk.get_gpu_culling() ? "GPU" : "CPU")
+		<< ", " << vulkan::simd_level_name(vk.get_simd_level()) << " transform kernels" << std::endl;
+
+	auto present_stats = vk.get_present_stats();
+	std::cout << "presenting: " << (vk.is_headless() ? "headless, " : "") << present_policy << " policy, " << vulkan::present_mode_name(present_stats.present_mode) << ", "
+		<< present_stats.image_count << " images, " << vk.get_frames_in_flight() << " frames in flight" << std::endl;
 
-	HINSTANCE hi = (HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE);
+	// Compare --record-threads 0 against 1..N on a large --instances count.
+	auto record_stats = vk.get_recording_stats();
+	std::cout << "recording: " << record_stats.command_buffers << " command buffers, " << record_stats.draws << " draws per frame, "
+		<< record_stats.threads << " threads, " << record_stats.record_ms << "ms" << std::endl;
 
-	vulkan::wrapper vk(true);
-	vk.init(hwnd, hi);
+	auto shader_stats = vk.get_shader_library_stats();
+	std::cout << "shaders: " << shader_stats.modules << " modules from " << shader_stats.files_mapped << " files, "
+		<< shader_stats.name_hits << " cache hits, " << shader_stats.content_hits << " duplicates" << std::endl;
+
+	auto memory_stats = vk.get_allocator_stats();
+	std::cout << "device memory: " << memory_stats.allocation_count << " allocations in " << memory_stats.block_count << " blocks + "
+		<< memory_stats.dedicated_count << " dedicated, " << memory_stats.requested_bytes << "/" << memory_stats.device_bytes << " bytes used, "
+		<< memory_stats.device_allocation_calls << " vkAllocateMemory calls, fragmentation " << memory_stats.fragmentation << std::endl;
+
+	auto texture_stats = vk.get_texture_stats();
+	std::cout << "textures: " << texture_stats.textures << ", " << vulkan::sampler_filter_name(vk.get_texture_filter()) << " filtering, mip chains "
+		<< texture_stats.mip_chains_blitted << " blitted / " << texture_stats.mip_chains_cpu << " on the CPU (" << texture_stats.cpu_mip_ms << "ms), "
+		<< texture_stats.compressed << " block-compressed, " << texture_stats.bytes << " bytes" << std::endl;
+
+	auto upload_stats = vk.get_upload_stats();
+	std::cout << "uploads: " << upload_stats.resources << " resources in " << upload_stats.batches << " batches, "
+		<< upload_stats.submits << " submits / " << upload_stats.waits << " waits, avoided "
+		<< upload_stats.submits_avoided << " submits / " << upload_stats.waits_avoided << " waits" << std::endl;
+
+	// Exercise background streaming while the cube keeps rendering.
+	for (uint32_t i = 0; i < stream_count; ++i) {
+		vk.stream_texture("test.png");
+	}
+	if (stream_count > 0) {
+		std::cout << "streaming " << stream_count << " textures on the " << (vk.has_transfer_queue() ? "transfer" : "graphics") << " queue" << std::endl;
+	}
+
+	// Report throughput once a second so runs with different ring depths can be compared.
+	uint32_t report_ticks = SDL_GetTicks();
+	uint32_t report_frame = vk.get_tick();
+	auto report_record_stats = vk.get_recording_stats();
+
+	auto run_start = std::chrono::high_resolution_clock::now();
+
+	// Every frame after warm-up is timed from the end of the one before.
+	frame_benchmark benchmark;
+	auto frame_start = run_start;
 
 	bool is_quit = false;
 	while (!is_quit) {
 		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
+		auto& profiler = vulkan::cpu_profiler::get();
+		const uint64_t events_start = profiler.now_ns();
+		while (!headless && SDL_PollEvent(&event)) {
 			//
 
 			if (event.type == SDL_WINDOWEVENT) {
 				if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
 					vk.demo_resize();
+
+					auto resize_stats = vk.get_resize_stats();
+					std::cout << "resized to " << event.window.data1 << "x" << event.window.data2 << " in " << resize_stats.last_ms << "ms (max "
+						<< resize_stats.max_ms << "ms), " << resize_stats.deletions_pending << " retired objects pending" << std::endl;
 				}
 
 			} else if (event.type == SDL_QUIT) {
@@ -54,10 +348,156 @@ int main(int argc, char ** argv) {
 				}
 			}
 		}
+		if (profiler.enabled()) {
+			profiler.record("events", events_start, profiler.now_ns(), 0);
+		}
+
 		vk.demo_tick();
-		SDL_Delay(3);
+
+		if (frame_limit > 0 && vk.get_tick() >= frame_limit) {
+			is_quit = true;
+		}
+
+		if (bench_scene != nullptr) {
+			const auto frame_end = std::chrono::high_resolution_clock::now();
+			if (vk.get_tick() > bench_warmup) {
+				benchmark.frame_ms.push_back(std::chrono::duration<double, std::milli>(frame_end - frame_start).count());
+			}
+			frame_start = frame_end;
+
+			if (benchmark.frame_ms.size() >= bench_frame_count) {
+				is_quit = true;
+			}
+			continue;
+		}
+
+		if (bench_instances) {
+			bench_frames++;
+			if (bench_frames == bench_warmup_frames) {
+				bench_start = std::chrono::high_resolution_clock::now();
+			} else if (bench_frames > bench_warmup_frames) {
+				const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - bench_start).count();
+				if (seconds >= bench_step_seconds) {
+					const uint32_t measured = bench_frames - bench_warmup_frames;
+					std::cout << "instances " << vk.get_instance_count() << " (" << vk.get_visible_instance_count() << " visible): "
+						<< (seconds * 1000.0 / measured) << " ms/frame (" << (measured / seconds) << " fps)" << std::endl;
+
+					if (++bench_step == bench_scales.size()) {
+						is_quit = true;
+					} else {
+						vk.set_instance_count(bench_scales[bench_step]);
+						bench_frames = 0;
+					}
+				}
+			}
+			continue;
+		}
+
+		// --sleep 0 to run flat out; the sleep shows up in the trace.
+		if (!headless && sleep_ms > 0) {
+			vulkan::cpu_scope sleep_scope("sleep");
+			SDL_Delay(sleep_ms);
+		}
+
+		uint32_t now = SDL_GetTicks();
+		if (now - report_ticks >= 1000) {
+			uint32_t frames = vk.get_tick() - report_frame;
+			auto sync_stats = vk.get_sync_pool_stats();
+			auto present_stats = vk.get_present_stats();
+			std::cout << vk.get_frames_in_flight() << " frames in flight: " << (frames * 1000.0 / (now - report_ticks)) << " fps, "
+				<< "present interval " << present_stats.interval_ms << "ms (" << present_stats.interval_min_ms << "-" << present_stats.interval_max_ms << "ms), "
+				<< "semaphores " << sync_stats.semaphores_created << " (peak " << sync_stats.semaphores_high_water << "), "
+				<< "fences " << sync_stats.fences_created << " (peak " << sync_stats.fences_high_water << ")";
+			if (stream_count > 0) {
+				auto stream_stats = vk.get_streamer_stats();
+				auto decoder_stats = vk.get_decoder_stats();
+				std::cout << ", streamed " << stream_stats.completed << "/" << stream_stats.requested << " (" << stream_stats.bytes << " bytes), decoded "
+					<< decoder_stats.decoded << " on " << decoder_stats.threads << " threads in " << decoder_stats.decode_ms << "ms ("
+					<< stream_stats.decodes_deferred << " held back, peak " << stream_stats.decodes_ahead_high_water << " ahead)";
+			}
+			if (rerecord) {
+				auto record_stats = vk.get_recording_stats();
+				const uint64_t recorded = record_stats.frames_recorded - report_record_stats.frames_recorded;
+				if (recorded > 0) {
+					std::cout << ", recording " << (record_stats.frame_record_ms_total - report_record_stats.frame_record_ms_total) / recorded << "ms/frame";
+				}
+				report_record_stats = record_stats;
+			}
+			if (gpu_profile || gpu_statistics) {
+				auto gpu_stats = vk.get_gpu_profiler_stats();
+				for (auto& pass : gpu_stats.passes) {
+					std::cout << ", gpu " << pass.name << " " << pass.avg_ms << "ms (p95 " << pass.p95_ms << "ms)";
+				}
+				if (gpu_stats.pipeline.valid) {
+					std::cout << ", " << gpu_stats.pipeline.vertex_invocations << " vs / " << gpu_stats.pipeline.fragment_invocations << " fs / "
+						<< gpu_stats.pipeline.compute_invocations << " cs invocations";
+				}
+			}
+			if (pipeline_variants > 0) {
+				auto pipeline_stats = vk.get_pipeline_builder_stats();
+				std::cout << ", pipelines " << pipeline_stats.compiled << "/" << pipeline_stats.submitted << " ("
+					<< pipeline_stats.compile_ms << "ms compiling, " << pipeline_stats.merge_ms << "ms merging)";
+			}
+			std::cout << std::endl;
+			report_ticks = now;
+			report_frame = vk.get_tick();
+		}
 
 	}
+
+	if (frame_limit > 0) {
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - run_start).count();
+		std::cout << vk.get_tick() << " frames in " << seconds << "s: " << (seconds * 1000.0 / vk.get_tick()) << " ms/frame" << std::endl;
+
+		auto gpu_stats = vk.get_gpu_profiler_stats();
+		for (auto& pass : gpu_stats.passes) {
+			std::cout << "gpu " << pass.name << ": " << pass.avg_ms << "ms avg, p50 " << pass.p50_ms << "ms, p95 " << pass.p95_ms
+				<< "ms, p99 " << pass.p99_ms << "ms, max " << pass.max_ms << "ms over the last " << (std::min)(pass.samples, (uint64_t)vulkan::gpu_profiler_window) << " frames" << std::endl;
+		}
+	}
+
+	if (bench_scene != nullptr) {
+		benchmark.scene = bench_scene;
+		benchmark.present_policy = present_policy;
+		benchmark.present_mode = vulkan::present_mode_name(vk.get_present_stats().present_mode);
+		benchmark.simd_level = vulkan::simd_level_name(vk.get_simd_level());
+		benchmark.width = width;
+		benchmark.height = height;
+		benchmark.frames_in_flight = vk.get_frames_in_flight();
+		benchmark.instances = vk.get_instance_count();
+		benchmark.headless = vk.is_headless();
+		benchmark.gpu_culling = vk.get_gpu_culling();
+		benchmark.warmup_frames = bench_warmup;
+		benchmark.texture_filter = vulkan::sampler_filter_name(vk.get_texture_filter());
+		benchmark.mipmaps = mipmaps;
+		benchmark.compressed_textures = vk.get_texture_stats().compressed > 0;
+
+		for (auto& pass : vk.get_gpu_profiler_stats().passes) {
+			benchmark.gpu_passes.push_back({ pass.name, pass.avg_ms, pass.p95_ms });
+		}
+
+		if (write_frame_benchmark(benchmark, bench_out) != 0) {
+			SDL_Quit();
+			return 1;
+		}
+	}
+
+	if (trace_path != nullptr) {
+		auto& profiler = vulkan::cpu_profiler::get();
+		profiler.set_enabled(false);
+
+		if (profiler.write_chrome_trace(trace_path)) {
+			std::cout << "wrote trace to " << trace_path << std::endl;
+		} else {
+			std::cout << "couldn't write trace to " << trace_path << std::endl;
+		}
+
+		for (auto& scope : profiler.summarize()) {
+			std::cout << "cpu " << scope.name << ": " << scope.count << " calls, " << scope.total_ms << "ms total, "
+				<< (scope.total_ms / scope.count) << "ms avg, " << scope.max_ms << "ms max" << std::endl;
+		}
+	}
+
 	SDL_Quit();
-	return 1;
+	return 0;
 }
@@ -1 +1,55 @@
 #pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Times the CPU scene update (model, MVP, frustum test, pack) for count
+// objects through glm and each batch kernel level; returns non-zero if a
+// kernel disagrees with the scalar reference.
+int bench_transforms(uint32_t count);
+
+// Times the CPU mip chain fallback for a width x height RGBA8 image at each
+// kernel level; returns non-zero if a kernel disagrees with the scalar one.
+int bench_mipmaps(uint32_t width, uint32_t height);
+
+// Offline: encodes a PNG and its mip chain into <output>.<format>.ktx2 for
+// each of a comma-separated list of bc1, bc3, bc7, etc2 and etc2a.
+int convert_texture(const char * input, const char * output, const char * formats);
+
+// Decodes every PNG in directory on the texture decoder with 1..N threads;
+// returns non-zero if any run fails or decodes differently.
+int bench_decode(const char * directory);
+
+// A fixed-frame benchmark run: what was drawn and how, and the time of
+// every measured frame after warm-up.
+struct frame_benchmark {
+	std::string scene;
+	std::string present_policy;
+	std::string present_mode;
+	std::string simd_level;
+	uint32_t width = 0, height = 0;
+	uint32_t frames_in_flight = 0;
+	uint32_t instances = 0;
+	bool headless = false;
+	bool gpu_culling = false;
+	std::string texture_filter;
+	bool mipmaps = false;
+	bool compressed_textures = false;
+	uint32_t warmup_frames = 0;
+	std::vector<double> frame_ms;
+
+	// With --gpu-profile, over the profiler's last window of frames.
+	struct gpu_pass {
+		std::string name;
+		double avg_ms;
+		double p95_ms;
+	};
+	std::vector<gpu_pass> gpu_passes;
+};
+
+// Writes min, mean, p50, p95, p99 and max frame times and throughput as one
+// JSON object to path, and prints a one-line summary; returns non-zero if the
+// file could not be written. Always a file, since stdout carries the demo's
+// own output.
+int write_frame_benchmark(const frame_benchmark& benchmark, const char * path);
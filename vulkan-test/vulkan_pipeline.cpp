@@ -5,7 +5,7 @@
 #include "vulkan_pipeline.hpp"
 
 namespace vulkan {
-	pipeline::pipeline(VkDevice vulkan_device) : _vulkan_device(vulkan_device) {
+	pipeline::pipeline(VkDevice vulkan_device, shader_library& shaders) : _vulkan_device(vulkan_device), _shaders(shaders) {
 
 
 
@@ -16,58 +16,6 @@ namespace vulkan {
 	}
 
 
-	VkShaderModule pipeline::create_shader_module(const char * filename) {
-
-		auto load_code = [](const char * filename, size_t& psize) -> void * {
-			long int size;
-			size_t retval;
-			void * shader_code;
-
-			FILE *fp = fopen(filename, "rb");
-			if (!fp)
-				return NULL;
-
-			fseek(fp, 0L, SEEK_END);
-			size = ftell(fp);
-
-			fseek(fp, 0L, SEEK_SET);
-
-			shader_code = malloc(size);
-			retval = fread(shader_code, size, 1, fp);
-			assert(retval == 1);
-
-			psize = size;
-
-			fclose(fp);
-			return shader_code;
-		};
-
-		VkShaderModule vert_shader_module;
-		{
-			size_t size;
-
-			void * vert_shader_code = load_code(filename, size);
-
-			VkShaderModuleCreateInfo module_create_info;
-			VkResult err;
-
-			module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-			module_create_info.pNext = NULL;
-
-			module_create_info.codeSize = size;
-			module_create_info.pCode = (uint32_t *)vert_shader_code;
-			module_create_info.flags = 0;
-
-			err = vkCreateShaderModule(_vulkan_device, &module_create_info, NULL, &vert_shader_module);
-			assert(!err);
-
-			free(vert_shader_code);
-
-		}
-
-		return vert_shader_module;
-	}
-
 	void pipeline::init() {
 
 		VkResult err;
@@ -81,8 +29,26 @@ namespace vulkan {
 		dynamicState.pDynamicStates = dynamicStateEnables;
 
 		VkPipelineVertexInputStateCreateInfo vi;
+		// Matches vulkan_vertex (vec3 position, vec2 uv) plus an instance-rate mat4.
+		const VkVertexInputBindingDescription vertex_bindings[2] = {
+			{ 0, 5 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX },
+			{ 1, 16 * sizeof(float), VK_VERTEX_INPUT_RATE_INSTANCE },
+		};
+		const VkVertexInputAttributeDescription vertex_attributes[6] = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+			{ 1, 0, VK_FORMAT_R32G32_SFLOAT, 3 * sizeof(float) },
+			{ 2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0 },
+			{ 3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 4 * sizeof(float) },
+			{ 4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 8 * sizeof(float) },
+			{ 5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 12 * sizeof(float) },
+		};
+
 		memset(&vi, 0, sizeof(vi));
 		vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vi.vertexBindingDescriptionCount = 2;
+		vi.pVertexBindingDescriptions = vertex_bindings;
+		vi.vertexAttributeDescriptionCount = 6;
+		vi.pVertexAttributeDescriptions = vertex_attributes;
 
 		VkPipelineInputAssemblyStateCreateInfo ia;
 		memset(&ia, 0, sizeof(ia));
@@ -145,7 +111,7 @@ namespace vulkan {
 		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
 
-		auto vert_shader_module = create_shader_module("cube-vert.spv");
+		VkShaderModule vert_shader_module = _shaders.get("cube-vert.spv");
 
 		shaderStages[0].module = vert_shader_module;
 		shaderStages[0].pName = "main";
@@ -153,7 +119,7 @@ namespace vulkan {
 		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		VkShaderModule frag_shader_module = create_shader_module("cube-frag.spv");
+		VkShaderModule frag_shader_module = _shaders.get("cube-frag.spv");
 
 		shaderStages[1].module = frag_shader_module;
 		shaderStages[1].pName = "main";
@@ -178,9 +144,6 @@ namespace vulkan {
 
 		err = vkCreateGraphicsPipelines(_vulkan_device, _pipeline_cache, 1, &pipeline_create_info, NULL, &_pipeline);
 		assert(!err);
-
-		vkDestroyShaderModule(_vulkan_device, frag_shader_module, NULL);
-		vkDestroyShaderModule(_vulkan_device, vert_shader_module, NULL);
 	}
 
 
@@ -2,10 +2,12 @@
 
 #include <vulkan/vulkan.h>
 
+#include "../src/vulkan_shader_library.hpp"
+
 namespace vulkan {
 	class pipeline {
 	public:
-		pipeline(VkDevice vulkan_device);
+		pipeline(VkDevice vulkan_device, shader_library& shaders);
 		~pipeline();
 
 		void init();
@@ -13,27 +15,28 @@ namespace vulkan {
 		VkPipeline get();
 
 		bool has_pipeline_cache() const {
-			return _pipeline_cache == VK_NULL_HANDLE;
+			return _pipeline_cache != VK_NULL_HANDLE;
 		}
 
 		void set_pipeline_cache(VkPipelineCache pipeline_cache) {
-			_pipeline_cache = _pipeline_cache;
+			_pipeline_cache = pipeline_cache;
 		}
 
-		VkPipelineCache create_pipeline_cache() const {
+		// initial_data should already have been checked with validate_pipeline_cache_data.
+		VkPipelineCache create_pipeline_cache(const void * initial_data = NULL, size_t initial_size = 0) const {
 			VkPipelineCache pipeline_cache;
 			VkResult err;
 			VkPipelineCacheCreateInfo pipeline_cache_create_info;
 			memset(&pipeline_cache_create_info, 0, sizeof(pipeline_cache_create_info));
 			pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			pipeline_cache_create_info.initialDataSize = initial_size;
+			pipeline_cache_create_info.pInitialData = initial_data;
 
 			err = vkCreatePipelineCache(_vulkan_device, &pipeline_cache_create_info, NULL, &pipeline_cache);
 			assert(!err);
 			return pipeline_cache;
 		}
 	private:
-		VkShaderModule create_shader_module(const char * filename);
-
 		VkPipeline _pipeline = VK_NULL_HANDLE;
 
 		VkPipelineLayout _pipeline_layout = VK_NULL_HANDLE;
@@ -41,5 +44,6 @@ namespace vulkan {
 		VkPipelineCache _pipeline_cache = VK_NULL_HANDLE;
 
 		VkDevice _vulkan_device = VK_NULL_HANDLE;
+		shader_library& _shaders;
 	};
 }
\ No newline at end of file